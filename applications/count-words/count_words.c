@@ -6,11 +6,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define NEEDLE_BUFFER_SIZE 256
+
+/* Allocated once by the checkpoint, so that snapshots of instances start with it */
+static char* needle_buffer = NULL;
+
 void out( const char* s )
 {
   fixpoint_unsafe_io( s, strlen( s ) );
 }
 
+__attribute__( ( export_name( "_fixpoint_checkpoint" ) ) ) void _fixpoint_checkpoint( void )
+{
+  needle_buffer = malloc( NEEDLE_BUFFER_SIZE );
+}
+
 __attribute__( ( export_name( "_fixpoint_apply" ) ) ) externref _fixpoint_apply( externref combination )
 {
   attach_tree_ro_table_0( combination );
@@ -33,7 +43,7 @@ __attribute__( ( export_name( "_fixpoint_apply" ) ) ) externref _fixpoint_apply(
   externref file = get_ro_table_0( 1 );
 
   size_t needle_size = get_length( pattern );
-  char *needle = malloc(needle_size);
+  char* needle = ( needle_buffer && needle_size <= NEEDLE_BUFFER_SIZE ) ? needle_buffer : malloc( needle_size );
   attach_blob_ro_mem_0(pattern);
   ro_mem_0_to_program_mem( needle, 0, needle_size );
 
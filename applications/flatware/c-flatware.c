@@ -232,6 +232,7 @@ dummy_trace( __attribute__( ( unused ) ) int reqd_arg, ... )
 {}
 
 externref fixpoint_apply( externref encode ) __attribute( ( export_name( "_fixpoint_apply" ) ) );
+void fixpoint_checkpoint( void ) __attribute( ( export_name( "_fixpoint_checkpoint" ) ) );
 
 /**
  * @brief Exits process, returning rval to the host environment.
@@ -785,6 +786,11 @@ int32_t fd_pwrite( int32_t fd, int32_t iovs, int32_t iovs_len, int64_t offset, i
 int32_t fd_readdir( int32_t fd, int32_t buf, int32_t buf_len, int64_t cookie, int32_t retptr0 )
 {
   struct substring path_str;
+#if FLATWARE_VECTORED_LISTING
+  struct listing listing;
+  const char* names;
+#endif
+  int32_t num_dirents;
   unsigned long offset = 0;
   unsigned long buf_used = 0;
   char null = '\0';
@@ -797,26 +803,49 @@ int32_t fd_readdir( int32_t fd, int32_t buf, int32_t buf_len, int64_t cookie, in
   }
 
   if ( is_dir( ScratchROTable ) ) {
+#if FLATWARE_VECTORED_LISTING
+    num_dirents = list_dir( ScratchROTable, &listing );
+    if ( num_dirents == FILESYS_SEARCH_FAILED ) {
+      return __WASI_ERRNO_NOMEM;
+    }
+    names = listing.names;
+#else
     attach_tree_ro_table( ScratchROTable, get_ro_table( ScratchROTable, DIRENT_CONTENT ) );
-    for ( int i = 0; i < size_ro_table( ScratchROTable ); i++ ) {
+    num_dirents = size_ro_table( ScratchROTable );
+#endif
+    for ( int i = 0; i < num_dirents; i++ ) {
       __wasi_dirent_t dirent;
-      struct substring name;
+      const char* name;
+      uint32_t name_len;
+      bool dir;
       unsigned long offset_next;
 
+#if FLATWARE_VECTORED_LISTING
+      name = names;
+      name_len = listing.name_lengths[i];
+      names += name_len;
+      dir = listing.contents[i].kind != FIXPOINT_ENTRY_BLOB && listing.contents[i].kind != FIXPOINT_ENTRY_BLOB_REF;
+#else
+      struct substring dirent_name;
+
       // attach flatware dirent
       attach_tree_ro_table( ScratchFileROTable, get_ro_table( ScratchROTable, i ) );
 
-      name = get_name( ScratchFileROTable );
+      dirent_name = get_name( ScratchFileROTable );
+      name = dirent_name.ptr;
+      name_len = (uint32_t)dirent_name.len;
+      dir = is_dir( ScratchFileROTable );
+#endif
 
-      if ( is_dir( ScratchFileROTable ) ) {
+      if ( dir ) {
         dirent.d_type = __WASI_FILETYPE_DIRECTORY;
       } else {
         dirent.d_type = __WASI_FILETYPE_REGULAR_FILE;
       }
 
-      dirent.d_namlen = name.len;
+      dirent.d_namlen = name_len;
 
-      offset_next = offset + sizeof( dirent ) + name.len + 1;
+      offset_next = offset + sizeof( dirent ) + name_len + 1;
       dirent.d_next = offset_next;
 
       if ( offset >= cookie && offset_next < cookie + (unsigned long)buf_len ) {
@@ -824,20 +853,26 @@ int32_t fd_readdir( int32_t fd, int32_t buf, int32_t buf_len, int64_t cookie, in
         flatware_mem_to_program_mem(
           ( buf + (int32_t)offset - (int32_t)cookie ), (int32_t)&dirent, sizeof( dirent ) );
         flatware_mem_to_program_mem( ( buf + (int32_t)offset - (int32_t)cookie + (int32_t)sizeof( dirent ) ),
-                                     (int32_t)name.ptr,
-                                     (int32_t)name.len );
+                                     (int32_t)name,
+                                     (int32_t)name_len );
         flatware_mem_to_program_mem(
-          ( buf + (int32_t)offset - (int32_t)cookie + (int32_t)sizeof( dirent ) + (int32_t)name.len ),
+          ( buf + (int32_t)offset - (int32_t)cookie + (int32_t)sizeof( dirent ) + (int32_t)name_len ),
           (int32_t)&null,
           1 );
 
       } else if ( offset_next >= cookie + (unsigned long)buf_len ) {
+#if FLATWARE_VECTORED_LISTING
+        free_listing( &listing );
+#endif
         buf_used = offset - (unsigned long)cookie;
         flatware_mem_to_program_mem( retptr0, (int32_t)&buf_used, sizeof( buf_used ) );
         return 0;
       }
       offset = offset_next;
     }
+#if FLATWARE_VECTORED_LISTING
+    free_listing( &listing );
+#endif
   }
 
   buf_used = offset - (unsigned long)cookie;
@@ -1532,10 +1567,21 @@ static void bitset_clear( unsigned int* bitset, uint32_t index )
   bitset[index / sizeof( unsigned int )] &= ~( 1 << ( index % sizeof( unsigned int ) ) );
 }
 
-externref fixpoint_apply( externref encode )
+/**
+ * @brief Sets up what does not depend on the input, so that instances started from a snapshot have it already.
+ * The interpreter itself can only start in fixpoint_apply, as its arguments, environment and files are input.
+ */
+void fixpoint_checkpoint( void )
 {
   ro_mem_use
     = (unsigned int*)calloc( ( NUM_RO_MEM - File0ROMem ) / sizeof( unsigned int ), sizeof( unsigned int ) );
+}
+
+externref fixpoint_apply( externref encode )
+{
+  if ( ro_mem_use == NULL ) {
+    fixpoint_checkpoint();
+  }
 
   attach_tree_ro_table( InputROTable, encode );
 
@@ -1559,8 +1605,6 @@ externref fixpoint_apply( externref encode )
   set_rw_table( OutputRWTable, OUTPUT_STDERR, create_blob_rw_mem( StdErrRWMem, (int32_t)fds[STDERR].offset ) );
   set_rw_table( OutputRWTable, OUTPUT_TRACE, create_blob_rw_mem( StdTraceRWMem, trace_offset ) );
 
-  free( ro_mem_use );
-
   return create_tree_rw_table( OutputRWTable, 5 );
 }
 
@@ -84,6 +84,56 @@ externref get_content( int32_t dirent_ROTable_index )
   return get_ro_table( dirent_ROTable_index, DIRENT_CONTENT );
 }
 
+#if FLATWARE_VECTORED_LISTING
+/**
+ * @brief Reads the names of the dirents in a directory and the kinds of their contents, with one fixpoint call each
+ *
+ * @param dir_ROTable_index index of the ro_table containing the directory
+ * @param listing the listing to fill in, to be released with free_listing
+ * @return int32_t number of dirents in the directory, FILESYS_SEARCH_FAILED if the names could not be read
+ */
+int32_t list_dir( int32_t dir_ROTable_index, struct listing* listing )
+{
+  externref content = get_content( dir_ROTable_index );
+  uint32_t count = get_length( content );
+  uint32_t capacity;
+  uint32_t needed;
+
+  listing->contents = malloc( count * sizeof( struct fixpoint_entry ) );
+  flatware_mem_get_lengths( content, 0, count, DIRENT_CONTENT, listing->contents );
+
+  // most names are short, so the first guess usually fits
+  capacity = count * ( sizeof( uint32_t ) + 32 );
+  listing->buffer = malloc( capacity );
+  needed = flatware_mem_read_blobs( content, 0, count, DIRENT_NAME, listing->buffer, capacity );
+  if ( needed > capacity ) {
+    free( listing->buffer );
+    listing->buffer = malloc( needed );
+    // the names are fixed by the directory's handle, so they take the same size again
+    if ( flatware_mem_read_blobs( content, 0, count, DIRENT_NAME, listing->buffer, needed ) != needed ) {
+      free_listing( listing );
+      return FILESYS_SEARCH_FAILED;
+    }
+  }
+
+  listing->count = (int32_t)count;
+  listing->name_lengths = listing->buffer;
+  listing->names = (const char*)listing->buffer + count * sizeof( uint32_t );
+  return listing->count;
+}
+
+/**
+ * @brief Releases a listing filled in by list_dir
+ *
+ * @param listing the listing to release
+ */
+void free_listing( struct listing* listing )
+{
+  free( listing->contents );
+  free( listing->buffer );
+}
+#endif
+
 /**
  * @brief Finds a dirent in a directory (one-level deep)
  *
@@ -94,8 +144,14 @@ externref get_content( int32_t dirent_ROTable_index )
  */
 int32_t find_local_entry( struct substring path, int32_t dir_ROTable_index, int32_t dest_ROTable_index )
 {
+#if FLATWARE_VECTORED_LISTING
+  struct listing listing;
+  const char* name;
+  int32_t found = FILESYS_SEARCH_FAILED;
+#else
   int32_t num_dirents;
   struct substring name;
+#endif
 
   if ( path.len == 0 ) {
     return dir_ROTable_index;
@@ -103,7 +159,29 @@ int32_t find_local_entry( struct substring path, int32_t dir_ROTable_index, int3
   if ( !is_dir( dir_ROTable_index ) ) {
     return FILESYS_SEARCH_FAILED;
   }
-  
+
+#if FLATWARE_VECTORED_LISTING
+  if ( list_dir( dir_ROTable_index, &listing ) == FILESYS_SEARCH_FAILED ) {
+    return FILESYS_SEARCH_FAILED;
+  }
+  name = listing.names;
+  for ( int32_t i = 0; i < listing.count; i++ ) {
+    if ( listing.name_lengths[i] == path.len && memcmp( name, path.ptr, path.len ) == 0 ) {
+      found = i;
+      break;
+    }
+    name += listing.name_lengths[i];
+  }
+  free_listing( &listing );
+
+  if ( found == FILESYS_SEARCH_FAILED ) {
+    return FILESYS_SEARCH_FAILED;
+  }
+
+  attach_tree_ro_table( ScratchFileROTable, get_content( dir_ROTable_index ) );
+  attach_tree_ro_table( dest_ROTable_index, get_ro_table( ScratchFileROTable, found ) );
+  return dest_ROTable_index;
+#else
   attach_tree_ro_table( ScratchFileROTable, get_content( dir_ROTable_index ) );
   num_dirents = size_ro_table( ScratchFileROTable );
 
@@ -117,6 +195,7 @@ int32_t find_local_entry( struct substring path, int32_t dir_ROTable_index, int3
   }
 
   return FILESYS_SEARCH_FAILED;
+#endif
 }
 
 /**
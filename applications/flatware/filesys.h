@@ -2,6 +2,12 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Lists directories with the vectored flatware_mem_get_lengths and flatware_mem_read_blobs imports (one call each
+// per directory) instead of attaching every dirent; build with -DFLATWARE_VECTORED_LISTING=0 for hosts without them
+#ifndef FLATWARE_VECTORED_LISTING
+#define FLATWARE_VECTORED_LISTING 1
+#endif
+
 enum DIRENT
 {
   DIRENT_NAME = 0,
@@ -17,6 +23,17 @@ struct substring
 
 static const int8_t FILESYS_SEARCH_FAILED = -1;
 
+#if FLATWARE_VECTORED_LISTING
+struct listing
+{
+  int32_t count;
+  const uint32_t* name_lengths;    // length of the name of each dirent
+  const char* names;               // names of the dirents, back to back
+  struct fixpoint_entry* contents; // length and kind of the content of each dirent
+  void* buffer;
+};
+#endif
+
 typedef char __attribute__( ( address_space( 10 ) ) ) * externref;
 
 bool is_dir( int32_t dirent_ROTable_index );
@@ -27,6 +44,12 @@ uint64_t get_permissions( int32_t dirent_ROTable_index );
 
 externref get_content( int32_t dirent_ROTable_index );
 
+#if FLATWARE_VECTORED_LISTING
+int32_t list_dir( int32_t dir_ROTable_index, struct listing* listing );
+
+void free_listing( struct listing* listing );
+#endif
+
 int32_t find_local_entry( struct substring path, int32_t dir_ROTable_index, int32_t dest_ROTable_index );
 
 int32_t find_deep_entry( struct substring path, int32_t curr_fd, int32_t desired_fd );
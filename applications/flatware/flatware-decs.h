@@ -55,3 +55,18 @@ enum FLATWARE_OUTPUT_ENCODE
   OUTPUT_STDERR = 3,
   OUTPUT_TRACE = 4,
 };
+
+// Vectored fixpoint api functions, writing into flatware's own memory
+extern void flatware_mem_get_lengths( externref tree,
+                                      uint32_t first,
+                                      uint32_t count,
+                                      uint32_t child,
+                                      struct fixpoint_entry* entries )
+  __attribute__( ( import_module( "fixpoint" ), import_name( "flatware_mem_get_lengths" ) ) );
+extern uint32_t flatware_mem_read_blobs( externref tree,
+                                         uint32_t first,
+                                         uint32_t count,
+                                         uint32_t child,
+                                         void* buffer,
+                                         uint32_t capacity )
+  __attribute__( ( import_module( "fixpoint" ), import_name( "flatware_mem_read_blobs" ) ) );
@@ -30,3 +30,20 @@ __attribute__( ( export_name( "_fixpoint_apply" ) ) ) externref _fixpoint_apply(
   externref main_blob = get_ro_table_0( 1 );
   return map( resource_limits, main_blob, arr, arr_size, 1 );
 }
+
+/* _fixpoint_apply_batch takes a tree of encodes, each as described above, applies them one after the other in this
+instance, and returns the tree of their results in the same order. */
+__attribute__( ( export_name( "_fixpoint_apply_batch" ) ) ) externref _fixpoint_apply_batch( externref encodes )
+{
+  attach_tree_ro_table_1( encodes );
+  int32_t count = size_ro_table_1();
+  // Returning anything but the tree of results would be taken as the results themselves
+  if ( grow_rw_table_2( count, encodes ) == -1 ) {
+    __builtin_trap();
+  }
+
+  for ( int32_t i = 0; i < count; i++ ) {
+    set_rw_table_2( i, _fixpoint_apply( get_ro_table_1( i ) ) );
+  }
+  return create_tree_rw_table_2( count );
+}
@@ -34,6 +34,43 @@ extern bool fixpoint_is_blob( externref x )
 extern uint32_t get_length( externref handle )
   __attribute__( ( import_module( "fixpoint" ), import_name( "get_length" ) ) );
 
+enum fixpoint_entry_kind
+{
+  FIXPOINT_ENTRY_BLOB,
+  FIXPOINT_ENTRY_TREE,
+  FIXPOINT_ENTRY_BLOB_REF,
+  FIXPOINT_ENTRY_TREE_REF,
+  FIXPOINT_ENTRY_THUNK,
+  FIXPOINT_ENTRY_ENCODE,
+  FIXPOINT_ENTRY_OTHER,
+};
+
+struct fixpoint_entry
+{
+  uint32_t length;
+  uint32_t kind; // an enum fixpoint_entry_kind
+};
+
+// Fills entries[0, count) with the lengths and kinds of the entries [first, first + count) of a tree (or of entry
+// `child` of each of those entries, unless child is UINT32_MAX), in one call.
+extern void get_lengths( externref tree,
+                         uint32_t first,
+                         uint32_t count,
+                         uint32_t child,
+                         struct fixpoint_entry* entries )
+  __attribute__( ( import_module( "fixpoint" ), import_name( "memory_get_lengths" ) ) );
+
+// Copies the blobs at the entries [first, first + count) of a tree (or at entry `child` of each of those entries,
+// unless child is UINT32_MAX) to buffer, in one call: a uint32_t length per blob, then the blobs back to back.
+// Returns the number of bytes this takes; nothing is written if that is more than capacity.
+extern uint32_t read_blobs( externref tree,
+                            uint32_t first,
+                            uint32_t count,
+                            uint32_t child,
+                            void* buffer,
+                            uint32_t capacity )
+  __attribute__( ( import_module( "fixpoint" ), import_name( "memory_read_blobs" ) ) );
+
 // copies memory from ro_mem_[ro_mem_id] to rw_mem_[ro_mem_id].
 void copy_ro_to_rw_mem( int32_t rw_mem_id, int32_t ro_mem_id, int32_t rw_offset, int32_t ro_offset, int32_t len );
 
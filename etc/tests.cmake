@@ -13,6 +13,9 @@ add_custom_target (all-fixpoint-check COMMAND ${CMAKE_CTEST_COMMAND} --output-on
 add_custom_target (all-local-fixpoint-check COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure -R "^l_"
   COMMENT "Testing Fix..."
 )
+add_custom_target (continuation-fixpoint-check COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure -R "^c_"
+  COMMENT "Testing Fix..."
+)
 
 add_custom_target (flatware-check COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure -R "^f_" -E "f_python_flatware"
   COMMENT "Testing Flatware..."
@@ -21,11 +24,18 @@ add_custom_target (all-flatware-check COMMAND ${CMAKE_CTEST_COMMAND} --output-on
 
 add_test(NAME u_handle COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-handle)
 add_test(NAME u_hash_table COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-hash-table)
+add_test(NAME u_peer_table COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-peer-table)
 add_test(NAME u_storage COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-storage)
+add_test(NAME u_front_cache COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-front-cache)
 add_test(NAME u_evaluator COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-evaluator)
 add_test(NAME u_executor COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-executor)
 add_test(NAME u_distributed COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-distributed)
+add_test(NAME u_lazy_results COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-lazy-results)
+add_test(NAME u_message COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-message)
+add_test(NAME u_result_directory COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-result-directory)
+add_test(NAME u_map_memo COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-map-memo)
 add_test(NAME u_blake3 WORKING_DIRECTORY COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-blake3)
+add_test(NAME u_metrics COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-metrics)
 add_test(NAME u_dependency_graph COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-dependency-graph)
 add_test(NAME u_pass_scheduler COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-pass-scheduler)
 add_test(NAME u_local_scheduler COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-local-scheduler)
@@ -37,6 +47,8 @@ add_test(NAME t_bptree COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-bptree
 add_test(NAME t_trap COMMAND ${CMAKE_CURRENT_SOURCE_DIR}/src/tests/test-trap.sh)
 add_test(NAME t_resource_limits COMMAND ${CMAKE_CURRENT_SOURCE_DIR}/src/tests/test-resource-limits.sh)
 add_test(NAME t_map COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-map)
+add_test(NAME t_map_batch COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-map-batch)
+add_test(NAME t_snapshot COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-snapshot)
 add_test(NAME t_curry COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-curry)
 add_test(NAME t_mapreduce COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-mapreduce)
 add_test(NAME t_count_words COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-countwords)
@@ -54,6 +66,14 @@ add_test(NAME l_mapreduce COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-map
 add_test(NAME l_count_words COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-countwords -s local)
 add_test(NAME l_self_host WORKING_DIRECTORY ${PROJECT_SOURCE_DIR} COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-self-host -s local)
 
+add_test(NAME c_add COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-add -s continuation)
+add_test(NAME c_fib COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-fib -s continuation)
+add_test(NAME c_bptree COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-bptree-get -s continuation)
+add_test(NAME c_map COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-map -s continuation)
+add_test(NAME c_curry COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-curry -s continuation)
+add_test(NAME c_mapreduce COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-mapreduce -s continuation)
+add_test(NAME c_count_words COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-countwords -s continuation)
+
 add_test(NAME f_add_flatware WORKING_DIRECTORY COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-add-flatware)
 add_test(NAME f_return_flatware WORKING_DIRECTORY COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-return-flatware)
 add_test(NAME f_helloworld_flatware WORKING_DIRECTORY COMMAND ${CMAKE_CURRENT_BINARY_DIR}/src/tests/test-helloworld-flatware)
@@ -6,6 +6,8 @@
 
 #include <glog/logging.h>
 
+#include "huge_pages.hh"
+
 template<typename S>
 Owned<S>::Owned( S span, AllocationType allocation_type )
   : span_( span )
@@ -36,6 +38,9 @@ Owned<S>::Owned( size_t size, AllocationType type ) requires( not std::is_const_
     case AllocationType::Allocated: {
       void* p = aligned_alloc( std::alignment_of<element_type>(), size * sizeof( element_type ) );
       CHECK( p );
+      if ( huge_pages::wanted( size * sizeof( element_type ) ) ) {
+        huge_pages::advise( p, size * sizeof( element_type ) );
+      }
       span_ = {
         reinterpret_cast<pointer>( p ),
         size,
@@ -51,6 +56,9 @@ Owned<S>::Owned( size_t size, AllocationType type ) requires( not std::is_const_
         CHECK( p != (void*)-1 );
       }
       CHECK( p );
+      if ( huge_pages::wanted( size * sizeof( element_type ) ) ) {
+        huge_pages::advise( p, size * sizeof( element_type ) );
+      }
       span_ = {
         reinterpret_cast<pointer>( p ),
         size,
@@ -178,8 +186,8 @@ Owned<S>::~Owned()
       free( const_cast<void*>( reinterpret_cast<const void*>( span_.data() ) ) );
       break;
     case AllocationType::Mapped:
-      VLOG( 2 ) << "unmapping " << span_.size() << " bytes at " << reinterpret_cast<const void*>( span_.data() );
-      munmap( const_cast<void*>( reinterpret_cast<const void*>( span_.data() ) ), span_.size() );
+      VLOG( 2 ) << "unmapping " << span_.size_bytes() << " bytes at " << reinterpret_cast<const void*>( span_.data() );
+      munmap( const_cast<void*>( reinterpret_cast<const void*>( span_.data() ) ), span_.size_bytes() );
       break;
   }
   leak();
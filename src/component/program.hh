@@ -1,12 +1,18 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 
 #include "handle.hh"
 #include "wasm-rt.h"
 
 #include "resource_limits.hh"
+#include "snapshot.hh"
 #include "timer.hh"
 #include "wasm-rt-impl.hh"
 
@@ -28,14 +34,21 @@ class Program
 private:
   // Code and data section of the program
   std::shared_ptr<char> code_;
+  size_t code_size_;
   // Entry point of init function
   uint64_t init_entry_;
   // Entry point of main function
   uint64_t main_entry_;
+  // Entry point of the function applying a tree of combinations, if the program exports one
+  std::optional<uint64_t> batch_entry_;
+  // Entry point of the function to run after init before taking a snapshot, if the program exports one
+  std::optional<uint64_t> checkpoint_entry_;
   // Entry point of clean up function
   uint64_t cleanup_entry_;
   // size of instance
   size_t instance_context_size_;
+  // The state new instances start from instead of running init, if there is one
+  std::atomic<std::shared_ptr<const Snapshot>> snapshot_ {};
 
   struct Context
   {
@@ -44,13 +57,19 @@ private:
 
 public:
   Program( std::shared_ptr<char> code,
+           size_t code_size,
            uint64_t init_entry,
            uint64_t main_entry,
            uint64_t cleanup_entry,
-           uint64_t instance_size_entry )
+           uint64_t instance_size_entry,
+           std::optional<uint64_t> batch_entry = {},
+           std::optional<uint64_t> checkpoint_entry = {} )
     : code_( code )
+    , code_size_( code_size )
     , init_entry_( init_entry )
     , main_entry_( main_entry )
+    , batch_entry_( batch_entry )
+    , checkpoint_entry_( checkpoint_entry )
     , cleanup_entry_( cleanup_entry )
     , instance_context_size_( 0 )
   {
@@ -66,16 +85,97 @@ public:
 
   size_t get_instance_and_context_size() const { return instance_context_size_; }
 
-  Handle<Object> execute( Handle<ObjectTree> encode_name ) const
+  bool batches() const { return batch_entry_.has_value(); }
+
+  size_t code_size() const { return code_size_; }
+
+  // Starts new instances from @p snapshot instead of running init
+  void use( std::shared_ptr<const Snapshot> snapshot )
+  {
+    if ( snapshot and snapshot->instance_size() == instance_context_size_ ) {
+      snapshot_.store( snapshot );
+    }
+  }
+
+  // Runs init, and the checkpoint if there is one, in two new instances and takes a snapshot of them; the second
+  // instance lives at another address, which tells the words pointing into the instance apart from the rest
+  std::shared_ptr<Snapshot> take_snapshot() const
+  {
+    void ( *init_func )( void* );
+    init_func = reinterpret_cast<void ( * )( void* )>( code_.get() + init_entry_ );
+
+    void ( *cleanup_func )( void* );
+    cleanup_func = reinterpret_cast<void ( * )( void* )>( code_.get() + cleanup_entry_ );
+
+    // The memory of the instances is not taken from any Application's limits
+    auto available_bytes = std::exchange( resource_limits::available_bytes, std::numeric_limits<uint64_t>::max() );
+
+    std::array<wasm_rt_allocation_record_t, 2> records {};
+    std::array<char*, 2> instances {};
+    for ( size_t i = 0; i < instances.size(); i++ ) {
+      wasm_rt_record_allocations( &records[i] );
+      instances[i] = static_cast<char*>( aligned_alloc( alignof( __m256i ), instance_context_size_ ) );
+      init_func( instances[i] );
+    }
+    wasm_rt_record_allocations( nullptr );
+
+    // A trap in the checkpoint leaves the records in use, and they do not outlive this call
+    auto release = [&] {
+      wasm_rt_record_allocations( nullptr );
+      for ( auto* instance : instances ) {
+        cleanup_func( instance );
+        free( instance );
+      }
+      resource_limits::available_bytes = available_bytes;
+    };
+
+    const wasm_rt_trap_t code = static_cast<wasm_rt_trap_t>( wasm_rt_impl_try() );
+    if ( code != 0 ) {
+      release();
+      throw std::runtime_error( std::string( "Checkpoint trapped: " ) + wasm_rt_strerror( code ) );
+    }
+
+    if ( checkpoint_entry_.has_value() ) {
+      void ( *checkpoint_func )( void* );
+      checkpoint_func = reinterpret_cast<void ( * )( void* )>( code_.get() + checkpoint_entry_.value() );
+      for ( size_t i = 0; i < instances.size(); i++ ) {
+        wasm_rt_record_allocations( &records[i] );
+        checkpoint_func( instances[i] );
+      }
+      wasm_rt_record_allocations( nullptr );
+    }
+
+    auto snapshot
+      = Snapshot::capture( instances[0], instances[1], instance_context_size_, code_.get(), code_size_, records[0] );
+
+    release();
+    return snapshot;
+  }
+
+  Handle<Object> execute( Handle<ObjectTree> encode_name ) const { return invoke( main_entry_, encode_name ); }
+
+  // Applies every combination in @p combinations in one instance; returns the tree of their results
+  Handle<Object> execute_batch( Handle<ObjectTree> combinations ) const
+  {
+    return invoke( batch_entry_.value(), combinations );
+  }
+
+private:
+  Handle<Object> invoke( uint64_t entry, Handle<ObjectTree> encode_name ) const
   {
     void ( *init_func )( void* );
     init_func = reinterpret_cast<void ( * )( void* )>( code_.get() + init_entry_ );
 
-    char* instance = static_cast<char*>( aligned_alloc( alignof( __m256i ), instance_context_size_ ) );
-    init_func( instance );
+    char* instance;
+    if ( auto snapshot = snapshot_.load(); snapshot ) {
+      instance = snapshot->restore( code_.get() );
+    } else {
+      instance = static_cast<char*>( aligned_alloc( alignof( __m256i ), instance_context_size_ ) );
+      init_func( instance );
+    }
 
     u8x32 ( *main_func )( void*, u8x32 );
-    main_func = reinterpret_cast<u8x32 ( * )( void*, u8x32 )>( code_.get() + main_entry_ );
+    main_func = reinterpret_cast<u8x32 ( * )( void*, u8x32 )>( code_.get() + entry );
 
     void ( *cleanup_func )( void* );
     cleanup_func = reinterpret_cast<void ( * )( void* )>( code_.get() + cleanup_entry_ );
@@ -96,24 +196,33 @@ public:
     return Handle<Fix>::forge( result ).try_into<Expression>().value().try_into<Object>().value();
   }
 
+public:
   Program( const Program& ) = delete;
   Program& operator=( const Program& ) = delete;
 
   Program( Program&& other )
     : code_( other.code_ )
+    , code_size_( other.code_size_ )
     , init_entry_( other.init_entry_ )
     , main_entry_( other.main_entry_ )
+    , batch_entry_( other.batch_entry_ )
+    , checkpoint_entry_( other.checkpoint_entry_ )
     , cleanup_entry_( other.cleanup_entry_ )
     , instance_context_size_( other.instance_context_size_ )
+    , snapshot_( other.snapshot_.load() )
   {}
 
   Program& operator=( Program&& other )
   {
     code_ = other.code_;
+    code_size_ = other.code_size_;
     init_entry_ = other.init_entry_;
     main_entry_ = other.main_entry_;
+    batch_entry_ = other.batch_entry_;
+    checkpoint_entry_ = other.checkpoint_entry_;
     cleanup_entry_ = other.cleanup_entry_;
     instance_context_size_ = other.instance_context_size_;
+    snapshot_.store( other.snapshot_.load() );
 
     return *this;
   }
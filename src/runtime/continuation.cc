@@ -0,0 +1,459 @@
+#include <concepts>
+#include <iterator>
+#include <stdexcept>
+
+#include "continuation.hh"
+#include "handle_post.hh"
+#include "overload.hh"
+#include "relater.hh"
+
+using namespace std;
+
+template<typename T>
+using Result = Continuation::Result<T>;
+
+namespace {
+
+template<typename T>
+Handle<Fix> fix( Handle<T> x )
+{
+  if constexpr ( constructible_from<Handle<Object>, Handle<T>> ) {
+    return Handle<Fix>( Handle<Expression>( Handle<Object>( x ) ) );
+  } else {
+    return Handle<Fix>( Handle<Expression>( x ) );
+  }
+}
+
+Handle<Object> object( Handle<Fix> x )
+{
+  return x.unwrap<Expression>().unwrap<Object>();
+}
+
+}
+
+Continuation::Continuation( Handle<Relation> job )
+  : job_( job )
+{
+  stack_.push_back( { .op = Op::Relate, .subject = Handle<Fix>( job ) } );
+}
+
+void Continuation::push( Op op, Handle<Fix> subject )
+{
+  stack_.push_back( { .op = op, .subject = subject } );
+}
+
+void Continuation::tail( Frame& frame, Op op, Handle<Fix> subject )
+{
+  frame.op = op;
+  frame.subject = subject;
+  frame.stage = 0;
+}
+
+void Continuation::map( Frame& frame, MapKind kind, Handle<Fix> tree, Relater& relater )
+{
+  auto make = [&]( auto t, TreeData data ) {
+    auto size = data->size();
+    return make_unique<MapState>(
+      MapState { .kind = kind, .tree = t, .data = std::move( data ), .results = OwnedMutTree::allocate( size ) } );
+  };
+
+  unique_ptr<MapState> state;
+  auto expression = tree.unwrap<Expression>();
+  switch ( kind ) {
+    case MapKind::Eval: {
+      auto t = handle::tree_unwrap<ObjectTree>( expression );
+      state = make( t, relater.get( t ).value() );
+      break;
+    }
+    case MapKind::EvalShallow: {
+      auto t = handle::tree_unwrap<ObjectTree>( expression );
+      state = make( t, relater.get_shallow( t ).value() );
+      break;
+    }
+    case MapKind::Reduce: {
+      auto t = handle::tree_unwrap<ExpressionTree>( expression );
+      state = make( t, relater.get( t ).value() );
+      break;
+    }
+    case MapKind::Lift: {
+      auto t = handle::tree_unwrap<ValueTree>( expression );
+      state = make( t, relater.get( t ).value() );
+      break;
+    }
+  }
+
+  frame.op = Op::Map;
+  frame.subject = tree;
+  frame.stage = 0;
+  frame.map = std::move( state );
+  maps_++;
+}
+
+void Continuation::ret( Handle<Fix> value )
+{
+  if ( stack_.back().op == Op::Map ) {
+    maps_--;
+  }
+  stack_.pop_back();
+  ret_ = value;
+}
+
+// Parks the frames above the innermost Map frame with that frame, which moves on to its next element. Returns
+// whether there is no such frame, in which case the whole stack has to wait.
+bool Continuation::block()
+{
+  size_t base = stack_.size() - 1;
+  while ( base > 0 and stack_[base - 1].op != Op::Map ) {
+    base--;
+  }
+  if ( base == 0 ) {
+    return true;
+  }
+
+  auto& map = *stack_[base - 1].map;
+  Segment segment( make_move_iterator( stack_.begin() + base ), make_move_iterator( stack_.end() ) );
+  stack_.erase( stack_.begin() + base, stack_.end() );
+  for ( const auto& frame : segment ) {
+    maps_ -= frame.op == Op::Map;
+  }
+
+  map.parked.emplace_back( map.current.value(), std::move( segment ) );
+  map.current.reset();
+  return false;
+}
+
+void Continuation::resume( Segment&& segment )
+{
+  for ( auto& frame : segment ) {
+    maps_ += frame.op == Op::Map;
+    stack_.push_back( std::move( frame ) );
+  }
+}
+
+bool Continuation::step_relate( Frame& frame )
+{
+  frame.subject.unwrap<Relation>().visit<void>( overload {
+    [&]( Handle<Think> x ) { tail( frame, Op::Force, fix( x.unwrap<Thunk>() ) ); },
+    [&]( Handle<Eval> x ) { tail( frame, Op::EvalStrict, fix( x.unwrap<Object>() ) ); },
+  } );
+  return true;
+}
+
+bool Continuation::step_force( Frame& frame, FixRuntime& rt, FixEvaluator& evaluator, Relater& relater )
+{
+  auto thunk = object( frame.subject ).unwrap<Thunk>();
+  Handle<Relation> goal = Handle<Think>( thunk );
+
+  switch ( frame.stage ) {
+    case 0:
+      if ( relater.contains( goal ) ) {
+        ret( fix( relater.get( goal ).value() ) );
+        return true;
+      }
+
+      return thunk.visit<bool>( overload {
+        [&]( Handle<Identification> ) {
+          ret( fix( evaluator.force( thunk ).value() ) );
+          return true;
+        },
+        [&]( Handle<Application> x ) {
+          // Inside a tree, every Application becomes a job of its own, so that its siblings can run in parallel
+          if ( maps_ > 0 ) {
+            frame.stage = 3;
+            spawned_.push_back( goal );
+            return not block();
+          }
+
+          return rt.load( x.unwrap<ExpressionTree>() )
+            .value()
+            .visit<bool>( overload {
+              [&]( Handle<ExpressionTree> t ) {
+                frame.stage = 1;
+                push( Op::Map, fix( t ) );
+                map( stack_.back(), MapKind::Reduce, fix( t ), relater );
+                return true;
+              },
+              [&]( Handle<ObjectTree> t ) {
+                frame.stage = 4;
+                frame.combination = t;
+                return true;
+              },
+              [&]( Handle<ValueTree> t ) {
+                frame.stage = 4;
+                frame.combination = Handle<ObjectTree>( t );
+                return true;
+              },
+            } );
+        },
+        [&]( Handle<Selection> x ) {
+          return rt.loadShallow( x.unwrap<ObjectTree>() )
+            .value()
+            .visit<bool>( overload {
+              [&]( Handle<ObjectTree> t ) {
+                frame.stage = 2;
+                push( Op::Map, fix( t ) );
+                map( stack_.back(), MapKind::EvalShallow, fix( t ), relater );
+                return true;
+              },
+              [&]( Handle<ValueTree> t ) {
+                ret( fix( rt.select( t.into<ObjectTree>() ).value() ) );
+                return true;
+              },
+              []( Handle<ExpressionTree> ) -> bool { throw runtime_error( "Invalid loadShallow return type" ); },
+            } );
+        },
+      } );
+
+    case 1:
+      frame.stage = 4;
+      frame.combination = handle::extract<ObjectTree>( ret_.value() ).value();
+      return true;
+
+    case 2:
+      ret( fix( rt.select( handle::extract<ObjectTree>( ret_.value() ).value() ).value() ) );
+      return true;
+
+    case 3:
+      if ( relater.contains( goal ) ) {
+        ret( fix( relater.get( goal ).value() ) );
+        return true;
+      }
+      spawned_.push_back( goal );
+      return not block();
+
+    case 4: {
+      auto result = rt.apply( frame.combination.value() );
+      if ( not result ) {
+        retry_ = true;
+        return false;
+      }
+      relater.put( goal, *result );
+      ret( fix( *result ) );
+      return true;
+    }
+
+    default:
+      throw runtime_error( "Invalid force stage" );
+  }
+}
+
+bool Continuation::step_eval_strict( Frame& frame, FixRuntime& rt, Relater& relater )
+{
+  if ( frame.stage == 1 ) {
+    tail( frame, Op::EvalStrict, ret_.value() );
+    return true;
+  }
+
+  object( frame.subject )
+    .visit<void>( overload {
+      [&]( Handle<Value> x ) { tail( frame, Op::Lift, fix( x ) ); },
+      [&]( Handle<Thunk> x ) {
+        frame.stage = 1;
+        push( Op::Force, fix( x ) );
+      },
+      [&]( Handle<ObjectTree> x ) { map( frame, MapKind::Eval, fix( x ), relater ); },
+      [&]( Handle<ObjectTreeRef> x ) {
+        rt.load( Handle<AnyTreeRef>( x ) )
+          .value()
+          .visit<void>( overload {
+            [&]( Handle<ValueTree> t ) { tail( frame, Op::Lift, fix( t ) ); },
+            [&]( Handle<ObjectTree> t ) { map( frame, MapKind::Eval, fix( t ), relater ); },
+            []( Handle<ExpressionTree> ) { throw runtime_error( "Invalid load() return type." ); },
+          } );
+      },
+    } );
+  return true;
+}
+
+bool Continuation::step_eval_shallow( Frame& frame, FixRuntime& rt, FixEvaluator& evaluator )
+{
+  if ( frame.stage == 1 ) {
+    tail( frame, Op::EvalShallow, ret_.value() );
+    return true;
+  }
+
+  object( frame.subject )
+    .visit<void>( overload {
+      [&]( Handle<Value> x ) { ret( fix( evaluator.lower( x ).value() ) ); },
+      [&]( Handle<Thunk> x ) {
+        frame.stage = 1;
+        push( Op::Force, fix( x ) );
+      },
+      [&]( Handle<ObjectTree> x ) { ret( fix( rt.ref( x ).unwrap<ObjectTreeRef>() ) ); },
+      [&]( Handle<ObjectTreeRef> x ) { ret( fix( x ) ); },
+    } );
+  return true;
+}
+
+bool Continuation::step_reduce( Frame& frame, Relater& relater )
+{
+  frame.subject.unwrap<Expression>().visit<void>( overload {
+    [&]( Handle<Object> x ) { ret( fix( x ) ); },
+    [&]( Handle<Encode> x ) {
+      x.visit<void>( overload {
+        [&]( Handle<Strict> s ) { tail( frame, Op::EvalStrict, fix( s.unwrap<Thunk>() ) ); },
+        [&]( Handle<Shallow> s ) { tail( frame, Op::EvalShallow, fix( s.unwrap<Thunk>() ) ); },
+      } );
+    },
+    [&]( Handle<ExpressionTree> x ) { map( frame, MapKind::Reduce, fix( x ), relater ); },
+  } );
+  return true;
+}
+
+bool Continuation::step_lift( Frame& frame, FixRuntime& rt, Relater& relater )
+{
+  object( frame.subject )
+    .unwrap<Value>()
+    .visit<void>( overload {
+      [&]( Handle<Blob> x ) { ret( fix( x ) ); },
+      [&]( Handle<ValueTree> x ) { map( frame, MapKind::Lift, fix( x ), relater ); },
+      [&]( Handle<BlobRef> x ) {
+        auto blob = x.unwrap<Blob>();
+        rt.load( blob );
+        ret( fix( blob ) );
+      },
+      [&]( Handle<ValueTreeRef> x ) {
+        auto t = rt.load( Handle<AnyTreeRef>( x ) ).value().unwrap<ValueTree>();
+        map( frame, MapKind::Lift, fix( t ), relater );
+      },
+    } );
+  return true;
+}
+
+bool Continuation::step_map( Frame& frame, Relater& relater )
+{
+  auto& map = *frame.map;
+
+  if ( map.current.has_value() ) {
+    auto value = ret_.value();
+    map.changed |= value != map.data->at( *map.current );
+    map.results[*map.current] = value;
+    map.current.reset();
+  }
+
+  if ( not map.waiting.empty() ) {
+    auto [slot, segment] = std::move( map.waiting.back() );
+    map.waiting.pop_back();
+    map.current = slot;
+    resume( std::move( segment ) );
+    return true;
+  }
+
+  if ( map.next < map.data->size() ) {
+    auto slot = map.next++;
+    map.current = slot;
+    auto x = map.data->at( slot );
+    switch ( map.kind ) {
+      case MapKind::Eval:
+        push( Op::EvalStrict, x );
+        break;
+      case MapKind::Reduce:
+        push( Op::Reduce, x );
+        break;
+      case MapKind::Lift:
+        push( Op::Lift, x );
+        break;
+      case MapKind::EvalShallow:
+        push( Op::EvalShallow, x );
+        break;
+    }
+    return true;
+  }
+
+  if ( not map.parked.empty() ) {
+    map.waiting = std::move( map.parked );
+    map.parked.clear();
+    return not block();
+  }
+
+  ret( finish_map( map, relater ) );
+  return true;
+}
+
+Handle<Fix> Continuation::finish_map( MapState& map, Relater& relater )
+{
+  auto create = [&] { return relater.get_storage().create( make_shared<OwnedTree>( std::move( map.results ) ) ); };
+
+  switch ( map.kind ) {
+    case MapKind::Eval: {
+      auto tree = get<Handle<ObjectTree>>( map.tree );
+      if ( not map.changed ) {
+        return fix( Handle<ValueTree>( tree.content, tree.size(), tree.is_tag() ) );
+      }
+      auto result = create().unwrap<ValueTree>();
+      return fix( tree.is_tag() ? result.tag() : result );
+    }
+
+    case MapKind::Reduce: {
+      auto tree = get<Handle<ExpressionTree>>( map.tree );
+      if ( not map.changed ) {
+        return fix( Handle<ObjectTree>( tree.content, tree.size(), tree.is_tag() ) );
+      }
+      auto result = handle::tree_unwrap<ObjectTree>( create() );
+      return fix( tree.is_tag() ? result.tag() : result );
+    }
+
+    case MapKind::Lift: {
+      auto tree = get<Handle<ValueTree>>( map.tree );
+      if ( not map.changed ) {
+        return fix( tree );
+      }
+      auto result = create().unwrap<ValueTree>();
+      return fix( tree.is_tag() ? result.tag() : result );
+    }
+
+    case MapKind::EvalShallow: {
+      auto tree = get<Handle<ObjectTree>>( map.tree );
+      if ( not map.changed ) {
+        return fix( tree );
+      }
+      auto result = create().visit<Handle<ObjectTree>>( overload {
+        []( Handle<ValueTree> t ) { return t.into<ObjectTree>(); },
+        []( Handle<ObjectTree> t ) { return t; },
+        []( Handle<ExpressionTree> ) -> Handle<ObjectTree> { throw runtime_error( "Unreachable" ); },
+      } );
+      return fix( tree.is_tag() ? result.tag() : result );
+    }
+  }
+
+  throw runtime_error( "Invalid map kind" );
+}
+
+Result<Object> Continuation::run( FixRuntime& rt, FixEvaluator& evaluator, Relater& relater )
+{
+  retry_ = false;
+
+  bool running = true;
+  while ( running and not stack_.empty() ) {
+    auto& frame = stack_.back();
+    switch ( frame.op ) {
+      case Op::Relate:
+        running = step_relate( frame );
+        break;
+      case Op::Force:
+        running = step_force( frame, rt, evaluator, relater );
+        break;
+      case Op::EvalStrict:
+        running = step_eval_strict( frame, rt, relater );
+        break;
+      case Op::EvalShallow:
+        running = step_eval_shallow( frame, rt, evaluator );
+        break;
+      case Op::Reduce:
+        running = step_reduce( frame, relater );
+        break;
+      case Op::Lift:
+        running = step_lift( frame, rt, relater );
+        break;
+      case Op::Map:
+        running = step_map( frame, relater );
+        break;
+    }
+  }
+
+  if ( not running ) {
+    return {};
+  }
+
+  return object( ret_.value() );
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "evaluator.hh"
+#include "handle.hh"
+#include "object.hh"
+
+class Relater;
+
+/**
+ * The evaluation of one job, with its stack kept on the heap instead of the C++ stack. Each frame is one step of
+ * FixEvaluator (relate, force, evalStrict, evalShallow, reduce, lift, or one of the map* loops over a tree), so the
+ * depth of a thunk chain or of a nested tree costs heap memory rather than stack.
+ *
+ * A nested Application is not applied inline; it is handed back to the caller as a job of its own, and the frames
+ * waiting for it are parked. A map over a tree parks only the evaluation of the element which is waiting and moves
+ * on to the next one, so every independent Application in a wide tree is discovered in one pass. Once the jobs it
+ * waits for are done, run() carries on from the parked frames instead of starting the evaluation again.
+ */
+class Continuation
+{
+public:
+  template<typename T>
+  using Result = FixRuntime::Result<T>;
+
+private:
+  enum class Op : uint8_t
+  {
+    Relate,
+    Force,
+    EvalStrict,
+    EvalShallow,
+    Reduce,
+    Lift,
+    Map,
+  };
+
+  enum class MapKind : uint8_t
+  {
+    Eval,
+    Reduce,
+    Lift,
+    EvalShallow,
+  };
+
+  struct Frame;
+  using Segment = std::vector<Frame>;
+
+  struct MapState
+  {
+    MapKind kind;
+    std::variant<Handle<ObjectTree>, Handle<ExpressionTree>, Handle<ValueTree>> tree;
+    TreeData data;
+    OwnedMutTree results;
+    bool changed {};
+    size_t next {};
+    // The element whose evaluation is on the stack above this frame
+    std::optional<size_t> current {};
+    // Evaluations of elements which are waiting for other jobs, in this pass and from the previous one
+    std::vector<std::pair<size_t, Segment>> parked {};
+    std::vector<std::pair<size_t, Segment>> waiting {};
+  };
+
+  struct Frame
+  {
+    Op op;
+    Handle<Fix> subject;
+    uint8_t stage {};
+    // The combination of an Application whose apply has to be retried
+    std::optional<Handle<ObjectTree>> combination {};
+    std::unique_ptr<MapState> map {};
+  };
+
+  Handle<Relation> job_;
+  Segment stack_ {};
+  // The value returned by the last frame popped off the stack
+  std::optional<Handle<Fix>> ret_ {};
+  // The number of Map frames on the stack: an Application is applied inline only if there are none
+  size_t maps_ {};
+  bool retry_ {};
+  // Jobs this evaluation started waiting for, which the caller has to start
+  std::vector<Handle<Relation>> spawned_ {};
+
+  // Stack manipulation. Each step ends with at most one of these, since push() may move the frame it came from.
+  void push( Op op, Handle<Fix> subject );
+  void tail( Frame& frame, Op op, Handle<Fix> subject );
+  void map( Frame& frame, MapKind kind, Handle<Fix> tree, Relater& relater );
+  void ret( Handle<Fix> value );
+  bool block();
+  void resume( Segment&& segment );
+
+  // Each step returns whether the evaluation can go on
+  bool step_relate( Frame& frame );
+  bool step_force( Frame& frame, FixRuntime& rt, FixEvaluator& evaluator, Relater& relater );
+  bool step_eval_strict( Frame& frame, FixRuntime& rt, Relater& relater );
+  bool step_eval_shallow( Frame& frame, FixRuntime& rt, FixEvaluator& evaluator );
+  bool step_reduce( Frame& frame, Relater& relater );
+  bool step_lift( Frame& frame, FixRuntime& rt, Relater& relater );
+  bool step_map( Frame& frame, Relater& relater );
+  Handle<Fix> finish_map( MapState& map, Relater& relater );
+
+public:
+  Continuation( Handle<Relation> job );
+
+  /**
+   * Runs the evaluation until it finishes or has to wait for other jobs.
+   *
+   * @param rt         The runtime providing load, ref, select and apply.
+   * @param evaluator  The evaluator for the steps which need no stack of their own.
+   * @param relater    The Relater holding the data and memoized results.
+   * @return           The result of the job, or std::nullopt if it is waiting.
+   */
+  Result<Object> run( FixRuntime& rt, FixEvaluator& evaluator, Relater& relater );
+
+  /**
+   * The jobs this evaluation started waiting for during the last run(); clears the list.
+   */
+  std::vector<Handle<Relation>> take_spawned() { return std::exchange( spawned_, {} ); }
+
+  /**
+   * Whether the last run() stopped because the job could not be applied for now (e.g., for lack of memory), rather
+   * than to wait for other jobs.
+   */
+  bool retry() const { return retry_; }
+
+  size_t depth() const { return stack_.size(); }
+};
@@ -1,12 +1,29 @@
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
 #include <memory>
+#include <optional>
 
 #include "elfloader.hh"
 #include "fixpointapi.hh"
+#include "guest_symbols.hh"
 
 using namespace std;
 
+namespace {
+const array<string_view, 4> required_functions {
+  "initProgram", "w2c_function_0x5Ffixpoint_apply", "wasm2c_function_free", "get_instance_size" };
+const array<string_view, 2> optional_functions { "w2c_function_0x5Ffixpoint_apply_batch",
+                                                 "w2c_function_0x5Ffixpoint_checkpoint" };
+
+bool is_wanted( string_view name )
+{
+  return find( required_functions.begin(), required_functions.end(), name ) != required_functions.end()
+         or find( optional_functions.begin(), optional_functions.end(), name ) != optional_functions.end();
+}
+}
+
 static void throw_assertion_failure( const char* __assertion,
                                      const char* __file,
                                      unsigned int __line,
@@ -55,6 +72,8 @@ const static map<string, uint64_t> library_func_map
       { "fixpoint_create_selection_thunk", (uint64_t)fixpoint::create_selection_thunk },
       { "fixpoint_create_selection_thunk_range", (uint64_t)fixpoint::create_selection_thunk_range },
       { "fixpoint_get_length", (uint64_t)fixpoint::get_length },
+      { "fixpoint_get_lengths", (uint64_t)fixpoint::get_lengths },
+      { "fixpoint_read_blobs", (uint64_t)fixpoint::read_blobs },
       { "fixpoint_create_strict_encode", (uint64_t)fixpoint::create_strict_encode },
       { "fixpoint_create_shallow_encode", (uint64_t)fixpoint::create_shallow_encode },
       { "fixpoint_unsafe_io", (uint64_t)fixpoint::unsafe_io },
@@ -141,18 +160,33 @@ Elf_Info load_program( std::span<const char> program_content )
       res.symstrs = string_view( program_content.data() + res.sheader[symbstrs_idx].sh_offset,
                                  res.sheader[symbstrs_idx].sh_size );
 
-      for ( const auto& symtb_entry : res.symtb ) {
+      const bool collect = GuestSymbols::wanted();
+
+      // An optional export is waited for only if its name is in the string table, so that the scan of a program
+      // without it still stops once the required functions are found
+      size_t wanted = required_functions.size();
+      for ( auto optional : optional_functions ) {
+        if ( res.symstrs.find( string( optional ) + '\0' ) != string_view::npos ) {
+          wanted++;
+        }
+      }
+
+      for ( size_t j = 0; j < res.symtb.size(); j++ ) {
+        const auto& symtb_entry = res.symtb[j];
         if ( symtb_entry.st_name != 0 ) {
           // Funtion/Variable not defined
           if ( symtb_entry.st_shndx == SHN_UNDEF ) {
             continue;
           }
 
+          if ( collect and ELF64_ST_TYPE( symtb_entry.st_info ) == STT_FUNC ) {
+            res.functions.push_back( j );
+          }
+
           string name = string( res.symstrs.data() + symtb_entry.st_name );
-          if ( name == "initProgram" or name == "w2c_function_0x5Ffixpoint_apply" or name == "wasm2c_function_free"
-               or name == "get_instance_size" ) {
+          if ( is_wanted( name ) ) {
             res.func_map[name] = { symtb_entry.st_value, symtb_entry.st_shndx };
-            if ( res.func_map.size() == 4 )
+            if ( not collect and res.func_map.size() == wanted )
               break;
           }
         }
@@ -172,7 +206,7 @@ Elf_Info load_program( std::span<const char> program_content )
   return res;
 }
 
-shared_ptr<Program> link_program( span<const char> program_content )
+shared_ptr<Program> link_program( span<const char> program_content, string_view procedure )
 {
   Elf_Info elf_info = load_program( program_content );
 
@@ -259,6 +293,21 @@ shared_ptr<Program> link_program( span<const char> program_content )
   }
   // cout << "Linking program at program_mem " << program_mem << endl;
   shared_ptr<char> code( static_cast<char*>( program_mem ), free );
+
+  if ( GuestSymbols::wanted() ) {
+    vector<GuestSymbols::Symbol> symbols;
+    for ( auto idx : elf_info.functions ) {
+      const auto& symtb_entry = elf_info.symtb[idx];
+      if ( auto section = elf_info.idx_to_offset.find( symtb_entry.st_shndx );
+           section != elf_info.idx_to_offset.end() ) {
+        symbols.push_back( { section->second + symtb_entry.st_value,
+                             symtb_entry.st_size,
+                             string( elf_info.symstrs.data() + symtb_entry.st_name ) } );
+      }
+    }
+    guest_symbols().add( procedure, code.get(), elf_info.size, symbols );
+  }
+
   auto& init_location = elf_info.func_map.at( "initProgram" );
   uint64_t init_entry = init_location.first + elf_info.idx_to_offset.at( init_location.second );
   auto& main_location = elf_info.func_map.at( "w2c_function_0x5Ffixpoint_apply" );
@@ -268,5 +317,22 @@ shared_ptr<Program> link_program( span<const char> program_content )
   auto& instance_size_location = elf_info.func_map.at( "get_instance_size" );
   uint64_t instance_size_entry
     = instance_size_location.first + elf_info.idx_to_offset.at( instance_size_location.second );
-  return make_shared<Program>( code, init_entry, main_entry, cleanup_entry, instance_size_entry );
+  optional<uint64_t> batch_entry;
+  if ( auto batch = elf_info.func_map.find( "w2c_function_0x5Ffixpoint_apply_batch" );
+       batch != elf_info.func_map.end() ) {
+    batch_entry = batch->second.first + elf_info.idx_to_offset.at( batch->second.second );
+  }
+  optional<uint64_t> checkpoint_entry;
+  if ( auto checkpoint = elf_info.func_map.find( "w2c_function_0x5Ffixpoint_checkpoint" );
+       checkpoint != elf_info.func_map.end() ) {
+    checkpoint_entry = checkpoint->second.first + elf_info.idx_to_offset.at( checkpoint->second.second );
+  }
+  return make_shared<Program>( code,
+                               elf_info.size,
+                               init_entry,
+                               main_entry,
+                               cleanup_entry,
+                               instance_size_entry,
+                               batch_entry,
+                               checkpoint_entry );
 }
@@ -31,6 +31,8 @@ struct Elf_Info
 
   // Map from function/variable name to st_value
   std::map<std::string, std::pair<uint64_t, unsigned short>> func_map;
+  // Index in the symbol table of every function defined by the program, if GuestSymbols::wanted()
+  std::vector<size_t> functions;
 
   // Map from section idx to the offset of section in program memory
   std::map<uint64_t, uint64_t> idx_to_offset;
@@ -44,10 +46,13 @@ struct Elf_Info
     , symtb()
     , sheader()
     , func_map()
+    , functions()
     , idx_to_offset()
     , relocation_tables()
   {}
 };
 
 Elf_Info load_program( std::span<const char> program_content );
-std::shared_ptr<Program> link_program( std::span<const char> program_content );
+// Links the program, naming its functions after @p procedure for profilers
+std::shared_ptr<Program> link_program( std::span<const char> program_content,
+                                       std::string_view procedure = "procedure" );
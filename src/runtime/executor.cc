@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <chrono>
 #include <glog/logging.h>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <string_view>
 #include <unistd.h>
@@ -10,6 +13,7 @@
 #include "handle.hh"
 #include "overload.hh"
 #include "resource_limits.hh"
+#include "scheduler.hh"
 #include "storage_exception.hh"
 
 template<typename T>
@@ -24,6 +28,10 @@ Executor::Executor( Relater& parent, size_t threads, optional<shared_ptr<Runner>
                                                            parent.labeled( "compile-fixed-point" ) ) )
 {
   fixpoint::storage = &parent_.storage_;
+  runner_->set_snapshot_store( {
+    [&]( Handle<Fix> procedure ) { return parent_.snapshot( procedure ); },
+    [&]( Handle<Fix> procedure, Handle<ValueTree> snapshot ) { parent_.keep_snapshot( procedure, snapshot ); },
+  } );
   for ( size_t i = 0; i < threads; i++ ) {
     threads_.emplace_back( [&]() {
       fixpoint::storage = &parent_.storage_;
@@ -48,7 +56,14 @@ void Executor::run()
   try {
     while ( true ) {
       todo_ >> next;
-      progress( next );
+      busy_++;
+      auto combination = batch_size > 1 ? ready_application( next ) : nullopt;
+      if ( combination.has_value() ) {
+        progress_batch( next, combination.value() );
+      } else {
+        progress( next );
+      }
+      busy_--;
     }
   } catch ( StorageException& e ) {
     std::unique_lock lock( error_mutex );
@@ -89,28 +104,145 @@ void Executor::progress( Handle<Relation> runnable )
   parent_.run( runnable );
 }
 
-Result<Object> Executor::apply( Handle<ObjectTree> combination )
-{
-  VLOG( 2 ) << "Apply " << combination;
+namespace {
 
-  TreeData tree = parent_.storage_.get( combination );
-  auto rlimits = tree->at( 0 );
-
-  VLOG( 2 ) << combination << " rlimits are " << rlimits;
-  auto limits = rlimits.unwrap<Expression>()
+uint64_t requested_bytes( const TreeData& combination )
+{
+  auto limits = combination->at( 0 )
+                  .unwrap<Expression>()
                   .unwrap<Object>()
                   .try_into<Value>()
                   .and_then( [&]( auto x ) { return x.template try_into<ValueTree>(); } )
                   .transform( [&]( auto x ) { return fixpoint::storage->get( x ); } );
 
-  auto requested
-    = limits
-        .and_then( [&]( auto x ) {
-          return handle::extract<Literal>(
-            x->at( 0 ).template unwrap<Expression>().template unwrap<Object>().template unwrap<Value>() );
-        } )
-        .transform( [&]( auto x ) { return uint64_t( x ); } )
-        .value_or( 0 );
+  return limits
+    .and_then( [&]( auto x ) {
+      return handle::extract<Literal>(
+        x->at( 0 ).template unwrap<Expression>().template unwrap<Object>().template unwrap<Value>() );
+    } )
+    .transform( [&]( auto x ) { return uint64_t( x ); } )
+    .value_or( 0 );
+}
+
+}
+
+optional<Handle<ObjectTree>> Executor::ready_application( Handle<Relation> job )
+{
+  auto application = job.try_into<Think>()
+                       .transform( []( auto h ) { return h.template unwrap<Thunk>(); } )
+                       .and_then( []( auto h ) { return h.template try_into<Application>(); } );
+  if ( not application.has_value() ) {
+    return {};
+  }
+
+  Handle<AnyTree> tree = application->unwrap<ExpressionTree>();
+  if ( not parent_.storage_.contains( tree ) ) {
+    return {};
+  }
+
+  return parent_.storage_.get_handle( tree ).value().visit<optional<Handle<ObjectTree>>>( overload {
+    []( Handle<ExpressionTree> ) -> optional<Handle<ObjectTree>> { return {}; },
+    []( auto x ) { return Handle<ObjectTree>( x ); },
+  } );
+}
+
+bool Executor::batches( const TreeData& combination )
+{
+  // Asking the runner links the procedure, so the answer is remembered rather than asked for every job
+  auto procedure = combination->at( 1 );
+  if ( auto known = batches_.get( procedure ); known.has_value() ) {
+    return known.value();
+  }
+
+  const bool batches = runner_->batches( combination );
+  batches_.insert( procedure, batches );
+  return batches;
+}
+
+void Executor::progress_batch( Handle<Relation> first, Handle<ObjectTree> combination )
+{
+  auto tree = parent_.storage_.get( combination );
+  if ( parent_.contains( first ) or not batches( tree ) ) {
+    progress( first );
+    return;
+  }
+
+  // The job continues once its owner has answered
+  if ( parent_.directory_.lookup( first ) ) {
+    return;
+  }
+
+  // Only take from the queue what the other threads would not get to before this one is done with the batch
+  const size_t limit = std::min( batch_size.load(), 1 + todo_.size_approx() / std::max<size_t>( 1, threads_.size() ) );
+
+  vector<Handle<Relation>> jobs { first };
+  vector<Handle<ObjectTree>> combinations { combination };
+  vector<TreeData> trees { tree };
+  vector<Handle<Relation>> others;
+  while ( jobs.size() < limit ) {
+    auto next = todo_.pop();
+    if ( not next.has_value() ) {
+      break;
+    }
+
+    auto ready = ready_application( *next );
+    auto data = ready.transform( [&]( auto h ) { return parent_.storage_.get( h ); } );
+    if ( not data.has_value() or data.value()->at( 1 ) != tree->at( 1 ) or parent_.contains( *next ) ) {
+      others.push_back( *next );
+    } else if ( not parent_.directory_.lookup( *next ) ) {
+      jobs.push_back( *next );
+      combinations.push_back( *ready );
+      trees.push_back( *data );
+    }
+  }
+  // The jobs which are not part of the batch go back to the head of the queue, where they were
+  todo_.push_front( move( others ) );
+
+  uint64_t requested = 0;
+  for ( const auto& data : trees ) {
+    requested = std::max( requested, requested_bytes( data ) );
+  }
+
+  bool reserved = false;
+  if ( jobs.size() > 1 ) {
+    auto w = parent_.available_memory_.write();
+    if ( w.get() >= requested ) {
+      w.get() -= requested;
+      reserved = true;
+    } else {
+      VLOG( 1 ) << "Out of memory for a batch " << w.get() << " " << requested;
+    }
+  }
+
+  // Without a batch to apply, each job goes through the scheduler as usual
+  if ( not reserved ) {
+    for ( auto job : jobs ) {
+      parent_.scheduler_->schedule( job );
+    }
+    return;
+  }
+
+  VLOG( 2 ) << "Applying a batch of " << jobs.size() << " combinations";
+  auto start = chrono::steady_clock::now();
+  auto results = runner_->apply_batch( combinations, trees );
+  parent_.available_memory_.write().get() += requested;
+  parent_.directory_.ran(
+    tree->at( 1 ),
+    chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - start ) / jobs.size() );
+
+  // Each result is recorded as if its job had been applied alone
+  for ( size_t i = 0; i < jobs.size(); i++ ) {
+    parent_.put( jobs[i], results[i] );
+  }
+}
+
+Result<Object> Executor::apply( Handle<ObjectTree> combination )
+{
+  VLOG( 2 ) << "Apply " << combination;
+
+  TreeData tree = parent_.storage_.get( combination );
+  VLOG( 2 ) << combination << " rlimits are " << tree->at( 0 );
+  auto requested = requested_bytes( tree );
 
   {
     auto w = parent_.available_memory_.write();
@@ -125,8 +257,11 @@ Result<Object> Executor::apply( Handle<ObjectTree> combination )
     w.get() -= requested;
   }
 
+  auto start = chrono::steady_clock::now();
   auto result = runner_->apply( combination, tree );
   parent_.available_memory_.write().get() += requested;
+  parent_.directory_.ran( tree->at( 1 ),
+                          chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - start ) );
 
   return result;
 }
@@ -163,6 +298,52 @@ void Executor::retry( Handle<Relation> name )
   todo_.push( name );
 }
 
+vector<Handle<Relation>> Executor::steal( size_t count, function<size_t( Handle<Relation> )> cost )
+{
+  // Look at a few more candidates than requested, and give away the cheapest ones
+  vector<pair<size_t, Handle<Relation>>> candidates;
+  for ( size_t i = 0; i < count * 4; i++ ) {
+    auto next = todo_.pop();
+    if ( not next.has_value() ) {
+      break;
+    }
+    candidates.push_back( { cost( *next ), *next } );
+  }
+
+  vector<size_t> order( candidates.size() );
+  iota( order.begin(), order.end(), 0 );
+  stable_sort(
+    order.begin(), order.end(), [&]( size_t a, size_t b ) { return candidates[a].first < candidates[b].first; } );
+
+  // Stolen relations stay marked as running in the dependency graph, so they are never started here again; they
+  // finish when the thief's result is put.
+  vector<bool> taken( candidates.size() );
+  vector<Handle<Relation>> stolen;
+  for ( auto i : order ) {
+    if ( stolen.size() < count and candidates[i].first != numeric_limits<size_t>::max() ) {
+      stolen.push_back( candidates[i].second );
+      taken[i] = true;
+    }
+  }
+
+  // The rest go back to the head of the queue, where they were
+  vector<Handle<Relation>> kept;
+  for ( size_t i = 0; i < candidates.size(); i++ ) {
+    if ( not taken[i] ) {
+      kept.push_back( candidates[i].second );
+    }
+  }
+  todo_.push_front( move( kept ) );
+
+  VLOG( 1 ) << "Giving away " << stolen.size() << " of " << candidates.size() << " queued jobs";
+  return stolen;
+}
+
+void Executor::return_stolen( Handle<Relation> name )
+{
+  todo_.push( name );
+}
+
 std::optional<Handle<AnyTree>> Executor::get_handle( Handle<AnyTree> )
 {
   return {};
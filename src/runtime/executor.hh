@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <limits>
 #include <memory>
 #include <thread>
@@ -8,6 +9,7 @@
 #include "channel.hh"
 #include "evaluator.hh"
 #include "handle.hh"
+#include "hash_table.hh"
 #include "interface.hh"
 #include "relater.hh"
 #include "runner.hh"
@@ -16,10 +18,17 @@ class Executor : public IRuntime
 {
   std::vector<std::thread> threads_ {};
   Channel<Handle<Relation>> todo_ {};
+  std::atomic<uint32_t> busy_ { 0 };
   Relater& parent_;
   std::shared_ptr<Runner> runner_ {};
+  // Whether each procedure, the second entry of the combinations applying it, has a batch entry point
+  FixTable<Fix, bool> batches_ { 10000 };
 
 public:
+  // Up to this many ready Applications of a procedure with a batch entry point are applied in one invocation of it;
+  // 0 or 1 disables batching. Executor threads read it while they run, so it may be changed at any time.
+  static inline std::atomic<size_t> batch_size { 64 };
+
   Executor( Relater& parent,
             size_t threads = std::thread::hardware_concurrency(),
             std::optional<std::shared_ptr<Runner>> runner = {} );
@@ -33,6 +42,11 @@ private:
   void run();
   void progress( Handle<Relation> runnable );
 
+  // The combination of @p job, if it is the Application of a combination whose elements are all evaluated
+  std::optional<Handle<ObjectTree>> ready_application( Handle<Relation> job );
+  void progress_batch( Handle<Relation> first, Handle<ObjectTree> combination );
+  bool batches( const TreeData& combination );
+
 public:
   Result<Object> apply( Handle<ObjectTree> combination );
 
@@ -62,4 +76,15 @@ public:
     return Info { .parallelism = static_cast<uint32_t>( threads_.size() ),
                   .link_speed = std::numeric_limits<double>::max() };
   }
+
+  virtual std::optional<Load> get_load() override
+  {
+    auto busy = busy_.load();
+    return Load { .queued = static_cast<uint32_t>( todo_.size_approx() ),
+                  .idle = static_cast<uint32_t>( threads_.size() ) - std::min( busy, uint32_t( threads_.size() ) ) };
+  }
+
+  virtual std::vector<Handle<Relation>> steal( size_t count,
+                                               std::function<size_t( Handle<Relation> )> cost ) override;
+  virtual void return_stolen( Handle<Relation> name ) override;
 };
@@ -1,10 +1,15 @@
+#include <cstring>
 #include <glog/logging.h>
 #include <stdexcept>
+#include <vector>
 
 #include "fixpointapi.hh"
+#include "front_cache.hh"
+#include "guest_symbols.hh"
 #include "handle.hh"
 #include "handle_post.hh"
 #include "object.hh"
+#include "overload.hh"
 #include "runtimestorage.hh"
 #include "wasm-rt.h"
 
@@ -12,9 +17,81 @@ using namespace std;
 
 #define check( t ) ( !t ? throw std::runtime_error( std::string( __PRETTY_FUNCTION__ ) + ": invalid handle" ) : 0 )
 
+namespace {
+thread_local bool in_invocation = false;
+thread_local FrontCache<Handle<Named>, BlobData> blobs;
+thread_local FrontCache<Handle<AnyTree>, TreeData> trees;
+
+optional<Handle<AnyTree>> as_tree( Handle<Fix> fix_handle )
+{
+  return handle::extract<ExpressionTree>( fix_handle )
+    .transform( []( auto h ) -> Handle<AnyTree> { return h; } )
+    .or_else( [&]() -> optional<Handle<AnyTree>> { return handle::extract<ObjectTree>( fix_handle ); } )
+    .or_else( [&]() -> optional<Handle<AnyTree>> { return handle::extract<ValueTree>( fix_handle ); } );
+}
+
+// The entries [first, first + count) of the Tree at @p handle; traps if they are out of bounds
+TreeSpan entries( u8x32 handle, uint32_t first, uint32_t count )
+{
+  auto h = as_tree( Handle<Fix>::forge( handle ) );
+  check( h );
+
+  auto tree = fixpoint::tree_span( *h );
+  if ( uint64_t( first ) + count > tree.size() ) {
+    wasm_rt_trap( WASM_RT_TRAP_OOB );
+  }
+  return tree.subspan( first, count );
+}
+
+// Entry @p i of the Tree at @p entry; traps if it is not a Tree or i is out of bounds
+Handle<Fix> nth( Handle<Fix> entry, uint32_t i )
+{
+  auto h = as_tree( entry );
+  check( h );
+
+  auto tree = fixpoint::tree_span( *h );
+  if ( i >= tree.size() ) {
+    wasm_rt_trap( WASM_RT_TRAP_OOB );
+  }
+  return tree[i];
+}
+}
+
 namespace fixpoint {
+Invocation::Invocation()
+  : outer_( not in_invocation )
+{
+  in_invocation = true;
+}
+
+Invocation::~Invocation()
+{
+  if ( outer_ ) {
+    blobs.clear();
+    trees.clear();
+    in_invocation = false;
+  }
+}
+
+BlobSpan blob_span( Handle<Named> handle )
+{
+  if ( in_invocation ) {
+    return blobs.get( handle, *storage )->span();
+  }
+  return storage->get( handle )->span();
+}
+
+TreeSpan tree_span( Handle<AnyTree> handle )
+{
+  if ( in_invocation ) {
+    return trees.get( handle, *storage )->span();
+  }
+  return storage->get( handle )->span();
+}
+
 void attach_tree( u8x32 handle, wasm_rt_externref_table_t* target_table )
 {
+  GuestCallTimer<Timer::Category::AttachTree> timer( __builtin_return_address( 0 ) );
   auto fix_handle = Handle<Fix>::forge( handle );
   optional<Handle<AnyTree>> h
     = handle::extract<ExpressionTree>( fix_handle )
@@ -24,22 +101,23 @@ void attach_tree( u8x32 handle, wasm_rt_externref_table_t* target_table )
 
   check( h );
 
-  auto tree = storage->get( *h );
+  auto tree = tree_span( *h );
   target_table->ref = h->content;
-  target_table->data = reinterpret_cast<wasm_rt_externref_t*>( const_cast<Handle<Fix>*>( tree->data() ) );
-  target_table->size = tree->size();
-  target_table->max_size = tree->size();
+  target_table->data = reinterpret_cast<wasm_rt_externref_t*>( const_cast<Handle<Fix>*>( tree.data() ) );
+  target_table->size = tree.size();
+  target_table->max_size = tree.size();
 }
 
 void attach_blob( u8x32 handle, wasm_rt_memory_t* target_memory )
 {
+  GuestCallTimer<Timer::Category::AttachBlob> timer( __builtin_return_address( 0 ) );
   auto h = handle::extract<Blob>( Handle<Fix>::forge( handle ) );
   check( h );
 
   target_memory->ref = h->content;
 
   BlobSpan blob = h->try_into<Named>()
-                    .transform( [&]( auto h ) { return storage->get( h )->span(); } )
+                    .transform( [&]( auto h ) { return blob_span( h ); } )
                     .or_else( [&]() -> optional<BlobSpan> {
                       return span<const char> { reinterpret_cast<const char*>( &target_memory->ref ),
                                                 h->try_into<Literal>()->size() };
@@ -55,6 +133,7 @@ void attach_blob( u8x32 handle, wasm_rt_memory_t* target_memory )
 // module_instance points to the WASM instance
 u8x32 create_blob( wasm_rt_memory_t* memory, size_t size )
 {
+  GuestCallTimer<Timer::Category::CreateBlob> timer( __builtin_return_address( 0 ) );
   if ( size > memory->size ) {
     wasm_rt_trap( WASM_RT_TRAP_OOB );
   }
@@ -103,6 +182,7 @@ void unsafe_io( int32_t index, int32_t length, wasm_rt_memory_t* mem )
 
 u8x32 create_tree( wasm_rt_externref_table_t* table, size_t size )
 {
+  GuestCallTimer<Timer::Category::CreateTree> timer( __builtin_return_address( 0 ) );
   if ( size > table->size ) {
     wasm_rt_trap( WASM_RT_TRAP_OOB );
   }
@@ -186,11 +266,101 @@ uint32_t get_length( u8x32 handle )
     .transform( []( auto h ) -> Handle<AnyTree> { return h; } )
     .or_else( [&]() -> optional<Handle<AnyTree>> { return handle::extract<ObjectTree>( fix ); } )
     .or_else( [&]() -> optional<Handle<AnyTree>> { return handle::extract<ValueTree>( fix ); } )
-    .transform( [&]( auto h ) { return storage->get( h )->size(); } )
+    .transform( [&]( auto h ) { return tree_span( h ).size(); } )
     .or_else( [&]() -> optional<size_t> { return handle::size( fix ); } )
     .value();
 }
 
+void get_lengths( u8x32 handle,
+                  uint32_t first,
+                  uint32_t count,
+                  uint32_t child,
+                  uint32_t index,
+                  wasm_rt_memory_t* memory )
+{
+  if ( uint64_t( index ) + uint64_t( count ) * 2 * sizeof( uint32_t ) > memory->size ) {
+    wasm_rt_trap( WASM_RT_TRAP_OOB );
+  }
+
+  auto* out = memory->data + index;
+  for ( Handle<Fix> entry : entries( handle, first, count ) ) {
+    if ( child != UINT32_MAX ) {
+      entry = nth( entry, child );
+    }
+
+    EntryKind kind = EntryKind::Other;
+    if ( handle::extract<Blob>( entry ) ) {
+      kind = EntryKind::Blob;
+    } else if ( as_tree( entry ) ) {
+      kind = EntryKind::Tree;
+    } else if ( handle::extract<BlobRef>( entry ) ) {
+      kind = EntryKind::BlobRef;
+    } else if ( handle::extract<ValueTreeRef>( entry ) or handle::extract<ObjectTreeRef>( entry ) ) {
+      kind = EntryKind::TreeRef;
+    } else if ( handle::extract<Encode>( entry ) ) {
+      kind = EntryKind::Encode;
+    } else if ( handle::extract<Thunk>( entry ) ) {
+      kind = EntryKind::Thunk;
+    }
+
+    // Trees and Blobs carry their length in the Handle, so no entry needs a lookup of its own
+    uint32_t record[2] = { kind < EntryKind::Thunk ? uint32_t( handle::size( entry ) ) : 0, uint32_t( kind ) };
+    memcpy( out, record, sizeof( record ) );
+    out += sizeof( record );
+  }
+}
+
+uint32_t read_blobs( u8x32 handle,
+                     uint32_t first,
+                     uint32_t count,
+                     uint32_t child,
+                     uint32_t index,
+                     uint32_t capacity,
+                     wasm_rt_memory_t* memory )
+{
+  vector<Handle<Blob>> targets;
+  uint64_t needed = uint64_t( count ) * sizeof( uint32_t );
+  for ( const auto& entry : entries( handle, first, count ) ) {
+    auto target = child != UINT32_MAX ? nth( entry, child ) : entry;
+    auto blob = handle::extract<Blob>( target );
+    check( blob );
+    targets.push_back( *blob );
+    needed += handle::size( *blob );
+  }
+
+  // The size would not fit in the result, so a caller could not allocate for it
+  if ( needed > UINT32_MAX ) {
+    wasm_rt_trap( WASM_RT_TRAP_OOB );
+  }
+  if ( needed > capacity ) {
+    return needed;
+  }
+  if ( uint64_t( index ) + needed > memory->size ) {
+    wasm_rt_trap( WASM_RT_TRAP_OOB );
+  }
+
+  auto* lengths = memory->data + index;
+  auto* out = lengths + targets.size() * sizeof( uint32_t );
+  for ( auto& blob : targets ) {
+    uint32_t length = blob.visit<uint32_t>( overload {
+      [&]( Handle<Named> n ) {
+        auto data = blob_span( n );
+        memcpy( out, data.data(), data.size() );
+        return data.size();
+      },
+      [&]( Handle<Literal> l ) {
+        memcpy( out, l.data(), l.size() );
+        return l.size();
+      },
+    } );
+
+    memcpy( lengths, &length, sizeof( length ) );
+    lengths += sizeof( length );
+    out += length;
+  }
+  return needed;
+}
+
 u8x32 create_strict_encode( u8x32 handle )
 {
   auto h = handle::extract<Thunk>( Handle<Fix>::forge( handle ) ).transform( []( auto h ) {
@@ -8,6 +8,27 @@ namespace fixpoint {
 inline thread_local RuntimeStorage* storage;
 inline thread_local Handle<Fix> current_procedure;
 
+/**
+ * The scope of one invocation of a procedure on this thread. While it lasts, the data of the Named Blobs and Trees
+ * the procedure looks up are remembered in a small per-thread cache, so that attaching the same data again neither
+ * probes the storage nor touches the reference count the data shares with other threads. The storage keeps the data
+ * alive, as it does for lookups outside of an Invocation, which go to the storage.
+ */
+class Invocation
+{
+  bool outer_;
+
+public:
+  Invocation();
+  ~Invocation();
+  Invocation( const Invocation& ) = delete;
+  Invocation& operator=( const Invocation& ) = delete;
+};
+
+// The contents of a Named Blob or a Tree, through the cache of the current Invocation
+BlobSpan blob_span( Handle<Named> handle );
+TreeSpan tree_span( Handle<AnyTree> handle );
+
 // Returns the canonical "nil" Handle (the Handle with all zero bits, which is a zero-length Literal).
 u8x32 nil( void );
 
@@ -48,6 +69,40 @@ u8x32 create_selection_thunk_range( u8x32 handle, uint32_t begin_idx, uint32_t e
 // Traps if handle is not Handle<AnyTree> or Handle<AnyTreeRef> or Handle<Blob> or Handle<BlobRef>
 uint32_t get_length( u8x32 handle );
 
+// The kinds of entries reported by get_lengths
+enum class EntryKind : uint32_t
+{
+  Blob,
+  Tree,
+  BlobRef,
+  TreeRef,
+  Thunk,
+  Encode,
+  Other,
+};
+
+// Writes a { uint32_t length; uint32_t kind; } record for each of the entries [first, first + count) of a Tree, or
+// for entry child of each of those entries unless child is UINT32_MAX, to memory at index, where length is what
+// get_length would return (or zero). Traps if a handle on the way is not a Tree.
+void get_lengths( u8x32 handle,
+                  uint32_t first,
+                  uint32_t count,
+                  uint32_t child,
+                  uint32_t index,
+                  wasm_rt_memory_t* memory );
+
+// Copies the Blobs at the entries [first, first + count) of a Tree, or at entry child of each of those entries unless
+// child is UINT32_MAX, to memory at index: a uint32_t length per Blob, then the Blobs back to back. Returns the number
+// of bytes this takes, and writes nothing if that is more than capacity. Traps if a handle on the way is not a Tree
+// or a Blob, or if the Blobs take more than UINT32_MAX bytes.
+uint32_t read_blobs( u8x32 handle,
+                     uint32_t first,
+                     uint32_t count,
+                     uint32_t child,
+                     uint32_t index,
+                     uint32_t capacity,
+                     wasm_rt_memory_t* memory );
+
 // Return Handle<Strict>, traps if handle is not Handle<Thunk>
 u8x32 create_strict_encode( u8x32 handle );
 
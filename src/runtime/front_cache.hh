@@ -0,0 +1,45 @@
+#pragma once
+
+#include "runtimestorage.hh"
+
+#include <array>
+#include <cstring>
+#include <optional>
+#include <utility>
+
+// A small direct-mapped cache from handles to their data in a RuntimeStorage. A lookup that misses replaces whatever
+// was in its slot; the storage keeps the replaced data alive, so spans into it stay valid.
+template<typename H, typename D>
+class FrontCache
+{
+  static constexpr size_t slots = 256;
+  std::array<std::optional<std::pair<H, D>>, slots> slots_ {};
+
+  static size_t slot_of( H handle )
+  {
+    uint64_t hash;
+    memcpy( &hash, &handle.content, sizeof( hash ) );
+    return hash % slots;
+  }
+
+public:
+  const D& get( H handle, RuntimeStorage& storage )
+  {
+    auto& slot = slots_[slot_of( handle )];
+    if ( not slot.has_value() or not( slot->first == handle ) ) {
+      slot.emplace( handle, storage.get( handle ) );
+    }
+    return slot->second;
+  }
+
+  bool contains( H handle ) const
+  {
+    const auto& slot = slots_[slot_of( handle )];
+    return slot.has_value() and slot->first == handle;
+  }
+
+  // Whether @p a and @p b would take the same slot
+  static bool collide( H a, H b ) { return slot_of( a ) == slot_of( b ); }
+
+  void clear() { slots_.fill( std::nullopt ); }
+};
@@ -0,0 +1,91 @@
+#include <fstream>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include "guest_symbols.hh"
+
+using namespace std;
+
+void GuestSymbols::add( string_view procedure, const char* code, size_t code_size, const vector<Symbol>& symbols )
+{
+  const auto base = reinterpret_cast<uint64_t>( code );
+
+  unique_lock lock( mutex_ );
+  // Code of procedures which were dropped may have been reused for this one
+  functions_.erase( functions_.lower_bound( base ), functions_.lower_bound( base + code_size ) );
+  for ( const auto& symbol : symbols ) {
+    functions_.insert_or_assign( base + symbol.offset,
+                                 Function { base + symbol.offset + symbol.size,
+                                            string( procedure ) + ":" + symbol.name } );
+  }
+
+  // Under the lock too, so that the lines of procedures linked by different threads do not interleave
+  if ( perf_map ) {
+    ofstream map( "/tmp/perf-" + to_string( getpid() ) + ".map", ios::app );
+    map << hex;
+    for ( const auto& symbol : symbols ) {
+      map << base + symbol.offset << " " << symbol.size << " " << procedure << ":" << symbol.name << "\n";
+    }
+    if ( not map ) {
+      LOG( WARNING ) << "could not write the perf map of " << procedure;
+    }
+  }
+
+  VLOG( 1 ) << "linked " << symbols.size() << " functions of " << procedure << " at "
+            << static_cast<const void*>( code );
+}
+
+optional<string> GuestSymbols::lookup_locked( uint64_t address ) const
+{
+  auto it = functions_.upper_bound( address );
+  if ( it == functions_.begin() ) {
+    return {};
+  }
+  --it;
+  if ( address >= it->second.end ) {
+    return {};
+  }
+  return it->second.name;
+}
+
+optional<string> GuestSymbols::lookup( uint64_t address ) const
+{
+  unique_lock lock( mutex_ );
+  return lookup_locked( address );
+}
+
+void GuestSymbols::log( Timer::Category category, const void* caller, uint64_t ticks )
+{
+  unique_lock lock( mutex_ );
+  calls_[{ category, reinterpret_cast<uint64_t>( caller ) }].log( ticks );
+}
+
+void GuestSymbols::summary( ostream& out ) const
+{
+  unique_lock lock( mutex_ );
+
+  // Calls are recorded by address, and only named when asked for, to keep logging them cheap
+  map<pair<string, Timer::Category>, Timer::Record> by_function;
+  for ( const auto& [key, record] : calls_ ) {
+    const auto& [category, address] = key;
+    auto& total = by_function[{ lookup_locked( address ).value_or( "(unknown)" ), category }];
+    total.count += record.count;
+    total.total_ticks += record.total_ticks;
+    total.max_ticks = max( total.max_ticks, record.max_ticks );
+    total.min_ticks = min( total.min_ticks, record.min_ticks );
+  }
+
+  out << "Fixpoint api calls by guest function\n------------------------------------\n\n";
+  for ( const auto& [key, record] : by_function ) {
+    const auto& [function, category] = key;
+    out << "   " << function << " " << Timer::_category_names.at( static_cast<size_t>( category ) ) << ": ";
+    out << "[total=" << record.total_ticks << "] [mean=" << record.total_ticks / record.count << "] [max="
+        << record.max_ticks << "] [count=" << record.count << "]\n";
+  }
+}
+
+void GuestSymbols::reset_summary()
+{
+  unique_lock lock( mutex_ );
+  calls_.clear();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "summarize.hh"
+#include "timer.hh"
+
+/**
+ * The functions of the procedures linked into this process, by address. Linked code lives in anonymous memory, so
+ * without this table profilers and the Timer-based instrumentation only see raw addresses in it.
+ *
+ * Each function is named after its procedure and its symbol in the procedure's ELF file. With perf_map set, the
+ * functions of every procedure linked from then on are also appended to /tmp/perf-<pid>.map, where perf looks for
+ * the symbols of code it cannot find in a file.
+ */
+class GuestSymbols : public Summarizable
+{
+public:
+  struct Symbol
+  {
+    uint64_t offset; // from the start of the procedure's code
+    uint64_t size;
+    std::string name;
+  };
+
+  inline static bool perf_map = false;
+
+  // Whether linked procedures need their functions named: for the perf map, or to time api calls by function
+  static bool wanted()
+  {
+#if defined( TIME_FIXPOINT ) && TIME_FIXPOINT == 2
+    return true;
+#else
+    return perf_map;
+#endif
+  }
+
+private:
+  struct Function
+  {
+    uint64_t end;
+    std::string name;
+  };
+
+  mutable std::mutex mutex_ {};
+  // By address of the first instruction
+  std::map<uint64_t, Function> functions_ {};
+  // Time spent in calls of the fixpoint api, by category and calling address
+  std::map<std::pair<Timer::Category, uint64_t>, Timer::Record> calls_ {};
+
+  std::optional<std::string> lookup_locked( uint64_t address ) const;
+
+public:
+  // Adds the functions of the procedure @p procedure, whose code of @p code_size bytes is at @p code
+  void add( std::string_view procedure, const char* code, size_t code_size, const std::vector<Symbol>& symbols );
+
+  // The name of the function containing @p address, if it is in the code of a linked procedure
+  std::optional<std::string> lookup( uint64_t address ) const;
+
+  // Records that a call of the fixpoint api made from @p caller took @p ticks
+  void log( Timer::Category category, const void* caller, uint64_t ticks );
+
+  // Prints the time spent in the fixpoint api by each guest function
+  void summary( std::ostream& out ) const override;
+  void reset_summary() override;
+};
+
+inline GuestSymbols& guest_symbols()
+{
+  static GuestSymbols the_guest_symbols;
+  return the_guest_symbols;
+}
+
+#if defined( TIME_FIXPOINT ) && TIME_FIXPOINT == 2
+// Times a call of the fixpoint api, on behalf of the guest function it returns to
+template<Timer::Category category>
+class GuestCallTimer
+{
+  const void* caller_;
+  uint64_t start_ { Timer::read_tsc() };
+
+public:
+  explicit GuestCallTimer( const void* caller )
+    : caller_( caller )
+  {}
+  ~GuestCallTimer() { guest_symbols().log( category, caller_, Timer::read_tsc() - start_ ); }
+
+  GuestCallTimer( const GuestCallTimer& ) = delete;
+  GuestCallTimer& operator=( const GuestCallTimer& ) = delete;
+};
+#else
+template<Timer::Category category>
+class GuestCallTimer
+{
+public:
+  explicit GuestCallTimer( const void* ) {}
+};
+#endif
@@ -8,6 +8,10 @@
 #include <glog/logging.h>
 #include <memory>
 #include <span>
+#include <sys/mman.h>
+
+#include "compression.hh"
+#include "exception.hh"
 
 using namespace std;
 
@@ -41,18 +45,23 @@ OutgoingMessage::OutgoingMessage( const Message::Opcode opcode, string&& payload
   , payload_( payload )
 {}
 
-void OutgoingMessage::serialize_header( string& out )
+void Message::serialize_header( Opcode opcode, size_t payload_length, string& out )
 {
   out.resize( Message::HEADER_LENGTH );
   Serializer s { out };
-  s.integer( payload_length() );
-  s.integer( static_cast<uint8_t>( opcode() ) );
+  s.integer( payload_length );
+  s.integer( static_cast<uint8_t>( opcode ) );
 
   if ( s.bytes_written() != Message::HEADER_LENGTH ) {
     throw runtime_error( "Wrong header length" );
   }
 }
 
+void OutgoingMessage::serialize_header( string& out )
+{
+  Message::serialize_header( opcode(), payload_length(), out );
+}
+
 string_view OutgoingMessage::payload()
 {
   return std::visit( overload {
@@ -67,6 +76,16 @@ string_view OutgoingMessage::payload()
                      payload_ );
 }
 
+size_t IncomingMessage::payload_length()
+{
+  return std::visit( overload {
+                       []( OwnedMutBlob& b ) { return b.size(); },
+                       []( OwnedMutTree& t ) { return t.span().size_bytes(); },
+                       []( string& s ) { return s.size(); },
+                     },
+                     payload_ );
+}
+
 size_t OutgoingMessage::payload_length()
 {
   return std::visit( overload {
@@ -109,11 +128,216 @@ OutgoingMessage OutgoingMessage::to_message( MessagePayload&& payload )
                      payload );
 }
 
-void MessageParser::complete_message()
+void MessageBatch::push( OutgoingMessage& msg )
+{
+  if ( Message::batched_length( msg.opcode() ) != msg.payload_length() ) {
+    throw runtime_error( "Message can not be batched" );
+  }
+
+  data_.push_back( static_cast<char>( msg.opcode() ) );
+  data_.append( msg.payload() );
+  count_++;
+}
+
+OutgoingMessage MessageBatch::release()
+{
+  if ( empty() ) {
+    throw runtime_error( "Empty batch" );
+  }
+
+  auto opcode = Message::Opcode::BATCH;
+  auto payload = std::move( data_ );
+  if ( count_ == 1 ) {
+    opcode = static_cast<Message::Opcode>( payload[0] );
+    payload.erase( 0, 1 );
+  }
+
+  data_ = {};
+  count_ = 0;
+  return { opcode, std::move( payload ) };
+}
+
+void MessageParser::unpack_batch( string_view batch )
 {
+  while ( not batch.empty() ) {
+    auto opcode = static_cast<Message::Opcode>( batch[0] );
+    auto length = Message::batched_length( opcode );
+    if ( length == 0 or batch.size() < 1 + length ) {
+      throw runtime_error( "Invalid batch entry" );
+    }
+
+    completed_messages_.emplace( opcode, string( batch.substr( 1, length ) ) );
+    batch.remove_prefix( 1 + length );
+  }
+}
+
+void MessageParser::map_shared_data( string_view payload )
+{
+  auto shared = ::parse<SharedDataPayload>( payload );
+  if ( shared_fds_.empty() ) {
+    throw runtime_error( "SHAREDDATA without file descriptor" );
+  }
+
+  FileDescriptor fd = std::move( shared_fds_.front() );
+  shared_fds_.pop();
+
+  if ( shared.size == 0 ) {
+    throw runtime_error( "Invalid size of shared data" );
+  }
+
+  // A private mapping shares the sender's pages until written to; the mapping stays valid after fd is closed.
+  void* p = mmap( nullptr, shared.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd.fd_num(), 0 );
+  if ( p == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+
+  if ( shared.tree ) {
+    completed_messages_.emplace(
+      Message::Opcode::TREEDATA,
+      OwnedMutTree( { static_cast<Handle<Fix>*>( p ), shared.size / sizeof( Handle<Fix> ) }, AllocationType::Mapped ) );
+  } else {
+    completed_messages_.emplace( Message::Opcode::BLOBDATA,
+                                 OwnedMutBlob( { static_cast<char*>( p ), shared.size }, AllocationType::Mapped ) );
+  }
+}
+
+void MessageParser::decompress( string_view payload )
+{
+  auto header = ::parse<CompressedHeader>( payload.substr( 0, min( payload.size(), CompressedHeader::LENGTH ) ) );
+  payload.remove_prefix( CompressedHeader::LENGTH );
+
+  // The announced size is only trusted if the frame agrees with it
+  if ( header.size > max_message_size or compression::content_size( payload ) != header.size ) {
+    throw runtime_error( "Invalid size of compressed message." );
+  }
+
+  switch ( header.opcode ) {
+    case Message::Opcode::BLOBDATA: {
+      auto blob = OwnedMutBlob::allocate( header.size );
+      compression::decompress( payload, { blob.data(), blob.size() } );
+      completed_messages_.emplace( header.opcode, std::move( blob ) );
+      break;
+    }
+
+    case Message::Opcode::TREEDATA: {
+      if ( header.size % sizeof( Handle<Fix> ) != 0 ) {
+        throw runtime_error( "Invalid size of compressed tree." );
+      }
+      auto tree = OwnedMutTree::allocate( header.size / sizeof( Handle<Fix> ) );
+      compression::decompress( payload, { reinterpret_cast<char*>( tree.data() ), header.size } );
+      completed_messages_.emplace( header.opcode, std::move( tree ) );
+      break;
+    }
+
+    default:
+      throw runtime_error( "Invalid opcode of compressed message." );
+  }
+}
+
+void MessageParser::parse_chunk( string_view& buf )
+{
+  if ( incomplete_chunk_header_.size() < ChunkHeader::LENGTH ) {
+    const auto remaining_length = min( buf.length(), ChunkHeader::LENGTH - incomplete_chunk_header_.size() );
+    incomplete_chunk_header_.append( buf.substr( 0, remaining_length ) );
+    buf.remove_prefix( remaining_length );
+    completed_payload_length_ += remaining_length;
+
+    if ( incomplete_chunk_header_.size() < ChunkHeader::LENGTH ) {
+      return;
+    }
+
+    auto header = ::parse<ChunkHeader>( incomplete_chunk_header_ );
+    auto [it, inserted] = streams_.try_emplace( header.stream );
+    if ( inserted ) {
+      if ( header.size > max_message_size ) {
+        throw runtime_error( "Chunked message is too large." );
+      }
+      it->second.opcode = header.opcode;
+      switch ( header.opcode ) {
+        case Message::Opcode::BLOBDATA:
+          it->second.payload = OwnedMutBlob::allocate( header.size );
+          break;
+
+        case Message::Opcode::TREEDATA:
+          if ( header.size % sizeof( Handle<Fix> ) != 0 ) {
+            throw runtime_error( "Invalid size of chunked tree." );
+          }
+          it->second.payload = OwnedMutTree::allocate( header.size / sizeof( Handle<Fix> ) );
+          break;
+
+        case Message::Opcode::SHALLOWTREEDATA:
+        case Message::Opcode::BLOBRANGE:
+        case Message::Opcode::COMPRESSED:
+          get<string>( it->second.payload ).resize( header.size );
+          break;
+
+        default:
+          throw runtime_error( "Invalid opcode of chunked message." );
+      }
+    } else if ( it->second.opcode != header.opcode ) {
+      throw runtime_error( "Opcode of chunk does not match its stream." );
+    }
+
+    current_stream_ = &it->second;
+    current_stream_id_ = header.stream;
+  }
+
+  auto& stream = *current_stream_;
   std::visit(
-    [&]( auto&& arg ) { completed_messages_.emplace( Message::opcode( incomplete_header_ ), std::move( arg ) ); },
-    incomplete_payload_ );
+    [&]( auto& arg ) {
+      const size_t stream_size = arg.size() * sizeof( *arg.data() );
+      const auto remaining_length = min( buf.length(), expected_payload_length_.value() - completed_payload_length_ );
+      if ( stream.received + remaining_length > stream_size ) {
+        throw runtime_error( "Chunk exceeds size of its stream." );
+      }
+
+      char* data = const_cast<char*>( reinterpret_cast<const char*>( arg.data() ) ) + stream.received;
+      memcpy( data, buf.data(), remaining_length );
+
+      buf.remove_prefix( remaining_length );
+      completed_payload_length_ += remaining_length;
+      stream.received += remaining_length;
+
+      if ( completed_payload_length_ < expected_payload_length_.value() ) {
+        return;
+      }
+
+      if ( stream.received == stream_size ) {
+        if constexpr ( std::same_as<std::decay_t<decltype( arg )>, string> ) {
+          if ( stream.opcode == Message::Opcode::COMPRESSED ) {
+            decompress( arg );
+            streams_.erase( current_stream_id_ );
+            return;
+          }
+        }
+        completed_messages_.emplace( stream.opcode, std::move( arg ) );
+        streams_.erase( current_stream_id_ );
+      }
+    },
+    stream.payload );
+
+  if ( completed_payload_length_ == expected_payload_length_.value() ) {
+    expected_payload_length_.reset();
+    incomplete_header_.clear();
+    incomplete_chunk_header_.clear();
+    current_stream_ = nullptr;
+    completed_payload_length_ = 0;
+  }
+}
+
+void MessageParser::complete_message()
+{
+  if ( Message::opcode( incomplete_header_ ) == Message::Opcode::BATCH ) {
+    unpack_batch( get<string>( incomplete_payload_ ) );
+  } else if ( Message::opcode( incomplete_header_ ) == Message::Opcode::SHAREDDATA ) {
+    map_shared_data( get<string>( incomplete_payload_ ) );
+  } else if ( Message::opcode( incomplete_header_ ) == Message::Opcode::COMPRESSED ) {
+    decompress( get<string>( incomplete_payload_ ) );
+  } else {
+    std::visit(
+      [&]( auto&& arg ) { completed_messages_.emplace( Message::opcode( incomplete_header_ ), std::move( arg ) ); },
+      incomplete_payload_ );
+  }
 
   expected_payload_length_.reset();
   incomplete_header_.clear();
@@ -133,6 +357,7 @@ size_t MessageParser::parse( string_view buf )
 
       if ( incomplete_header_.length() == Message::HEADER_LENGTH ) {
         expected_payload_length_ = IncomingMessage::expected_payload_length( incomplete_header_ );
+        frames_++;
 
         if ( expected_payload_length_.value() == 0 ) {
           switch ( Message::opcode( incomplete_header_ ) ) {
@@ -161,7 +386,19 @@ size_t MessageParser::parse( string_view buf )
             case Message::Opcode::REQUESTSHALLOWTREE:
             case Message::Opcode::PROPOSE_TRANSFER:
             case Message::Opcode::ACCEPT_TRANSFER:
-            case Message::Opcode::SHALLOWTREEDATA: {
+            case Message::Opcode::SHALLOWTREEDATA:
+            case Message::Opcode::BATCH:
+            case Message::Opcode::SHAREDDATA:
+            case Message::Opcode::STATUS:
+            case Message::Opcode::STEAL:
+            case Message::Opcode::GRANT:
+            case Message::Opcode::CANCEL:
+            case Message::Opcode::BLOBRANGE:
+            case Message::Opcode::CREDIT:
+            case Message::Opcode::COMPRESSED:
+            case Message::Opcode::LOOKUP:
+            case Message::Opcode::MISS:
+            case Message::Opcode::HOLDER: {
               incomplete_payload_ = "";
               get<string>( incomplete_payload_ ).resize( expected_payload_length_.value() );
               break;
@@ -178,11 +415,20 @@ size_t MessageParser::parse( string_view buf )
               break;
             }
 
+            case Message::Opcode::CHUNK: {
+              if ( expected_payload_length_.value() <= ChunkHeader::LENGTH ) {
+                throw runtime_error( "Invalid size of chunk." );
+              }
+              break;
+            }
+
             default:
               throw runtime_error( "Invalid combination of message type and payload size." );
           }
         }
       }
+    } else if ( Message::opcode( incomplete_header_ ) == Message::Opcode::CHUNK ) {
+      parse_chunk( buf );
     } else {
       std::visit(
         [&]( auto& arg ) {
@@ -228,14 +474,93 @@ void RunPayload::serialize( Serializer& serializer ) const
   serializer.integer( task.content );
 }
 
+CancelPayload CancelPayload::parse( Parser& parser )
+{
+  return { .task { parse_handle<Relation>( parser ) } };
+}
+
+void CancelPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( task.content );
+}
+
+LookupPayload LookupPayload::parse( Parser& parser )
+{
+  return { .task { parse_handle<Relation>( parser ) } };
+}
+
+void LookupPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( task.content );
+}
+
+MissPayload MissPayload::parse( Parser& parser )
+{
+  return { .task { parse_handle<Relation>( parser ) } };
+}
+
+void MissPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( task.content );
+}
+
+HolderPayload HolderPayload::parse( Parser& parser )
+{
+  HolderPayload payload { .handle = parse_handle<AnyDataType>( parser ) };
+  parser.integer( payload.node );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse node." );
+  }
+  return payload;
+}
+
+void HolderPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( handle.content );
+  serializer.integer( node );
+}
+
 RequestBlobPayload RequestBlobPayload::parse( Parser& parser )
 {
-  return { .handle { parse_handle<Named>( parser ) } };
+  RequestBlobPayload payload { .handle { parse_handle<Named>( parser ) } };
+
+  // Requests for a whole blob carry no range
+  if ( not parser.input().empty() ) {
+    parser.integer( payload.offset );
+    parser.integer( payload.length );
+    if ( parser.error() ) {
+      throw runtime_error( "Failed to parse blob range." );
+    }
+  }
+  return payload;
 }
 
 void RequestBlobPayload::serialize( Serializer& serializer ) const
 {
   serializer.integer( handle.content );
+  if ( length ) {
+    serializer.integer( offset );
+    serializer.integer( length );
+  }
+}
+
+BlobRangePayload BlobRangePayload::parse( Parser& parser )
+{
+  BlobRangePayload payload;
+  payload.handle = parse_handle<Named>( parser );
+  parser.integer( payload.offset );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse blob range." );
+  }
+  payload.data = parser.input();
+  return payload;
+}
+
+void BlobRangePayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( handle.content );
+  serializer.integer( offset );
+  serializer.string( data );
 }
 
 RequestTreePayload RequestTreePayload::parse( Parser& parser )
@@ -301,6 +626,21 @@ InfoPayload InfoPayload::parse( Parser& parser )
   for ( size_t i = 0; i < data_entries; i++ ) {
     payload.data.insert( parse_handle<AnyDataType>( parser ) );
   }
+
+  // Peers which predate feature negotiation do not send any features
+  if ( not parser.input().empty() ) {
+    parser.integer( payload.features );
+    if ( parser.error() ) {
+      throw runtime_error( "Failed to parse features." );
+    }
+  }
+
+  if ( not parser.input().empty() ) {
+    parser.integer( payload.node );
+    if ( parser.error() ) {
+      throw runtime_error( "Failed to parse node." );
+    }
+  }
   return payload;
 }
 
@@ -312,6 +652,8 @@ void InfoPayload::serialize( Serializer& serializer ) const
   for ( const auto& h : data ) {
     serializer.integer( h.content );
   }
+  serializer.integer( features );
+  serializer.integer( node );
 }
 
 ShallowTreeDataPayload ShallowTreeDataPayload::parse( Parser& parser )
@@ -331,6 +673,63 @@ void ShallowTreeDataPayload::serialize( Serializer& serializer ) const
     string_view( reinterpret_cast<const char*>( data->span().data() ), data->span().size_bytes() ) );
 }
 
+SharedDataPayload SharedDataPayload::parse( Parser& parser )
+{
+  SharedDataPayload payload;
+  parser.integer( payload.tree );
+  parser.integer( payload.size );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse shared data." );
+  }
+  return payload;
+}
+
+void SharedDataPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( tree );
+  serializer.integer( size );
+}
+
+ChunkHeader ChunkHeader::parse( Parser& parser )
+{
+  ChunkHeader header;
+  parser.integer( header.stream );
+  uint8_t opcode;
+  parser.integer( opcode );
+  header.opcode = static_cast<Message::Opcode>( opcode );
+  parser.integer( header.size );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse chunk header." );
+  }
+  return header;
+}
+
+void ChunkHeader::serialize( Serializer& serializer ) const
+{
+  serializer.integer( stream );
+  serializer.integer( static_cast<uint8_t>( opcode ) );
+  serializer.integer( size );
+}
+
+CompressedHeader CompressedHeader::parse( Parser& parser )
+{
+  CompressedHeader header;
+  uint8_t opcode;
+  parser.integer( opcode );
+  header.opcode = static_cast<Message::Opcode>( opcode );
+  parser.integer( header.size );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse compressed header." );
+  }
+  return header;
+}
+
+void CompressedHeader::serialize( Serializer& serializer ) const
+{
+  serializer.integer( static_cast<uint8_t>( opcode ) );
+  serializer.integer( size );
+}
+
 LoadBlobPayload LoadBlobPayload::parse( Parser& parser )
 {
   LoadBlobPayload payload;
@@ -355,6 +754,79 @@ void LoadTreePayload::serialize( Serializer& serializer ) const
   serializer.integer( handle.content );
 }
 
+StatusPayload StatusPayload::parse( Parser& parser )
+{
+  StatusPayload payload;
+  parser.integer( payload.queued );
+  parser.integer( payload.idle );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse status." );
+  }
+  return payload;
+}
+
+void StatusPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( queued );
+  serializer.integer( idle );
+}
+
+CreditPayload CreditPayload::parse( Parser& parser )
+{
+  CreditPayload payload;
+  parser.integer( payload.bytes );
+  parser.integer( payload.messages );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse credit." );
+  }
+  return payload;
+}
+
+void CreditPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( bytes );
+  serializer.integer( messages );
+}
+
+StealPayload StealPayload::parse( Parser& parser )
+{
+  StealPayload payload;
+  parser.integer( payload.count );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse steal request." );
+  }
+  return payload;
+}
+
+void StealPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer( count );
+}
+
+GrantPayload GrantPayload::parse( Parser& parser )
+{
+  size_t count = 0;
+  parser.integer<size_t>( count );
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse number of granted jobs." );
+  }
+
+  GrantPayload payload;
+  payload.jobs.reserve( count );
+  for ( size_t i = 0; i < count; i++ ) {
+    payload.jobs.push_back( parse_handle<Relation>( parser ) );
+  }
+  return payload;
+}
+
+void GrantPayload::serialize( Serializer& serializer ) const
+{
+  serializer.integer<size_t>( jobs.size() );
+  for ( const auto& job : jobs ) {
+    serializer.integer( job.content );
+  }
+}
+
 template<Message::Opcode O>
 TransferPayload<O> TransferPayload<O>::parse( Parser& parser )
 {
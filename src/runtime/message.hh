@@ -2,9 +2,11 @@
 
 #include <queue>
 #include <span>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include "file_descriptor.hh"
 #include "handle.hh"
 #include "interface.hh"
 #include "object.hh"
@@ -30,6 +32,19 @@ public:
     SHALLOWTREEDATA,
     PROPOSE_TRANSFER,
     ACCEPT_TRANSFER,
+    BATCH,
+    SHAREDDATA,
+    CHUNK,
+    STATUS,
+    STEAL,
+    GRANT,
+    CANCEL,
+    BLOBRANGE,
+    CREDIT,
+    COMPRESSED,
+    LOOKUP,
+    MISS,
+    HOLDER,
     COUNT,
   };
 
@@ -46,7 +61,20 @@ public:
                                                                                        "LOADTREE",
                                                                                        "SHALLOWTREEDATA",
                                                                                        "PROPOSE_TRANSFER",
-                                                                                       "ACCEPT_TRANSFER" };
+                                                                                       "ACCEPT_TRANSFER",
+                                                                                       "BATCH",
+                                                                                       "SHAREDDATA",
+                                                                                       "CHUNK",
+                                                                                       "STATUS",
+                                                                                       "STEAL",
+                                                                                       "GRANT",
+                                                                                       "CANCEL",
+                                                                                       "BLOBRANGE",
+                                                                                       "CREDIT",
+                                                                                       "COMPRESSED",
+                                                                                       "LOOKUP",
+                                                                                       "MISS",
+                                                                                       "HOLDER" };
 
   constexpr static size_t HEADER_LENGTH = sizeof( size_t ) + sizeof( Opcode );
 
@@ -62,6 +90,28 @@ public:
   Opcode opcode() { return opcode_; }
 
   static Opcode opcode( std::string_view header );
+  static void serialize_header( Opcode opcode, size_t payload_length, std::string& out );
+
+  /**
+   * Length of the payload of messages that can be packed into a BATCH, or 0 if messages of @p opcode can not be
+   * batched. Only small, fixed-length payloads are batched.
+   */
+  static constexpr size_t batched_length( Opcode opcode )
+  {
+    switch ( opcode ) {
+      case Opcode::RUN:
+      case Opcode::CANCEL:
+      case Opcode::LOOKUP:
+      case Opcode::MISS:
+      case Opcode::LOADBLOB:
+      case Opcode::LOADTREE:
+        return sizeof( u8x32 );
+      case Opcode::RESULT:
+        return 2 * sizeof( u8x32 );
+      default:
+        return 0;
+    }
+  }
 };
 
 struct RunPayload
@@ -87,15 +137,97 @@ struct ResultPayload
   size_t payload_length() const { return 2 * sizeof( u8x32 ); }
 };
 
+/**
+ * Tells the receiver that the sender no longer needs the result of a RUN it sent earlier.
+ */
+struct CancelPayload
+{
+  Handle<Relation> task {};
+
+  static CancelPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::CANCEL;
+  size_t payload_length() const { return sizeof( u8x32 ); }
+};
+
+/**
+ * Asks the receiver, as the owner of @p task in the result directory, for the result of @p task. The receiver
+ * answers with a RESULT if it knows the result, or with a MISS otherwise.
+ */
+struct LookupPayload
+{
+  Handle<Relation> task {};
+
+  static LookupPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::LOOKUP;
+  size_t payload_length() const { return sizeof( u8x32 ); }
+};
+
+/**
+ * Answers a LOOKUP of a Relation whose result the sender does not know.
+ */
+struct MissPayload
+{
+  Handle<Relation> task {};
+
+  static MissPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::MISS;
+  size_t payload_length() const { return sizeof( u8x32 ); }
+};
+
+/**
+ * Tells the receiver that @p handle, which the sender left out of data it sent, is held by the peer whose node id
+ * is @p node.
+ */
+struct HolderPayload
+{
+  Handle<AnyDataType> handle {};
+  uint64_t node {};
+
+  static HolderPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::HOLDER;
+  size_t payload_length() const { return sizeof( u8x32 ) + sizeof( uint64_t ); }
+};
+
+/**
+ * Requests a blob. If @p length is not 0, only the bytes [@p offset, @p offset + @p length) are requested, and they
+ * are sent back as a BLOBRANGE.
+ */
 struct RequestBlobPayload
 {
   Handle<Named> handle;
+  uint64_t offset {};
+  uint64_t length {};
 
   static RequestBlobPayload parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
 
   constexpr static Message::Opcode OPCODE = Message::Opcode::REQUESTBLOB;
-  size_t payload_length() const { return sizeof( u8x32 ); }
+  size_t payload_length() const { return sizeof( u8x32 ) + ( length ? 2 * sizeof( uint64_t ) : 0 ); }
+};
+
+/**
+ * Part of a blob, starting at @p offset. @p data refers to the blob being sent or to the received message. A range
+ * without data means the sender can not serve it.
+ */
+struct BlobRangePayload
+{
+  Handle<Named> handle {};
+  uint64_t offset {};
+  std::string_view data {};
+
+  static BlobRangePayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::BLOBRANGE;
+  size_t payload_length() const { return sizeof( u8x32 ) + sizeof( uint64_t ) + data.size(); }
 };
 
 struct RequestTreePayload
@@ -122,9 +254,19 @@ struct RequestShallowTreePayload
 
 struct InfoPayload
 {
+  // Optional protocol features, negotiated per connection
+  static constexpr uint32_t FEATURE_BATCH = 1;
+  static constexpr uint32_t FEATURE_CHUNK = 2;
+  static constexpr uint32_t FEATURE_STEAL = 4;
+  static constexpr uint32_t FEATURE_RANGE = 8;
+  static constexpr uint32_t FEATURE_CREDIT = 16;
+  static constexpr uint32_t FEATURE_COMPRESS = 32;
+
   uint32_t parallelism {};
   double link_speed {};
   std::unordered_set<Handle<AnyDataType>> data {};
+  uint32_t features {};
+  uint64_t node {};
 
   static InfoPayload parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
@@ -132,7 +274,8 @@ struct InfoPayload
   constexpr static Message::Opcode OPCODE = Message::Opcode::INFO;
   size_t payload_length() const
   {
-    return sizeof( uint32_t ) + sizeof( double ) + sizeof( size_t ) + data.size() * sizeof( u8x32 );
+    return sizeof( uint32_t ) + sizeof( double ) + sizeof( size_t ) + data.size() * sizeof( u8x32 )
+           + sizeof( uint32_t ) + sizeof( uint64_t );
   }
 };
 
@@ -170,6 +313,114 @@ struct LoadTreePayload
   size_t payload_length() const { return sizeof( u8x32 ); }
 };
 
+/**
+ * BLOBDATA or TREEDATA whose content is not part of the message: it is in a memfd passed alongside the message
+ * over a Unix-domain socket. Only sent between peers on the same host.
+ */
+struct SharedDataPayload
+{
+  bool tree {};
+  uint64_t size {};
+
+  static SharedDataPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::SHAREDDATA;
+  size_t payload_length() const { return sizeof( bool ) + sizeof( uint64_t ); }
+};
+
+/**
+ * Header of a CHUNK message. The payload of a large BLOBDATA, TREEDATA or SHALLOWTREEDATA message can be sent as a
+ * stream of chunks, so that other messages can be sent in between. The chunks of one stream are sent in order; the
+ * CHUNK header is followed by the next part of the original payload.
+ */
+struct ChunkHeader
+{
+  uint32_t stream {};
+  Message::Opcode opcode {};
+  uint64_t size {};
+
+  static ChunkHeader parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  static constexpr size_t LENGTH = sizeof( uint32_t ) + sizeof( Message::Opcode ) + sizeof( uint64_t );
+  size_t payload_length() const { return LENGTH; }
+};
+
+/**
+ * Header of a COMPRESSED message: a BLOBDATA or TREEDATA message whose payload of @p size bytes has been compressed.
+ * The header is followed by the compressed payload.
+ */
+struct CompressedHeader
+{
+  Message::Opcode opcode {};
+  uint64_t size {};
+
+  static CompressedHeader parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  static constexpr size_t LENGTH = sizeof( Message::Opcode ) + sizeof( uint64_t );
+  size_t payload_length() const { return LENGTH; }
+};
+
+/**
+ * The load of the sender, advertised periodically to peers which support work stealing.
+ */
+struct StatusPayload
+{
+  uint32_t queued {};
+  uint32_t idle {};
+
+  static StatusPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::STATUS;
+  size_t payload_length() const { return 2 * sizeof( uint32_t ); }
+};
+
+/**
+ * Allows the receiver to send @p bytes more bytes, in at most @p messages more messages, on this connection.
+ */
+struct CreditPayload
+{
+  uint64_t bytes {};
+  uint64_t messages {};
+
+  static CreditPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::CREDIT;
+  size_t payload_length() const { return 2 * sizeof( uint64_t ); }
+};
+
+/**
+ * Asks the receiver to hand over up to @p count of its queued Relations.
+ */
+struct StealPayload
+{
+  uint32_t count {};
+
+  static StealPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::STEAL;
+  size_t payload_length() const { return sizeof( uint32_t ); }
+};
+
+/**
+ * Answers a STEAL. Each granted Relation is also sent to the thief as a RUN; @p jobs may be empty.
+ */
+struct GrantPayload
+{
+  std::vector<Handle<Relation>> jobs {};
+
+  static GrantPayload parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  constexpr static Message::Opcode OPCODE = Message::Opcode::GRANT;
+  size_t payload_length() const { return sizeof( size_t ) + jobs.size() * sizeof( u8x32 ); }
+};
+
 template<Message::Opcode O>
 struct TransferPayload
 {
@@ -206,7 +457,12 @@ using MessagePayload = std::variant<RunPayload,
                                     TreeDataPayload,
                                     LoadBlobPayload,
                                     LoadTreePayload,
-                                    ShallowTreeDataPayload>;
+                                    ShallowTreeDataPayload,
+                                    GrantPayload,
+                                    CancelPayload,
+                                    LookupPayload,
+                                    MissPayload,
+                                    HolderPayload>;
 
 class IncomingMessage : public Message
 {
@@ -232,6 +488,7 @@ public:
 
   static size_t expected_payload_length( std::string_view header );
   auto& payload() { return payload_; }
+  size_t payload_length();
 };
 
 class OutgoingMessage : public Message
@@ -249,6 +506,26 @@ public:
   size_t payload_length();
 };
 
+/**
+ * Packs small control messages into a single BATCH message. The payload of a BATCH is a sequence of entries, each
+ * an opcode byte followed by a payload of Message::batched_length( opcode ) bytes.
+ */
+class MessageBatch
+{
+  std::string data_ {};
+  size_t count_ {};
+
+public:
+  void push( OutgoingMessage& msg );
+
+  bool empty() const { return count_ == 0; }
+  size_t count() const { return count_; }
+  size_t size() const { return data_.size(); }
+
+  // Returns the pending messages as one message (which is not a BATCH if only one message is pending)
+  OutgoingMessage release();
+};
+
 class MessageParser
 {
 private:
@@ -262,15 +539,43 @@ private:
 
   std::queue<IncomingMessage> completed_messages_ {};
 
+  // Number of messages read off the wire, counting each BATCH and each CHUNK as one
+  size_t frames_ {};
+
+  // Descriptors received for SHAREDDATA messages, in the order the messages were sent
+  std::queue<FileDescriptor> shared_fds_ {};
+
+  // Payloads of chunked messages that have not been completely received
+  struct Stream
+  {
+    Message::Opcode opcode {};
+    std::variant<std::string, OwnedMutBlob, OwnedMutTree> payload {};
+    size_t received {};
+  };
+  std::unordered_map<uint32_t, Stream> streams_ {};
+  std::string incomplete_chunk_header_ {};
+  Stream* current_stream_ {};
+  uint32_t current_stream_id_ {};
+
   void complete_message();
+  void unpack_batch( std::string_view batch );
+  void map_shared_data( std::string_view payload );
+  void decompress( std::string_view payload );
+  void parse_chunk( std::string_view& buf );
 
 public:
+  // Largest size a peer may announce for the payload of a compressed or chunked message; larger messages are
+  // rejected before anything is allocated for them
+  inline static uint64_t max_message_size = uint64_t( 4 ) << 30;
+
   size_t parse( std::string_view buf );
+  void add_fd( FileDescriptor&& fd ) { shared_fds_.push( std::move( fd ) ); }
 
   bool empty() { return completed_messages_.empty(); }
   IncomingMessage& front() { return completed_messages_.front(); }
   void pop() { completed_messages_.pop(); }
   size_t size() { return completed_messages_.size(); }
+  size_t frames() const { return frames_; }
 };
 
 template<class T>
@@ -1,6 +1,7 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
@@ -11,9 +12,14 @@
 #include <variant>
 
 #include <glog/logging.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "compression.hh"
 #include "eventloop.hh"
+#include "exception.hh"
 #include "handle.hh"
+#include "handle_post.hh"
 #include "message.hh"
 #include "network.hh"
 #include "types.hh"
@@ -21,77 +27,866 @@
 using namespace std;
 using Opcode = Message::Opcode;
 
+bool Remote::has_credit() const
+{
+  return not credit_ or ( tx_credit_bytes_ > 0 and tx_credit_messages_ > 0 );
+}
+
+bool Remote::tx_ready() const
+{
+  return tx_grant_bytes_ != 0 or tx_grant_messages_ != 0
+         or ( has_credit() and ( not tx_messages_.empty() or not tx_bulk_.empty() ) );
+}
+
 void Remote::load_tx_message()
 {
-  if ( not current_msg_unsent_header_.empty() or not current_msg_unsent_payload_.empty() or tx_messages_.empty() )
+  if ( tx_lane_ != TxLane::None )
+    throw runtime_error( "Unable to load" );
+
+  if ( tx_grant_bytes_ != 0 or tx_grant_messages_ != 0 ) {
+    // Credit is granted even when we are out of credit ourselves, or both peers could end up waiting on each other
+    tx_lane_ = TxLane::Credit;
+    tx_grant_.emplace( Opcode::CREDIT,
+                       serialize( CreditPayload { .bytes = tx_grant_bytes_, .messages = tx_grant_messages_ } ) );
+    tx_grant_bytes_ = 0;
+    tx_grant_messages_ = 0;
+    tx_grant_->serialize_header( current_msg_header_ );
+    current_msg_unsent_payload_ = tx_grant_->payload();
+  } else if ( tx_messages_.empty() and tx_bulk_.empty() ) {
     throw runtime_error( "Unable to load" );
+  } else if ( not has_credit() ) {
+    // Loaded by write_to_rb() once the peer grants more credit
+    return;
+  } else if ( not tx_messages_.empty() ) {
+    tx_lane_ = TxLane::Control;
+    tx_messages_.front().serialize_header( current_msg_header_ );
+    current_msg_unsent_payload_ = tx_messages_.front().payload();
+  } else {
+    // Send the next chunk of the transfer at the front
+    auto& transfer = tx_bulk_.front();
+    auto payload = transfer.message.payload();
+    tx_lane_ = TxLane::Bulk;
+    tx_chunk_length_ = min( CHUNK_SIZE, payload.size() - transfer.offset );
+
+    ChunkHeader chunk { .stream = transfer.stream, .opcode = transfer.message.opcode(), .size = payload.size() };
+    Message::serialize_header( Opcode::CHUNK, ChunkHeader::LENGTH + tx_chunk_length_, current_msg_header_ );
+    current_msg_header_.append( serialize( chunk ) );
+    current_msg_unsent_payload_ = payload.substr( transfer.offset, tx_chunk_length_ );
+  }
+
+  current_msg_unsent_header_ = current_msg_header_;
+
+  // A message may overdraw the credit left, so that messages larger than the window still go out
+  tx_credit_bytes_ -= current_msg_header_.size() + current_msg_unsent_payload_.size();
+  tx_credit_messages_--;
+}
+
+void Remote::finish_tx_message()
+{
+  const auto lane = tx_lane_;
+  tx_lane_ = TxLane::None;
+
+  if ( lane == TxLane::Credit ) {
+    tx_grant_.reset();
+    return;
+  }
+
+  if ( lane == TxLane::Control ) {
+    if ( telemetry_ ) {
+      telemetry_->tx_latency->record(
+        chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - tx_queued_.front() ).count() );
+    }
+    tx_backlog_ -= Message::HEADER_LENGTH + tx_messages_.front().payload_length();
+    tx_messages_.pop();
+    tx_queued_.pop();
+    sample_queues();
+    return;
+  }
+
+  auto transfer = move( tx_bulk_.front() );
+  tx_bulk_.pop_front();
+  transfer.offset += tx_chunk_length_;
+
+  if ( transfer.offset < transfer.message.payload_length() ) {
+    tx_bulk_.push_back( move( transfer ) );
+    return;
+  }
+  tx_backlog_ -= Message::HEADER_LENGTH + transfer.message.payload_length();
+  if ( telemetry_ ) {
+    telemetry_->tx_latency->record(
+      chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - transfer.queued ).count() );
+  }
+  sample_queues();
+
+  if ( transfer.handle.has_value() ) {
+    auto it = tx_bulk_handles_.find( *transfer.handle );
+    if ( it != tx_bulk_handles_.end() and it->second == transfer.seq ) {
+      tx_bulk_handles_.erase( it );
+    }
+  }
+  release_fenced();
+}
+
+void Remote::write_to_rb()
+{
+  if ( tx_lane_ == TxLane::None ) {
+    load_tx_message();
+  } else if ( not current_msg_unsent_header_.empty() ) {
+    current_msg_unsent_header_.remove_prefix( tx_data_.push_from_const_str( current_msg_unsent_header_ ) );
+  } else if ( not current_msg_unsent_payload_.empty() ) {
+    current_msg_unsent_payload_.remove_prefix( tx_data_.push_from_const_str( current_msg_unsent_payload_ ) );
+  } else {
+    finish_tx_message();
+
+    // A message released from tx_fenced_ may already have been loaded
+    if ( tx_lane_ == TxLane::None and tx_ready() ) {
+      load_tx_message();
+    }
+  }
+}
+
+void Remote::read_from_rb()
+{
+  const auto frames = rx_messages_.frames();
+  const auto consumed = rx_messages_.parse( rx_data_.readable_region() );
+  rx_data_.pop( consumed );
+  rx_credit_bytes_ -= consumed;
+  rx_credit_messages_ -= rx_messages_.frames() - frames;
+  sample_queues();
+}
+
+void Remote::sample_queues()
+{
+  if ( telemetry_ ) {
+    telemetry_->tx_queue->set( tx_messages_.size() + tx_bulk_.size() );
+    telemetry_->tx_backlog->set( tx_backlog_ );
+    telemetry_->rx_queue->set( rx_messages_.size() + in_flight_ );
+  }
+}
+
+Remote::Telemetry::Telemetry( const string& peer )
+{
+  auto& metrics = global_metrics();
+  auto counter = [&]( const string& name, const string& help, const Metrics::Labels& labels ) {
+    series.emplace_back( name, labels );
+    return &metrics.counter( name, help, labels );
+  };
+  auto gauge = [&]( const string& name, const string& help, const Metrics::Labels& labels ) {
+    series.emplace_back( name, labels );
+    return &metrics.gauge( name, help, labels );
+  };
+  auto histogram = [&]( const string& name, const string& help, const Metrics::Labels& labels ) {
+    series.emplace_back( name, labels );
+    return &metrics.histogram( name, help, labels );
+  };
+
+  for ( size_t i = 0; i < OPCODES; i++ ) {
+    const Metrics::Labels labels { { "peer", peer }, { "opcode", Message::OPCODE_NAMES[i] } };
+    tx_messages[i] = counter( "fix_tx_messages_total", "Messages sent", labels );
+    tx_bytes[i] = counter( "fix_tx_bytes_total", "Payload bytes sent", labels );
+    rx_messages[i] = counter( "fix_rx_messages_total", "Messages received", labels );
+    rx_bytes[i] = counter( "fix_rx_bytes_total", "Payload bytes received", labels );
+  }
+
+  const Metrics::Labels labels { { "peer", peer } };
+  tx_latency
+    = histogram( "fix_tx_latency_us", "Time from queueing a message to handing its last byte to the socket", labels );
+  rx_processing = histogram( "fix_rx_processing_us", "Time spent processing a received message", labels );
+  tx_queue = gauge( "fix_tx_queue_messages", "Messages and transfers queued to be sent", labels );
+  tx_backlog = gauge( "fix_tx_backlog_bytes", "Bytes queued to be sent, including proposals", labels );
+  rx_queue = gauge( "fix_rx_queue_messages", "Received messages waiting to be processed", labels );
+  proposed = counter( "fix_proposed_objects_total", "Objects offered in PROPOSE_TRANSFER", labels );
+  accepted = counter( "fix_accepted_objects_total", "Offered objects the peer asked for", labels );
+  compress_raw = counter( "fix_compress_raw_bytes_total", "Bytes of data passed to the compressor", labels );
+  compress_wire
+    = counter( "fix_compress_wire_bytes_total", "Bytes sent for the data passed to the compressor", labels );
+  compress_skipped = counter(
+    "fix_compress_skipped_total", "Messages sent uncompressed because compressing did not pay off", labels );
+  compress_time = histogram( "fix_compress_us", "Time spent compressing a message", labels );
+  link_speed = gauge( "fix_link_speed_bytes", "Measured bytes per second of the link", labels );
+}
+
+Remote::Telemetry::~Telemetry()
+{
+  for ( const auto& [name, labels] : series ) {
+    global_metrics().release( name, labels );
+  }
+}
+
+void Remote::register_telemetry( const string& peer )
+{
+  telemetry_ = make_unique<Telemetry>( peer );
+  sample_queues();
+}
+
+void Remote::grant_credit()
+{
+  // Top the peer's credit back up to the full window
+  const auto bytes = max<int64_t>( static_cast<int64_t>( credit_bytes ) - rx_credit_bytes_, 0 );
+  const auto messages = max<int64_t>( static_cast<int64_t>( credit_messages ) - rx_credit_messages_, 0 );
+  rx_credit_bytes_ += bytes;
+  rx_credit_messages_ += messages;
+  tx_grant_bytes_ += bytes;
+  tx_grant_messages_ += messages;
+
+  VLOG( 2 ) << "Granting " << bytes << " bytes and " << messages << " messages of credit";
+  if ( tx_lane_ == TxLane::None ) {
+    load_tx_message();
+  }
+}
+
+void Remote::send_blob( BlobData blob )
+{
+  push_message( { Opcode::BLOBDATA, blob } );
+}
+
+void Remote::send_tree( Handle<AnyTree> handle, TreeData )
+{
+  auto& parent = parent_.value().get();
+  parent.visit_minrepo_pruned(
+    handle::upcast( handle ),
+    [&]( Handle<AnyDataType> h ) {
+      h.visit<void>( overload {
+        []( Handle<Literal> ) {},
+        []( Handle<Relation> ) {},
+        [&]( Handle<AnyTree> t ) {
+          push_message( { Opcode::TREEDATA, parent.get( t ).value() }, handle::fix( h ) );
+        },
+        [&]( Handle<Named> b ) {
+          push_message( { Opcode::BLOBDATA, parent.get( b ).value() }, handle::fix( h ) );
+        },
+      } );
+    },
+    [&]( Handle<AnyDataType> h ) {
+      return h.visit<bool>( overload {
+        []( Handle<Literal> ) { return true; },
+        []( Handle<Relation> ) { return true; },
+        [&]( auto x ) {
+          if ( !parent.contains( x ) ) {
+            if ( auto notice = holder_notice( x ) ) {
+              push_message( OutgoingMessage::to_message( std::move( *notice ) ) );
+            }
+            return true;
+          }
+          return contains( x );
+        },
+      } );
+    } );
+
+  add_to_view( handle );
+}
+
+template<FixType T>
+optional<HolderPayload> Remote::holder_notice( Handle<T> handle )
+{
+  if ( contains( handle ) ) {
+    return {};
+  }
+
+  const auto data = handle::data( handle ).value();
+  auto node = parent_.value().get().holder( data );
+  if ( not node.has_value() ) {
+    LOG( WARNING ) << "Leaving out " << handle << ", which no peer is known to hold";
+    return {};
+  }
+  return HolderPayload { .handle = data, .node = *node };
+}
+
+template<FixType T>
+void Remote::send_minrepo( Handle<T> root )
+{
+  auto& parent = parent_.value().get();
+  parent.visit_minrepo_pruned(
+    root,
+    [&]( Handle<AnyDataType> h ) {
+      h.visit<void>( overload {
+        []( Handle<Literal> ) {},
+        []( Handle<Relation> ) {},
+        [&]( auto x ) { msg_q_.enqueue( make_pair( index_, make_pair( x, parent.get( x ).value() ) ) ); },
+      } );
+    },
+    // Anything the remote already has is pruned along with everything below it, and so is data that was left on
+    // the peer which computed it
+    [&]( Handle<AnyDataType> h ) {
+      return h.visit<bool>( overload {
+        []( Handle<Literal> ) { return true; },
+        []( Handle<Relation> ) { return true; },
+        [&]( Handle<Named> x ) {
+          if ( !parent.contains( x ) ) {
+            if ( auto notice = holder_notice( x ) ) {
+              msg_q_.enqueue( make_pair( index_, std::move( *notice ) ) );
+            }
+            return true;
+          }
+          if ( !contains( x ) ) {
+            return false;
+          }
+          if ( !loaded( x ) ) {
+            msg_q_.enqueue( make_pair( index_, LoadBlobPayload( x ) ) );
+          }
+          return true;
+        },
+        [&]( Handle<AnyTree> x ) {
+          if ( !parent.contains( x ) ) {
+            if ( auto notice = holder_notice( x ) ) {
+              msg_q_.enqueue( make_pair( index_, std::move( *notice ) ) );
+            }
+            return true;
+          }
+          if ( !contains( x ) ) {
+            return false;
+          }
+          if ( !loaded( x ) ) {
+            msg_q_.enqueue( make_pair( index_, LoadTreePayload( x ) ) );
+          }
+          return true;
+        },
+      } );
+    } );
+}
+
+void Remote::push_message( OutgoingMessage&& msg, optional<Handle<Fix>> data )
+{
+  VLOG( 1 ) << "push_message " << Message::OPCODE_NAMES[static_cast<uint8_t>( msg.opcode() )];
+  if ( compressing_ and ( msg.opcode() == Opcode::BLOBDATA or msg.opcode() == Opcode::TREEDATA )
+       and msg.payload_length() >= compress_min_size ) {
+    // Compressed on the calling thread: replies pushed from processing threads are compressed there, while data
+    // queued through msg_q_ (such as minrepos) is compressed on the network thread
+    msg = compress( move( msg ) );
+  }
+
+  if ( this_thread::get_id() != network_thread_ ) {
+    // Pushed from a processing thread; the network thread owns tx_messages_
+    unique_lock lock( tx_replies_mutex_ );
+    tx_replies_.emplace( move( msg ), data );
+    tx_replies_size_++;
+    return;
+  }
+
+  if ( telemetry_ ) {
+    const auto opcode = static_cast<size_t>( msg.opcode() );
+    telemetry_->tx_messages[opcode]->add();
+    telemetry_->tx_bytes[opcode]->add( msg.payload_length() );
+  }
+
+  if ( batching_ and Message::batched_length( msg.opcode() ) != 0 ) {
+    if ( tx_batch_.empty() ) {
+      tx_batch_deadline_ = chrono::steady_clock::now() + chrono::microseconds( batch_delay );
+    }
+    tx_batch_.push( msg );
+    if ( tx_batch_.size() >= BATCH_SIZE ) {
+      flush_batch();
+    }
+    return;
+  }
+
+  // Anything batched so far has to go out before this message
+  flush_batch();
+  if ( bulk( msg ) ) {
+    enqueue_bulk_message( move( msg ), data );
+  } else {
+    enqueue_tx_message( move( msg ) );
+  }
+}
+
+bool Remote::should_compress()
+{
+  unique_lock lock( compress_mutex_ );
+
+  // Compressing a byte takes 1 / compress_speed_ seconds and saves ( 1 - compress_ratio_ ) / link seconds of
+  // sending it; a link that was never the bottleneck gains nothing from compression
+  const double link = link_speed_;
+  if ( compress_samples_ == 0
+       or ( link > 0 and compress_ratio_ < compress_max_ratio and link < ( 1 - compress_ratio_ ) * compress_speed_ ) ) {
+    compress_skipped_ = 0;
+    return true;
+  }
+
+  if ( ++compress_skipped_ >= COMPRESS_PROBE_INTERVAL ) {
+    compress_skipped_ = 0;
+    return true;
+  }
+  return false;
+}
+
+OutgoingMessage Remote::compress( OutgoingMessage&& msg )
+{
+  if ( not should_compress() ) {
+    if ( telemetry_ ) {
+      telemetry_->compress_skipped->add();
+    }
+    return move( msg );
+  }
+
+  const size_t size = msg.payload_length();
+  const auto start = chrono::steady_clock::now();
+  string payload = serialize( CompressedHeader { .opcode = msg.opcode(), .size = size } );
+  payload += compression::compress( msg.payload(), compress_level );
+  const auto elapsed = chrono::steady_clock::now() - start;
+
+  const double ratio = static_cast<double>( payload.size() - CompressedHeader::LENGTH ) / size;
+  const double speed = size / max( chrono::duration<double>( elapsed ).count(), 1e-9 );
+  {
+    unique_lock lock( compress_mutex_ );
+    if ( compress_samples_++ == 0 ) {
+      compress_ratio_ = ratio;
+      compress_speed_ = speed;
+    } else {
+      compress_ratio_ += COMPRESS_EWMA_WEIGHT * ( ratio - compress_ratio_ );
+      compress_speed_ += COMPRESS_EWMA_WEIGHT * ( speed - compress_speed_ );
+    }
+  }
+
+  const bool smaller = ratio < compress_max_ratio;
+  if ( telemetry_ ) {
+    telemetry_->compress_time->record( chrono::duration_cast<chrono::microseconds>( elapsed ).count() );
+    telemetry_->compress_raw->add( size );
+    telemetry_->compress_wire->add( smaller ? payload.size() : size );
+  }
+
+  VLOG( 2 ) << "Compressed " << size << " bytes to " << payload.size() - CompressedHeader::LENGTH;
+  if ( not smaller ) {
+    return move( msg );
+  }
+  return { Opcode::COMPRESSED, move( payload ) };
+}
+
+void Remote::write_to_socket()
+{
+  const string_view data = tx_data_.readable_region();
+  const size_t written = socket_.write( data );
+  tx_data_.pop( written );
+
+  // The socket is the bottleneck while it does not take everything it is offered
+  const auto now = chrono::steady_clock::now();
+  if ( tx_busy_ ) {
+    tx_busy_bytes_ += written;
+    const double elapsed = chrono::duration<double>( now - tx_busy_since_ ).count();
+    if ( elapsed >= 0.01 ) {
+      const double speed = tx_busy_bytes_ / elapsed;
+      const double previous = link_speed_;
+      link_speed_ = previous == 0 ? speed : previous + COMPRESS_EWMA_WEIGHT * ( speed - previous );
+      if ( telemetry_ ) {
+        telemetry_->link_speed->set( link_speed_ );
+      }
+      tx_busy_since_ = now;
+      tx_busy_bytes_ = 0;
+    }
+  }
+
+  const bool busy = written < data.size();
+  if ( busy and not tx_busy_ ) {
+    tx_busy_since_ = now;
+    tx_busy_bytes_ = 0;
+  }
+  tx_busy_ = busy;
+}
+
+bool Remote::bulk( OutgoingMessage& msg )
+{
+  switch ( msg.opcode() ) {
+    case Opcode::BLOBDATA:
+    case Opcode::TREEDATA:
+    case Opcode::SHALLOWTREEDATA:
+    case Opcode::BLOBRANGE:
+    case Opcode::COMPRESSED:
+      return chunking_ and msg.payload_length() > CHUNK_SIZE;
+    default:
+      return false;
+  }
+}
+
+void Remote::enqueue_tx_message( OutgoingMessage&& msg )
+{
+  tx_backlog_ += Message::HEADER_LENGTH + msg.payload_length();
+  tx_messages_.push( move( msg ) );
+  tx_queued_.push( chrono::steady_clock::now() );
+
+  // Otherwise the next message is loaded by write_to_rb() once the current one has been written
+  if ( tx_lane_ == TxLane::None ) {
+    load_tx_message();
+  }
+}
+
+void Remote::enqueue_bulk_message( OutgoingMessage&& msg, optional<Handle<Fix>> data )
+{
+  auto seq = next_bulk_seq_++;
+  tx_backlog_ += Message::HEADER_LENGTH + msg.payload_length();
+  if ( data.has_value() ) {
+    tx_bulk_handles_.insert_or_assign( *data, seq );
+  }
+  tx_bulk_.push_back( { .stream = next_stream_++, .seq = seq, .handle = data, .message = move( msg ) } );
+
+  if ( tx_lane_ == TxLane::None ) {
+    load_tx_message();
+  }
+}
+
+optional<uint64_t> Remote::bulk_fence( Handle<Relation> todo, optional<Handle<Object>> result )
+{
+  if ( tx_bulk_.empty() ) {
+    tx_fences_.clear();
+    return {};
+  }
+
+  // Without a parent the data can not be traced, so wait for everything that is outstanding
+  if ( not parent_.has_value() ) {
+    return next_bulk_seq_ - 1;
+  }
+
+  // The minrepo is walked again only if bulk transfers were queued since the fence was last found
+  const Handle<Fix> root = result.has_value() ? handle::fix( *result ) : job::get_root( todo );
+  if ( auto cached = tx_fences_.find( root ); cached != tx_fences_.end() and cached->second.first == next_bulk_seq_ ) {
+    return cached->second.second;
+  }
+
+  optional<uint64_t> fence;
+  auto visitor = [&]( Handle<AnyDataType> h ) {
+    auto it = tx_bulk_handles_.find( handle::fix( h ) );
+    if ( it != tx_bulk_handles_.end() ) {
+      fence = max( fence.value_or( 0 ), it->second );
+    }
+  };
+  auto prune = []( Handle<AnyDataType> h ) {
+    return h.visit<bool>( overload {
+      []( Handle<Literal> ) { return true; },
+      []( Handle<Relation> ) { return true; },
+      []( auto ) { return false; },
+    } );
+  };
+
+  auto& parent = parent_.value().get();
+  if ( result.has_value() ) {
+    parent.visit_minrepo_pruned( *result, visitor, prune );
+  } else {
+    parent.visit_minrepo_pruned( job::get_root( todo ), visitor, prune );
+  }
+  tx_fences_.insert_or_assign( root, make_pair( next_bulk_seq_, fence ) );
+  return fence;
+}
+
+void Remote::release_fenced()
+{
+  if ( tx_fenced_.empty() ) {
+    return;
+  }
+
+  const uint64_t outstanding
+    = tx_bulk_.empty() ? numeric_limits<uint64_t>::max()
+                       : min_element( tx_bulk_.begin(), tx_bulk_.end(), []( const auto& a, const auto& b ) {
+                           return a.seq < b.seq;
+                         } )->seq;
+
+  for ( auto it = tx_fenced_.begin(); it != tx_fenced_.end(); ) {
+    if ( it->first < outstanding ) {
+      push_message( move( it->second ) );
+      it = tx_fenced_.erase( it );
+    } else {
+      it++;
+    }
+  }
+}
+
+void Remote::flush_batch()
+{
+  if ( not tx_batch_.empty() ) {
+    VLOG( 2 ) << "Sending batch of " << tx_batch_.count() << " messages";
+    enqueue_tx_message( tx_batch_.release() );
+  }
+}
+
+void Remote::send_status()
+{
+  next_status_ = chrono::steady_clock::now() + chrono::microseconds( status_interval );
+
+  auto load = parent_.value().get().get_load();
+  if ( not load.has_value() ) {
+    return;
+  }
+  push_message( { Opcode::STATUS, serialize( StatusPayload { .queued = load->queued, .idle = load->idle } ) } );
+
+  // Only an idle node steals, and only from a peer that has more queued jobs than free threads
+  if ( steal_pending_ or load->queued > 0 or load->idle == 0 ) {
+    return;
+  }
+
+  optional<Load> peer;
+  {
+    unique_lock lock( mutex_ );
+    peer = peer_load_;
+    if ( peer.has_value() and peer->queued > peer->idle ) {
+      peer_load_.reset();
+    }
+  }
+  if ( not peer.has_value() or peer->queued <= peer->idle ) {
+    return;
+  }
+
+  uint32_t count = min( load->idle, max( ( peer->queued - peer->idle ) / 2, uint32_t( 1 ) ) );
+  VLOG( 1 ) << "Stealing " << count << " jobs from " << peer_name();
+  steal_pending_ = true;
+  push_message( { Opcode::STEAL, serialize( StealPayload { .count = count } ) } );
+}
+
+void Remote::grant( uint32_t count )
+{
+  auto& parent = parent_.value().get();
+
+  // The cost of a job is the number of objects in its minrepo that the peer does not have yet
+  auto cost = [&]( Handle<Relation> job ) -> size_t {
+    {
+      // Never hand a job back to the peer that asked us to run it
+      shared_lock lock( mutex_ );
+      if ( reply_to_.contains( job ) ) {
+        return numeric_limits<size_t>::max();
+      }
+    }
+
+    size_t missing = 0;
+    parent.visit_minrepo_pruned(
+      job::get_root( job ),
+      [&]( Handle<AnyDataType> ) { missing++; },
+      [&]( Handle<AnyDataType> h ) {
+        return h.visit<bool>( overload {
+          []( Handle<Literal> ) { return true; },
+          []( Handle<Relation> ) { return true; },
+          [&]( auto x ) { return contains( x ); },
+        } );
+      } );
+    return missing;
+  };
+
+  auto jobs = parent.steal( count, cost );
+  {
+    unique_lock lock( mutex_ );
+    stolen_.insert( jobs.begin(), jobs.end() );
+  }
+
+  for ( auto job : jobs ) {
+    get( job );
+  }
+  msg_q_.enqueue( make_pair( index_, GrantPayload { .jobs = move( jobs ) } ) );
+}
+
+void Remote::forward_replies()
+{
+  unique_lock lock( tx_replies_mutex_ );
+  while ( not tx_replies_.empty() ) {
+    push_message( move( tx_replies_.front().first ), tx_replies_.front().second );
+    tx_replies_.pop();
+    tx_replies_size_--;
+  }
+}
+
+bool Remote::runs_on_network_thread( Opcode opcode )
+{
+  switch ( opcode ) {
+    // These change state of the connection which only the network thread touches without a lock: the negotiated
+    // features, the credit, the pending steal and the proposals being negotiated
+    case Opcode::INFO:
+    case Opcode::CREDIT:
+    case Opcode::GRANT:
+    case Opcode::ACCEPT_TRANSFER:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void Remote::dispatch_incoming_message( IncomingMessage&& msg )
+{
+  if ( lane_ == nullptr or runs_on_network_thread( msg.opcode() ) ) {
+    process_incoming_message( move( msg ) );
+    return;
+  }
+
+  in_flight_++;
+  lane_->move_push( make_pair( this, make_unique<IncomingMessage>( move( msg ) ) ) );
+}
+
+void Remote::send_todo( Handle<Relation> todo, optional<Handle<Object>> result )
+{
+  auto msg = result ? OutgoingMessage::to_message( ResultPayload { .task = todo, .result = *result } )
+                    : OutgoingMessage::to_message( RunPayload { .task = todo } );
+  if ( result ) {
+    add_to_view( todo );
+  }
+
+  // Jobs that do not depend on bulk data in flight go ahead of it
+  auto fence = bulk_fence( todo, result );
+  if ( fence.has_value() ) {
+    VLOG( 2 ) << "Holding " << todo << " until bulk transfer " << *fence << " is sent";
+    tx_fenced_.emplace_back( *fence, move( msg ) );
+  } else {
+    push_message( move( msg ) );
+  }
+}
+
+void Remote::send_proposal_directly( Handle<Relation> todo, optional<Handle<Object>> result )
+{
+  for ( const auto& [name, data] : *incomplete_proposal_ ) {
+    auto h = name;
+    h.visit<void>( overload {
+      [&]( Handle<Named> x ) {
+        push_message( { Opcode::BLOBDATA, std::get<BlobData>( data ) }, handle::fix( name ) );
+        add_to_view( x );
+      },
+      [&]( Handle<AnyTree> x ) {
+        push_message( { Opcode::TREEDATA, std::get<TreeData>( data ) }, handle::fix( name ) );
+        add_to_view( x );
+      },
+      []( Handle<Literal> ) {},
+      []( Handle<Relation> ) {},
+    } );
+  }
+  send_todo( todo, result );
+  incomplete_proposal_ = make_unique<DataProposal>();
+  tx_backlog_ -= proposal_size_;
+  proposal_size_ = 0;
+}
+
+void Remote::start_negotiation( Handle<Relation> todo, optional<Handle<Object>> result )
+{
+  PendingProposal pending { .todo = todo, .result = result, .proposal = std::move( incomplete_proposal_ ) };
+  incomplete_proposal_ = make_unique<DataProposal>();
+  tx_backlog_ -= proposal_size_;
+  proposal_size_ = 0;
+
+  auto& proposal = *pending.proposal;
+  pending.offered.resize( proposal.size() );
+  pending.wanted.resize( proposal.size() );
+  for ( size_t i = 0; i < proposal.size(); i++ ) {
+    pending.index.emplace( handle::fix( proposal[i].first ), i );
+  }
 
-  tx_messages_.front().serialize_header( current_msg_header_ );
-  current_msg_unsent_header_ = current_msg_header_;
-  current_msg_unsent_payload_ = tx_messages_.front().payload();
+  proposed_proposals_.push_back( std::move( pending ) );
+  offer_roots( proposed_proposals_.back() );
 }
 
-void Remote::write_to_rb()
+void Remote::offer_roots( PendingProposal& pending )
 {
-  if ( not current_msg_unsent_header_.empty() ) {
-    current_msg_unsent_header_.remove_prefix( tx_data_.push_from_const_str( current_msg_unsent_header_ ) );
-  } else if ( not current_msg_unsent_payload_.empty() ) {
-    current_msg_unsent_payload_.remove_prefix( tx_data_.push_from_const_str( current_msg_unsent_payload_ ) );
-  } else {
-    tx_messages_.pop();
+  auto& proposal = *pending.proposal;
+
+  // The roots are the proposed data that no proposed tree refers to
+  vector<bool> referenced( proposal.size() );
+  for ( const auto& [_, data] : proposal ) {
+    if ( holds_alternative<TreeData>( data ) ) {
+      for ( const auto& child : std::get<TreeData>( data )->span() ) {
+        auto it = pending.index.find( child );
+        if ( it != pending.index.end() ) {
+          referenced[it->second] = true;
+        }
+      }
+    }
+  }
 
-    if ( not tx_messages_.empty() ) {
-      load_tx_message();
+  ProposeTransferPayload payload { .todo = pending.todo, .result = pending.result };
+  for ( size_t i = 0; i < proposal.size(); i++ ) {
+    if ( not referenced[i] ) {
+      pending.offered[i] = true;
+      payload.handles.push_back( proposal[i].first );
     }
   }
+
+  VLOG( 1 ) << "Proposing " << payload.handles.size() << " of " << proposal.size() << " objects for "
+            << pending.todo;
+  if ( telemetry_ ) {
+    telemetry_->proposed->add( payload.handles.size() );
+  }
+  push_message( OutgoingMessage::to_message( std::move( payload ) ) );
 }
 
-void Remote::read_from_rb()
+void Remote::continue_negotiation( PendingProposal& pending, const vector<Handle<AnyDataType>>& wanted )
 {
-  rx_data_.pop( rx_messages_.parse( rx_data_.readable_region() ) );
+  auto& proposal = *pending.proposal;
+
+  if ( telemetry_ ) {
+    telemetry_->accepted->add( wanted.size() );
+  }
+
+  // Offer the children of every wanted tree as the next level
+  ProposeTransferPayload next { .todo = pending.todo, .result = pending.result };
+  for ( const auto& h : wanted ) {
+    auto it = pending.index.find( handle::fix( h ) );
+    if ( it == pending.index.end() or not pending.offered[it->second] ) {
+      throw runtime_error( "Accepted data that was not proposed" );
+    }
+    pending.wanted[it->second] = true;
+
+    if ( holds_alternative<TreeData>( proposal[it->second].second ) ) {
+      for ( const auto& child : std::get<TreeData>( proposal[it->second].second )->span() ) {
+        auto c = pending.index.find( child );
+        if ( c != pending.index.end() and not pending.offered[c->second] ) {
+          pending.offered[c->second] = true;
+          next.handles.push_back( proposal[c->second].first );
+        }
+      }
+    }
+  }
+
+  if ( not next.handles.empty() ) {
+    VLOG( 1 ) << "Proposing " << next.handles.size() << " more objects for " << pending.todo;
+    if ( telemetry_ ) {
+      telemetry_->proposed->add( next.handles.size() );
+    }
+    push_message( OutgoingMessage::to_message( std::move( next ) ) );
+    return;
+  }
+
+  // Children precede their parents in the proposal, so the remote never receives a tree before its children
+  for ( size_t i = 0; i < proposal.size(); i++ ) {
+    if ( pending.wanted[i] ) {
+      VLOG( 2 ) << "Sending " << proposal[i].first;
+      auto data = handle::fix( proposal[i].first );
+      std::visit( overload {
+                    [&]( const BlobData& b ) { push_message( { Opcode::BLOBDATA, b }, data ); },
+                    [&]( const TreeData& t ) { push_message( { Opcode::TREEDATA, t }, data ); },
+                  },
+                  proposal[i].second );
+    }
+  }
+
+  pending.negotiated = true;
+  pending.proposal = make_unique<DataProposal>();
+  pending.index.clear();
 }
 
-void Remote::send_blob( BlobData blob )
+void Remote::send_negotiated_todos()
 {
-  push_message( { Opcode::BLOBDATA, blob } );
+  // A todo queued without a proposal of its own only waits for the proposals before it
+  while ( not proposed_proposals_.empty()
+          and ( proposed_proposals_.front().negotiated or proposed_proposals_.front().offered.empty() ) ) {
+    send_todo( proposed_proposals_.front().todo, proposed_proposals_.front().result );
+    proposed_proposals_.pop_front();
+  }
 }
 
-void Remote::send_tree( Handle<AnyTree> handle, TreeData )
+void Remote::request_blob( Handle<Named> name, uint64_t offset, uint64_t length )
 {
-  parent_.value().get().visit_minrepo( handle::upcast( handle ), [&]( Handle<AnyDataType> h ) {
-    h.visit<void>( overload {
-      []( Handle<Literal> ) {},
-      []( Handle<Relation> ) {},
-      [&]( Handle<AnyTree> t ) { push_message( { Opcode::TREEDATA, parent_.value().get().get( t ).value() } ); },
-      [&]( Handle<Named> b ) { push_message( { Opcode::BLOBDATA, parent_.value().get().get( b ).value() } ); },
-    } );
-  } );
-
-  add_to_view( handle );
+  RequestBlobPayload payload { .handle = name, .offset = offset, .length = length };
+  msg_q_.enqueue( make_pair( index_, move( payload ) ) );
 }
 
-void Remote::push_message( OutgoingMessage&& msg )
+void Remote::request_tree( Handle<AnyTree> name )
 {
-  VLOG( 1 ) << "push_message " << Message::OPCODE_NAMES[static_cast<uint8_t>( msg.opcode() )];
-  tx_messages_.push( move( msg ) );
-
-  if ( current_msg_unsent_header_.empty() and current_msg_unsent_payload_.empty() ) {
-    load_tx_message();
-  }
+  RequestTreePayload payload { .handle = name };
+  msg_q_.enqueue( make_pair( index_, move( payload ) ) );
 }
 
 optional<BlobData> Remote::get( Handle<Named> name )
 {
-  RequestBlobPayload payload { .handle = name };
-  msg_q_.enqueue( make_pair( index_, move( payload ) ) );
+  if ( fetcher_ == nullptr or not fetcher_->fetch( name, *this ) ) {
+    request_blob( name );
+  }
 
   return {};
 }
 
 optional<TreeData> Remote::get( Handle<AnyTree> name )
 {
-  RequestTreePayload payload { .handle = name };
-  msg_q_.enqueue( make_pair( index_, move( payload ) ) );
+  if ( fetcher_ == nullptr or not fetcher_->fetch( name, *this ) ) {
+    request_tree( name );
+  }
 
   return {};
 }
@@ -107,27 +902,7 @@ optional<TreeData> Remote::get_shallow( Handle<AnyTree> name )
 optional<Handle<Object>> Remote::get( Handle<Relation> name )
 {
   if ( !contains( name ) ) {
-    // XXX
-    parent_.value().get().visit_minrepo( job::get_root( name ), [&]( Handle<AnyDataType> h ) {
-      h.visit<void>( overload {
-        []( Handle<Literal> ) {},
-        []( Handle<Relation> ) {},
-        [&]( Handle<Named> x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadBlobPayload( x ) ) );
-          }
-        },
-        [&]( auto x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadTreePayload( x ) ) );
-          }
-        },
-      } );
-    } );
+    send_minrepo( job::get_root( name ) );
   }
 
   RunPayload payload { .task = name };
@@ -147,30 +922,7 @@ void Remote::put( Handle<Named> name, BlobData data )
 
 void Remote::put( Handle<AnyTree> name, TreeData )
 {
-  if ( !contains( name ) ) {
-    parent_.value().get().visit_minrepo( handle::upcast( name ), [&]( Handle<AnyDataType> h ) {
-      h.visit<void>( overload {
-        []( Handle<Literal> ) {},
-        []( Handle<Relation> ) {},
-        [&]( Handle<Named> x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadBlobPayload( x ) ) );
-          }
-        },
-        [&]( auto x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadTreePayload( x ) ) );
-          }
-        },
-      } );
-    } );
-  } else if ( !loaded( name ) ) {
-    msg_q_.enqueue( make_pair( index_, LoadTreePayload( name ) ) );
-  }
+  send_minrepo( handle::upcast( name ) );
 }
 
 void Remote::put_shallow( Handle<AnyTree> name, TreeData data )
@@ -180,32 +932,31 @@ void Remote::put_shallow( Handle<AnyTree> name, TreeData data )
   }
 }
 
+bool Remote::ship_result_data( Handle<Object> result )
+{
+  if ( result_shipping == ResultShipping::Eager ) {
+    return true;
+  }
+
+  // A peer which does not schedule jobs of its own (such as a client) would have no way to fetch the data later
+  if ( get_info().transform( []( auto info ) { return info.parallelism; } ).value_or( 0 ) == 0 ) {
+    return true;
+  }
+
+  return handle::data( result ).transform( []( auto h ) { return handle::byte_size( h ); } ).value_or( 0 )
+         < eager_result_size;
+}
+
 void Remote::put( Handle<Relation> name, Handle<Object> data )
 {
+  const bool ship = ship_result_data( data );
   unique_lock lock( mutex_ );
   if ( reply_to_.contains( name ) ) {
     if ( !contains( name ) ) {
       // Send the result of the relation first
-      parent_.value().get().visit_minrepo( data, [&]( Handle<AnyDataType> h ) {
-        h.visit<void>( overload {
-          []( Handle<Literal> ) {},
-          []( Handle<Relation> ) {},
-          [&]( Handle<Named> x ) {
-            if ( !contains( x ) ) {
-              msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-            } else if ( !loaded( x ) ) {
-              msg_q_.enqueue( make_pair( index_, LoadBlobPayload( x ) ) );
-            }
-          },
-          [&]( auto x ) {
-            if ( !contains( x ) ) {
-              msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-            } else if ( !loaded( x ) ) {
-              msg_q_.enqueue( make_pair( index_, LoadTreePayload( x ) ) );
-            }
-          },
-        } );
-      } );
+      if ( ship ) {
+        send_minrepo( data );
+      }
 
       VLOG( 2 ) << "Putting result to remote " << name << " " << data;
       ResultPayload payload { .task = name, .result = data };
@@ -219,61 +970,106 @@ void Remote::put_force( Handle<Relation> name, Handle<Object> data )
 {
   if ( !contains( name ) ) {
     // Send the result of the relation first
-    parent_.value().get().visit_minrepo( data, [&]( Handle<AnyDataType> h ) {
-      h.visit<void>( overload {
-        []( Handle<Literal> ) {},
-        []( Handle<Relation> ) {},
-        [&]( Handle<Named> x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadBlobPayload( x ) ) );
-          }
-        },
-        [&]( auto x ) {
-          if ( !contains( x ) ) {
-            msg_q_.enqueue( make_pair( index_, make_pair( x, parent_.value().get().get( x ).value() ) ) );
-          } else if ( !loaded( x ) ) {
-            msg_q_.enqueue( make_pair( index_, LoadTreePayload( x ) ) );
-          }
-        },
-      } );
-    } );
+    if ( ship_result_data( data ) ) {
+      send_minrepo( data );
+    }
 
     VLOG( 2 ) << "Putting result to remote " << name << " " << data;
     ResultPayload payload { .task = name, .result = data };
     msg_q_.enqueue( make_pair( index_, move( payload ) ) );
   }
-  reply_to_.erase( name );
+  erase_reply_to( name );
+}
+
+void Remote::cancel( Handle<Relation> name )
+{
+  {
+    unique_lock lock( mutex_ );
+    if ( not pending_result_.erase( name ) ) {
+      return;
+    }
+    stolen_.erase( name );
+  }
+  msg_q_.enqueue( make_pair( index_, CancelPayload { .task = name } ) );
+}
+
+bool Remote::lookup( Handle<Relation> name )
+{
+  {
+    unique_lock lock( mutex_ );
+    if ( dead_ or not lookups_.insert( name ).second ) {
+      return not dead_;
+    }
+  }
+  msg_q_.enqueue( make_pair( index_, LookupPayload { .task = name } ) );
+  return true;
+}
+
+void Remote::publish( Handle<Relation> name, Handle<Object> data )
+{
+  // The owner answers lookups from other peers with the data, so it is always sent along
+  if ( !contains( name ) ) {
+    send_minrepo( data );
+    msg_q_.enqueue( make_pair( index_, ResultPayload { .task = name, .result = data } ) );
+  }
+}
+
+void Remote::holds( Handle<AnyDataType> data )
+{
+  data.visit<void>( overload {
+    []( Handle<Literal> ) {},
+    []( Handle<Relation> ) {},
+    [&]( auto h ) { add_to_view( h ); },
+  } );
+}
+
+optional<size_t> RemoteViews::attach()
+{
+  unique_lock lock( mutex_ );
+  for ( size_t slot = 0; slot < used_.size(); slot++ ) {
+    if ( not used_[slot] ) {
+      used_[slot] = true;
+      return slot;
+    }
+  }
+  return {};
+}
+
+void RemoteViews::detach( size_t slot )
+{
+  blobs.clear( slot );
+  trees.clear( slot );
+  relations.clear( slot );
+
+  unique_lock lock( mutex_ );
+  used_.at( slot ) = false;
 }
 
 bool Remote::contains( Handle<Named> handle )
 {
-  return blobs_view_.contains( handle );
+  return view_slot_ and views_->blobs.contains( handle, *view_slot_ );
 }
 
 bool Remote::loaded( Handle<Named> handle )
 {
-  return blobs_view_.contains( handle ) && blobs_view_.get_ref( handle ).load( memory_order_acquire );
+  return view_slot_ and views_->blobs.loaded( handle, *view_slot_ );
 }
 
 void Remote::add_to_view( Handle<Named> handle )
 {
-  if ( !blobs_view_.contains( handle ) ) {
-    blobs_view_.insert_no_value( handle );
+  if ( view_slot_ ) {
+    views_->blobs.insert( handle, *view_slot_, true );
   }
-
-  blobs_view_.get_ref( handle ).store( true, memory_order_release );
 }
 
 bool Remote::contains( Handle<AnyTree> handle )
 {
-  return trees_view_.contains( handle );
+  return view_slot_ and views_->trees.contains( handle, *view_slot_ );
 }
 
 bool Remote::loaded( Handle<AnyTree> handle )
 {
-  return trees_view_.contains( handle ) && trees_view_.get_ref( handle ).load( memory_order_acquire );
+  return view_slot_ and views_->trees.loaded( handle, *view_slot_ );
 }
 
 bool Remote::contains_shallow( Handle<AnyTree> handle )
@@ -283,41 +1079,39 @@ bool Remote::contains_shallow( Handle<AnyTree> handle )
 
 void Remote::add_to_view( Handle<AnyTree> handle )
 {
-  if ( !trees_view_.contains( handle ) ) {
-    trees_view_.insert_no_value( handle );
+  if ( view_slot_ ) {
+    views_->trees.insert( handle, *view_slot_, true );
   }
-
-  trees_view_.get_ref( handle ).store( true, memory_order_release );
 }
 
 bool Remote::contains( Handle<Relation> handle )
 {
-  return relations_view_.contains( handle );
+  return view_slot_ and views_->relations.contains( handle, *view_slot_ );
 }
 
 bool Remote::loaded( Handle<Relation> handle )
 {
-  return relations_view_.contains( handle ) && relations_view_.get_ref( handle ).load( memory_order_acquire );
+  return view_slot_ and views_->relations.loaded( handle, *view_slot_ );
 }
 
 void Remote::add_to_view( Handle<Relation> handle )
 {
-  if ( !relations_view_.contains( handle ) ) {
-    relations_view_.insert_no_value( handle );
+  if ( view_slot_ ) {
+    views_->relations.insert( handle, *view_slot_, true );
   }
-
-  relations_view_.get_ref( handle ).store( true, memory_order_release );
 }
 
 std::optional<Handle<AnyTree>> Remote::get_handle( Handle<AnyTree> handle )
 {
-  return trees_view_.get_handle( handle );
+  if ( not view_slot_ ) {
+    return {};
+  }
+  return views_->trees.get_handle( handle, *view_slot_ );
 }
 
 std::optional<Handle<AnyTree>> Remote::contains( Handle<AnyTreeRef> handle )
 {
-  auto tmp_tree = Handle<AnyTree>::forge( handle.content );
-  auto entry = trees_view_.get_handle( tmp_tree );
+  auto entry = get_handle( Handle<AnyTree>::forge( handle.content ) );
 
   if ( !entry.has_value() ) {
     return {};
@@ -344,7 +1138,15 @@ std::optional<IRuntime::Info> Remote::get_info()
   return info_;
 }
 
-Remote::Remote( TCPSocket socket,
+std::optional<IRuntime::Load> Remote::get_load()
+{
+  shared_lock lock( mutex_ );
+  auto load = peer_load_.value_or( Load {} );
+  load.backlog = tx_backlog_;
+  return load;
+}
+
+Remote::Remote( Socket socket,
                 size_t index,
                 MessageQueue& msg_q,
                 optional<reference_wrapper<MultiWorkerRuntime>> parent )
@@ -356,7 +1158,7 @@ Remote::Remote( TCPSocket socket,
 
 Remote::Remote( EventLoop& events,
                 EventCategories categories,
-                TCPSocket socket,
+                Socket socket,
                 size_t index,
                 MessageQueue& msg_q,
                 optional<reference_wrapper<MultiWorkerRuntime>> parent )
@@ -366,7 +1168,7 @@ Remote::Remote( EventLoop& events,
     categories.rx_read_data,
     socket_,
     Direction::In,
-    [&] { rx_data_.push_from_fd( socket_ ); },
+    [&] { read_from_socket(); },
     [&] { return rx_data_.can_write(); },
     [&] { this->clean_up(); } ) );
 
@@ -374,7 +1176,7 @@ Remote::Remote( EventLoop& events,
     categories.tx_write_data,
     socket_,
     Direction::Out,
-    [&] { tx_data_.pop_to_fd( socket_ ); },
+    [&] { write_to_socket(); },
     [&] { return tx_data_.can_read(); },
     [&] { this->clean_up(); } ) );
 
@@ -384,20 +1186,158 @@ Remote::Remote( EventLoop& events,
   install_rule( events.add_rule(
     categories.tx_serialize_msg,
     [&] { write_to_rb(); },
-    [&] { return not tx_messages_.empty() and tx_data_.can_write(); } ) );
+    [&] { return ( tx_lane_ != TxLane::None or tx_ready() ) and tx_data_.can_write(); } ) );
 
+  // Messages of one connection are processed in order: a message that has to run on the network thread waits
+  // until everything handed to the processing lane before it has completed.
   install_rule( events.add_rule(
     categories.rx_process_msg,
     [&] {
       IncomingMessage message = move( rx_messages_.front() );
       rx_messages_.pop();
-      process_incoming_message( move( message ) );
+      dispatch_incoming_message( move( message ) );
     },
-    [&] { return not rx_messages_.empty(); } ) );
+    [&] {
+      return not rx_messages_.empty()
+             and ( in_flight_ == 0
+                   or ( lane_ != nullptr and not runs_on_network_thread( rx_messages_.front().opcode() ) ) );
+    } ) );
+
+  install_rule( events.add_rule(
+    categories.forward_reply, [&] { forward_replies(); }, [&] { return tx_replies_size_ > 0; } ) );
+
+  install_rule( events.add_rule(
+    categories.tx_flush_batch,
+    [&] { flush_batch(); },
+    [&] {
+      return not tx_batch_.empty()
+             and ( chrono::steady_clock::now() >= tx_batch_deadline_
+                   or ( tx_messages_.empty() and msg_q_.size_approx() == 0 ) );
+    } ) );
+
+  install_rule( events.add_rule(
+    categories.tx_status,
+    [&] { send_status(); },
+    [&] { return stealing_ and chrono::steady_clock::now() >= next_status_; } ) );
+
+  // Credit is granted as received messages are drained, so a peer can not queue up more than the window here
+  install_rule( events.add_rule(
+    categories.tx_credit,
+    [&] { grant_credit(); },
+    [&] {
+      return credit_ and rx_messages_.size() + in_flight_ < RX_BACKLOG
+             and ( rx_credit_bytes_ < static_cast<int64_t>( credit_bytes / 2 )
+                   or rx_credit_messages_ < static_cast<int64_t>( credit_messages / 2 ) );
+    } ) );
 
   push_message( { Opcode::REQUESTINFO, string( "" ) } );
 }
 
+LocalRemote::LocalRemote( EventLoop& events,
+                          EventCategories categories,
+                          LocalStreamSocket socket,
+                          size_t index,
+                          MessageQueue& msg_q,
+                          optional<reference_wrapper<MultiWorkerRuntime>> parent )
+  : Remote( events, categories, move( socket ), index, msg_q, parent )
+{
+  // Nothing is gained by compressing data that never leaves the host
+  compressible_ = false;
+}
+
+bool LocalRemote::is_local( const Address& address )
+{
+  // Binding succeeds only for an address of one of our interfaces
+  try {
+    TCPSocket probe;
+    probe.bind( Address( address.ip() ) );
+    return true;
+  } catch ( const unix_error& ) {
+    return false;
+  }
+}
+
+bool LocalRemote::trusted( const LocalStreamSocket& socket )
+{
+  try {
+    return socket.peer_uid() == geteuid();
+  } catch ( const exception& ) {
+    return false;
+  }
+}
+
+bool LocalRemote::bulk( OutgoingMessage& msg )
+{
+  // Blob and tree data of at least shared_size bytes is passed through a memfd by enqueue_tx_message instead
+  const bool shared = ( msg.opcode() == Opcode::BLOBDATA or msg.opcode() == Opcode::TREEDATA )
+                      and msg.payload_length() >= shared_size;
+  return not shared and Remote::bulk( msg );
+}
+
+void LocalRemote::enqueue_tx_message( OutgoingMessage&& msg )
+{
+  const bool tree = msg.opcode() == Opcode::TREEDATA;
+  if ( ( msg.opcode() != Opcode::BLOBDATA and not tree ) or msg.payload_length() < shared_size ) {
+    Remote::enqueue_tx_message( move( msg ) );
+    return;
+  }
+
+  string_view data = msg.payload();
+  FileDescriptor fd { CheckSystemCall( "memfd_create", memfd_create( "fix-shared", MFD_CLOEXEC ) ) };
+  CheckSystemCall( "ftruncate", ftruncate( fd.fd_num(), data.size() ) );
+  while ( not data.empty() ) {
+    data.remove_prefix( fd.write( data ) );
+  }
+
+  VLOG( 2 ) << "Sharing " << msg.payload_length() << " bytes through memfd";
+  tx_shared_fds_.push( move( fd ) );
+  Remote::enqueue_tx_message(
+    { Opcode::SHAREDDATA, serialize( SharedDataPayload { .tree = tree, .size = msg.payload_length() } ) } );
+}
+
+void LocalRemote::load_tx_message()
+{
+  Remote::load_tx_message();
+
+  // The header of this message is the next thing written to tx_data_
+  if ( tx_lane_ == TxLane::Control and tx_messages_.front().opcode() == Opcode::SHAREDDATA ) {
+    tx_fds_.emplace_back( tx_data_.bytes_pushed(), move( tx_shared_fds_.front() ) );
+    tx_shared_fds_.pop();
+  }
+}
+
+void LocalRemote::write_to_socket()
+{
+  // A descriptor has to arrive no later than the header of its SHAREDDATA message, so it is sent together with
+  // some bytes up to and including that header.
+  string_view data = tx_data_.readable_region();
+  const size_t sent = tx_data_.bytes_popped();
+
+  vector<int> fds;
+  auto it = tx_fds_.begin();
+  for ( ; it != tx_fds_.end() and it->first < sent + data.size() and fds.size() < MAX_FDS_PER_WRITE; it++ ) {
+    fds.push_back( it->second.fd_num() );
+  }
+  if ( it != tx_fds_.end() and it->first < sent + data.size() ) {
+    data = data.substr( 0, it->first - sent );
+  }
+
+  const size_t written = socket_.send_with_fds( data, fds );
+  if ( written > 0 ) {
+    tx_fds_.erase( tx_fds_.begin(), tx_fds_.begin() + fds.size() );
+  }
+  tx_data_.pop( written );
+}
+
+void LocalRemote::read_from_socket()
+{
+  vector<FileDescriptor> fds;
+  rx_data_.push( socket_.recv_with_fds( rx_data_.writable_region(), fds ) );
+  for ( auto& fd : fds ) {
+    rx_messages_.add_fd( move( fd ) );
+  }
+}
+
 DataServer::DataServer( EventLoop& events,
                         EventCategories categories,
                         TCPSocket socket,
@@ -428,7 +1368,7 @@ DataServer::DataServer( EventLoop& events,
   install_rule( events.add_rule(
     categories.tx_serialize_msg,
     [&] { write_to_rb(); },
-    [&] { return not tx_messages_.empty() and tx_data_.can_write(); } ) );
+    [&] { return tx_lane_ != TxLane::None and tx_data_.can_write(); } ) );
 
   install_rule( events.add_rule(
     categories.rx_process_msg,
@@ -452,6 +1392,9 @@ DataServer::DataServer( EventLoop& events,
     },
     [&] { return ready_.size_approx() > 0; } ) );
 
+  install_rule(
+    events.add_rule( categories.data_server_ready, [&] { timers_.advance(); }, [&] { return timers_.due(); } ) );
+
   // push_message( { Opcode::REQUESTINFO, string( "" ) } );
 }
 
@@ -464,6 +1407,13 @@ void Remote::process_incoming_message( IncomingMessage&& msg )
 
   VLOG( 1 ) << "process_incoming_message " << Message::OPCODE_NAMES[static_cast<uint8_t>( msg.opcode() )];
 
+  if ( telemetry_ ) {
+    const auto opcode = static_cast<size_t>( msg.opcode() );
+    telemetry_->rx_messages[opcode]->add();
+    telemetry_->rx_bytes[opcode]->add( msg.payload_length() );
+  }
+  HistogramTimer timer( telemetry_ ? telemetry_->rx_processing : nullptr );
+
   switch ( msg.opcode() ) {
     case Opcode::RUN: {
       auto payload = parse<RunPayload>( std::get<string>( msg.payload() ) );
@@ -483,53 +1433,164 @@ void Remote::process_incoming_message( IncomingMessage&& msg )
 
     case Opcode::RESULT: {
       auto payload = parse<ResultPayload>( std::get<string>( msg.payload() ) );
-      pending_result_.erase( payload.task );
+      {
+        unique_lock lock( mutex_ );
+        pending_result_.erase( payload.task );
+        stolen_.erase( payload.task );
+        lookups_.erase( payload.task );
+      }
+      // The peer holds the data of the result whether or not it sent it along, which the scheduler takes into
+      // account when placing the jobs that use it
+      handle::data( payload.result ).transform( [&]( auto root ) {
+        root.template visit<void>( overload { []( Handle<Literal> ) {}, [&]( auto h ) { add_to_view( h ); } } );
+        // Data left on the peer is recorded, so that jobs sent to other peers can tell them where it is
+        const auto node = get_info().transform( []( auto info ) { return info.node; } ).value_or( 0 );
+        if ( node != 0 and not root.template visit<bool>( overload {
+                             []( Handle<Literal> ) { return true; },
+                             [&]( auto h ) { return parent.contains( h ); },
+                           } ) ) {
+          parent.held_by( root, node );
+        }
+        return true;
+      } );
+      parent.finished_remotely( payload.task, *this );
       parent.put( payload.task, payload.result );
       break;
     }
 
     case Opcode::REQUESTINFO: {
       auto parent_info = parent.get_info().value_or( IRuntime::Info { .parallelism = 0, .link_speed = 0 } );
-      InfoPayload payload {
-        .parallelism = parent_info.parallelism, .link_speed = parent_info.link_speed, .data = parent.data() };
+      InfoPayload payload { .parallelism = parent_info.parallelism,
+                            .link_speed = parent_info.link_speed,
+                            .data = parent.data(),
+                            .features = ( enable_batching ? InfoPayload::FEATURE_BATCH : 0 )
+                                        | ( enable_chunking ? InfoPayload::FEATURE_CHUNK : 0 )
+                                        | ( enable_stealing ? InfoPayload::FEATURE_STEAL : 0 )
+                                        | ( enable_credit ? InfoPayload::FEATURE_CREDIT : 0 )
+                                        | ( enable_compression and compressible_ and compression::available()
+                                              ? InfoPayload::FEATURE_COMPRESS
+                                              : 0 )
+                                        | InfoPayload::FEATURE_RANGE,
+                            .node = parent_info.node };
       push_message( OutgoingMessage::to_message( move( payload ) ) );
       break;
     }
 
-    case Opcode::INFO: {
-      auto payload = parse<InfoPayload>( std::get<string>( msg.payload() ) );
+    case Opcode::INFO: {
+      auto payload = parse<InfoPayload>( std::get<string>( msg.payload() ) );
+
+      for ( auto handle : payload.data ) {
+        if ( not view_slot_ ) {
+          break;
+        }
+        handle.visit<void>( overload {
+          [&]( Handle<Named> h ) { views_->blobs.insert( h, *view_slot_, false ); },
+          [&]( Handle<AnyTree> t ) { views_->trees.insert( t, *view_slot_, false ); },
+          []( Handle<Literal> ) {},
+          [&]( Handle<Relation> r ) { views_->relations.insert( r, *view_slot_, false ); },
+        } );
+      }
+
+      batching_ = enable_batching and ( payload.features & InfoPayload::FEATURE_BATCH );
+      chunking_ = enable_chunking and ( payload.features & InfoPayload::FEATURE_CHUNK );
+      stealing_ = enable_stealing and ( payload.features & InfoPayload::FEATURE_STEAL );
+      ranges_ = payload.features & InfoPayload::FEATURE_RANGE;
+      credit_ = enable_credit and ( payload.features & InfoPayload::FEATURE_CREDIT );
+      compressing_ = enable_compression and compressible_ and compression::available()
+                     and ( payload.features & InfoPayload::FEATURE_COMPRESS );
+
+      {
+        unique_lock lock( mutex_ );
+        info_ = { .parallelism = payload.parallelism, .link_speed = payload.link_speed, .node = payload.node };
+        info_cv_.notify_all();
+      }
+
+      break;
+    }
+
+    case Opcode::STATUS: {
+      auto payload = parse<StatusPayload>( std::get<string>( msg.payload() ) );
+      unique_lock lock( mutex_ );
+      peer_load_ = { .queued = payload.queued, .idle = payload.idle };
+      break;
+    }
+
+    case Opcode::CREDIT: {
+      auto payload = parse<CreditPayload>( std::get<string>( msg.payload() ) );
+      tx_credit_bytes_ += payload.bytes;
+      tx_credit_messages_ += payload.messages;
+      break;
+    }
+
+    case Opcode::STEAL: {
+      auto payload = parse<StealPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "STEAL " << payload.count;
+      grant( payload.count );
+      break;
+    }
+
+    case Opcode::GRANT: {
+      auto payload = parse<GrantPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "GRANT " << payload.jobs.size();
+      steal_pending_ = false;
+      break;
+    }
+
+    case Opcode::CANCEL: {
+      auto payload = parse<CancelPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "CANCEL " << payload.task;
+      erase_reply_to( payload.task );
+      parent.cancel( payload.task );
+      break;
+    }
 
-      for ( auto handle : payload.data ) {
-        handle.visit<void>( overload {
-          [&]( Handle<Named> h ) {
-            blobs_view_.insert_no_value( h );
-            blobs_view_.get_ref( h ).store( false, memory_order_release );
-          },
-          [&]( Handle<AnyTree> t ) {
-            trees_view_.insert_no_value( t );
-            trees_view_.get_ref( t ).store( false, memory_order_release );
-          },
-          []( Handle<Literal> ) {},
-          [&]( Handle<Relation> r ) {
-            relations_view_.insert_no_value( r );
-            relations_view_.get_ref( r ).store( false, memory_order_release );
-          },
-        } );
+    case Opcode::LOOKUP: {
+      auto payload = parse<LookupPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "LOOKUP " << payload.task;
+
+      // Only a result whose data is here can be handed out, since the peer may fetch the data from here
+      auto result = parent.contains( payload.task ) ? parent.get( payload.task ) : optional<Handle<Object>> {};
+      const bool known
+        = result.has_value()
+          and handle::data( *result )
+                .transform( [&]( auto root ) {
+                  return root.template visit<bool>( overload {
+                    []( Handle<Literal> ) { return true; },
+                    [&]( auto h ) { return parent.contains( h ); },
+                  } );
+                } )
+                .value_or( true );
+
+      if ( known ) {
+        put_force( payload.task, *result );
+      } else {
+        msg_q_.enqueue( make_pair( index_, MissPayload { .task = payload.task } ) );
       }
+      break;
+    }
 
+    case Opcode::HOLDER: {
+      auto payload = parse<HolderPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "HOLDER " << payload.handle << " " << payload.node;
+      parent.held_by( payload.handle, payload.node );
+      break;
+    }
+
+    case Opcode::MISS: {
+      auto payload = parse<MissPayload>( std::get<string>( msg.payload() ) );
+      VLOG( 1 ) << "MISS " << payload.task;
       {
         unique_lock lock( mutex_ );
-        info_ = { .parallelism = payload.parallelism, .link_speed = payload.link_speed };
-        info_cv_.notify_all();
+        lookups_.erase( payload.task );
       }
-
+      parent.missed( payload.task );
       break;
     }
 
     case Opcode::REQUESTTREE: {
       auto payload = parse<RequestTreePayload>( std::get<string>( msg.payload() ) );
       auto tree = parent.get( payload.handle );
-      if ( tree && !trees_view_.contains( payload.handle ) ) {
+      if ( tree && !contains( payload.handle ) ) {
         send_tree( payload.handle, tree.value() );
         add_to_view( payload.handle );
       }
@@ -539,13 +1600,41 @@ void Remote::process_incoming_message( IncomingMessage&& msg )
     case Opcode::REQUESTBLOB: {
       auto payload = parse<RequestBlobPayload>( std::get<string>( msg.payload() ) );
       auto blob = parent.get( payload.handle );
-      if ( blob && !blobs_view_.contains( payload.handle ) ) {
+      if ( payload.length ) {
+        // A range without data tells the requester to ask another holder
+        BlobRangePayload range { .handle = payload.handle, .offset = payload.offset };
+        if ( blob and payload.offset <= blob.value()->size()
+             and payload.length <= blob.value()->size() - payload.offset ) {
+          range.data = { blob.value()->data() + payload.offset, payload.length };
+        }
+        push_message( { Opcode::BLOBRANGE, serialize( range ) } );
+      } else if ( blob && !contains( payload.handle ) ) {
         send_blob( blob.value() );
         add_to_view( payload.handle );
       }
       break;
     }
 
+    case Opcode::BLOBRANGE: {
+      auto payload = parse<BlobRangePayload>( std::get<string>( msg.payload() ) );
+      if ( fetcher_ == nullptr ) {
+        break;
+      }
+      if ( payload.data.empty() ) {
+        fetcher_->refused( *this, payload.handle, payload.offset );
+        break;
+      }
+
+      auto blob = fetcher_->received( *this, payload.handle, payload.offset, payload.data );
+      if ( blob.has_value() ) {
+        auto handle = parent.create( make_shared<OwnedBlob>( std::move( *blob ) ) );
+        if ( handle::extract<Named>( handle ) != payload.handle ) {
+          throw runtime_error( "Fetched blob does not match its handle" );
+        }
+      }
+      break;
+    }
+
     case Opcode::REQUESTSHALLOWTREE: {
       auto payload = parse<RequestShallowTreePayload>( std::get<string>( msg.payload() ) );
       auto tree = parent.get_shallow( payload.handle );
@@ -557,12 +1646,23 @@ void Remote::process_incoming_message( IncomingMessage&& msg )
     }
 
     case Opcode::BLOBDATA: {
-      parent.create( msg.get_blob() );
+      auto handle = parent.create( msg.get_blob() );
+      if ( auto named = handle::extract<Named>( handle ); named.has_value() ) {
+        // The peer evidently holds what it sent
+        add_to_view( *named );
+        if ( fetcher_ ) {
+          fetcher_->arrived( *this, *named );
+        }
+      }
       break;
     }
 
     case Opcode::TREEDATA: {
-      parent.create( msg.get_tree() );
+      auto handle = parent.create( msg.get_tree() );
+      add_to_view( handle );
+      if ( fetcher_ ) {
+        fetcher_->arrived( *this, handle );
+      }
       break;
     }
 
@@ -638,49 +1738,17 @@ void Remote::process_incoming_message( IncomingMessage&& msg )
     case Opcode::ACCEPT_TRANSFER: {
       auto [todo, result, handles] = parse<AcceptTransferPayload>( std::get<string>( msg.payload() ) );
 
-      if ( proposed_proposals_.size() == 0 ) {
+      // Answers for the same todo come back in the order its proposals were made
+      auto pending = std::find_if( proposed_proposals_.begin(), proposed_proposals_.end(), [&]( const auto& p ) {
+        return p.todo == todo and not p.negotiated and not p.offered.empty();
+      } );
+      if ( pending == proposed_proposals_.end() ) {
         throw std::runtime_error( "Mismatch propose and accept" );
       }
 
-      VLOG( 1 ) << "Sending " << handles.size() << " objects for " << todo;
-      for ( const auto& h : handles ) {
-        VLOG( 2 ) << "Sending " << handle::fix( h );
-        std::visit( overload {
-                      [&]( Handle<Named> n ) { push_message( { Opcode::BLOBDATA, parent.get( n ).value() } ); },
-                      [&]( Handle<AnyTree> t ) { push_message( { Opcode::TREEDATA, parent.get( t ).value() } ); },
-                      []( Handle<Literal> ) {},
-                      []( Handle<Relation> ) {},
-                    },
-                    h.get() );
-      }
-
-      proposed_proposals_.pop();
-
-      if ( result ) {
-        push_message( OutgoingMessage::to_message( ResultPayload { .task = todo, .result = *result } ) );
-        add_to_view( todo );
-      } else {
-        push_message( OutgoingMessage::to_message( RunPayload { .task = todo } ) );
-      }
-
-      while ( !proposed_proposals_.empty() ) {
-        // Handle and Run/Result payload without corresponding proposal but should be started now
-        if ( proposed_proposals_.front().second->empty() ) {
-          auto pending_todo = proposed_proposals_.front().first.first;
-          auto pending_result = proposed_proposals_.front().first.second;
-          if ( pending_result ) {
-            push_message(
-              OutgoingMessage::to_message( ResultPayload { .task = pending_todo, .result = *pending_result } ) );
-            add_to_view( pending_todo );
-          } else {
-            push_message( OutgoingMessage::to_message( RunPayload { .task = pending_todo } ) );
-          }
-
-          proposed_proposals_.pop();
-        } else {
-          break;
-        }
-      }
+      VLOG( 1 ) << "Remote wants " << handles.size() << " objects for " << todo;
+      continue_negotiation( *pending, handles );
+      send_negotiated_todos();
       break;
     }
 
@@ -696,10 +1764,7 @@ void DataServer::run_after( function<void()> fn )
   if ( DataServer::latency == 0 ) {
     fn();
   } else {
-    threads_.push_back( thread( [fn]() {
-      this_thread::sleep_for( chrono::microseconds( latency ) );
-      fn();
-    } ) );
+    timers_.schedule( chrono::microseconds( latency ), move( fn ) );
   }
 }
 
@@ -778,6 +1843,10 @@ void Remote::clean_up()
   // Reset info
   info_.reset();
   dead_ = true;
+
+  if ( fetcher_ ) {
+    fetcher_->peer_died( *this );
+  }
 }
 
 Remote::~Remote()
@@ -789,8 +1858,28 @@ Remote::~Remote()
     handle.cancel();
   }
 
+  if ( view_slot_ ) {
+    views_->detach( *view_slot_ );
+  }
+
+  // A connection that died has been handed over already; one torn down alive (e.g. at shutdown) is dropped here
+  if ( fetcher_ and not dead_ ) {
+    fetcher_->peer_died( *this );
+  }
+
+  // The metrics of this connection are released along with it
+  telemetry_.reset();
+
   // Forward pending tasks
   if ( parent_.has_value() ) {
+    // Stolen jobs are still marked as running locally, so they have to be queued again explicitly
+    for ( auto task : stolen_ ) {
+      pending_result_.erase( task );
+      parent_->get().return_stolen( task );
+    }
+    for ( auto task : lookups_ ) {
+      parent_->get().missed( task );
+    }
     for ( auto it = pending_result_.begin(); it != pending_result_.end(); ) {
       auto task = pending_result_.extract( it++ );
       parent_->get().get( task.value() );
@@ -798,13 +1887,379 @@ Remote::~Remote()
   }
 }
 
-DataServer::~DataServer()
+void FetchCoordinator::add_peer( shared_ptr<Remote> peer )
+{
+  unique_lock lock( mutex_ );
+  erase_if( peers_, []( const auto& p ) { return p.expired(); } );
+  peers_.push_back( peer );
+}
+
+vector<shared_ptr<Remote>> FetchCoordinator::holders( Handle<Named> name, const Peers& excluded )
+{
+  vector<shared_ptr<Remote>> result;
+  for ( const auto& peer : peers_ ) {
+    auto locked = peer.lock();
+    if ( locked and not excluded.contains( locked->index_ ) and not locked->dead_ and locked->supports_ranges()
+         and locked->contains( name ) ) {
+      result.push_back( locked );
+    }
+  }
+  return result;
+}
+
+vector<shared_ptr<Remote>> FetchCoordinator::holders( Handle<AnyTree> name, const Peers& excluded )
+{
+  vector<shared_ptr<Remote>> result;
+  for ( const auto& peer : peers_ ) {
+    auto locked = peer.lock();
+    if ( locked and not excluded.contains( locked->index_ ) and not locked->dead_ and locked->contains( name ) ) {
+      result.push_back( locked );
+    }
+  }
+  return result;
+}
+
+shared_ptr<Remote> FetchCoordinator::least_busy( const vector<shared_ptr<Remote>>& peers )
+{
+  shared_ptr<Remote> best;
+  for ( const auto& peer : peers ) {
+    if ( not best or outstanding_[peer->index_] < outstanding_[best->index_] ) {
+      best = peer;
+    }
+  }
+  return best;
+}
+
+void FetchCoordinator::dispatch( Handle<Named> name, BlobFetch& fetch, Remote& peer )
+{
+  for ( auto& range : fetch.ranges ) {
+    if ( outstanding_[peer.index_] >= MAX_RANGES_PER_PEER ) {
+      return;
+    }
+    if ( range.done or range.peer.has_value() ) {
+      continue;
+    }
+
+    range.peer = peer.index_;
+    range.sent = Clock::now();
+    outstanding_[peer.index_]++;
+    peer.request_blob( name, range.offset, range.length );
+  }
+}
+
+void FetchCoordinator::fail( BlobFetch& fetch, size_t peer )
+{
+  fetch.failed.insert( peer );
+  for ( auto& range : fetch.ranges ) {
+    if ( range.peer == peer and not range.done ) {
+      range.peer.reset();
+      if ( outstanding_.contains( peer ) ) {
+        outstanding_[peer]--;
+      }
+    }
+  }
+}
+
+bool FetchCoordinator::reassign( Handle<Named> name, BlobFetch& fetch )
+{
+  auto peers = holders( name, fetch.failed );
+  for ( const auto& holder : peers ) {
+    dispatch( name, fetch, *holder );
+  }
+  return not peers.empty();
+}
+
+bool FetchCoordinator::reassign( Handle<AnyTree> name, TreeFetch& fetch )
+{
+  auto peers = holders( name, fetch.failed );
+  if ( peers.empty() ) {
+    return false;
+  }
+
+  auto holder = least_busy( peers );
+  fetch.peer = holder->index_;
+  fetch.sent = Clock::now();
+  outstanding_[holder->index_]++;
+  holder->request_tree( name );
+  return true;
+}
+
+void FetchCoordinator::drop( Handle<Named> name, BlobFetch& fetch )
+{
+  LOG( WARNING ) << "No peer left to fetch " << name << " from";
+  for ( const auto& range : fetch.ranges ) {
+    if ( range.peer.has_value() and not range.done ) {
+      outstanding_[*range.peer]--;
+    }
+  }
+}
+
+bool FetchCoordinator::fetch( Handle<Named> name, Remote& origin )
+{
+  if ( not enable or name.size() < 2 * RANGE_SIZE ) {
+    return false;
+  }
+
+  unique_lock lock( mutex_ );
+  if ( blobs_.contains( name ) ) {
+    return true;
+  }
+
+  // The peer the blob was requested from is assumed to hold it even if we have not learned so
+  auto peers = holders( name );
+  if ( origin.supports_ranges() and not origin.contains( name ) ) {
+    for ( const auto& peer : peers_ ) {
+      if ( auto locked = peer.lock(); locked.get() == &origin ) {
+        peers.push_back( locked );
+      }
+    }
+  }
+  if ( peers.size() < 2 ) {
+    return false;
+  }
+
+  VLOG( 1 ) << "Fetching " << name << " from " << peers.size() << " peers";
+  BlobFetch fetch { .data = OwnedMutBlob::allocate( name.size() ) };
+  for ( uint64_t offset = 0; offset < name.size(); offset += RANGE_SIZE ) {
+    fetch.ranges.push_back( { .offset = offset, .length = min<uint64_t>( RANGE_SIZE, name.size() - offset ) } );
+  }
+  fetch.remaining = fetch.ranges.size();
+
+  auto& pending = blobs_.emplace( name, std::move( fetch ) ).first->second;
+  for ( const auto& peer : peers ) {
+    dispatch( name, pending, *peer );
+  }
+  update_pending();
+  return true;
+}
+
+bool FetchCoordinator::fetch( Handle<AnyTree> name, Remote& origin )
+{
+  if ( not enable ) {
+    return false;
+  }
+
+  unique_lock lock( mutex_ );
+  if ( trees_.contains( name ) ) {
+    return true;
+  }
+
+  auto peers = holders( name );
+  if ( peers.empty() ) {
+    return false;
+  }
+
+  auto peer = least_busy( peers );
+  if ( peer.get() != &origin ) {
+    VLOG( 1 ) << "Fetching " << name << " from another holder";
+  }
+  trees_.emplace( name, TreeFetch { .peer = peer->index_, .sent = Clock::now() } );
+  outstanding_[peer->index_]++;
+  peer->request_tree( name );
+  update_pending();
+  return true;
+}
+
+optional<OwnedMutBlob> FetchCoordinator::received( Remote& from,
+                                                   Handle<Named> name,
+                                                   uint64_t offset,
+                                                   string_view data )
+{
+  unique_lock lock( mutex_ );
+  auto it = blobs_.find( name );
+  if ( it == blobs_.end() ) {
+    return {};
+  }
+
+  auto& fetch = it->second;
+  auto range = find_if( fetch.ranges.begin(), fetch.ranges.end(), [&]( const auto& r ) {
+    return r.offset == offset and r.peer == from.index_ and not r.done;
+  } );
+  if ( range == fetch.ranges.end() ) {
+    // The range was handed to another peer after this one was presumed dead or too slow
+    return {};
+  }
+  if ( data.size() != range->length ) {
+    LOG( WARNING ) << from.peer_name() << " sent " << data.size() << " bytes of " << name << " at " << offset
+                   << " instead of " << range->length;
+    fail( fetch, from.index_ );
+    if ( not reassign( name, fetch ) ) {
+      drop( name, fetch );
+      blobs_.erase( it );
+      update_pending();
+    }
+    return {};
+  }
+
+  memcpy( fetch.data.data() + offset, data.data(), data.size() );
+  range->done = true;
+  outstanding_[from.index_]--;
+
+  if ( --fetch.remaining == 0 ) {
+    auto blob = std::move( fetch.data );
+    blobs_.erase( it );
+    update_pending();
+    return blob;
+  }
+
+  dispatch( name, fetch, from );
+  return {};
+}
+
+void FetchCoordinator::refused( Remote& from, Handle<Named> name, uint64_t offset )
+{
+  unique_lock lock( mutex_ );
+  auto it = blobs_.find( name );
+  if ( it == blobs_.end() ) {
+    return;
+  }
+
+  VLOG( 1 ) << from.peer_name() << " can not send " << name << " at " << offset;
+  fail( it->second, from.index_ );
+  if ( not reassign( name, it->second ) ) {
+    drop( name, it->second );
+    blobs_.erase( it );
+    update_pending();
+  }
+}
+
+void FetchCoordinator::arrived( Remote& from, Handle<Named> name )
+{
+  unique_lock lock( mutex_ );
+  auto it = blobs_.find( name );
+  if ( it == blobs_.end() ) {
+    return;
+  }
+
+  // The whole blob was sent, so the ranges still outstanding are not needed anymore
+  for ( const auto& range : it->second.ranges ) {
+    if ( range.peer.has_value() and not range.done ) {
+      outstanding_[*range.peer]--;
+    }
+  }
+  blobs_.erase( it );
+  update_pending();
+  VLOG( 2 ) << "Fetch of " << name << " completed by " << from.peer_name();
+}
+
+void FetchCoordinator::arrived( Remote&, Handle<AnyTree> name )
+{
+  unique_lock lock( mutex_ );
+  auto it = trees_.find( name );
+  if ( it == trees_.end() ) {
+    return;
+  }
+
+  if ( it->second.peer.has_value() ) {
+    outstanding_[*it->second.peer]--;
+  }
+  trees_.erase( it );
+  update_pending();
+}
+
+void FetchCoordinator::peer_died( Remote& peer )
+{
+  const auto id = peer.index_;
+  unique_lock lock( mutex_ );
+  if ( not outstanding_.contains( id ) ) {
+    return;
+  }
+
+  for ( auto it = blobs_.begin(); it != blobs_.end(); ) {
+    auto& [name, fetch] = *it;
+    fail( fetch, id );
+    if ( not reassign( name, fetch ) ) {
+      drop( name, fetch );
+      blobs_.erase( it++ );
+      continue;
+    }
+    it++;
+  }
+
+  for ( auto it = trees_.begin(); it != trees_.end(); ) {
+    auto& [name, fetch] = *it;
+    if ( fetch.peer != id ) {
+      it++;
+      continue;
+    }
+
+    fetch.peer.reset();
+    fetch.failed.insert( id );
+    if ( not reassign( name, fetch ) ) {
+      LOG( WARNING ) << "No peer left to fetch " << name << " from";
+      trees_.erase( it++ );
+      continue;
+    }
+    it++;
+  }
+
+  outstanding_.erase( id );
+  update_pending();
+}
+
+void FetchCoordinator::expire()
 {
-  for ( auto& t : threads_ ) {
-    t.join();
+  if ( pending_ == 0 ) {
+    return;
+  }
+
+  unique_lock lock( mutex_ );
+  const auto now = Clock::now();
+  if ( now < next_expiry_ ) {
+    return;
+  }
+  next_expiry_ = now + chrono::milliseconds( timeout ) / 8;
+  const auto deadline = now - chrono::milliseconds( timeout );
+
+  for ( auto it = blobs_.begin(); it != blobs_.end(); ) {
+    auto& [name, fetch] = *it;
+    Peers late;
+    for ( const auto& range : fetch.ranges ) {
+      if ( range.peer.has_value() and not range.done and range.sent < deadline ) {
+        late.insert( *range.peer );
+      }
+    }
+    if ( late.empty() ) {
+      it++;
+      continue;
+    }
+
+    VLOG( 1 ) << "Fetch of " << name << " timed out on " << late.size() << " peers";
+    for ( auto peer : late ) {
+      fail( fetch, peer );
+    }
+    if ( not reassign( name, fetch ) ) {
+      drop( name, fetch );
+      blobs_.erase( it++ );
+      continue;
+    }
+    it++;
+  }
+
+  for ( auto it = trees_.begin(); it != trees_.end(); ) {
+    auto& [name, fetch] = *it;
+    if ( not fetch.peer.has_value() or fetch.sent >= deadline ) {
+      it++;
+      continue;
+    }
+
+    VLOG( 1 ) << "Fetch of " << name << " timed out";
+    outstanding_[*fetch.peer]--;
+    fetch.failed.insert( *fetch.peer );
+    fetch.peer.reset();
+    if ( not reassign( name, fetch ) ) {
+      LOG( WARNING ) << "No peer left to fetch " << name << " from";
+      trees_.erase( it++ );
+      continue;
+    }
+    it++;
   }
+
+  update_pending();
 }
 
+DataServer::~DataServer() {}
+
 template<typename Connection>
 void NetworkWorker<Connection>::process_outgoing_message( size_t remote_idx, MessagePayload&& payload )
 {
@@ -816,7 +2271,8 @@ void NetworkWorker<Connection>::process_outgoing_message( size_t remote_idx, Mes
       parent_->get().get( move( std::get<RunPayload>( payload ).task ) );
     }
   } else {
-    Remote& connection = *connections_.read()->at( remote_idx );
+    auto shared_connection = connections_.read()->at( remote_idx );
+    Remote& connection = *shared_connection;
 
     visit(
       overload {
@@ -825,6 +2281,7 @@ void NetworkWorker<Connection>::process_outgoing_message( size_t remote_idx, Mes
             VLOG( 2 ) << "Adding " << b.first << " to proposal " << remote_idx;
             connection.incomplete_proposal_->push_back( { b.first, b.second } );
             connection.proposal_size_ += b.second->size();
+            connection.tx_backlog_ += b.second->size();
             connection.add_to_view( b.first );
           }
         },
@@ -834,97 +2291,44 @@ void NetworkWorker<Connection>::process_outgoing_message( size_t remote_idx, Mes
             connection.incomplete_proposal_->push_back(
               { visit( []( auto h ) -> Handle<AnyDataType> { return h; }, t.first.get() ), t.second } );
             connection.proposal_size_ += t.second->size() * sizeof( Handle<Fix> );
+            connection.tx_backlog_ += t.second->size() * sizeof( Handle<Fix> );
             connection.add_to_view( t.first );
           }
         },
         [&]( RunPayload r ) {
           if ( connection.incomplete_proposal_->empty() && connection.proposed_proposals_.empty() ) {
             VLOG( 2 ) << "No proposal sending run directly";
-            connection.push_message( OutgoingMessage::to_message( r ) );
+            connection.send_todo( r.task, {} );
           } else if ( connection.incomplete_proposal_->empty() ) {
             // Payload should be sent after last proposed_proposals_ is sent
-            connection.proposed_proposals_.push( { pair<Handle<Relation>, optional<Handle<Object>>> { r.task, {} },
-                                                   make_unique<Remote::DataProposal>() } );
+            connection.proposed_proposals_.push_back( { .todo = r.task } );
           } else if ( connection.proposal_size_ < 1048576 && connection.proposed_proposals_.empty() ) {
             VLOG( 2 ) << "Proposal too small, sending directly " << remote_idx;
-            for ( const auto& [name, data] : *connection.incomplete_proposal_ ) {
-              auto h = name;
-              h.visit<void>( overload {
-                [&]( Handle<Named> x ) {
-                  connection.push_message( { Opcode::BLOBDATA, std::get<BlobData>( data ) } );
-                  connection.add_to_view( x );
-                },
-                [&]( Handle<AnyTree> x ) {
-                  connection.push_message( { Opcode::TREEDATA, std::get<TreeData>( data ) } );
-                  connection.add_to_view( x );
-                },
-                []( Handle<Literal> ) {},
-                []( Handle<Relation> ) {},
-              } );
-            }
-            connection.push_message( OutgoingMessage::to_message( r ) );
-            connection.incomplete_proposal_ = make_unique<Remote::DataProposal>();
-            connection.proposal_size_ = 0;
+            connection.send_proposal_directly( r.task, {} );
           } else {
-            ProposeTransferPayload payload;
-            payload.todo = r.task;
-            for ( const auto& [name, _] : *connection.incomplete_proposal_ ) {
-              payload.handles.push_back( name );
-            }
-            connection.push_message( OutgoingMessage::to_message( move( payload ) ) );
-            connection.proposed_proposals_.push( { pair<Handle<Relation>, optional<Handle<Object>>> { r.task, {} },
-                                                   std::move( connection.incomplete_proposal_ ) } );
-            connection.incomplete_proposal_ = make_unique<Remote::DataProposal>();
-            connection.proposal_size_ = 0;
+            connection.start_negotiation( r.task, {} );
           }
 
-          connection.pending_result_.insert( r.task );
+          {
+            unique_lock lock( connection.mutex_ );
+            connection.pending_result_.insert( r.task );
+          }
+          if ( parent_.has_value() ) {
+            parent_->get().started_remotely( r.task, shared_connection );
+          }
         },
         [&]( ResultPayload r ) {
           if ( connection.incomplete_proposal_->empty() && connection.proposed_proposals_.empty() ) {
             VLOG( 2 ) << "No proposal sending result directly";
-            connection.push_message( OutgoingMessage::to_message( r ) );
-            connection.add_to_view( r.task );
+            connection.send_todo( r.task, r.result );
           } else if ( connection.incomplete_proposal_->empty() ) {
             // Paylod should be send after last proposed_proposals_ is sent
-            connection.proposed_proposals_.push(
-              { pair<Handle<Relation>, optional<Handle<Object>>> { r.task, r.result },
-                make_unique<Remote::DataProposal>() } );
+            connection.proposed_proposals_.push_back( { .todo = r.task, .result = r.result } );
           } else if ( connection.proposal_size_ < 1048576 && connection.proposed_proposals_.empty() ) {
             // Proposal too small, sending directly
-            for ( const auto& [name, data] : *connection.incomplete_proposal_ ) {
-              auto h = name;
-              h.visit<void>( overload {
-                [&]( Handle<Named> x ) {
-                  connection.push_message( { Opcode::BLOBDATA, std::get<BlobData>( data ) } );
-                  connection.add_to_view( x );
-                },
-                [&]( Handle<AnyTree> x ) {
-                  connection.push_message( { Opcode::TREEDATA, std::get<TreeData>( data ) } );
-                  connection.add_to_view( x );
-                },
-                []( Handle<Literal> ) {},
-                []( Handle<Relation> ) {},
-              } );
-            }
-            connection.push_message( OutgoingMessage::to_message( r ) );
-            connection.add_to_view( r.task );
-            connection.incomplete_proposal_ = make_unique<Remote::DataProposal>();
-            connection.proposal_size_ = 0;
+            connection.send_proposal_directly( r.task, r.result );
           } else {
-            ProposeTransferPayload payload;
-            payload.todo = r.task;
-            payload.result = r.result;
-            for ( const auto& [name, _] : *connection.incomplete_proposal_ ) {
-              VLOG( 2 ) << "Proposing " << name << " for " << r.task;
-              payload.handles.push_back( name );
-            }
-            connection.push_message( OutgoingMessage::to_message( move( payload ) ) );
-            connection.proposed_proposals_.push(
-              { pair<Handle<Relation>, optional<Handle<Object>>> { r.task, r.result },
-                std::move( connection.incomplete_proposal_ ) } );
-            connection.incomplete_proposal_ = make_unique<Remote::DataProposal>();
-            connection.proposal_size_ = 0;
+            connection.start_negotiation( r.task, r.result );
           }
         },
         [&]( LoadBlobPayload payload ) {
@@ -946,93 +2350,172 @@ void NetworkWorker<Connection>::process_outgoing_message( size_t remote_idx, Mes
 }
 
 template<typename Connection>
-void NetworkWorker<Connection>::run_loop()
-{
-  categories_ = {
-    .server_new_socket = events_.add_category( "server - new socket" ),
-    .server_new_connection = events_.add_category( "server - new connection" ),
-    .client_new_connection = events_.add_category( "client - new connection" ),
-    .rx_read_data = events_.add_category( "rx - read" ),
-    .rx_parse_msg = events_.add_category( "rx - parse message" ),
-    .rx_process_msg = events_.add_category( "rx - process message" ),
-    .tx_serialize_msg = events_.add_category( "tx - serialize message" ),
-    .tx_write_data = events_.add_category( "tx - write" ),
-    .forward_msg = events_.add_category( "networkworker - forward msg to remote" ),
-    .data_server_ready = events_.add_category( "networkworker - forward msg to remote" ),
-  };
-  // When we have a new server socket, add it to the event loop
-  events_.add_rule(
-    categories_.server_new_socket,
-    [&] {
-      server_sockets_.push_back( *listening_sockets_.pop() );
-      TCPSocket& server_socket = server_sockets_.back();
-
-      VLOG( 1 ) << "Listening on " << server_socket.local_address();
-      // When someone connects to the socket, accept it and add the new connection to the event loop
-      events_.add_rule( categories_.server_new_connection, server_socket, Direction::In, [&] {
-        connections_.write()->emplace(
-          next_connection_id_,
-          make_unique<Connection>(
-            events_, categories_, server_socket.accept(), next_connection_id_, msg_q_, parent_ ) );
-
-        {
-          addresses_.write()->emplace( connections_.read()->at( next_connection_id_ )->peer_address().to_string(),
-                                       next_connection_id_ );
-        }
+void NetworkWorker<Connection>::add_connection( Shard& shard, size_t connection_id, TCPSocket&& socket )
+{
+  auto connection = make_shared<Connection>(
+    shard.events, shard.categories, std::move( socket ), connection_id, shard.msg_q, parent_ );
+  register_connection( shard, connection_id, connection, connection->peer_address().to_string() );
+}
 
-        VLOG( 1 ) << "New connection from "
-                  << connections_.read()->at( next_connection_id_ )->peer_address().to_string();
+template<typename Connection>
+void NetworkWorker<Connection>::add_local_connection( Shard& shard, LocalConnection&& local )
+{
+  if constexpr ( is_same_v<Connection, Remote> ) {
+    auto connection = make_shared<LocalRemote>(
+      shard.events, shard.categories, std::move( local.socket ), local.id, shard.msg_q, parent_ );
+    register_connection( shard, local.id, connection, local.peer );
+  }
+}
 
-        if ( parent_.has_value() ) {
-          parent_.value().get().add_worker( connections_.read()->at( next_connection_id_ ) );
-        }
+template<typename Connection>
+void NetworkWorker<Connection>::register_connection( Shard& shard,
+                                                     size_t connection_id,
+                                                     shared_ptr<Connection> connection,
+                                                     const string& peer )
+{
+  if ( not lanes_.empty() ) {
+    connection->lane_ = lanes_.at( connection_id % lanes_.size() ).get();
+  }
 
-        next_connection_id_++;
-      } );
-    },
-    [&] { return listening_sockets_.size_approx() > 0; } );
+  if constexpr ( is_same_v<Connection, Remote> ) {
+    connection->fetcher_ = &fetcher_;
+    fetcher_.add_peer( connection );
+  }
+  connection->views_ = views_;
+  connection->view_slot_ = views_->attach();
+  if ( not connection->view_slot_ ) {
+    LOG( WARNING ) << "No room to record what " << peer << " holds; all of its data will be sent";
+  }
+  connection->peer_name_ = peer;
+  connection->register_telemetry( peer );
 
-  // When we've made a new outgoing connection, add it to the event loop
-  events_.add_rule(
-    categories_.client_new_connection,
-    [&] {
-      TCPSocket client_socket = *connecting_sockets_.pop();
-      connections_.write()->emplace(
-        next_connection_id_,
-        make_unique<Connection>(
-          events_, categories_, std::move( client_socket ), next_connection_id_, msg_q_, parent_ ) );
+  shard.connections.push_back( connection );
+  connections_.write()->emplace( connection_id, connection );
+  addresses_.write()->emplace( peer, connection_id );
 
-      addresses_.write()->emplace( connections_.read()->at( next_connection_id_ )->peer_address().to_string(),
-                                   next_connection_id_ );
+  VLOG( 1 ) << "New connection with " << peer << " on network thread " << shard.index;
 
-      VLOG( 1 ) << "New connection to "
-                << connections_.read()->at( next_connection_id_ )->peer_address().to_string();
+  if ( parent_.has_value() ) {
+    parent_.value().get().add_worker( connection );
+  }
+}
 
-      if ( parent_.has_value() ) {
-        parent_.value().get().add_worker( connections_.read()->at( next_connection_id_ ) );
-      }
+template<typename Connection>
+void NetworkWorker<Connection>::run_lane( ProcessingLane& lane )
+{
+  try {
+    while ( true ) {
+      auto [connection, message] = lane.pop_or_wait();
+      connection->process_incoming_message( std::move( *message ) );
+      connection->in_flight_--;
+    }
+  } catch ( ChannelClosed& ) {
+    return;
+  }
+}
 
-      next_connection_id_++;
-    },
-    [&] { return connecting_sockets_.size_approx() > 0; } );
+template<typename Connection>
+void NetworkWorker<Connection>::run_loop( Shard& shard )
+{
+  auto& events = shard.events;
+  shard.categories = {
+    .server_new_socket = events.add_category( "server - new socket" ),
+    .server_new_connection = events.add_category( "server - new connection" ),
+    .client_new_connection = events.add_category( "client - new connection" ),
+    .rx_read_data = events.add_category( "rx - read" ),
+    .rx_parse_msg = events.add_category( "rx - parse message" ),
+    .rx_process_msg = events.add_category( "rx - process message" ),
+    .tx_serialize_msg = events.add_category( "tx - serialize message" ),
+    .tx_write_data = events.add_category( "tx - write" ),
+    .tx_flush_batch = events.add_category( "tx - flush batch" ),
+    .tx_status = events.add_category( "tx - status" ),
+    .tx_credit = events.add_category( "tx - credit" ),
+    .forward_msg = events.add_category( "networkworker - forward msg to remote" ),
+    .forward_reply = events.add_category( "networkworker - forward reply to remote" ),
+    .data_server_ready = events.add_category( "networkworker - forward msg to remote" ),
+  };
+
+  // Listening sockets are owned by the first network thread, which hands accepted sockets to the owning shard
+  if ( shard.index == 0 ) {
+    // When we have a new server socket, add it to the event loop
+    events.add_rule(
+      shard.categories.server_new_socket,
+      [&] {
+        server_sockets_.push_back( *listening_sockets_.pop() );
+        TCPSocket& server_socket = server_sockets_.back();
+
+        VLOG( 1 ) << "Listening on " << server_socket.local_address();
+        // When someone connects to the socket, accept it and pass it to the network thread that owns it
+        events.add_rule( shard.categories.server_new_connection, server_socket, Direction::In, [&] {
+          auto id = next_connection_id_++;
+          shard_of( id ).new_sockets.move_push( { id, server_socket.accept() } );
+        } );
+      },
+      [&] { return listening_sockets_.size_approx() > 0; } );
+
+    events.add_rule(
+      shard.categories.server_new_socket,
+      [&] {
+        local_server_sockets_.push_back( *listening_local_sockets_.pop() );
+        LocalStreamSocket& server_socket = local_server_sockets_.back();
+
+        events.add_rule( shard.categories.server_new_connection, server_socket, Direction::In, [&] {
+          auto socket = server_socket.accept();
+          if ( not LocalRemote::trusted( socket ) ) {
+            LOG( WARNING ) << "Refusing a local connection from a process of another user";
+            return;
+          }
+          auto id = next_connection_id_++;
+          shard_of( id ).new_local_sockets.move_push( { id, std::move( socket ), "local:" + to_string( id ) } );
+        } );
+      },
+      [&] { return listening_local_sockets_.size_approx() > 0; } );
+  }
 
-  // Forward msg_q_ to Remotes
-  events_.add_rule(
-    categories_.forward_msg,
+  // When a new connection is assigned to this shard, add it to the event loop
+  events.add_rule(
+    shard.categories.client_new_connection,
+    [&] {
+      auto [id, socket] = *shard.new_sockets.pop();
+      add_connection( shard, id, std::move( socket ) );
+    },
+    [&] { return shard.new_sockets.size_approx() > 0; } );
+
+  events.add_rule(
+    shard.categories.client_new_connection,
+    [&] { add_local_connection( shard, std::move( *shard.new_local_sockets.pop() ) ); },
+    [&] { return shard.new_local_sockets.size_approx() > 0; } );
+
+  // Forward msg_q to Remotes
+  auto& queued = global_metrics().gauge( "fix_outgoing_queue_messages",
+                                         "Messages waiting to be handed to a connection",
+                                         { { "shard", to_string( shard.index ) } } );
+  events.add_rule(
+    shard.categories.forward_msg,
     [&] {
+      queued.set( shard.msg_q.size_approx() );
       std::pair<uint32_t, MessagePayload> entry;
-      while ( msg_q_.try_dequeue( entry ) ) {
+      while ( shard.msg_q.try_dequeue( entry ) ) {
         process_outgoing_message( entry.first, move( entry.second ) );
       }
     },
-    [&] { return msg_q_.size_approx() > 0; } );
+    [&] { return shard.msg_q.size_approx() > 0; } );
 
   // TODO: kick
   while ( not should_exit_ ) {
-    std::erase_if( connections_.write().get(), []( const auto& item ) {
-      auto const& [_, value] = item;
-      return value->dead();
-    } );
-    events_.wait_next_event( 1 );
+    if ( any_of( shard.connections.begin(), shard.connections.end(), []( const auto& c ) { return c->dead(); } ) ) {
+      auto connections = connections_.write();
+      std::erase_if( shard.connections, [&]( const auto& connection ) {
+        if ( not connection->dead() ) {
+          return false;
+        }
+        connections->erase( connection->index_ );
+        return true;
+      } );
+    }
+    if ( shard.index == 0 ) {
+      fetcher_.expire();
+    }
+    events.wait_next_event( 1 );
   }
 }
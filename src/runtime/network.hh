@@ -2,12 +2,19 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <concurrentqueue/concurrentqueue.h>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <glog/logging.h>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <shared_mutex>
 #include <thread>
 #include <unordered_map>
@@ -15,16 +22,25 @@
 
 #include "channel.hh"
 #include "eventloop.hh"
+#include "exception.hh"
 #include "handle.hh"
 #include "interface.hh"
 #include "message.hh"
+#include "metrics.hh"
 #include "mutex.hh"
+#include "peer_table.hh"
 #include "ring_buffer.hh"
 #include "runtimestorage.hh"
 #include "socket.hh"
+#include "timer_wheel.hh"
 
 using MessageQueue = moodycamel::ConcurrentQueue<std::pair<uint32_t, MessagePayload>>;
 
+class Remote;
+
+// Incoming messages handed off from a network thread to a processing thread
+using ProcessingLane = Channel<std::pair<Remote*, std::unique_ptr<IncomingMessage>>>;
+
 struct EventCategories
 {
   size_t server_new_socket;
@@ -35,24 +51,49 @@ struct EventCategories
   size_t rx_process_msg;
   size_t tx_serialize_msg;
   size_t tx_write_data;
+  size_t tx_flush_batch;
+  size_t tx_status;
+  size_t tx_credit;
   size_t forward_msg;
+  size_t forward_reply;
   size_t data_server_ready;
 };
 
+/**
+ * What each peer of a node is known to hold, shared by all of the node's connections. Each connection is given a
+ * peer slot in the tables when it is registered and gives it back when it goes away.
+ */
+class RemoteViews
+{
+  std::mutex mutex_ {};
+  std::array<bool, PeerTable<Named>::MAX_PEERS> used_ {};
+
+public:
+  PeerTable<Named, AbslHash> blobs {};
+  PeerTable<AnyTree, AbslHash, handle::any_tree_equal> trees {};
+  PeerTable<Relation, AbslHash> relations {};
+
+  // A free slot, or nullopt if every slot is taken
+  std::optional<size_t> attach();
+  void detach( size_t slot );
+};
+
 template<typename Connection>
 class NetworkWorker;
 
-class Remote;
 class DataServer;
 
+class FetchCoordinator;
+
 class Remote : public IRuntime
 {
   friend class NetworkWorker<Remote>;
   friend class NetworkWorker<DataServer>;
+  friend class FetchCoordinator;
   static constexpr size_t STORAGE_SIZE = 65536;
 
 protected:
-  TCPSocket socket_;
+  Socket socket_;
 
   MessageQueue& msg_q_;
   std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent_;
@@ -62,13 +103,123 @@ protected:
   RingBuffer tx_data_ { STORAGE_SIZE };
 
   MessageParser rx_messages_ {};
+
+  // Outgoing messages are sent on two lanes. Control messages preempt bulk data, which is sent in chunks of
+  // CHUNK_SIZE bytes that interleave round-robin across the outstanding transfers. CREDIT messages go ahead of
+  // both, on a lane of their own.
+  enum class TxLane
+  {
+    None,
+    Credit,
+    Control,
+    Bulk,
+  };
+
+  struct BulkTransfer
+  {
+    uint32_t stream {};
+    uint64_t seq {};
+    std::optional<Handle<Fix>> handle {};
+    OutgoingMessage message;
+    size_t offset {};
+    std::chrono::steady_clock::time_point queued { std::chrono::steady_clock::now() };
+  };
+
   std::queue<OutgoingMessage> tx_messages_ {};
+  // When each message in tx_messages_ was queued
+  std::queue<std::chrono::steady_clock::time_point> tx_queued_ {};
+  std::deque<BulkTransfer> tx_bulk_ {};
+  TxLane tx_lane_ { TxLane::None };
+  size_t tx_chunk_length_ {};
+  uint64_t next_bulk_seq_ {};
+  uint32_t next_stream_ {};
+  std::atomic<bool> chunking_ { false };
+
+  // Data in tx_bulk_, by the sequence number of its transfer
+  absl::flat_hash_map<Handle<Fix>, uint64_t> tx_bulk_handles_ {};
+  // RUN and RESULT messages that must not overtake bulk data they depend on; each is sent once no transfer with a
+  // sequence number up to its own is outstanding
+  std::deque<std::pair<uint64_t, OutgoingMessage>> tx_fenced_ {};
+  // The fence last found for the data under a job's root or result, with next_bulk_seq_ at the time
+  absl::flat_hash_map<Handle<Fix>, std::pair<uint64_t, std::optional<uint64_t>>> tx_fences_ {};
+
+  // Small control messages are packed into one BATCH message if the peer supports it
+  MessageBatch tx_batch_ {};
+  std::chrono::steady_clock::time_point tx_batch_deadline_ {};
+  std::atomic<bool> batching_ { false };
+
+  // Flow control: every message sent uses up credit granted by the peer, which grants more as it drains what it
+  // has received. Once credit_ is negotiated, nothing but CREDIT is sent while either kind of credit is used up.
+  std::atomic<bool> credit_ { false };
+  std::atomic<int64_t> tx_credit_bytes_ { INITIAL_CREDIT_BYTES };
+  std::atomic<int64_t> tx_credit_messages_ { INITIAL_CREDIT_MESSAGES };
+  // Credit to be granted to the peer, and the CREDIT message being sent
+  uint64_t tx_grant_bytes_ {};
+  uint64_t tx_grant_messages_ {};
+  std::optional<OutgoingMessage> tx_grant_ {};
+  // Credit the peer has left, as far as we know
+  int64_t rx_credit_bytes_ { INITIAL_CREDIT_BYTES };
+  int64_t rx_credit_messages_ { INITIAL_CREDIT_MESSAGES };
+
+  // Bytes queued to be sent to the peer, including data waiting in a proposal
+  std::atomic<size_t> tx_backlog_ { 0 };
+
+  // Compression of bulk data, if both sides support it. Data is compressed only while compressing it is faster than
+  // sending the bytes it saves: the compression ratio and speed are averaged over the messages compressed so far,
+  // and the speed of the link over the periods in which the socket could not keep up. Messages that are sent
+  // uncompressed are still sampled every COMPRESS_PROBE_INTERVAL messages, in case the data or the link changes.
+  bool compressible_ { true };
+  std::atomic<bool> compressing_ { false };
+  std::mutex compress_mutex_ {};
+  double compress_ratio_ { 1 };
+  double compress_speed_ {};
+  size_t compress_samples_ {};
+  size_t compress_skipped_ {};
+  // Bytes per second the socket drains while it is the bottleneck, or 0 if it never has been
+  std::atomic<double> link_speed_ { 0 };
+  bool tx_busy_ { false };
+  std::chrono::steady_clock::time_point tx_busy_since_ {};
+  size_t tx_busy_bytes_ {};
+
+  // Metrics of this connection in global_metrics(), labelled with the address of the peer
+  struct Telemetry
+  {
+    static constexpr size_t OPCODES = static_cast<size_t>( Message::Opcode::COUNT );
+
+    std::array<Counter*, OPCODES> tx_messages {};
+    std::array<Counter*, OPCODES> tx_bytes {};
+    std::array<Counter*, OPCODES> rx_messages {};
+    std::array<Counter*, OPCODES> rx_bytes {};
+    Histogram* tx_latency {};
+    Histogram* rx_processing {};
+    Gauge* tx_queue {};
+    Gauge* tx_backlog {};
+    Gauge* rx_queue {};
+    Counter* proposed {};
+    Counter* accepted {};
+    Counter* compress_raw {};
+    Counter* compress_wire {};
+    Counter* compress_skipped {};
+    Histogram* compress_time {};
+    Gauge* link_speed {};
+
+    // The series above, released when the connection goes away so that a peer's metrics do not outlive it
+    std::vector<std::pair<std::string, Metrics::Labels>> series {};
+
+    explicit Telemetry( const std::string& peer );
+    ~Telemetry();
+
+    Telemetry( const Telemetry& ) = delete;
+    Telemetry& operator=( const Telemetry& ) = delete;
+  };
+  std::unique_ptr<Telemetry> telemetry_ {};
 
   std::string current_msg_header_ {};
   std::string_view current_msg_unsent_header_ {};
   std::string_view current_msg_unsent_payload_ {};
 
   std::vector<EventLoop::RuleHandle> installed_rules_ {};
+  std::string peer_name_ {};
 
   std::shared_mutex mutex_ {};
   std::condition_variable_any info_cv_ {};
@@ -77,25 +228,117 @@ protected:
 
   bool dead_ { false };
 
+  // Work stealing: peers which support it periodically exchange their load, and an idle peer asks a busy one to
+  // hand over some of its queued jobs
+  std::atomic<bool> stealing_ { false };
+  std::optional<Load> peer_load_ {};
+  std::atomic<bool> steal_pending_ { false };
+  std::chrono::steady_clock::time_point next_status_ {};
+  // Jobs handed over to the peer by a STEAL, which go back to the local queue if the peer goes away
+  absl::flat_hash_set<Handle<Relation>> stolen_ {};
+
+  // Jobs whose result the peer has been asked for as their owner in the result directory, which count as missed if
+  // the peer goes away
+  absl::flat_hash_set<Handle<Relation>> lookups_ {};
+
+  // Data requested from this connection may be fetched from other peers instead; ranges_ is set if the peer
+  // answers ranged REQUESTBLOBs
+  FetchCoordinator* fetcher_ {};
+  std::atomic<bool> ranges_ { false };
+
+  // Processing of incoming messages is handed to lane_ (if set) and runs off the network thread; replies pushed
+  // from there are queued in tx_replies_ until the network thread picks them up.
+  ProcessingLane* lane_ {};
+  std::atomic<size_t> in_flight_ { 0 };
+  std::thread::id network_thread_ { std::this_thread::get_id() };
+  std::mutex tx_replies_mutex_ {};
+  std::queue<std::pair<OutgoingMessage, std::optional<Handle<Fix>>>> tx_replies_ {};
+  std::atomic<size_t> tx_replies_size_ { 0 };
+
   using DataProposal = std::vector<std::pair<Handle<AnyDataType>, std::variant<BlobData, TreeData>>>;
   std::unique_ptr<DataProposal> incomplete_proposal_ { std::make_unique<DataProposal>() };
   size_t proposal_size_ {};
-  std::queue<std::pair<std::pair<Handle<Relation>, std::optional<Handle<Object>>>, std::unique_ptr<DataProposal>>>
-    proposed_proposals_ {};
 
-  FixTable<Named, std::atomic<bool>, AbslHash> blobs_view_ { 1000000 };
-  FixTable<AnyTree, std::atomic<bool>, AbslHash, handle::any_tree_equal> trees_view_ { 1000000 };
-  FixTable<Relation, std::atomic<bool>, AbslHash> relations_view_ { 100000 };
+  /**
+   * A proposal that is negotiated with the remote one level of the Merkle DAG at a time. Only the roots of the
+   * proposed data are offered first; the children of a tree are offered only once the remote wants the tree, so any
+   * subtree the remote already has is pruned without being listed.
+   *
+   * Every proposal is negotiated as soon as it is made, and the remote's answers are matched to it by its todo. Its
+   * data is sent once its negotiation ends, but the todos are sent in the order they were queued in, since a todo may
+   * need data which an earlier proposal carries.
+   */
+  struct PendingProposal
+  {
+    Handle<Relation> todo {};
+    std::optional<Handle<Object>> result {};
+    std::unique_ptr<DataProposal> proposal { std::make_unique<DataProposal>() };
+    absl::flat_hash_map<Handle<Fix>, size_t> index {};
+    std::vector<bool> offered {};
+    std::vector<bool> wanted {};
+    bool negotiated {};
+  };
+  std::deque<PendingProposal> proposed_proposals_ {};
+
+  // What the peer is known to hold, recorded under view_slot_ in the node-wide views_. A connection without a
+  // slot records nothing and claims the peer holds nothing.
+  std::shared_ptr<RemoteViews> views_ {};
+  std::optional<size_t> view_slot_ {};
 
 public:
+  // A batch is sent once it reaches BATCH_SIZE bytes, after batch_delay microseconds, or as soon as the
+  // connection is otherwise idle.
+  static constexpr size_t BATCH_SIZE = 16384;
+  inline static bool enable_batching = true;
+  inline static size_t batch_delay = 50;
+
+  // Payloads larger than CHUNK_SIZE are sent in chunks if the peer supports it
+  static constexpr size_t CHUNK_SIZE = 65536;
+  inline static bool enable_chunking = true;
+
+  // The load is advertised every status_interval microseconds
+  inline static bool enable_stealing = true;
+  inline static size_t status_interval = 10000;
+
+  // Every connection starts out with INITIAL_CREDIT_* of credit. A receiver keeps up to credit_bytes and
+  // credit_messages outstanding, topping them up once half has been used, but grants nothing while more than
+  // RX_BACKLOG received messages are waiting to be processed.
+  static constexpr int64_t INITIAL_CREDIT_BYTES = 4 << 20;
+  static constexpr int64_t INITIAL_CREDIT_MESSAGES = 1024;
+  static constexpr size_t RX_BACKLOG = 4096;
+  inline static bool enable_credit = true;
+  inline static size_t credit_bytes = 64 << 20;
+  inline static size_t credit_messages = 16384;
+
+  // How the result of a job run for a peer is sent back. Eager sends the data of the result along with it. Lazy
+  // sends only the handle, unless the result is smaller than eager_result_size bytes or the peer does not schedule
+  // jobs of its own; the data stays here, and the peer fetches it only if a job it places needs it, or if it is the
+  // result of Relater::execute. Peers the data is passed on to are told where it is by a HOLDER.
+  enum class ResultShipping
+  {
+    Eager,
+    Lazy,
+  };
+  inline static ResultShipping result_shipping = ResultShipping::Eager;
+  inline static size_t eager_result_size = 4096;
+
+  // BLOBDATA and TREEDATA of at least compress_min_size bytes are compressed at compress_level if the peer
+  // supports it and it pays off; data which does not shrink below compress_max_ratio of its size is sent as is.
+  static constexpr size_t COMPRESS_PROBE_INTERVAL = 64;
+  static constexpr double COMPRESS_EWMA_WEIGHT = 0.125;
+  inline static bool enable_compression = false;
+  inline static size_t compress_min_size = 16384;
+  inline static int compress_level = 1;
+  inline static double compress_max_ratio = 0.9;
+
   Remote( EventLoop& events,
           EventCategories categories,
-          TCPSocket socket,
+          Socket socket,
           size_t index,
           MessageQueue& msg_q,
           std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent );
 
-  Remote( TCPSocket socket,
+  Remote( Socket socket,
           size_t index,
           MessageQueue& msg_q,
           std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent );
@@ -111,6 +354,11 @@ public:
   void put_shallow( Handle<AnyTree> name, TreeData data ) override;
   void put( Handle<Relation> name, Handle<Object> data ) override;
   void put_force( Handle<Relation> name, Handle<Object> data ) override;
+  void cancel( Handle<Relation> name ) override;
+  bool lookup( Handle<Relation> name ) override;
+  void publish( Handle<Relation> name, Handle<Object> data ) override;
+  void holds( Handle<AnyDataType> data ) override;
+  std::optional<Load> get_load() override;
 
   bool contains( Handle<Named> handle ) override;
   bool contains( Handle<AnyTree> handle ) override;
@@ -120,14 +368,25 @@ public:
   bool contains( const std::string_view label ) override;
   std::optional<Info> get_info() override;
 
-  void push_message( OutgoingMessage&& msg );
+  // Requests data from this peer only
+  void request_blob( Handle<Named> name, uint64_t offset = 0, uint64_t length = 0 );
+  void request_tree( Handle<AnyTree> name );
+  bool supports_ranges() const { return ranges_; }
+
+  // @p data is the handle of the data carried by @p msg, if any
+  void push_message( OutgoingMessage&& msg, std::optional<Handle<Fix>> data = {} );
+
+  // Starts recording the metrics of this connection
+  void register_telemetry( const std::string& peer );
 
   Address local_address() { return socket_.local_address(); }
   Address peer_address() { return socket_.peer_address(); }
+  // How the peer is named in logs and metrics: its address, or its connection id on the local transport
+  const std::string& peer_name() const { return peer_name_; }
 
   std::unordered_set<Handle<Relation>> pending_result_ {};
 
-  bool dead() const { return dead_; }
+  bool dead() const { return dead_ and in_flight_ == 0; }
 
   bool erase_reply_to( Handle<Relation> handle )
   {
@@ -137,17 +396,57 @@ public:
   ~Remote();
 
 protected:
-  void load_tx_message();
+  virtual void read_from_socket() { rx_data_.push_from_fd( socket_ ); }
+  virtual void write_to_socket();
+  virtual void load_tx_message();
+  bool tx_ready() const;
+  bool has_credit() const;
+  void grant_credit();
+  virtual void enqueue_tx_message( OutgoingMessage&& msg );
+  virtual bool bulk( OutgoingMessage& msg );
+  void enqueue_bulk_message( OutgoingMessage&& msg, std::optional<Handle<Fix>> data );
+  void finish_tx_message();
+  std::optional<uint64_t> bulk_fence( Handle<Relation> todo, std::optional<Handle<Object>> result );
+  void release_fenced();
+  void flush_batch();
+  void send_status();
+  void grant( uint32_t count );
   void write_to_rb();
   void read_from_rb();
+  void sample_queues();
   void install_rule( EventLoop::RuleHandle rule ) { installed_rules_.push_back( rule ); }
   void process_incoming_message( IncomingMessage&& msg );
+  void dispatch_incoming_message( IncomingMessage&& msg );
+  // Whether a message has to be processed on the network thread even if the connection has a processing lane
+  static bool runs_on_network_thread( Message::Opcode opcode );
+  void forward_replies();
 
   void send_blob( BlobData blob );
   void send_tree( Handle<AnyTree>, TreeData tree );
 
+  template<FixType T>
+  void send_minrepo( Handle<T> root );
+
+  // Data that is not here was left on the peer which computed it (see ResultShipping::Lazy), so instead of being
+  // sent the remote is told which peer holds it, unless it holds it already
+  template<FixType T>
+  std::optional<HolderPayload> holder_notice( Handle<T> handle );
+
+  void send_todo( Handle<Relation> todo, std::optional<Handle<Object>> result );
+  void send_proposal_directly( Handle<Relation> todo, std::optional<Handle<Object>> result );
+  void start_negotiation( Handle<Relation> todo, std::optional<Handle<Object>> result );
+  void offer_roots( PendingProposal& pending );
+  void continue_negotiation( PendingProposal& pending, const std::vector<Handle<AnyDataType>>& wanted );
+  // Sends the todos at the front of the queue whose data has been sent
+  void send_negotiated_todos();
+
   void clean_up();
 
+  bool ship_result_data( Handle<Object> result );
+
+  bool should_compress();
+  OutgoingMessage compress( OutgoingMessage&& msg );
+
   bool loaded( Handle<Named> handle );
   bool loaded( Handle<AnyTree> handle );
   bool loaded( Handle<Relation> handle );
@@ -157,13 +456,148 @@ protected:
   void add_to_view( Handle<Relation> handle );
 };
 
+/**
+ * A connection to a peer on the same host over a Unix-domain socket. Blob and tree data of at least shared_size
+ * bytes does not go through the socket: it is written to a memfd whose descriptor is passed with a SHAREDDATA
+ * message, and the receiver maps the memfd instead of copying the data out of the socket.
+ */
+class LocalRemote : public Remote
+{
+  // At most this many descriptors are passed with one sendmsg()
+  static constexpr size_t MAX_FDS_PER_WRITE = 64;
+
+  // Descriptors of SHAREDDATA messages that have not been loaded for sending yet
+  std::queue<FileDescriptor> tx_shared_fds_ {};
+  // Descriptors of loaded SHAREDDATA messages, with the offset of the message header in the outgoing byte stream
+  std::deque<std::pair<size_t, FileDescriptor>> tx_fds_ {};
+
+protected:
+  void read_from_socket() override;
+  void write_to_socket() override;
+  void load_tx_message() override;
+  void enqueue_tx_message( OutgoingMessage&& msg ) override;
+  bool bulk( OutgoingMessage& msg ) override;
+
+public:
+  inline static bool enable = true;
+  inline static size_t shared_size = 65536;
+
+  LocalRemote( EventLoop& events,
+               EventCategories categories,
+               LocalStreamSocket socket,
+               size_t index,
+               MessageQueue& msg_q,
+               std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent );
+
+  // Name of the Unix-domain socket of a server listening on TCP port @p port
+  static std::string socket_name( uint16_t port ) { return "fix-" + std::to_string( port ); }
+
+  // Whether @p address is an address of this host
+  static bool is_local( const Address& address );
+
+  // Whether the process at the other end of @p socket runs as the same user as this one; anyone on the host can
+  // bind or connect to a name in the abstract namespace
+  static bool trusted( const LocalStreamSocket& socket );
+};
+
+/**
+ * Fetches data from every peer that holds it. A peer holds an object if it listed it in its INFO, proposed it, or
+ * sent it to us before. Large blobs are split into ranges of RANGE_SIZE bytes which are requested from all holders
+ * in parallel, at most MAX_RANGES_PER_PEER at a time from each; trees are requested from the holder with the fewest
+ * outstanding requests. Requests outstanding on a peer that goes away, refuses them, or does not answer within
+ * timeout milliseconds are sent to the remaining holders; once no holder is left the fetch is dropped, so the data
+ * can be requested again.
+ */
+class FetchCoordinator
+{
+  using Clock = std::chrono::steady_clock;
+  // Peers are known by their connection id, which is never reused, so a connection that goes away can not pass
+  // its state on to a later one
+  using Peers = absl::flat_hash_set<size_t>;
+
+  struct Range
+  {
+    uint64_t offset {};
+    uint64_t length {};
+    std::optional<size_t> peer {};
+    Clock::time_point sent {};
+    bool done {};
+  };
+
+  struct BlobFetch
+  {
+    OwnedMutBlob data;
+    std::vector<Range> ranges {};
+    size_t remaining {};
+    // Holders that went away, refused a range or let one time out
+    Peers failed {};
+  };
+
+  struct TreeFetch
+  {
+    std::optional<size_t> peer {};
+    Clock::time_point sent {};
+    Peers failed {};
+  };
+
+  std::mutex mutex_ {};
+  std::vector<std::weak_ptr<Remote>> peers_ {};
+  absl::flat_hash_map<Handle<Named>, BlobFetch, AbslHash> blobs_ {};
+  absl::flat_hash_map<Handle<AnyTree>, TreeFetch, AbslHash, handle::any_tree_equal> trees_ {};
+  absl::flat_hash_map<size_t, size_t> outstanding_ {};
+  // Number of fetches in progress, so that expire() only takes the lock if there are any
+  std::atomic<size_t> pending_ { 0 };
+  Clock::time_point next_expiry_ {};
+
+  std::vector<std::shared_ptr<Remote>> holders( Handle<Named> name, const Peers& excluded = {} );
+  std::vector<std::shared_ptr<Remote>> holders( Handle<AnyTree> name, const Peers& excluded = {} );
+  std::shared_ptr<Remote> least_busy( const std::vector<std::shared_ptr<Remote>>& peers );
+  void dispatch( Handle<Named> name, BlobFetch& fetch, Remote& peer );
+
+  // Takes the ranges of @p fetch back from @p peer and never asks it again
+  void fail( BlobFetch& fetch, size_t peer );
+  // Hands what is not requested from anyone to the holders left; false if there are none
+  bool reassign( Handle<Named> name, BlobFetch& fetch );
+  bool reassign( Handle<AnyTree> name, TreeFetch& fetch );
+  void drop( Handle<Named> name, BlobFetch& fetch );
+  void update_pending() { pending_ = blobs_.size() + trees_.size(); }
+
+public:
+  static constexpr size_t RANGE_SIZE = 1 << 20;
+  static constexpr size_t MAX_RANGES_PER_PEER = 4;
+  inline static bool enable = true;
+  inline static size_t timeout = 5000;
+
+  void add_peer( std::shared_ptr<Remote> peer );
+
+  // Starts fetching @p name, which was requested from @p origin. Returns false if @p origin should be asked alone.
+  bool fetch( Handle<Named> name, Remote& origin );
+  bool fetch( Handle<AnyTree> name, Remote& origin );
+
+  // @p from sent a range of @p name; returns the blob once all its ranges have arrived
+  std::optional<OwnedMutBlob> received( Remote& from, Handle<Named> name, uint64_t offset, std::string_view data );
+
+  // @p from can not send the range of @p name at @p offset
+  void refused( Remote& from, Handle<Named> name, uint64_t offset );
+
+  // @p from sent the whole of @p name
+  void arrived( Remote& from, Handle<Named> name );
+  void arrived( Remote& from, Handle<AnyTree> name );
+
+  // Hands the requests outstanding on @p peer to the other holders and forgets it
+  void peer_died( Remote& peer );
+
+  // Sends requests that have been outstanding for longer than timeout to other holders
+  void expire();
+};
+
 class DataServer : public Remote
 {
   friend class NetworkWorker<DataServer>;
 
 private:
   Channel<Handle<Named>> ready_ {};
-  std::list<std::thread> threads_ {};
+  TimerWheel timers_ {};
   void process_incoming_message( IncomingMessage&& msg );
   void run_after( std::function<void()> );
 
@@ -184,45 +618,119 @@ template<typename Connection>
 class NetworkWorker
 {
 private:
-  EventCategories categories_ {};
+  // A Unix-domain socket handed to the shard that owns connection @p id, named @p peer
+  struct LocalConnection
+  {
+    size_t id {};
+    LocalStreamSocket socket {};
+    std::string peer {};
+  };
+
+  /**
+   * A network thread together with the connections it owns. A connection is owned by shard (id % shards_.size())
+   * for its whole lifetime, so all socket I/O and tx state of a connection is touched by exactly one thread.
+   */
+  struct Shard
+  {
+    size_t index {};
+    EventCategories categories {};
+    EventLoop events {};
+    std::thread thread {};
+    MessageQueue msg_q {};
+    Channel<std::pair<size_t, TCPSocket>> new_sockets {};
+    Channel<LocalConnection> new_local_sockets {};
+    // The connections of this shard, touched only by its thread, so they can be checked for death without locking
+    // connections_
+    std::vector<std::shared_ptr<Connection>> connections {};
+  };
 
-  EventLoop events_ {};
-  std::thread network_thread_ {};
   std::atomic<bool> should_exit_ = false;
 
+  FetchCoordinator fetcher_ {};
+  std::shared_ptr<RemoteViews> views_ { std::make_shared<RemoteViews>() };
+
   Channel<TCPSocket> listening_sockets_ {};
-  Channel<TCPSocket> connecting_sockets_ {};
+  Channel<LocalStreamSocket> listening_local_sockets_ {};
 
-  std::size_t next_connection_id_ { 0 };
+  std::atomic<size_t> next_connection_id_ { 0 };
   SharedMutex<std::unordered_map<std::string, size_t>> addresses_ {};
   std::vector<TCPSocket> server_sockets_ {};
+  std::list<LocalStreamSocket> local_server_sockets_ {};
 
-  MessageQueue msg_q_ {};
+  std::vector<std::unique_ptr<Shard>> shards_ {};
+
+  std::vector<std::unique_ptr<ProcessingLane>> lanes_ {};
+  std::vector<std::thread> lane_threads_ {};
 
   std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent_;
 
-  void run_loop();
+  Shard& shard_of( size_t connection_id ) { return *shards_.at( connection_id % shards_.size() ); }
+
+  void run_loop( Shard& shard );
+  void run_lane( ProcessingLane& lane );
+  void add_connection( Shard& shard, size_t connection_id, TCPSocket&& socket );
+  void add_local_connection( Shard& shard, LocalConnection&& local );
+  void register_connection( Shard& shard,
+                            size_t connection_id,
+                            std::shared_ptr<Connection> connection,
+                            const std::string& peer );
   void process_outgoing_message( size_t remote_id, MessagePayload&& message );
 
 public:
   SharedMutex<std::unordered_map<size_t, std::shared_ptr<Connection>>> connections_ {};
 
-  NetworkWorker( std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent = {} )
+  /**
+   * @param network_threads     Number of network threads; connections are sharded across them.
+   * @param processing_threads  Number of threads that process incoming messages. If 0, incoming messages are
+   *                            processed on the network thread of the connection.
+   */
+  NetworkWorker( std::optional<std::reference_wrapper<MultiWorkerRuntime>> parent = {},
+                 size_t network_threads = 1,
+                 size_t processing_threads = 0 )
     : parent_( parent )
-  {}
+  {
+    for ( size_t i = 0; i < std::max( network_threads, size_t( 1 ) ); i++ ) {
+      shards_.push_back( std::make_unique<Shard>() );
+      shards_.back()->index = i;
+    }
+    for ( size_t i = 0; i < processing_threads; i++ ) {
+      lanes_.push_back( std::make_unique<ProcessingLane>() );
+    }
+  }
 
-  void start() { network_thread_ = std::thread( std::bind( &NetworkWorker::run_loop, this ) ); }
+  void start()
+  {
+    for ( auto& shard : shards_ ) {
+      shard->thread = std::thread( std::bind( &NetworkWorker::run_loop, this, std::ref( *shard ) ) );
+    }
+    for ( auto& lane : lanes_ ) {
+      lane_threads_.emplace_back( std::bind( &NetworkWorker::run_lane, this, std::ref( *lane ) ) );
+    }
+  }
 
-  void join() { network_thread_.join(); }
+  void join()
+  {
+    for ( auto& shard : shards_ ) {
+      shard->thread.join();
+    }
+  }
 
   void stop()
   {
     should_exit_ = true;
-    network_thread_.join();
+    join();
+    for ( auto& lane : lanes_ ) {
+      lane->close();
+    }
+    for ( auto& thread : lane_threads_ ) {
+      thread.join();
+    }
   }
 
   ~NetworkWorker() {}
 
+  size_t network_threads() const { return shards_.size(); }
+
   Address start_server( const Address& address )
   {
     TCPSocket socket;
@@ -232,15 +740,50 @@ public:
     socket.set_blocking( false );
     Address listen_address = socket.local_address();
     listening_sockets_.move_push( std::move( socket ) );
+
+    // Peers on the same host connect through a Unix-domain socket named after the TCP port
+    if constexpr ( std::is_same_v<Connection, Remote> ) {
+      if ( LocalRemote::enable ) {
+        try {
+          LocalStreamSocket local;
+          local.bind_abstract( LocalRemote::socket_name( listen_address.port() ) );
+          local.listen();
+          local.set_blocking( false );
+          listening_local_sockets_.move_push( std::move( local ) );
+        } catch ( const unix_error& e ) {
+          LOG( WARNING ) << "Local transport unavailable for " << listen_address.to_string() << ": " << e.what();
+        }
+      }
+    }
+
     return listen_address;
   }
 
   void connect( const Address& address )
   {
+    if constexpr ( std::is_same_v<Connection, Remote> ) {
+      if ( LocalRemote::enable and LocalRemote::is_local( address ) ) {
+        try {
+          LocalStreamSocket socket;
+          socket.connect_abstract( LocalRemote::socket_name( address.port() ) );
+          if ( not LocalRemote::trusted( socket ) ) {
+            throw unix_error( "local transport at " + address.to_string() + " is run by another user", EACCES );
+          }
+          VLOG( 1 ) << "Connecting to " << address.to_string() << " through local transport";
+          auto id = next_connection_id_++;
+          shard_of( id ).new_local_sockets.move_push( { id, std::move( socket ), address.to_string() } );
+          return;
+        } catch ( const unix_error& ) {
+          VLOG( 1 ) << "No local transport at " << address.to_string() << ", falling back to TCP";
+        }
+      }
+    }
+
     TCPSocket socket;
     VLOG( 1 ) << "Connecting to " << address.to_string();
     socket.connect( address );
-    connecting_sockets_.move_push( std::move( socket ) );
+    auto id = next_connection_id_++;
+    shard_of( id ).new_sockets.move_push( { id, std::move( socket ) } );
   }
 
   std::shared_ptr<IRuntime> get_remote( const Address& address )
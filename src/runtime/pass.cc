@@ -80,8 +80,12 @@ BasePass::BasePass( reference_wrapper<Relater> relater )
       if ( info.has_value() ) {
         remotes_.push_back( locked_remote );
       }
-      if ( info.has_value() and info->parallelism > 0 ) {
+      auto backlog = locked_remote->get_load().transform( []( auto load ) { return load.backlog; } ).value_or( 0 );
+      if ( info.has_value() and info->parallelism > 0 and backlog <= max_backlog ) {
         available_remotes_.push_back( locked_remote );
+      } else if ( info.has_value() and info->parallelism > 0 ) {
+        VLOG( 1 ) << "Not placing jobs on congested remote " << locked_remote.get() << " (" << backlog
+                  << " bytes queued)";
       }
     }
   }
@@ -63,6 +63,9 @@ private:
   std::vector<std::shared_ptr<IRuntime>> remotes_ {};
 
 public:
+  // Remotes with more than max_backlog bytes waiting to be sent to them are given no new jobs
+  inline static size_t max_backlog = 256 << 20;
+
   BasePass( std::reference_wrapper<Relater> relater );
 
   const std::unordered_map<std::shared_ptr<IRuntime>, size_t>& get_present_size( const Handle<Dependee> task ) const
@@ -1,4 +1,5 @@
 #include "relater.hh"
+#include "base16.hh"
 #include "executor.hh"
 #include "handle.hh"
 #include "handle_post.hh"
@@ -86,6 +87,11 @@ Handle<Value> Relater::execute( Handle<Relation> r )
     }
 
     top_level_done_.wait( false, std::memory_order_acquire );
+    // A result computed by a peer may have been sent without its data
+    handle::data( result ).transform( [&]( auto data ) {
+      fetch( data );
+      return true;
+    } );
     return result;
   } else {
     throw std::runtime_error( "Unexpected top level value." );
@@ -108,6 +114,10 @@ Handle<Value> Relater::direct_execute( Handle<Relation> r )
     }
 
     top_level_done_.wait( false, std::memory_order_acquire );
+    handle::data( result ).transform( [&]( auto data ) {
+      fetch( data );
+      return true;
+    } );
     return result;
   } else {
     throw std::runtime_error( "Unexpected top level value." );
@@ -127,6 +137,90 @@ bool Relater::finish_top_level( Handle<Relation> name, Handle<Object> value )
   return false;
 }
 
+template<FixType T>
+void Relater::fetch_one( Handle<T> handle )
+{
+  if ( contains( handle ) ) {
+    return;
+  }
+
+  fetching_++;
+  unique_lock lock( fetch_mutex_ );
+  while ( not contains( handle ) ) {
+    shared_ptr<IRuntime> holder;
+    for ( const auto& worker : remotes_.read().get() ) {
+      auto locked = worker.lock();
+      if ( locked and locked->contains( handle ) ) {
+        holder = locked;
+        break;
+      }
+    }
+    if ( not holder ) {
+      break;
+    }
+
+    // Asked again if it does not arrive in time, since the peer may have been busy or gone away
+    holder->get( handle );
+    fetch_cv_.wait_for( lock, chrono::seconds( 1 ), [&] { return contains( handle ); } );
+  }
+  fetching_--;
+
+  if ( not contains( handle ) ) {
+    if constexpr ( std::same_as<T, Named> ) {
+      throw HandleNotFound( handle );
+    } else {
+      throw HandleNotFound( handle::fix( handle ) );
+    }
+  }
+}
+
+void Relater::fetch( Handle<AnyDataType> data )
+{
+  data.visit<void>( overload {
+    []( Handle<Literal> ) {},
+    []( Handle<Relation> ) {},
+    [&]( Handle<Named> blob ) { fetch_one( blob ); },
+    [&]( Handle<AnyTree> tree ) {
+      fetch_one( tree );
+      for ( const auto& element : get( tree ).value()->span() ) {
+        handle::data( element ).transform( [&]( auto child ) {
+          fetch( child );
+          return true;
+        } );
+      }
+    },
+  } );
+}
+
+void Relater::arrived()
+{
+  if ( fetching_.load( memory_order_acquire ) > 0 ) {
+    lock_guard lock( fetch_mutex_ );
+    fetch_cv_.notify_all();
+  }
+}
+
+void Relater::held_by( Handle<AnyDataType> data, uint64_t node )
+{
+  holders_.write()->insert_or_assign( data, node );
+  for ( const auto& worker : remotes_.read().get() ) {
+    auto locked = worker.lock();
+    if ( locked and locked->get_info().transform( []( auto info ) { return info.node; } ) == node ) {
+      locked->holds( data );
+    }
+  }
+}
+
+optional<uint64_t> Relater::holder( Handle<AnyDataType> data )
+{
+  auto holders = holders_.read();
+  auto it = holders->find( data );
+  if ( it == holders->end() ) {
+    return {};
+  }
+  return it->second;
+}
+
 optional<BlobData> Relater::get( Handle<Named> name )
 {
   if ( storage_.contains( name ) ) {
@@ -216,6 +310,7 @@ void Relater::put( Handle<Named> name, BlobData data )
 {
   if ( !storage_.contains( name ) ) {
     storage_.create( data, name );
+    arrived();
     absl::flat_hash_set<Handle<Relation>> unblocked;
     {
       auto graph = graph_.write();
@@ -231,6 +326,7 @@ void Relater::put( Handle<AnyTree> name, TreeData data )
 {
   if ( !storage_.contains( name ) ) {
     storage_.create( data, name );
+    arrived();
     absl::flat_hash_set<Handle<Relation>> unblocked;
     {
       auto graph = graph_.write();
@@ -265,6 +361,10 @@ void Relater::put( Handle<Relation> name, Handle<Object> data )
 {
   if ( !storage_.contains( name ) ) {
     storage_.create( data, name );
+    scheduler_->forget( name );
+    scheduler_->resolved( name );
+    speculator_.finished( name, nullptr );
+    directory_.finished( name, data );
 
     if ( finish_top_level( name, data ) ) {
       return;
@@ -325,6 +425,45 @@ Handle<Fix> Relater::labeled( const std::string_view label )
   return storage_.labeled( label );
 }
 
+namespace {
+string snapshot_label( Handle<Fix> procedure )
+{
+  return "snapshot-" + base16::encode( procedure.content );
+}
+}
+
+optional<Handle<ValueTree>> Relater::snapshot( Handle<Fix> procedure )
+{
+  auto label = snapshot_label( procedure );
+  if ( not contains( label ) ) {
+    return {};
+  }
+
+  auto snapshot = handle::extract<ValueTree>( labeled( label ) );
+  if ( snapshot.has_value() ) {
+    get( Handle<AnyTree>( snapshot.value() ) );
+  }
+  return snapshot;
+}
+
+void Relater::keep_snapshot( Handle<Fix> procedure, Handle<ValueTree> snapshot )
+{
+  auto label = snapshot_label( procedure );
+  storage_.label( handle::fix( Handle<AnyTree>( snapshot ) ), label );
+
+  auto tree = storage_.get( Handle<AnyTree>( snapshot ) );
+  for ( const auto& element : tree->span() ) {
+    auto blob = handle::extract<Named>( element );
+    if ( blob.has_value() and not repository_.contains( blob.value() ) ) {
+      repository_.put( blob.value(), storage_.get( blob.value() ) );
+    }
+  }
+  if ( not repository_.contains( Handle<AnyTree>( snapshot ) ) ) {
+    repository_.put( Handle<AnyTree>( snapshot ), tree );
+  }
+  repository_.label( label, handle::fix( Handle<AnyTree>( snapshot ) ) );
+}
+
 Handle<AnyTreeRef> Relater::ref( Handle<AnyTree> tree )
 {
   if ( !storage_.contains( tree ) ) {
@@ -352,7 +491,26 @@ Handle<AnyTree> Relater::unref( Handle<AnyTreeRef> tree )
   return h.value();
 }
 
+vector<Handle<Relation>> Relater::steal( size_t count, function<size_t( Handle<Relation> )> cost )
+{
+  auto stolen = local_->steal( count, cost );
+  for ( auto job : stolen ) {
+    scheduler_->forget( job );
+  }
+  return stolen;
+}
+
+void Relater::cancel( Handle<Relation> name )
+{
+  scheduler_->forget( name );
+}
+
 std::optional<Handle<Object>> Relater::run( Handle<Relation> r )
 {
+  // The job continues once its owner has answered
+  if ( directory_.lookup( r ) ) {
+    return {};
+  }
+
   return scheduler_->schedule( r );
 }
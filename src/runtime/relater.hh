@@ -4,13 +4,18 @@
 #include "dependency_graph.hh"
 #include "handle.hh"
 #include "repository.hh"
+#include "result_directory.hh"
 #include "runner.hh"
 #include "runtimestorage.hh"
+#include "speculator.hh"
+#include <condition_variable>
+#include <unordered_map>
 #include <unordered_set>
 
 class Executor;
 class Scheduler;
 class LocalScheduler;
+class ContinuationScheduler;
 class SketchGraphScheduler;
 class BasePass;
 class RelaterTest;
@@ -19,9 +24,12 @@ class Relater : public MultiWorkerRuntime
 {
   friend class Executor;
   friend class LocalScheduler;
+  friend class ContinuationScheduler;
   friend class SketchGraphScheduler;
   friend class BasePass;
   friend class RelaterTest;
+  friend class Speculator;
+  friend class ResultDirectory;
 
 private:
   std::atomic<bool> top_level_done_ { true };
@@ -42,9 +50,27 @@ private:
   // tmp_trees_ holds Trees that only the first layers (the TreeData) are presenting in memory
   FixTable<AnyTree, TreeData, AbslHash, handle::any_tree_equal> tmp_trees_ { 10000 };
 
+  // Looks up the results of expensive jobs on other nodes
+  ResultDirectory directory_ { *this };
+
+  // Peers known to hold data that was left with them instead of being sent here (see Remote::ResultShipping)
+  SharedMutex<std::unordered_map<Handle<AnyDataType>, uint64_t>> holders_ {};
+
+  // Wakes up fetch() when data arrives, as long as it has callers
+  std::mutex fetch_mutex_ {};
+  std::condition_variable fetch_cv_ {};
+  std::atomic<size_t> fetching_ { 0 };
+  void arrived();
+
+  // Launches backups of straggling remote jobs; last, since its thread uses the members above
+  Speculator speculator_ { *this };
+
   template<FixType T>
   void get_from_repository( Handle<T> handle );
 
+  template<FixType T>
+  void fetch_one( Handle<T> handle );
+
 public:
   Relater( size_t threads = std::thread::hardware_concurrency(),
            std::optional<std::shared_ptr<Runner>> runner = {},
@@ -55,6 +81,9 @@ public:
   Handle<Value> execute( Handle<Relation> x );
   Handle<Value> direct_execute( Handle<Relation> x );
 
+  // Brings @p data and everything it refers to here from the peers holding it, and waits until it has arrived
+  void fetch( Handle<AnyDataType> data );
+
   virtual std::optional<BlobData> get( Handle<Named> name ) override;
   virtual std::optional<TreeData> get( Handle<AnyTree> name ) override;
   virtual std::optional<Handle<Object>> get( Handle<Relation> name ) override;
@@ -74,6 +103,11 @@ public:
   virtual bool contains( const std::string_view label ) override;
   virtual Handle<Fix> labeled( const std::string_view label ) override;
 
+  // The snapshot kept for @p procedure, in this process or in the repository
+  std::optional<Handle<ValueTree>> snapshot( Handle<Fix> procedure );
+  // Keeps @p snapshot of @p procedure, and writes it to the repository for later processes
+  void keep_snapshot( Handle<Fix> procedure, Handle<ValueTree> snapshot );
+
   Handle<AnyTreeRef> ref( Handle<AnyTree> );
   Handle<AnyTree> unref( Handle<AnyTreeRef> );
 
@@ -82,9 +116,31 @@ public:
     // Info to be exposed to other nodes
     auto info = local_->get_info();
     info->link_speed = 7.5;
+    info->node = directory_.node();
     return info;
   }
 
+  virtual std::optional<Load> get_load() override { return local_->get_load(); }
+  virtual std::vector<Handle<Relation>> steal( size_t count,
+                                               std::function<size_t( Handle<Relation> )> cost ) override;
+  virtual void return_stolen( Handle<Relation> name ) override { local_->return_stolen( name ); }
+  virtual void cancel( Handle<Relation> name ) override;
+
+  virtual void started_remotely( Handle<Relation> name, std::shared_ptr<IRuntime> worker ) override
+  {
+    speculator_.started( name, worker );
+  }
+  virtual void finished_remotely( Handle<Relation> name, IRuntime& worker ) override
+  {
+    speculator_.finished( name, &worker );
+  }
+  Speculator& get_speculator() { return speculator_; }
+
+  virtual void missed( Handle<Relation> name ) override { directory_.missed( name ); }
+  virtual void held_by( Handle<AnyDataType> data, uint64_t node ) override;
+  virtual std::optional<uint64_t> holder( Handle<AnyDataType> data ) override;
+  ResultDirectory& get_directory() { return directory_; }
+
   template<FixType T>
   void visit_full( Handle<T> handle,
                    std::function<void( Handle<AnyDataType> )> visitor,
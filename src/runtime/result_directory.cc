@@ -0,0 +1,217 @@
+#include <glog/logging.h>
+#include <random>
+
+#include "executor.hh"
+#include "overload.hh"
+#include "relater.hh"
+#include "result_directory.hh"
+
+using namespace std;
+
+namespace {
+
+// splitmix64 finalizer, to score (job, node) pairs independently of each other
+uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111eb;
+  return x ^ ( x >> 31 );
+}
+
+uint64_t random_node()
+{
+  random_device device;
+  uint64_t node = 0;
+  while ( node == 0 ) {
+    node = ( uint64_t( device() ) << 32 ) | device();
+  }
+  return node;
+}
+
+}
+
+ResultDirectory::ResultDirectory( Relater& relater )
+  : relater_( relater )
+  , node_( random_node() )
+  , lookups_metric_( global_metrics().counter( "fix_directory_lookups_total",
+                                               "Expensive jobs whose owner was asked for their result" ) )
+  , hits_metric_( global_metrics().counter( "fix_directory_hits_total", "Jobs whose result their owner knew" ) )
+  , published_metric_(
+      global_metrics().counter( "fix_directory_published_total", "Results published to the owner of their job" ) )
+{}
+
+shared_ptr<IRuntime> ResultDirectory::owner( Handle<Relation> job )
+{
+  // Rendezvous hashing: the owner is the node with the highest score for the job; nullptr stands for this node
+  const uint64_t key = hash<Handle<Relation>>()( job );
+  shared_ptr<IRuntime> best;
+  uint64_t best_score = mix( key ^ node_ );
+
+  for ( const auto& remote : relater_.remotes_.read().get() ) {
+    auto locked = remote.lock();
+    if ( not locked ) {
+      continue;
+    }
+    auto info = locked->get_info();
+    if ( not info.has_value() or info->parallelism == 0 or info->node == 0 ) {
+      continue;
+    }
+    const uint64_t score = mix( key ^ info->node );
+    if ( score > best_score ) {
+      best = locked;
+      best_score = score;
+    }
+  }
+
+  return best;
+}
+
+optional<Handle<Fix>> ResultDirectory::procedure( Handle<Relation> job )
+{
+  auto application = job.try_into<Think>()
+                       .transform( []( auto h ) { return h.template unwrap<Thunk>(); } )
+                       .and_then( []( auto h ) { return h.template try_into<Application>(); } );
+  if ( not application.has_value() or not relater_.contains( application->unwrap<ExpressionTree>() ) ) {
+    return {};
+  }
+
+  auto tree = relater_.get( application->unwrap<ExpressionTree>() ).value();
+  if ( tree->size() < 2 ) {
+    return {};
+  }
+
+  // The combination holds the procedure as it is evaluated: objects stay as they are, and a strict encode is
+  // replaced by the result of evaluating its thunk
+  return tree->at( 1 ).unwrap<Expression>().visit<optional<Handle<Fix>>>( overload {
+    [&]( Handle<Object> ) -> optional<Handle<Fix>> { return tree->at( 1 ); },
+    [&]( Handle<Encode> x ) -> optional<Handle<Fix>> {
+      auto strict = x.try_into<Strict>();
+      if ( not strict.has_value() ) {
+        return {};
+      }
+      Handle<Relation> eval = Handle<Eval>( Handle<Object>( strict->unwrap<Thunk>() ) );
+      if ( not relater_.contains( eval ) ) {
+        return {};
+      }
+      return Handle<Fix>( Handle<Expression>( relater_.get( eval ).value() ) );
+    },
+    []( Handle<ExpressionTree> ) -> optional<Handle<Fix>> { return {}; },
+  } );
+}
+
+void ResultDirectory::ran( Handle<Fix> procedure, chrono::microseconds duration )
+{
+  if ( not enable ) {
+    return;
+  }
+
+  unique_lock lock( mutex_ );
+  auto [it, inserted] = costs_.try_emplace( procedure, duration.count() );
+  if ( not inserted ) {
+    it->second += COST_EWMA_WEIGHT * ( duration.count() - it->second );
+  }
+}
+
+bool ResultDirectory::lookup( Handle<Relation> job )
+{
+  if ( not enable ) {
+    return false;
+  }
+
+  // Only applications run procedures; everything else is cheap to redo
+  const bool application = job.visit<bool>( overload {
+    []( Handle<Think> s ) {
+      return s.unwrap<Thunk>().visit<bool>(
+        overload { []( Handle<Application> ) { return true; }, []( auto ) { return false; } } );
+    },
+    []( Handle<Eval> ) { return false; },
+  } );
+  if ( not application ) {
+    return false;
+  }
+
+  auto procedure = this->procedure( job );
+  {
+    unique_lock lock( mutex_ );
+    if ( missed_.contains( job ) ) {
+      return false;
+    }
+    if ( asked_.contains( job ) ) {
+      return true;
+    }
+    auto it = procedure.has_value() ? costs_.find( *procedure ) : costs_.end();
+    if ( it != costs_.end() and it->second < min_cost ) {
+      return false;
+    }
+  }
+
+  auto peer = owner( job );
+  if ( not peer ) {
+    return false;
+  }
+
+  {
+    unique_lock lock( mutex_ );
+    if ( not asked_.insert( job ).second ) {
+      return true;
+    }
+  }
+
+  if ( not peer->lookup( job ) ) {
+    unique_lock lock( mutex_ );
+    asked_.erase( job );
+    return false;
+  }
+
+  VLOG( 1 ) << "Looking up " << job << " on " << peer.get();
+  lookups_++;
+  lookups_metric_.add();
+  return true;
+}
+
+void ResultDirectory::missed( Handle<Relation> job )
+{
+  {
+    unique_lock lock( mutex_ );
+    if ( not asked_.erase( job ) ) {
+      return;
+    }
+    missed_.insert( job );
+  }
+
+  if ( relater_.contains( job ) ) {
+    unique_lock lock( mutex_ );
+    missed_.erase( job );
+    return;
+  }
+
+  VLOG( 1 ) << "Owner does not know " << job << ", running it here";
+  dynamic_pointer_cast<Executor>( relater_.get_local() )->retry( job );
+}
+
+void ResultDirectory::finished( Handle<Relation> job, Handle<Object> result )
+{
+  if ( not enable ) {
+    return;
+  }
+
+  bool publish = false;
+  {
+    unique_lock lock( mutex_ );
+    if ( asked_.erase( job ) ) {
+      hits_++;
+      hits_metric_.add();
+    }
+    publish = missed_.erase( job );
+  }
+
+  if ( publish ) {
+    if ( auto peer = owner( job ); peer ) {
+      VLOG( 1 ) << "Publishing " << job << " to " << peer.get();
+      peer->publish( job, result );
+      published_++;
+      published_metric_.add();
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "handle.hh"
+#include "interface.hh"
+#include "metrics.hh"
+
+class Relater;
+
+/**
+ * A cluster-wide memo of the results of expensive Relations. Each Relation is owned by one node, chosen by
+ * rendezvous hashing over the node ids of this node and its peers, so every node agrees on the owner without any
+ * coordination and only the Relations of a departed node move when the cluster changes.
+ *
+ * Before an expensive Relation is started, its owner is asked for the result. If the owner does not know it, the
+ * Relation runs here and its result is published to the owner. A Relation is expensive if applying its procedure
+ * has taken at least min_cost microseconds here, or if its procedure has not been applied here yet. Costs are kept
+ * by the procedure as it is applied, i.e. after any encode that produces it has been evaluated.
+ */
+class ResultDirectory
+{
+  Relater& relater_;
+  const uint64_t node_;
+
+  std::mutex mutex_ {};
+  // Average time (in microseconds) of applying each procedure here, by the second entry of its combinations
+  absl::flat_hash_map<Handle<Fix>, double> costs_ {};
+  // Relations waiting for an answer from their owner
+  absl::flat_hash_set<Handle<Relation>> asked_ {};
+  // Relations whose owner did not know the result, which run here and are published once they finish
+  absl::flat_hash_set<Handle<Relation>> missed_ {};
+
+  std::atomic<size_t> lookups_ { 0 };
+  std::atomic<size_t> hits_ { 0 };
+  std::atomic<size_t> published_ { 0 };
+  // The same counts, summed over every ResultDirectory of the process, in global_metrics()
+  Counter& lookups_metric_;
+  Counter& hits_metric_;
+  Counter& published_metric_;
+
+  std::shared_ptr<IRuntime> owner( Handle<Relation> job );
+
+  // The procedure that @p job applies, as passed to ran(), or nothing if it is not known yet
+  std::optional<Handle<Fix>> procedure( Handle<Relation> job );
+
+public:
+  inline static bool enable = false;
+  inline static size_t min_cost = 100000;
+  static constexpr double COST_EWMA_WEIGHT = 0.25;
+
+  ResultDirectory( Relater& relater );
+
+  // The id of this node, advertised to its peers
+  uint64_t node() const { return node_; }
+
+  // Whether this node owns @p job
+  bool owns( Handle<Relation> job ) { return owner( job ) == nullptr; }
+
+  // Applying @p procedure, the second entry of a combination, here took @p duration
+  void ran( Handle<Fix> procedure, std::chrono::microseconds duration );
+
+  // Whether @p job has to wait for its owner to be asked, in which case the owner has been asked
+  bool lookup( Handle<Relation> job );
+
+  // The owner of @p job did not know its result
+  void missed( Handle<Relation> job );
+
+  // The result of @p job is known
+  void finished( Handle<Relation> job, Handle<Object> result );
+
+  size_t lookups() const { return lookups_; }
+  size_t hits() const { return hits_; }
+  size_t published() const { return published_; }
+};
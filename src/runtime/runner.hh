@@ -1,4 +1,5 @@
 #pragma once
+#include "base16.hh"
 #include "elfloader.hh"
 #include "fixpointapi.hh"
 #include "handle.hh"
@@ -9,16 +10,37 @@
 #include "program.hh"
 #include "resource_limits.hh"
 #include "runtimestorage.hh"
+#include "snapshot.hh"
 #include "types.hh"
 
 #include <absl/container/flat_hash_map.h>
+#include <algorithm>
 #include <glog/logging.h>
+#include <vector>
 
 class Runner
 {
 public:
   virtual void init() {};
   virtual Handle<Object> apply( Handle<ObjectTree> handle, TreeData combination ) = 0;
+
+  // Whether the procedure of @p combination can apply many combinations in one invocation
+  virtual bool batches( TreeData ) { return false; }
+
+  // Applies combinations which share a procedure, returning their results in the same order
+  virtual std::vector<Handle<Object>> apply_batch( const std::vector<Handle<ObjectTree>>& handles,
+                                                   const std::vector<TreeData>& combinations )
+  {
+    std::vector<Handle<Object>> results;
+    for ( size_t i = 0; i < handles.size(); i++ ) {
+      results.push_back( apply( handles[i], combinations[i] ) );
+    }
+    return results;
+  }
+
+  // Where the Runner finds and keeps the snapshots of the procedures it links
+  virtual void set_snapshot_store( SnapshotStore ) {}
+
   virtual ~Runner() {}
 };
 
@@ -39,11 +61,72 @@ public:
   }
 
   virtual Handle<Object> apply( Handle<ObjectTree> handle, TreeData combination ) override
+  {
+    auto rlimits = combination->at( 0 );
+    auto program = link( combination );
+
+    VLOG( 2 ) << handle << " rlimits are " << rlimits;
+    resource_limits::available_bytes = requested_bytes( rlimits );
+
+    VLOG( 1 ) << handle << " requested " << resource_limits::available_bytes << " bytes";
+    fixpoint::Invocation invocation;
+    auto result = program->execute( handle );
+    VLOG( 2 ) << handle << " -> " << result;
+    return result;
+  }
+
+  virtual bool batches( TreeData combination ) override { return link( combination )->batches(); }
+
+  virtual std::vector<Handle<Object>> apply_batch( const std::vector<Handle<ObjectTree>>& handles,
+                                                   const std::vector<TreeData>& combinations ) override
+  {
+    auto program = link( combinations.front() );
+
+    // One instance applies every combination, so it gets the most memory any of them asked for
+    resource_limits::available_bytes = 0;
+    auto table = OwnedMutTree::allocate( handles.size() );
+    for ( size_t i = 0; i < handles.size(); i++ ) {
+      resource_limits::available_bytes
+        = std::max( resource_limits::available_bytes, requested_bytes( combinations[i]->at( 0 ) ) );
+      table[i] = handles[i];
+    }
+
+    auto created = fixpoint::storage->create( std::make_shared<OwnedTree>( std::move( table ) ) );
+    auto batch = created.visit<Handle<ObjectTree>>( overload {
+      []( Handle<ExpressionTree> ) -> Handle<ObjectTree> { throw std::runtime_error( "Invalid batch." ); },
+      []( auto x ) { return Handle<ObjectTree>( x ); },
+    } );
+
+    VLOG( 1 ) << "applying " << handles.size() << " combinations as " << batch;
+    fixpoint::Invocation invocation;
+    auto result = program->execute_batch( batch );
+    auto tree = result.try_into<ObjectTree>()
+                  .transform( []( auto h ) { return Handle<AnyTree>( h ); } )
+                  .or_else( [&]() -> std::optional<Handle<AnyTree>> { return handle::extract<ValueTree>( result ); } );
+    if ( not tree.has_value() ) {
+      throw std::runtime_error( "Batch result is not an object/value tree." );
+    }
+
+    auto data = fixpoint::storage->get( tree.value() );
+    if ( data->size() != handles.size() ) {
+      throw std::runtime_error( "Batch result has the wrong number of elements." );
+    }
+
+    std::vector<Handle<Object>> results;
+    for ( const auto& element : data->span() ) {
+      results.push_back( element.unwrap<Expression>().unwrap<Object>() );
+    }
+    return results;
+  }
+
+  virtual void set_snapshot_store( SnapshotStore store ) override { store_ = std::move( store ); }
+
+private:
+  // The linked program of the procedure of @p combination, following curried procedures down to the tag
+  std::shared_ptr<Program> link( TreeData combination )
   {
     std::optional<Handle<AnyTree>> next_level {};
     std::optional<Handle<Blob>> function_name {};
-
-    auto rlimits = combination->at( 0 );
     std::optional<std::shared_ptr<Program>> program;
 
     while ( true ) {
@@ -119,9 +202,14 @@ public:
 
       bool program_linked = programs_.contains( function_tag );
       if ( !program_linked ) {
+        // Profilers name the procedure's functions after the start of its handle
+        auto name = base16::encode( function_tag.content ).substr( 0, 16 );
         auto program = function_name.value().visit<std::shared_ptr<Program>>(
-          overload { [&]( Handle<Literal> f ) { return link_program( f.view() ); },
-                     [&]( Handle<Named> f ) { return link_program( fixpoint::storage->get( f )->span() ); } } );
+          overload { [&]( Handle<Literal> f ) { return link_program( f.view(), name ); },
+                     [&]( Handle<Named> f ) { return link_program( fixpoint::storage->get( f )->span(), name ); } } );
+        if ( Snapshot::enable ) {
+          prepare( function_tag, *program );
+        }
         programs_.insert( function_tag, program );
       }
 
@@ -130,7 +218,39 @@ public:
       fixpoint::current_procedure = combination->at( 1 );
     }
 
-    VLOG( 2 ) << handle << " rlimits are " << rlimits;
+    return program.value();
+  }
+
+  // Starts the instances of @p program from a snapshot, reusing the one kept for @p procedure if there is one
+  // Any failure leaves the program to initialize every instance on its own
+  void prepare( Handle<Fix> procedure, Program& program )
+  {
+    try {
+      if ( auto kept = store_.find ? store_.find( procedure ) : std::nullopt; kept.has_value() ) {
+        if ( auto snapshot = Snapshot::from_tree( *fixpoint::storage, kept.value(), program.code_size() ) ) {
+          VLOG( 1 ) << procedure << " starts from kept snapshot " << kept.value();
+          program.use( snapshot );
+          return;
+        }
+      }
+
+      auto snapshot = program.take_snapshot();
+      if ( not snapshot ) {
+        VLOG( 1 ) << procedure << " cannot be captured in a snapshot";
+        return;
+      }
+
+      program.use( snapshot );
+      if ( snapshot->portable() and store_.keep ) {
+        store_.keep( procedure, snapshot->to_tree( *fixpoint::storage ) );
+      }
+    } catch ( std::exception& e ) {
+      LOG( WARNING ) << "could not start " << procedure << " from a snapshot: " << e.what();
+    }
+  }
+
+  static uint64_t requested_bytes( Handle<Fix> rlimits )
+  {
     // invalid resource limits are interpreted as 0
     auto limits = rlimits.unwrap<Expression>()
                     .unwrap<Object>()
@@ -138,26 +258,20 @@ public:
                     .and_then( [&]( auto x ) { return x.template try_into<ValueTree>(); } )
                     .transform( [&]( auto x ) { return fixpoint::storage->get( x ); } );
 
-    resource_limits::available_bytes
-      = limits
-          .and_then( [&]( auto x ) {
-            return handle::extract<Literal>(
-              x->at( 0 ).template unwrap<Expression>().template unwrap<Object>().template unwrap<Value>() );
-          } )
-          .transform( [&]( auto x ) { return uint64_t( x ); } )
-          .value_or( 0 );
-
-    VLOG( 1 ) << handle << " requested " << resource_limits::available_bytes << " bytes";
-    auto result = program.value()->execute( handle );
-    VLOG( 2 ) << handle << " -> " << result;
-    return result;
+    return limits
+      .and_then( [&]( auto x ) {
+        return handle::extract<Literal>(
+          x->at( 0 ).template unwrap<Expression>().template unwrap<Object>().template unwrap<Value>() );
+      } )
+      .transform( [&]( auto x ) { return uint64_t( x ); } )
+      .value_or( 0 );
   }
 
-private:
   FixTable<Fix, std::shared_ptr<Program>> programs_ { 100000 };
   Handle<Fix> trusted_compiler_;
   Handle<Fix> trusted_compiler_fixed_point_;
   const Handle<Fix> runnable_ { Handle<Literal>( "Runnable" ).into<Fix>() };
+  SnapshotStore store_ {};
 };
 
 /**
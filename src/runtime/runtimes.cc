@@ -78,10 +78,12 @@ void DataServerRT::join()
 shared_ptr<Server> Server::init( const Address& address,
                                  shared_ptr<Scheduler> scheduler,
                                  vector<Address> peer_servers,
-                                 optional<size_t> threads )
+                                 optional<size_t> threads,
+                                 size_t network_threads,
+                                 size_t processing_threads )
 {
   auto runtime = std::make_shared<Server>( scheduler, threads );
-  runtime->network_worker_.emplace( runtime->relater_ );
+  runtime->network_worker_.emplace( runtime->relater_, network_threads, processing_threads );
   runtime->network_worker_->start();
   runtime->network_worker_->start_server( address );
 
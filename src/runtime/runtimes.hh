@@ -70,7 +70,9 @@ public:
   static std::shared_ptr<Server> init( const Address& address,
                                        std::shared_ptr<Scheduler> scheduler,
                                        const std::vector<Address> peer_servers = {},
-                                       std::optional<std::size_t> threads = {} );
+                                       std::optional<std::size_t> threads = {},
+                                       std::size_t network_threads = 1,
+                                       std::size_t processing_threads = 0 );
   void join();
   ~Server();
 };
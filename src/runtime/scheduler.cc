@@ -6,12 +6,164 @@
 #include "pass.hh"
 #include "relater.hh"
 #include "types.hh"
+#include <algorithm>
 #include <memory>
 #include <optional>
 #include <stdexcept>
 
 using namespace std;
 
+namespace {
+
+optional<Handle<Fix>> as_fix( FixRuntime::Result<Value> x )
+{
+  return x.transform( []( auto h ) { return Handle<Fix>( Handle<Expression>( Handle<Object>( h ) ) ); } );
+}
+
+optional<Handle<Fix>> as_fix( FixRuntime::Result<Object> x )
+{
+  return x.transform( []( auto h ) { return Handle<Fix>( Handle<Expression>( h ) ); } );
+}
+
+// Evaluates each child of @p data which @p progress has not resolved yet, and records the results of the ones
+// which are ready. Returns whether every child is resolved.
+template<typename F>
+bool resolve( MapMemo::Progress& progress, const TreeData& data, F eval )
+{
+  for ( size_t i = 0; i < data->size() and progress.outstanding > 0; i++ ) {
+    if ( progress.resolved[i] ) {
+      continue;
+    }
+
+    auto result = eval( data->at( i ) );
+    if ( result ) {
+      progress.results[i] = *result;
+      progress.resolved[i] = true;
+      progress.outstanding--;
+      progress.changed |= *result != data->at( i );
+    }
+  }
+  return progress.outstanding == 0;
+}
+
+}
+
+MapMemo::Progress MapMemo::take( Handle<AnyTree> tree, Mode mode, size_t size )
+{
+  {
+    unique_lock lock( mutex_ );
+    auto& records = records_[static_cast<size_t>( mode )];
+    if ( auto it = records.find( tree ); it != records.end() ) {
+      auto progress = std::move( it->second );
+      records.erase( it );
+      unlist( progress.job, mode, tree );
+      return progress;
+    }
+  }
+
+  return { .results = OwnedMutTree::allocate( size ), .resolved = vector<bool>( size ), .outstanding = size };
+}
+
+void MapMemo::keep( Handle<AnyTree> tree, Mode mode, Progress&& progress, optional<Handle<Relation>> job )
+{
+  unique_lock lock( mutex_ );
+  auto& records = records_[static_cast<size_t>( mode )];
+  auto it = records.find( tree );
+  if ( it != records.end() and progress.outstanding >= it->second.outstanding ) {
+    return;
+  }
+
+  progress.job = job;
+  if ( it == records.end() ) {
+    records.emplace( tree, std::move( progress ) );
+    if ( job.has_value() ) {
+      jobs_[*job].push_back( { mode, tree } );
+    }
+    return;
+  }
+
+  if ( it->second.job != job ) {
+    unlist( it->second.job, mode, tree );
+    if ( job.has_value() ) {
+      jobs_[*job].push_back( { mode, tree } );
+    }
+  }
+  it->second = std::move( progress );
+}
+
+void MapMemo::unlist( optional<Handle<Relation>> job, Mode mode, Handle<AnyTree> tree )
+{
+  if ( not job.has_value() ) {
+    return;
+  }
+  auto kept = jobs_.find( *job );
+  if ( kept == jobs_.end() ) {
+    return;
+  }
+
+  auto& entries = kept->second;
+  std::erase( entries, pair { mode, tree } );
+  if ( entries.empty() ) {
+    jobs_.erase( kept );
+  }
+}
+
+void MapMemo::drop( Mode mode, Handle<AnyTree> tree )
+{
+  auto& records = records_[static_cast<size_t>( mode )];
+  if ( auto it = records.find( tree ); it != records.end() ) {
+    unlist( it->second.job, mode, tree );
+    records.erase( it );
+  }
+}
+
+void MapMemo::resolved( Handle<Relation> relation )
+{
+  unique_lock lock( mutex_ );
+  relation.visit<void>( overload {
+    [&]( Handle<Eval> eval ) {
+      if ( auto tree = handle::extract<ObjectTree>( eval.unwrap<Object>() ) ) {
+        drop( Mode::Eval, *tree );
+        drop( Mode::EvalShallow, *tree );
+      } else if ( auto value = handle::extract<ValueTree>( eval.unwrap<Object>() ) ) {
+        drop( Mode::Lift, *value );
+      }
+    },
+    [&]( Handle<Think> think ) {
+      if ( auto application = think.unwrap<Thunk>().try_into<Application>() ) {
+        drop( Mode::Reduce, application->unwrap<ExpressionTree>() );
+      }
+    },
+  } );
+}
+
+void MapMemo::forget( Handle<Relation> job )
+{
+  unique_lock lock( mutex_ );
+  auto kept = jobs_.find( job );
+  if ( kept == jobs_.end() ) {
+    return;
+  }
+
+  for ( const auto& [mode, tree] : kept->second ) {
+    auto& records = records_[static_cast<size_t>( mode )];
+    if ( auto it = records.find( tree ); it != records.end() and it->second.job == job ) {
+      records.erase( it );
+    }
+  }
+  jobs_.erase( kept );
+}
+
+size_t MapMemo::size()
+{
+  unique_lock lock( mutex_ );
+  size_t size = 0;
+  for ( const auto& records : records_ ) {
+    size += records.size();
+  }
+  return size;
+}
+
 LocalScheduler::Result<Blob> LocalScheduler::load( Handle<Blob> handle )
 {
   handle.visit<void>( overload {
@@ -617,50 +769,118 @@ SketchGraphScheduler::Result<Object> SketchGraphScheduler::force( Handle<Thunk>
   return result;
 }
 
-LocalScheduler::Result<ValueTree> LocalScheduler::mapEval( Handle<ObjectTree> tree )
+// Splits the children of a wide tree into chunks, each evaluated by an Eval job of its own. Fills in the children of
+// the chunks which are done, and returns whether every chunk is done.
+bool LocalScheduler::fan_out( const TreeData& data, MapMemo::Progress& progress )
 {
-  bool ready = true;
-  bool toreplace = false;
-  auto data = relater_->get().get( tree ).value();
+  auto& relater = relater_->get();
+  const size_t chunk = std::max<size_t>( 1, std::min( fan_out_chunk, fan_out_width - 1 ) );
+
+  vector<Handle<Relation>> pending;
+  for ( size_t begin = 0; begin < data->size(); begin += chunk ) {
+    const size_t end = std::min( begin + chunk, data->size() );
+    auto resolved = progress.resolved.begin();
+    if ( std::all_of( resolved + begin, resolved + end, []( bool b ) { return b; } ) ) {
+      continue;
+    }
 
-  auto prev_nested = nested_;
-  nested_ = true;
+    auto slice = OwnedMutTree::allocate( end - begin );
+    for ( size_t i = begin; i < end; i++ ) {
+      slice[i - begin] = data->at( i );
+    }
+    Handle<Relation> goal = Handle<Eval>(
+      relater.get_storage()
+        .create( std::make_shared<OwnedTree>( std::move( slice ) ) )
+        .visit<Handle<Object>>( overload {
+          []( Handle<ValueTree> t ) { return Handle<Object>( Handle<Value>( t ) ); },
+          []( Handle<ObjectTree> t ) { return Handle<Object>( t ); },
+          []( Handle<ExpressionTree> ) -> Handle<Object> { throw std::runtime_error( "Unreachable" ); } } ) );
+
+    if ( not relater.contains( goal ) ) {
+      pending.push_back( goal );
+      continue;
+    }
 
-  for ( const auto& x : data->span() ) {
-    auto obj = x.unwrap<Expression>().unwrap<Object>();
-    auto result = evalStrict( obj );
+    auto values = relater.get( relater.get( goal ).value().unwrap<Value>().unwrap<ValueTree>() ).value();
+    for ( size_t i = begin; i < end; i++ ) {
+      if ( progress.resolved[i] ) {
+        continue;
+      }
+      progress.results[i] = values->at( i - begin );
+      progress.resolved[i] = true;
+      progress.outstanding--;
+      progress.changed |= values->at( i - begin ) != data->at( i );
+    }
+  }
+
+  if ( pending.empty() ) {
+    return true;
+  }
 
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && Handle<Object>( result.value() ) != obj ) {
-      toreplace = true;
+  bool waiting = false;
+  vector<Handle<Relation>> ready;
+  {
+    auto graph = relater.graph_.write();
+    for ( const auto& goal : pending ) {
+      if ( relater.contains( goal ) ) {
+        continue;
+      }
+      graph->add_dependency( current_schedule_step_.value(), goal );
+      waiting = true;
+      if ( graph->get_forward_dependencies( goal ).empty() ) {
+        ready.push_back( goal );
+      }
     }
   }
 
-  nested_ = prev_nested;
+  for ( const auto& goal : ready ) {
+    relater.get_local()->get( goal );
+  }
+
+  // Every chunk finished in the meantime, so nothing would wake this step up
+  if ( not waiting ) {
+    return fan_out( data, progress );
+  }
+  return false;
+}
+
+LocalScheduler::Result<ValueTree> LocalScheduler::mapEval( Handle<ObjectTree> tree )
+{
+  auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Eval, data->size() );
+
+  bool ready;
+  if ( fan_out_width > 0 and data->size() >= fan_out_width and current_schedule_step_.has_value()
+       and relater_->get().get_local()->get_info().transform( []( auto i ) { return i.parallelism; } ).value_or( 0 )
+             > 1 ) {
+    ready = fan_out( data, progress );
+  } else {
+    auto prev_nested = nested_;
+    nested_ = true;
+
+    ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+      return as_fix( evalStrict( x.unwrap<Expression>().unwrap<Object>() ) );
+    } );
+
+    nested_ = prev_nested;
+  }
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Eval, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto values = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto obj = x.unwrap<Expression>().unwrap<Object>();
-      values[i] = evalStrict( obj ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( values ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>()
         .tag();
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( values ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>();
     }
   } else {
@@ -670,47 +890,34 @@ LocalScheduler::Result<ValueTree> LocalScheduler::mapEval( Handle<ObjectTree> tr
 
 SketchGraphScheduler::Result<ValueTree> SketchGraphScheduler::mapEval( Handle<ObjectTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Eval, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto obj = x.unwrap<Expression>().unwrap<Object>();
-    auto result = evalStrict( obj );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && Handle<Object>( result.value() ) != obj ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+    return as_fix( evalStrict( x.unwrap<Expression>().unwrap<Object>() ) );
+  } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Eval, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto values = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto obj = x.unwrap<Expression>().unwrap<Object>();
-      values[i] = evalStrict( obj ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( values ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>()
         .tag();
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( values ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>();
     }
   } else {
@@ -720,43 +927,30 @@ SketchGraphScheduler::Result<ValueTree> SketchGraphScheduler::mapEval( Handle<Ob
 
 LocalScheduler::Result<ObjectTree> LocalScheduler::mapReduce( Handle<ExpressionTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Reduce, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto exp = x.unwrap<Expression>();
-    auto result = evaluator_.reduce( exp );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && x != Handle<Fix>( Handle<Expression>( result.value() ) ) ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve(
+    progress, data, [&]( Handle<Fix> x ) { return as_fix( evaluator_.reduce( x.unwrap<Expression>() ) ); } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Reduce, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto objs = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto exp = data->at( i ).unwrap<Expression>();
-      objs[i] = evaluator_.reduce( exp ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return handle::tree_unwrap<ObjectTree>(
-               relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( objs ) ) ) )
+               relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( progress.results ) ) ) )
         .tag();
     } else {
       return handle::tree_unwrap<ObjectTree>(
-        relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( objs ) ) ) );
+        relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( progress.results ) ) ) );
     }
   } else {
     return Handle<ObjectTree>( tree.content, tree.size(), tree.is_tag() );
@@ -765,43 +959,30 @@ LocalScheduler::Result<ObjectTree> LocalScheduler::mapReduce( Handle<ExpressionT
 
 SketchGraphScheduler::Result<ObjectTree> SketchGraphScheduler::mapReduce( Handle<ExpressionTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Reduce, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto exp = x.unwrap<Expression>();
-    auto result = evaluator_.reduce( exp );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && x != Handle<Fix>( Handle<Expression>( result.value() ) ) ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve(
+    progress, data, [&]( Handle<Fix> x ) { return as_fix( evaluator_.reduce( x.unwrap<Expression>() ) ); } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Reduce, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto objs = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto exp = data->at( i ).unwrap<Expression>();
-      objs[i] = evaluator_.reduce( exp ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return handle::tree_unwrap<ObjectTree>(
-               relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( objs ) ) ) )
+               relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( progress.results ) ) ) )
         .tag();
     } else {
       return handle::tree_unwrap<ObjectTree>(
-        relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( objs ) ) ) );
+        relater_->get().get_storage().create( std::make_shared<OwnedTree>( std::move( progress.results ) ) ) );
     }
   } else {
     return Handle<ObjectTree>( tree.content, tree.size(), tree.is_tag() );
@@ -810,47 +991,34 @@ SketchGraphScheduler::Result<ObjectTree> SketchGraphScheduler::mapReduce( Handle
 
 LocalScheduler::Result<ValueTree> LocalScheduler::mapLift( Handle<ValueTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Lift, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto val = x.unwrap<Expression>().unwrap<Object>().unwrap<Value>();
-    auto result = evaluator_.lift( val );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && result.value() != val ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+    return as_fix( evaluator_.lift( x.unwrap<Expression>().unwrap<Object>().unwrap<Value>() ) );
+  } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Lift, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto vals = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto val = x.unwrap<Expression>().unwrap<Object>().unwrap<Value>();
-      vals[i] = evaluator_.lift( val ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>()
         .tag();
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>();
     }
   } else {
@@ -860,47 +1028,34 @@ LocalScheduler::Result<ValueTree> LocalScheduler::mapLift( Handle<ValueTree> tre
 
 SketchGraphScheduler::Result<ValueTree> SketchGraphScheduler::mapLift( Handle<ValueTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::Lift, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto val = x.unwrap<Expression>().unwrap<Object>().unwrap<Value>();
-    auto result = evaluator_.lift( val );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && result.value() != val ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+    return as_fix( evaluator_.lift( x.unwrap<Expression>().unwrap<Object>().unwrap<Value>() ) );
+  } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::Lift, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto vals = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto val = x.unwrap<Expression>().unwrap<Object>().unwrap<Value>();
-      vals[i] = evaluator_.lift( val ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>()
         .tag();
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .unwrap<ValueTree>();
     }
   } else {
@@ -910,41 +1065,28 @@ SketchGraphScheduler::Result<ValueTree> SketchGraphScheduler::mapLift( Handle<Va
 
 LocalScheduler::Result<ObjectTree> LocalScheduler::mapEvalShallow( Handle<ObjectTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get_shallow( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::EvalShallow, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto val = x.unwrap<Expression>().unwrap<Object>();
-    auto result = evaluator_.evalShallow( val );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && result.value() != val ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+    return as_fix( evaluator_.evalShallow( x.unwrap<Expression>().unwrap<Object>() ) );
+  } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::EvalShallow, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto vals = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto val = x.unwrap<Expression>().unwrap<Object>();
-      vals[i] = evaluator_.evalShallow( val ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .visit<Handle<ObjectTree>>( overload {
           []( Handle<ValueTree> t ) { return t.into<ObjectTree>(); },
           []( Handle<ObjectTree> t ) { return t; },
@@ -953,7 +1095,7 @@ LocalScheduler::Result<ObjectTree> LocalScheduler::mapEvalShallow( Handle<Object
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .visit<Handle<ObjectTree>>( overload {
           []( Handle<ValueTree> t ) { return t.into<ObjectTree>(); },
           []( Handle<ObjectTree> t ) { return t; },
@@ -966,41 +1108,28 @@ LocalScheduler::Result<ObjectTree> LocalScheduler::mapEvalShallow( Handle<Object
 
 SketchGraphScheduler::Result<ObjectTree> SketchGraphScheduler::mapEvalShallow( Handle<ObjectTree> tree )
 {
-  bool ready = true;
-  bool toreplace = false;
   auto data = relater_->get().get_shallow( tree ).value();
+  auto progress = map_memo_.take( tree, MapMemo::Mode::EvalShallow, data->size() );
 
   auto prev_nested = nested_;
   nested_ = true;
 
-  for ( const auto& x : data->span() ) {
-    auto val = x.unwrap<Expression>().unwrap<Object>();
-    auto result = evaluator_.evalShallow( val );
-    if ( not result ) {
-      ready = false;
-    } else if ( !toreplace && result.value() != val ) {
-      toreplace = true;
-    }
-  }
+  bool ready = resolve( progress, data, [&]( Handle<Fix> x ) {
+    return as_fix( evaluator_.evalShallow( x.unwrap<Expression>().unwrap<Object>() ) );
+  } );
 
   nested_ = prev_nested;
 
   if ( not ready ) {
+    map_memo_.keep( tree, MapMemo::Mode::EvalShallow, std::move( progress ), current_schedule_step_ );
     return {};
   }
 
-  if ( toreplace ) {
-    auto vals = OwnedMutTree::allocate( data->size() );
-    for ( size_t i = 0; i < data->size(); i++ ) {
-      auto x = data->at( i );
-      auto val = x.unwrap<Expression>().unwrap<Object>();
-      vals[i] = evaluator_.evalShallow( val ).value();
-    }
-
+  if ( progress.changed ) {
     if ( tree.is_tag() ) {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .visit<Handle<ObjectTree>>( overload {
           []( Handle<ValueTree> t ) { return t.into<ObjectTree>(); },
           []( Handle<ObjectTree> t ) { return t; },
@@ -1009,7 +1138,7 @@ SketchGraphScheduler::Result<ObjectTree> SketchGraphScheduler::mapEvalShallow( H
     } else {
       return relater_->get()
         .get_storage()
-        .create( std::make_shared<OwnedTree>( std::move( vals ) ) )
+        .create( std::make_shared<OwnedTree>( std::move( progress.results ) ) )
         .visit<Handle<ObjectTree>>( overload {
           []( Handle<ValueTree> t ) { return t.into<ObjectTree>(); },
           []( Handle<ObjectTree> t ) { return t; },
@@ -1135,6 +1264,76 @@ LocalScheduler::Result<Object> LocalScheduler::schedule( Handle<Relation> top_le
   return result;
 }
 
+ContinuationScheduler::Result<Object> ContinuationScheduler::schedule( Handle<Relation> top_level_job )
+{
+  nested_ = false;
+  auto& relater = relater_->get();
+
+  unique_ptr<Continuation> continuation;
+  {
+    unique_lock lock( mutex_ );
+    if ( auto it = parked_.find( top_level_job ); it != parked_.end() ) {
+      continuation = std::move( it->second );
+      parked_.erase( it );
+    }
+  }
+  if ( not continuation ) {
+    continuation = make_unique<Continuation>( top_level_job );
+  }
+
+  while ( true ) {
+    auto result = continuation->run( *this, evaluator_, relater );
+    if ( result.has_value() ) {
+      relater.put( top_level_job, *result );
+      return result;
+    }
+
+    auto spawned = continuation->take_spawned();
+    bool retry = continuation->retry();
+
+    // The continuation is parked before any dependency is added, so that it is there when the job is resumed
+    {
+      unique_lock lock( mutex_ );
+      parked_.insert_or_assign( top_level_job, std::move( continuation ) );
+    }
+
+    if ( retry ) {
+      dynamic_pointer_cast<Executor>( relater.get_local() )->retry( top_level_job );
+      return {};
+    }
+
+    bool waiting = false;
+    vector<Handle<Relation>> ready;
+    {
+      auto graph = relater.graph_.write();
+      for ( const auto& goal : spawned ) {
+        if ( relater.contains( goal ) ) {
+          continue;
+        }
+        graph->add_dependency( top_level_job, goal );
+        waiting = true;
+        if ( graph->get_forward_dependencies( goal ).empty() ) {
+          ready.push_back( goal );
+        }
+      }
+    }
+
+    for ( const auto& goal : ready ) {
+      relater.get_local()->get( goal );
+    }
+
+    if ( waiting ) {
+      return {};
+    }
+
+    // Everything the job was waiting for finished in the meantime, so nothing will resume it
+    unique_lock lock( mutex_ );
+    auto it = parked_.find( top_level_job );
+    continuation = std::move( it->second );
+    parked_.erase( it );
+  }
+}
+
 SketchGraphScheduler::Result<Object> SketchGraphScheduler::schedule( Handle<Relation> top_level_job )
 {
   nested_ = false;
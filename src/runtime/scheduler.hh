@@ -1,16 +1,85 @@
 #pragma once
 
+#include "continuation.hh"
 #include "evaluator.hh"
 #include "pass.hh"
 #include "relater.hh"
 
+#include <absl/container/flat_hash_map.h>
+#include <array>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * The progress of the map* functions over trees with children which were not ready, so that the next attempt only
+ * evaluates the children which are still missing and the result is assembled without evaluating the rest again.
+ * A record is taken out while it is being worked on, so two threads never share one. Each record belongs to the
+ * job that was being scheduled when it was kept, and is dropped once that job finishes or is given up on here.
+ */
+class MapMemo
+{
+public:
+  enum class Mode : uint8_t
+  {
+    Eval,
+    Reduce,
+    Lift,
+    EvalShallow,
+  };
+
+  struct Progress
+  {
+    OwnedMutTree results;
+    std::vector<bool> resolved;
+    size_t outstanding;
+    bool changed {};
+    std::optional<Handle<Relation>> job {};
+  };
+
+private:
+  std::mutex mutex_ {};
+  std::array<absl::flat_hash_map<Handle<AnyTree>, Progress>, 4> records_ {};
+  // The records kept by each job, each listed once
+  absl::flat_hash_map<Handle<Relation>, std::vector<std::pair<Mode, Handle<AnyTree>>>> jobs_ {};
+
+  // Removes the entry of the record of @p tree in @p mode from the list of @p job
+  void unlist( std::optional<Handle<Relation>> job, Mode mode, Handle<AnyTree> tree );
+  // Drops the record of @p tree in @p mode, if there is one
+  void drop( Mode mode, Handle<AnyTree> tree );
+
+public:
+  /**
+   * Takes the progress recorded for @p tree in @p mode, or starts a new record for its @p size children.
+   */
+  Progress take( Handle<AnyTree> tree, Mode mode, size_t size );
+
+  /**
+   * Records the progress of @p tree in @p mode for the next attempt of @p job. If another thread recorded progress
+   * in the meantime, the record with fewer outstanding children is kept.
+   */
+  void keep( Handle<AnyTree> tree, Mode mode, Progress&& progress, std::optional<Handle<Relation>> job );
+
+  /**
+   * Drops the records of @p job, which finished or will not be attempted here again.
+   */
+  void forget( Handle<Relation> job );
+
+  /**
+   * Drops the records of the tree whose result @p relation holds, whichever job kept them.
+   */
+  void resolved( Handle<Relation> relation );
+
+  size_t size();
+};
 
 class Scheduler : public FixRuntime
 {
 protected:
   FixEvaluator evaluator_;
   std::optional<std::reference_wrapper<Relater>> relater_ {};
+  MapMemo map_memo_ {};
 
 public:
   /*
@@ -23,6 +92,11 @@ public:
 
   virtual void set_relater( std::reference_wrapper<Relater> relater ) { relater_ = relater; }
 
+  // @p job finished or was given up on here, so the progress of its maps is not needed anymore
+  void forget( Handle<Relation> job ) { map_memo_.forget( job ); }
+  // @p relation has its result, so the progress of mapping its tree is not needed anymore
+  void resolved( Handle<Relation> relation ) { map_memo_.resolved( relation ); }
+
   Scheduler()
     : evaluator_( *this )
   {}
@@ -35,8 +109,14 @@ class LocalScheduler : public Scheduler
 private:
   Result<Object> select_single( Handle<Object>, size_t );
   Result<Object> select_range( Handle<Object>, size_t begin_idx, size_t end_idx );
+  bool fan_out( const TreeData& data, MapMemo::Progress& progress );
 
 public:
+  // ObjectTrees with at least this many children (0 for none) are evaluated in chunks of at most fan_out_chunk
+  // children, each of which is a job of its own that idle executor threads can pick up
+  static inline size_t fan_out_width = 0;
+  static inline size_t fan_out_chunk = 4096;
+
   LocalScheduler() {}
 
   virtual Result<Blob> load( Handle<Blob> value ) override;
@@ -56,6 +136,22 @@ public:
   virtual Result<Object> schedule( Handle<Relation> top_level_job ) override;
 };
 
+/**
+ * A LocalScheduler which evaluates each job with an explicit Continuation instead of recursing through
+ * FixEvaluator. A job which has to wait for other jobs is parked with its continuation, and resumed from where it
+ * stopped once they are done; the other schedulers give up such a job and evaluate it again from the start.
+ */
+class ContinuationScheduler : public LocalScheduler
+{
+  std::mutex mutex_ {};
+  absl::flat_hash_map<Handle<Relation>, std::unique_ptr<Continuation>> parked_ {};
+
+public:
+  ContinuationScheduler() {}
+
+  virtual Result<Object> schedule( Handle<Relation> top_level_job ) override;
+};
+
 inline thread_local std::optional<Handle<Relation>> current_schedule_step_;
 inline thread_local bool nested_;
 inline thread_local bool go_for_it_;
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cstring>
+#include <glog/logging.h>
+#include <immintrin.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "exception.hh"
+#include "handle_post.hh"
+#include "overload.hh"
+#include "parser.hh"
+#include "runtimestorage.hh"
+#include "snapshot.hh"
+
+using namespace std;
+
+namespace {
+
+BlobData copy( const void* data, size_t size )
+{
+  auto blob = OwnedMutBlob::allocate( size );
+  memcpy( blob.data(), data, size );
+  return make_shared<OwnedBlob>( std::move( blob ) );
+}
+
+// Records are written field by field, so that no padding ends up in the snapshot's content
+template<typename T>
+BlobData pack( const vector<T>& records )
+{
+  auto blob = OwnedMutBlob::allocate( records.size() * T::serialized_length() );
+  Serializer serializer( { blob.data(), blob.size() } );
+  for ( const auto& record : records ) {
+    serializer.object( record );
+  }
+  return make_shared<OwnedBlob>( std::move( blob ) );
+}
+
+template<typename T>
+vector<T> unpack( const BlobData& blob )
+{
+  if ( blob->size() % T::serialized_length() != 0 ) {
+    throw runtime_error( "Snapshot records have an invalid size." );
+  }
+
+  Parser parser( { blob->data(), blob->size() } );
+  vector<T> records;
+  for ( size_t i = 0; i < blob->size() / T::serialized_length(); i++ ) {
+    records.push_back( T::parse( parser ) );
+  }
+  if ( parser.error() ) {
+    throw runtime_error( "Failed to parse snapshot records." );
+  }
+  return records;
+}
+
+bool parse_bool( Parser& parser )
+{
+  uint8_t value {};
+  parser.integer( value );
+  return value;
+}
+
+BlobData bytes( RuntimeStorage& storage, Handle<Fix> handle )
+{
+  auto blob = handle::extract<Blob>( handle );
+  if ( not blob.has_value() ) {
+    throw runtime_error( "Snapshot element is not a blob." );
+  }
+
+  return blob->visit<BlobData>( overload {
+    [&]( Handle<Named> n ) { return storage.get( n ); },
+    []( Handle<Literal> l ) { return copy( l.data(), l.size() ); },
+  } );
+}
+
+}
+
+void Snapshot::Memory::serialize( Serializer& serializer ) const
+{
+  serializer.integer( offset );
+  serializer.integer( pages );
+  serializer.integer( max_pages );
+  serializer.integer( uint8_t( is64 ) );
+  serializer.integer( uint8_t( hw_checked ) );
+}
+
+Snapshot::Memory Snapshot::Memory::parse( Parser& parser )
+{
+  Memory memory {};
+  parser.integer( memory.offset );
+  parser.integer( memory.pages );
+  parser.integer( memory.max_pages );
+  memory.is64 = parse_bool( parser );
+  memory.hw_checked = parse_bool( parser );
+  return memory;
+}
+
+void Snapshot::Table::serialize( Serializer& serializer ) const
+{
+  serializer.integer( offset );
+  serializer.integer( size );
+  serializer.integer( max_size );
+  serializer.integer( uint8_t( funcref ) );
+}
+
+Snapshot::Table Snapshot::Table::parse( Parser& parser )
+{
+  Table table {};
+  parser.integer( table.offset );
+  parser.integer( table.size );
+  parser.integer( table.max_size );
+  table.funcref = parse_bool( parser );
+  return table;
+}
+
+void Snapshot::Relocation::serialize( Serializer& serializer ) const
+{
+  serializer.integer( buffer );
+  serializer.integer( uint8_t( base ) );
+  serializer.integer( offset );
+}
+
+Snapshot::Relocation Snapshot::Relocation::parse( Parser& parser )
+{
+  Relocation relocation {};
+  uint8_t base {};
+  parser.integer( relocation.buffer );
+  parser.integer( base );
+  parser.integer( relocation.offset );
+  if ( base > uint8_t( Base::Code ) ) {
+    parser.set_error();
+  }
+  relocation.base = Base( base );
+  return relocation;
+}
+
+bool Snapshot::relativize( char* buffer,
+                           const char* other,
+                           size_t size,
+                           uint32_t index,
+                           const Origin& origin,
+                           const vector<pair<uint64_t, uint64_t>>& skip )
+{
+  const auto instance_begin = reinterpret_cast<uint64_t>( origin.instance );
+  const auto distance = reinterpret_cast<uint64_t>( origin.other ) - instance_begin;
+  const auto code_begin = reinterpret_cast<uint64_t>( origin.code );
+
+  for ( size_t offset = 0; offset + sizeof( uint64_t ) <= size; offset += sizeof( uint64_t ) ) {
+    if ( any_of( skip.begin(), skip.end(), [&]( const auto& range ) {
+           return offset + sizeof( uint64_t ) > range.first and offset < range.first + range.second;
+         } ) ) {
+      continue;
+    }
+
+    uint64_t word, other_word;
+    memcpy( &word, buffer + offset, sizeof( word ) );
+    memcpy( &other_word, other + offset, sizeof( other_word ) );
+
+    if ( other_word - word == distance and word >= instance_begin and word <= instance_begin + origin.size ) {
+      word -= instance_begin;
+      relocations_.push_back( { index, Base::Instance, offset } );
+    } else if ( other_word != word ) {
+      VLOG( 1 ) << "word " << offset << " of buffer " << index << " differs between instances";
+      return false;
+    } else if ( word >= code_begin and word < code_begin + code_size_ ) {
+      // Both instances share the code, so a pointer into it is the same in both
+      word -= code_begin;
+      relocations_.push_back( { index, Base::Code, offset } );
+    } else {
+      continue;
+    }
+    memcpy( buffer + offset, &word, sizeof( word ) );
+  }
+  return true;
+}
+
+shared_ptr<Snapshot> Snapshot::capture( const char* instance,
+                                        const char* other,
+                                        size_t size,
+                                        const char* code,
+                                        size_t code_size,
+                                        const wasm_rt_allocation_record_t& record )
+{
+  if ( record.overflowed or instance == other ) {
+    return nullptr;
+  }
+
+  shared_ptr<Snapshot> snapshot( new Snapshot );
+  snapshot->code_size_ = code_size;
+
+  // Memories and tables have to live in the instance, and must not be attached to any Fix data
+  auto offset_of = [&]( const void* p, size_t length ) -> optional<uint64_t> {
+    auto offset = static_cast<const char*>( p ) - instance;
+    if ( offset < 0 or offset + length > size ) {
+      return {};
+    }
+    return offset;
+  };
+
+  // The same structure of the second instance, which lives at the same offset in it
+  auto counterpart = [&]<typename T>( const T* p ) {
+    return reinterpret_cast<const T*>( other + ( reinterpret_cast<const char*>( p ) - instance ) );
+  };
+
+  // The memories and tables are allocated again on restore, so their own words are not compared
+  vector<pair<uint64_t, uint64_t>> reallocated;
+
+  for ( size_t i = 0; i < record.num_memories; i++ ) {
+    const auto* memory = record.memories[i];
+    auto offset = offset_of( memory, sizeof( *memory ) );
+    if ( not offset.has_value() or memory->read_only ) {
+      return nullptr;
+    }
+    const auto* other_memory = counterpart( memory );
+    if ( other_memory->size != memory->size or memcmp( other_memory->data, memory->data, memory->size ) ) {
+      VLOG( 1 ) << "memory " << i << " differs between instances";
+      return nullptr;
+    }
+    snapshot->memories_.push_back(
+      { *offset, memory->pages, memory->max_pages, memory->is64, record.hw_checked[i] } );
+    snapshot->memory_images_.push_back( copy( memory->data, memory->size ) );
+    reallocated.push_back( { *offset, sizeof( *memory ) } );
+  }
+
+  // The funcref tables of the second instance, to compare with the first
+  vector<const char*> other_tables;
+  for ( size_t i = 0; i < record.num_funcref_tables; i++ ) {
+    const auto* table = record.funcref_tables[i];
+    auto offset = offset_of( table, sizeof( *table ) );
+    if ( not offset.has_value() or table->read_only or counterpart( table )->size != table->size ) {
+      return nullptr;
+    }
+    snapshot->tables_.push_back( { *offset, table->size, table->max_size, true } );
+    snapshot->table_images_.push_back( copy( table->data, table->size * sizeof( wasm_rt_funcref_t ) ) );
+    other_tables.push_back( reinterpret_cast<const char*>( counterpart( table )->data ) );
+    reallocated.push_back( { *offset, sizeof( *table ) } );
+  }
+
+  for ( size_t i = 0; i < record.num_externref_tables; i++ ) {
+    const auto* table = record.externref_tables[i];
+    auto offset = offset_of( table, sizeof( *table ) );
+    if ( not offset.has_value() or table->read_only ) {
+      return nullptr;
+    }
+    const auto* other_table = counterpart( table );
+    if ( other_table->size != table->size
+         or memcmp( other_table->data, table->data, table->size * sizeof( wasm_rt_externref_t ) ) ) {
+      VLOG( 1 ) << "externref table " << i << " differs between instances";
+      return nullptr;
+    }
+    for ( uint32_t j = 0; j < table->size; j++ ) {
+      if ( handle::is_local( Handle<Fix>::forge( table->data[j] ) ) ) {
+        snapshot->portable_ = false;
+      }
+    }
+    snapshot->tables_.push_back( { *offset, table->size, table->max_size, false } );
+    snapshot->table_images_.push_back( copy( table->data, table->size * sizeof( wasm_rt_externref_t ) ) );
+    reallocated.push_back( { *offset, sizeof( *table ) } );
+  }
+
+  const Origin origin { instance, other, size, code };
+  auto image = OwnedMutBlob::allocate( size );
+  memcpy( image.data(), instance, size );
+  if ( not snapshot->relativize( image.data(), other, size, 0, origin, reallocated ) ) {
+    return nullptr;
+  }
+  snapshot->instance_ = make_shared<OwnedBlob>( std::move( image ) );
+
+  for ( size_t i = 0; i < other_tables.size(); i++ ) {
+    auto table = OwnedMutBlob::allocate( snapshot->table_images_[i]->size() );
+    memcpy( table.data(), snapshot->table_images_[i]->data(), table.size() );
+    if ( not snapshot->relativize( table.data(), other_tables[i], table.size(), i + 1, origin ) ) {
+      return nullptr;
+    }
+    snapshot->table_images_[i] = make_shared<OwnedBlob>( std::move( table ) );
+  }
+
+  snapshot->open_memory_files();
+  VLOG( 1 ) << "captured a snapshot of " << snapshot->memories_.size() << " memories, " << snapshot->tables_.size()
+            << " tables and " << snapshot->relocations_.size() << " relocations";
+  return snapshot;
+}
+
+void Snapshot::open_memory_files()
+{
+  for ( size_t i = 0; i < memories_.size(); i++ ) {
+    const auto& image = memory_images_[i];
+    if ( not memories_[i].hw_checked or image->size() == 0 ) {
+      memory_files_.emplace_back();
+      continue;
+    }
+
+    FileDescriptor fd( CheckSystemCall( "memfd_create", memfd_create( "fix-snapshot", MFD_CLOEXEC ) ) );
+    CheckSystemCall( "ftruncate", ftruncate( fd.fd_num(), image->size() ) );
+    void* p = mmap( nullptr, image->size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd_num(), 0 );
+    if ( p == MAP_FAILED ) {
+      throw unix_error( "mmap" );
+    }
+    memcpy( p, image->data(), image->size() );
+    munmap( p, image->size() );
+    memory_files_.emplace_back( std::move( fd ) );
+  }
+}
+
+char* Snapshot::restore( const char* code ) const
+{
+  char* instance = static_cast<char*>( aligned_alloc( alignof( __m256i ), instance_->size() ) );
+  memcpy( instance, instance_->data(), instance_->size() );
+
+  auto relocate = [&]( char* buffer, uint32_t index ) {
+    for ( const auto& relocation : relocations_ ) {
+      if ( relocation.buffer != index ) {
+        continue;
+      }
+      uint64_t word;
+      memcpy( &word, buffer + relocation.offset, sizeof( word ) );
+      word += reinterpret_cast<uint64_t>( relocation.base == Base::Instance ? instance : code );
+      memcpy( buffer + relocation.offset, &word, sizeof( word ) );
+    }
+  };
+  relocate( instance, 0 );
+
+  for ( size_t i = 0; i < memories_.size(); i++ ) {
+    const auto& memory = memories_[i];
+    wasm_rt_allocate_memory_from_image( reinterpret_cast<wasm_rt_memory_t*>( instance + memory.offset ),
+                                        memory.pages,
+                                        memory.max_pages,
+                                        memory.is64,
+                                        memory.hw_checked,
+                                        reinterpret_cast<const uint8_t*>( memory_images_[i]->data() ),
+                                        memory_files_[i].has_value() ? memory_files_[i]->fd_num() : -1 );
+  }
+
+  for ( size_t i = 0; i < tables_.size(); i++ ) {
+    const auto& table = tables_[i];
+    if ( table.funcref ) {
+      auto* t = reinterpret_cast<wasm_rt_funcref_table_t*>( instance + table.offset );
+      wasm_rt_allocate_funcref_table( t, table.size, table.max_size );
+      memcpy( t->data, table_images_[i]->data(), table_images_[i]->size() );
+      relocate( reinterpret_cast<char*>( t->data ), i + 1 );
+    } else {
+      auto* t = reinterpret_cast<wasm_rt_externref_table_t*>( instance + table.offset );
+      wasm_rt_allocate_externref_table( t, table.size, table.max_size );
+      memcpy( t->data, table_images_[i]->data(), table_images_[i]->size() );
+    }
+  }
+
+  return instance;
+}
+
+Handle<ValueTree> Snapshot::to_tree( RuntimeStorage& storage ) const
+{
+  auto tree = OwnedMutTree::allocate( 5 + memory_images_.size() + table_images_.size() );
+  tree[0] = Handle<Literal>( static_cast<uint64_t>( code_size_ ) );
+  tree[1] = storage.create( instance_ );
+  tree[2] = storage.create( pack( memories_ ) );
+  tree[3] = storage.create( pack( tables_ ) );
+  tree[4] = storage.create( pack( relocations_ ) );
+  for ( size_t i = 0; i < memory_images_.size(); i++ ) {
+    tree[5 + i] = storage.create( memory_images_[i] );
+  }
+  for ( size_t i = 0; i < table_images_.size(); i++ ) {
+    tree[5 + memory_images_.size() + i] = storage.create( table_images_[i] );
+  }
+
+  return storage.create( make_shared<OwnedTree>( std::move( tree ) ) ).visit<Handle<ValueTree>>( overload {
+    []( Handle<ValueTree> t ) { return t; },
+    []( auto ) -> Handle<ValueTree> { throw runtime_error( "Snapshot is not a value tree." ); },
+  } );
+}
+
+shared_ptr<Snapshot> Snapshot::from_tree( RuntimeStorage& storage, Handle<ValueTree> handle, size_t code_size )
+{
+  auto tree = storage.get( handle );
+  if ( tree->size() < 5 or uint64_t( handle::extract<Literal>( tree->at( 0 ) ).value() ) != code_size ) {
+    return nullptr;
+  }
+
+  shared_ptr<Snapshot> snapshot( new Snapshot );
+  snapshot->code_size_ = code_size;
+  snapshot->instance_ = bytes( storage, tree->at( 1 ) );
+  snapshot->memories_ = unpack<Memory>( bytes( storage, tree->at( 2 ) ) );
+  snapshot->tables_ = unpack<Table>( bytes( storage, tree->at( 3 ) ) );
+  snapshot->relocations_ = unpack<Relocation>( bytes( storage, tree->at( 4 ) ) );
+  if ( tree->size() != 5 + snapshot->memories_.size() + snapshot->tables_.size() ) {
+    return nullptr;
+  }
+
+  for ( size_t i = 0; i < snapshot->memories_.size(); i++ ) {
+    snapshot->memory_images_.push_back( bytes( storage, tree->at( 5 + i ) ) );
+  }
+  for ( size_t i = 0; i < snapshot->tables_.size(); i++ ) {
+    snapshot->table_images_.push_back( bytes( storage, tree->at( 5 + snapshot->memories_.size() + i ) ) );
+  }
+
+  snapshot->open_memory_files();
+  return snapshot;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "handle.hh"
+#include "object.hh"
+#include "wasm-rt-impl.hh"
+
+class RuntimeStorage;
+class Parser;
+class Serializer;
+
+/**
+ * The state of an instance of a Program right after its init (and its _fixpoint_checkpoint export, if it has one)
+ * ran: the instance itself, its linear memories and its tables. New instances of the Program start as a copy of the
+ * snapshot instead of running the init again. A hardware-checked memory is a copy-on-write mapping of the snapshot's
+ * image, so only the pages an instance writes to are copied.
+ *
+ * Words of the instance and of its funcref tables which point into the instance or into the Program's code are kept
+ * relative to them, so a snapshot written out as Fix data can be used by any process which linked the same Program.
+ * A snapshot is captured from two instances initialized the same way at different addresses: a word points into the
+ * instance if it differs between them by exactly the distance between the instances, and an instance in which any
+ * other word differs cannot be captured.
+ */
+class Snapshot
+{
+  struct Memory
+  {
+    uint64_t offset;
+    uint64_t pages;
+    uint64_t max_pages;
+    bool is64;
+    bool hw_checked;
+
+    static constexpr size_t serialized_length() { return 3 * sizeof( uint64_t ) + 2; }
+    void serialize( Serializer& serializer ) const;
+    static Memory parse( Parser& parser );
+  };
+
+  struct Table
+  {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t max_size;
+    bool funcref;
+
+    static constexpr size_t serialized_length() { return sizeof( uint64_t ) + 2 * sizeof( uint32_t ) + 1; }
+    void serialize( Serializer& serializer ) const;
+    static Table parse( Parser& parser );
+  };
+
+  enum class Base : uint8_t
+  {
+    Instance,
+    Code,
+  };
+
+  // A word in the instance (buffer 0) or in a table (buffer i + 1) holding an offset from its base
+  struct Relocation
+  {
+    uint32_t buffer;
+    Base base;
+    uint64_t offset;
+
+    static constexpr size_t serialized_length() { return sizeof( uint32_t ) + 1 + sizeof( uint64_t ); }
+    void serialize( Serializer& serializer ) const;
+    static Relocation parse( Parser& parser );
+  };
+
+  size_t code_size_ {};
+  BlobData instance_ {};
+  std::vector<Memory> memories_ {};
+  std::vector<Table> tables_ {};
+  std::vector<Relocation> relocations_ {};
+  std::vector<BlobData> memory_images_ {};
+  std::vector<BlobData> table_images_ {};
+  // Holds the image of each hardware-checked memory, for copy-on-write mappings of it
+  std::vector<std::optional<FileDescriptor>> memory_files_ {};
+  // Whether the snapshot holds no handles which only mean something in this process
+  bool portable_ { true };
+
+  // The two instances a snapshot is captured from, and the code of their Program
+  struct Origin
+  {
+    const char* instance;
+    const char* other;
+    size_t size;
+    const char* code;
+  };
+
+  Snapshot() {}
+  void open_memory_files();
+
+  /**
+   * Records the words of @p buffer which point into the instance or the code as relocations of buffer @p index,
+   * given the same buffer @p other of the second instance. Words overlapping the (offset, length) ranges in @p skip
+   * are left as they are.
+   *
+   * @return  Whether every other word is the same in both instances.
+   */
+  bool relativize( char* buffer,
+                   const char* other,
+                   size_t size,
+                   uint32_t index,
+                   const Origin& origin,
+                   const std::vector<std::pair<uint64_t, uint64_t>>& skip = {} );
+
+public:
+  inline static bool enable = false;
+
+  /**
+   * Takes a snapshot of an instance.
+   *
+   * @param instance  The instance, with its context.
+   * @param other     A second instance, initialized the same way as the first at another address.
+   * @param size      The size of the instance and its context.
+   * @param code      The code of its Program.
+   * @param code_size The size of the code of its Program.
+   * @param record    The memories and tables allocated by the init of the first instance.
+   * @return          The snapshot, or nullptr if the instance cannot be captured.
+   */
+  static std::shared_ptr<Snapshot> capture( const char* instance,
+                                            const char* other,
+                                            size_t size,
+                                            const char* code,
+                                            size_t code_size,
+                                            const wasm_rt_allocation_record_t& record );
+
+  // Reads back a snapshot written by to_tree(); nullptr if it is not a snapshot of a Program with this code size
+  static std::shared_ptr<Snapshot> from_tree( RuntimeStorage& storage, Handle<ValueTree> tree, size_t code_size );
+  Handle<ValueTree> to_tree( RuntimeStorage& storage ) const;
+
+  // A new instance, for the Program whose code is at @p code; accounts for its memories and tables like an init
+  char* restore( const char* code ) const;
+
+  size_t instance_size() const { return instance_->size(); }
+  bool portable() const { return portable_; }
+};
+
+// Where the snapshots of procedures are kept, by the handle of the procedure
+struct SnapshotStore
+{
+  std::function<std::optional<Handle<ValueTree>>( Handle<Fix> )> find {};
+  std::function<void( Handle<Fix>, Handle<ValueTree> )> keep {};
+};
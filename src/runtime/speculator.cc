@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+#include <tuple>
+
+#include "handle_post.hh"
+#include "overload.hh"
+#include "relater.hh"
+#include "speculator.hh"
+
+using namespace std;
+
+Speculator::Speculator( Relater& relater )
+  : relater_( relater )
+  , launched_metric_(
+      global_metrics().counter( "fix_backups_launched_total", "Backup copies of straggling remote jobs launched" ) )
+  , won_metric_( global_metrics().counter( "fix_backups_won_total", "Jobs whose result came first from a backup" ) )
+{
+  if ( enable ) {
+    thread_ = thread( [&] { run(); } );
+  }
+}
+
+Speculator::~Speculator()
+{
+  {
+    unique_lock lock( mutex_ );
+    should_exit_ = true;
+    cv_.notify_all();
+  }
+  if ( thread_.joinable() ) {
+    thread_.join();
+  }
+}
+
+optional<Handle<Fix>> Speculator::procedure( Handle<Relation> job )
+{
+  // Jobs are grouped by the procedure they apply
+  return job.visit<optional<Handle<Fix>>>( overload {
+    [&]( Handle<Think> s ) {
+      return s.unwrap<Thunk>().visit<optional<Handle<Fix>>>( overload {
+        [&]( Handle<Application> a ) -> optional<Handle<Fix>> {
+          if ( relater_.contains( a.unwrap<ExpressionTree>() ) ) {
+            auto tree = relater_.get( a.unwrap<ExpressionTree>() ).value();
+            if ( tree->size() > 1 ) {
+              return tree->at( 1 );
+            }
+          }
+          return {};
+        },
+        []( auto ) -> optional<Handle<Fix>> { return {}; },
+      } );
+    },
+    []( Handle<Eval> ) -> optional<Handle<Fix>> { return {}; },
+  } );
+}
+
+optional<int64_t> Speculator::threshold( Handle<Fix> procedure )
+{
+  auto it = durations_.find( procedure );
+  if ( it == durations_.end() or it->second.size() < min_samples ) {
+    return {};
+  }
+
+  vector<int64_t> sorted( it->second.begin(), it->second.end() );
+  auto index = min( sorted.size() - 1, static_cast<size_t>( quantile * sorted.size() ) );
+  nth_element( sorted.begin(), sorted.begin() + index, sorted.end() );
+  return sorted[index];
+}
+
+void Speculator::started( Handle<Relation> job, shared_ptr<IRuntime> worker )
+{
+  if ( not enable ) {
+    return;
+  }
+
+  auto proc = procedure( job );
+  if ( not proc.has_value() ) {
+    return;
+  }
+
+  unique_lock lock( mutex_ );
+  auto& state = in_flight_[job];
+  if ( state.attempts.empty() ) {
+    state.procedure = *proc;
+  }
+  for ( const auto& attempt : state.attempts ) {
+    if ( attempt.id == worker.get() ) {
+      return;
+    }
+  }
+  state.attempts.push_back( { .worker = worker, .id = worker.get(), .start = Clock::now() } );
+}
+
+void Speculator::finished( Handle<Relation> job, IRuntime* worker )
+{
+  if ( not enable ) {
+    return;
+  }
+
+  vector<weak_ptr<IRuntime>> losers;
+  {
+    unique_lock lock( mutex_ );
+    auto it = in_flight_.find( job );
+    if ( it == in_flight_.end() ) {
+      return;
+    }
+
+    auto& state = it->second;
+    for ( size_t i = 0; i < state.attempts.size(); i++ ) {
+      const auto& attempt = state.attempts[i];
+      if ( attempt.id != worker ) {
+        losers.push_back( attempt.worker );
+        continue;
+      }
+
+      auto& history = durations_[state.procedure];
+      history.push_back( chrono::duration_cast<chrono::microseconds>( Clock::now() - attempt.start ).count() );
+      if ( history.size() > Speculator::history ) {
+        history.pop_front();
+      }
+      if ( i > 0 ) {
+        backups_won_++;
+        won_metric_.add();
+      }
+    }
+    in_flight_.erase( it );
+  }
+
+  for ( auto& loser : losers ) {
+    if ( auto locked = loser.lock(); locked ) {
+      VLOG( 1 ) << "Cancelling " << job << " on " << locked.get();
+      locked->cancel( job );
+    }
+  }
+}
+
+void Speculator::run()
+{
+  unique_lock lock( mutex_ );
+  while ( not should_exit_ ) {
+    cv_.wait_for( lock, chrono::milliseconds( interval ) );
+    if ( should_exit_ ) {
+      break;
+    }
+
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+void Speculator::check()
+{
+  auto now = Clock::now();
+
+  vector<pair<Handle<Relation>, IRuntime*>> stragglers;
+  absl::flat_hash_map<IRuntime*, size_t> running;
+  {
+    unique_lock lock( mutex_ );
+    for ( auto& [job, state] : in_flight_ ) {
+      for ( const auto& attempt : state.attempts ) {
+        running[attempt.id]++;
+      }
+
+      if ( state.backed_up or state.attempts.empty() ) {
+        continue;
+      }
+      auto limit = threshold( state.procedure );
+      auto elapsed = chrono::duration_cast<chrono::microseconds>( now - state.attempts.front().start ).count();
+      if ( limit.has_value() and elapsed > *limit ) {
+        state.backed_up = true;
+        stragglers.push_back( { job, state.attempts.front().id } );
+      }
+    }
+  }
+
+  if ( stragglers.empty() ) {
+    return;
+  }
+
+  vector<shared_ptr<IRuntime>> workers;
+  for ( const auto& remote : relater_.remotes_.read().get() ) {
+    auto locked = remote.lock();
+    if ( locked and locked->get_info().transform( []( auto info ) { return info.parallelism; } ).value_or( 0 ) ) {
+      workers.push_back( locked );
+    }
+  }
+
+  for ( auto [job, owner] : stragglers ) {
+    auto data = job.visit<optional<Handle<AnyDataType>>>( overload {
+      []( Handle<Think> s ) {
+        return s.unwrap<Thunk>().visit<optional<Handle<AnyDataType>>>( []( auto x ) { return handle::data( x ); } );
+      },
+      []( Handle<Eval> e ) { return handle::data( e.unwrap<Object>() ); },
+    } );
+
+    // Prefer workers which hold the job's data, then the ones with the fewest queued and running jobs
+    shared_ptr<IRuntime> best;
+    tuple<bool, size_t> best_score { false, numeric_limits<size_t>::max() };
+    for ( const auto& worker : workers ) {
+      if ( worker.get() == owner ) {
+        continue;
+      }
+
+      bool holds = data.transform( [&]( auto h ) {
+                         return h.template visit<bool>( overload {
+                           []( Handle<Literal> ) { return true; },
+                           [&]( auto x ) { return worker->contains( x ); },
+                         } );
+                       } )
+                     .value_or( false );
+      size_t load = running[worker.get()]
+                    + worker->get_load().transform( []( auto l ) { return size_t( l.queued ); } ).value_or( 0 );
+
+      tuple<bool, size_t> score { not holds, load };
+      if ( not best or score < best_score ) {
+        best = worker;
+        best_score = score;
+      }
+    }
+
+    if ( not best ) {
+      continue;
+    }
+
+    VLOG( 1 ) << "Launching backup of " << job << " on " << best.get();
+    backups_launched_++;
+    launched_metric_.add();
+    running[best.get()]++;
+    best->get( job );
+  }
+}
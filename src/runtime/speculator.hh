@@ -0,0 +1,90 @@
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "handle.hh"
+#include "interface.hh"
+#include "metrics.hh"
+
+class Relater;
+
+/**
+ * Detects straggling remote jobs and launches backup copies of them. Since Fix procedures are deterministic, a
+ * Relation can safely run on several nodes: the first result wins, and the other copies are cancelled.
+ *
+ * A job is a straggler once it has been running for longer than the given quantile of the recent durations of its
+ * procedure. Its backup runs on the least-loaded other worker, preferring workers which already hold its data.
+ */
+class Speculator
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Attempt
+  {
+    std::weak_ptr<IRuntime> worker {};
+    IRuntime* id {};
+    Clock::time_point start {};
+  };
+
+  struct Job
+  {
+    Handle<Fix> procedure {};
+    std::vector<Attempt> attempts {};
+    bool backed_up {};
+  };
+
+  Relater& relater_;
+
+  std::mutex mutex_ {};
+  std::condition_variable cv_ {};
+  bool should_exit_ { false };
+
+  absl::flat_hash_map<Handle<Relation>, Job> in_flight_ {};
+  // Recent durations (in microseconds) of the jobs of each procedure, oldest first
+  absl::flat_hash_map<Handle<Fix>, std::deque<int64_t>> durations_ {};
+
+  std::atomic<size_t> backups_launched_ { 0 };
+  std::atomic<size_t> backups_won_ { 0 };
+  // The same counts, summed over every Speculator of the process, in global_metrics()
+  Counter& launched_metric_;
+  Counter& won_metric_;
+
+  std::thread thread_ {};
+
+  std::optional<int64_t> threshold( Handle<Fix> procedure );
+  void run();
+  void check();
+
+public:
+  // Backups are launched past this quantile of the durations of a procedure, once at least min_samples jobs of the
+  // procedure have completed. Running jobs are checked every interval milliseconds.
+  inline static bool enable = false;
+  inline static double quantile = 0.95;
+  inline static size_t min_samples = 8;
+  inline static size_t history = 64;
+  inline static size_t interval = 10;
+
+  Speculator( Relater& relater );
+  ~Speculator();
+
+  // The procedure applied by @p job, if it is known. Jobs of unknown procedures have no durations to compare to,
+  // so they are neither timed nor backed up.
+  std::optional<Handle<Fix>> procedure( Handle<Relation> job );
+
+  // @p worker has been asked to run @p job
+  void started( Handle<Relation> job, std::shared_ptr<IRuntime> worker );
+
+  // The result of @p job is known, reported by @p worker (or locally if nullptr)
+  void finished( Handle<Relation> job, IRuntime* worker );
+
+  size_t backups_launched() const { return backups_launched_; }
+  size_t backups_won() const { return backups_won_; }
+};
@@ -57,7 +57,7 @@ class FixTable
     }
   }
 
-  size_t find_first_unoccupied( size_t idx )
+  std::optional<size_t> try_find_first_unoccupied( size_t idx )
   {
     auto init_idx = idx;
 
@@ -73,12 +73,21 @@ class FixTable
         }
 
         if ( idx == init_idx ) {
-          throw std::runtime_error( "Hash table is full." );
+          return {};
         }
       }
     }
   }
 
+  size_t find_first_unoccupied( size_t idx )
+  {
+    auto slot = try_find_first_unoccupied( idx );
+    if ( not slot.has_value() ) {
+      throw std::runtime_error( "Hash table is full." );
+    }
+    return *slot;
+  }
+
 public:
   FixTable( size_t s )
     : data_( s )
@@ -121,6 +130,51 @@ public:
     }
   }
 
+  // Like insert, but returns false instead of throwing if the table is full
+  bool try_insert( const Handle<T> h, V v )
+  {
+    Hash hash;
+    auto idx = hash( h ) % data_.size();
+    auto init_idx = idx;
+
+    while ( true ) {
+      auto occupied = data_.at( idx ).occupied.load( std::memory_order_acquire );
+
+      if ( occupied == static_cast<uint8_t>( SlotStatus::Empty ) ) {
+        auto empty_slot = try_find_first_unoccupied( idx );
+        if ( not empty_slot.has_value() ) {
+          return false;
+        }
+        data_.at( *empty_slot ).h = h;
+        data_.at( *empty_slot ).v = v;
+
+        uint8_t expected = static_cast<uint8_t>( SlotStatus::Claimed );
+        if ( data_.at( *empty_slot )
+               .occupied.compare_exchange_strong(
+                 expected, static_cast<uint8_t>( SlotStatus::Occupied ), std::memory_order_acq_rel ) ) {
+          return true;
+        } else {
+          throw std::runtime_error( "Unexpected occupied status " + std::to_string( expected ) );
+        }
+      }
+
+      if ( occupied == static_cast<uint8_t>( SlotStatus::Occupied ) ) {
+        KeyEqual eq;
+        if ( eq( data_.at( idx ).h, h ) ) {
+          return true;
+        }
+      }
+
+      idx++;
+      if ( idx == data_.size() ) {
+        idx = 0;
+      }
+      if ( idx == init_idx ) {
+        return false;
+      }
+    }
+  }
+
   void insert_no_value( const Handle<T> h )
   {
     Hash hash;
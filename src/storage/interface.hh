@@ -10,6 +10,7 @@
 #include <functional>
 #include <glog/logging.h>
 #include <unordered_set>
+#include <vector>
 
 /**
  * A basic Runtime environment, capable of loading/storing Fix data and (if parallelism != 0) discovering new Fix
@@ -25,6 +26,8 @@ public:
   {
     uint32_t parallelism;
     double link_speed;
+    // Identifies the node among its peers, or 0 if it schedules no jobs
+    uint64_t node {};
   };
 
   /*
@@ -129,6 +132,70 @@ public:
    */
   virtual std::optional<Info> get_info() { return {}; }
 
+  /**
+   * Live counterpart to Info: how much work is waiting, how much parallelism is currently free, and how many bytes
+   * are waiting to be sent to this IRuntime.
+   */
+  struct Load
+  {
+    uint32_t queued;
+    uint32_t idle;
+    uint64_t backlog {};
+  };
+
+  /**
+   * Gets the current load of this IRuntime.
+   *
+   * @return The runtime's load, if it has a queue of its own.
+   */
+  virtual std::optional<Load> get_load() { return {}; }
+
+  /**
+   * Gives up to @p count runnable Relations which have not started executing yet.  The returned Relations will not
+   * be run by this IRuntime; the caller takes responsibility for eventually putting their results, or for handing
+   * them back with return_stolen().
+   *
+   * @param count  The maximum number of Relations to hand over.
+   * @param cost   The cost of moving a Relation away; cheaper Relations are handed over first, and Relations with
+   *               a cost of SIZE_MAX are never handed over.
+   * @return       The Relations given up.
+   */
+  virtual std::vector<Handle<Relation>> steal( [[maybe_unused]] size_t count,
+                                               [[maybe_unused]] std::function<size_t( Handle<Relation> )> cost )
+  {
+    return {};
+  }
+
+  /**
+   * Takes back a Relation previously given up by steal(), whose result will not be put by anyone else.
+   */
+  virtual void return_stolen( [[maybe_unused]] Handle<Relation> name ) {}
+
+  /**
+   * Tells this IRuntime that the result of @p name is no longer needed from it, since it has been learned
+   * elsewhere.  This is only a hint; the IRuntime may still put the result.
+   */
+  virtual void cancel( [[maybe_unused]] Handle<Relation> name ) {}
+
+  /**
+   * Asks this IRuntime, as the owner of @p name in the result directory, for the result of @p name. It eventually
+   * either puts the result or reports a miss to its parent.
+   *
+   * @return  Whether the request was sent.
+   */
+  virtual bool lookup( [[maybe_unused]] Handle<Relation> name ) { return false; }
+
+  /**
+   * Hands the result @p data of @p name, together with its data, to this IRuntime as the owner of @p name in the
+   * result directory.
+   */
+  virtual void publish( [[maybe_unused]] Handle<Relation> name, [[maybe_unused]] Handle<Object> data ) {}
+
+  /**
+   * Tells this IRuntime that it holds @p data, as learned from another runtime.
+   */
+  virtual void holds( [[maybe_unused]] Handle<AnyDataType> data ) {}
+
   virtual Handle<Fix> labeled( [[maybe_unused]] const std::string_view label ) { return Handle<Literal>::nil(); };
   virtual bool contains( [[maybe_unused]] const std::string_view label ) { return false; };
 
@@ -167,6 +234,46 @@ public:
     }
   }
 
+  // Visit from a root like visit_minrepo, but skip every piece of data for which prune() returns true together with
+  // everything reachable from it. Data is visited after its children.
+  template<FixType T>
+  void visit_minrepo_pruned( Handle<T> handle,
+                             std::function<void( Handle<AnyDataType> )> visitor,
+                             std::function<bool( Handle<AnyDataType> )> prune )
+  {
+    std::unordered_set<Handle<Fix>> visited;
+    visit_minrepo_pruned( handle, visitor, prune, visited );
+  }
+
+  template<FixType T>
+  void visit_minrepo_pruned( Handle<T> handle,
+                             std::function<void( Handle<AnyDataType> )>& visitor,
+                             std::function<bool( Handle<AnyDataType> )>& prune,
+                             std::unordered_set<Handle<Fix>>& visited )
+  {
+    if constexpr ( std::same_as<T, Literal> or std::same_as<T, ValueTreeRef> or std::same_as<T, ObjectTreeRef> ) {
+      return;
+    } else if constexpr ( Handle<T>::is_fix_sum_type ) {
+      if constexpr ( not( std::same_as<T, Thunk> or std::same_as<T, Encode> or std::same_as<T, BlobRef> ) )
+        std::visit( [&]( const auto x ) { visit_minrepo_pruned( x, visitor, prune, visited ); }, handle.get() );
+    } else {
+      if ( visited.contains( handle ) )
+        return;
+      visited.insert( handle );
+
+      if ( prune( handle ) )
+        return;
+
+      if constexpr ( FixTreeType<T> ) {
+        auto tree = get( handle );
+        for ( const auto& element : tree.value()->span() ) {
+          visit_minrepo_pruned( element, visitor, prune, visited );
+        }
+      }
+      visitor( handle );
+    }
+  }
+
   // Return the list of data presening in .fix repository
   virtual std::unordered_set<Handle<AnyDataType>> data() const { return {}; };
   // Return the list of forward dependencies
@@ -177,4 +284,31 @@ class MultiWorkerRuntime : public IRuntime
 {
 public:
   virtual void add_worker( std::shared_ptr<IRuntime> ) = 0;
+
+  /**
+   * Notifications from workers about Relations they run on behalf of this runtime: @p worker has been asked to run
+   * @p name, and @p worker has sent back the result of @p name.
+   */
+  ///@{
+  virtual void started_remotely( [[maybe_unused]] Handle<Relation> name,
+                                 [[maybe_unused]] std::shared_ptr<IRuntime> worker )
+  {}
+  virtual void finished_remotely( [[maybe_unused]] Handle<Relation> name, [[maybe_unused]] IRuntime& worker ) {}
+  ///@}
+
+  /**
+   * Notification from the owner of @p name in the result directory that it does not know the result of @p name.
+   */
+  virtual void missed( [[maybe_unused]] Handle<Relation> name ) {}
+
+  /**
+   * Records that @p data, which this runtime may not have, is held by the worker whose Info::node is @p node.
+   * Workers that send data referring to @p data pass this on instead.
+   */
+  virtual void held_by( [[maybe_unused]] Handle<AnyDataType> data, [[maybe_unused]] uint64_t node ) {}
+
+  /**
+   * The Info::node of a worker known to hold @p data, if any.
+   */
+  virtual std::optional<uint64_t> holder( [[maybe_unused]] Handle<AnyDataType> data ) { return {}; }
 };
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "handle.hh"
+
+/**
+ * Records, for each piece of data, which of up to MAX_PEERS peers hold it and which of them hold it loaded. One
+ * PeerTable is shared by all connections of a node, each of which is told apart by a peer slot, so a handle known
+ * to several peers is stored only once.
+ *
+ * The table grows by adding segments, each twice the size of the last, so it stays proportional to the number of
+ * handles recorded. Lookups and changes to the bits of an existing entry are lock-free; only adding a handle takes
+ * a lock. Each slot keeps the entries it was recorded in, so forgetting a peer does not scan the whole table.
+ */
+template<FixType T, class Hash = std::hash<Handle<T>>, class KeyEqual = std::equal_to<Handle<T>>>
+class PeerTable
+{
+public:
+  static constexpr size_t MAX_PEERS = 128;
+
+private:
+  static constexpr size_t WORDS = MAX_PEERS / 64;
+  static constexpr size_t INITIAL_SIZE = 1024;
+  static constexpr size_t MAX_SEGMENTS = 40;
+
+  using Bits = std::array<std::atomic<uint64_t>, WORDS>;
+
+  struct Entry
+  {
+    Handle<T> h { Handle<T>::forge( u8x32 {} ) };
+    std::atomic<bool> occupied { false };
+    Bits present {};
+    Bits loaded {};
+  };
+
+  struct Segment
+  {
+    std::unique_ptr<Entry[]> entries;
+    size_t size;
+    size_t used {};
+  };
+
+  // The entries a slot's present bit has been set in. Entries never move, so they are referred to directly.
+  struct Slot
+  {
+    std::mutex mutex {};
+    std::vector<Entry*> entries {};
+  };
+
+  std::array<std::unique_ptr<Segment>, MAX_SEGMENTS> segments_ {};
+  std::atomic<size_t> num_segments_ { 0 };
+  std::mutex mutex_ {};
+  std::array<Slot, MAX_PEERS> slots_ {};
+
+  static bool test( const Bits& bits, size_t slot )
+  {
+    return bits[slot / 64].load( std::memory_order_acquire ) & ( uint64_t( 1 ) << ( slot % 64 ) );
+  }
+
+  //! Sets the bit of @p slot to @p value, and returns whether it changed.
+  static bool set( Bits& bits, size_t slot, bool value )
+  {
+    const uint64_t mask = uint64_t( 1 ) << ( slot % 64 );
+    if ( value ) {
+      return not( bits[slot / 64].fetch_or( mask, std::memory_order_acq_rel ) & mask );
+    } else {
+      return bits[slot / 64].fetch_and( ~mask, std::memory_order_acq_rel ) & mask;
+    }
+  }
+
+  Entry* find( const Handle<T> h ) const
+  {
+    Hash hash;
+    KeyEqual eq;
+    const size_t segments = num_segments_.load( std::memory_order_acquire );
+    for ( size_t s = 0; s < segments; s++ ) {
+      const auto& segment = *segments_[s];
+      for ( size_t idx = hash( h ) % segment.size;; idx = ( idx + 1 ) % segment.size ) {
+        auto& entry = segment.entries[idx];
+        if ( not entry.occupied.load( std::memory_order_acquire ) ) {
+          break;
+        }
+        if ( eq( entry.h, h ) ) {
+          return &entry;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  Entry& find_or_insert( const Handle<T> h )
+  {
+    if ( auto* entry = find( h ) ) {
+      return *entry;
+    }
+
+    std::unique_lock lock( mutex_ );
+    if ( auto* entry = find( h ) ) {
+      return *entry;
+    }
+
+    // Segments are kept at most half full, so probing always ends at an empty slot
+    size_t segments = num_segments_.load( std::memory_order_relaxed );
+    if ( segments == 0 or ( segments_[segments - 1]->used + 1 ) * 2 > segments_[segments - 1]->size ) {
+      if ( segments == MAX_SEGMENTS ) {
+        throw std::runtime_error( "PeerTable is full." );
+      }
+      const size_t size = segments == 0 ? INITIAL_SIZE : segments_[segments - 1]->size * 2;
+      segments_[segments] = std::make_unique<Segment>( std::make_unique<Entry[]>( size ), size );
+      num_segments_.store( ++segments, std::memory_order_release );
+    }
+
+    auto& segment = *segments_[segments - 1];
+    Hash hash;
+    size_t idx = hash( h ) % segment.size;
+    while ( segment.entries[idx].occupied.load( std::memory_order_relaxed ) ) {
+      idx = ( idx + 1 ) % segment.size;
+    }
+    segment.used++;
+    segment.entries[idx].h = h;
+    segment.entries[idx].occupied.store( true, std::memory_order_release );
+    return segment.entries[idx];
+  }
+
+public:
+  //! Whether the peer in @p slot holds @p h.
+  bool contains( const Handle<T> h, size_t slot ) const
+  {
+    auto* entry = find( h );
+    return entry and test( entry->present, slot );
+  }
+
+  //! Whether the peer in @p slot holds @p h loaded.
+  bool loaded( const Handle<T> h, size_t slot ) const
+  {
+    auto* entry = find( h );
+    return entry and test( entry->present, slot ) and test( entry->loaded, slot );
+  }
+
+  //! Records that the peer in @p slot holds @p h, and whether it is loaded.
+  void insert( const Handle<T> h, size_t slot, bool loaded )
+  {
+    auto& entry = find_or_insert( h );
+    set( entry.loaded, slot, loaded );
+    if ( set( entry.present, slot, true ) ) {
+      std::unique_lock lock( slots_[slot].mutex );
+      slots_[slot].entries.push_back( &entry );
+    }
+  }
+
+  //! The handle recorded for @p h, if the peer in @p slot holds it.
+  std::optional<Handle<T>> get_handle( const Handle<T> h, size_t slot ) const
+  {
+    auto* entry = find( h );
+    if ( entry and test( entry->present, slot ) ) {
+      return entry->h;
+    }
+    return {};
+  }
+
+  //! Forgets everything recorded for the peer in @p slot, so the slot can be reused.
+  void clear( size_t slot )
+  {
+    std::vector<Entry*> entries;
+    {
+      std::unique_lock lock( slots_[slot].mutex );
+      entries.swap( slots_[slot].entries );
+    }
+
+    for ( auto* entry : entries ) {
+      set( entry->present, slot, false );
+      set( entry->loaded, slot, false );
+    }
+  }
+};
@@ -1,7 +1,10 @@
+#include <atomic>
 #include <concepts>
 #include <filesystem>
 #include <glog/logging.h>
 #include <memory>
+#include <string>
+#include <unistd.h>
 
 #include "base16.hh"
 #include "handle_post.hh"
@@ -183,16 +186,62 @@ std::optional<Handle<Object>> Repository::get( Handle<Relation> relation )
   try {
     VLOG( 2 ) << "loading " << fix.content << " from disk";
     assert( not handle::is_local( fix ) );
-    return Handle<Fix>::forge(
-             base16::decode(
-               fs::read_symlink( repo_ / "relations" / base16::encode( fix.content ) ).filename().string() ) )
-      .unwrap<Expression>()
-      .unwrap<Object>();
+    auto target = Handle<Fix>::forge(
+                    base16::decode(
+                      fs::read_symlink( repo_ / "relations" / base16::encode( fix.content ) ).filename().string() ) )
+                    .unwrap<Expression>()
+                    .unwrap<Object>();
+
+    if ( relation.contains<Think>() and target.contains<Thunk>() ) {
+      std::vector<Handle<Think>> path { relation.unwrap<Think>() };
+      return follow( target, path );
+    }
+    return target;
   } catch ( std::filesystem::filesystem_error& ) {
     throw HandleNotFound( fix );
   }
 }
 
+Handle<Object> Repository::follow( Handle<Object> next, std::vector<Handle<Think>>& path )
+{
+  std::unordered_set<Handle<Fix>> visited( path.begin(), path.end() );
+
+  auto current = next;
+  while ( auto thunk = current.try_into<Thunk>() ) {
+    Handle<Think> hop( thunk.value() );
+    std::error_code error;
+    auto link = fs::read_symlink( repo_ / "relations" / base16::encode( Handle<Fix>( hop ).content ), error );
+    if ( error or visited.contains( hop ) ) {
+      break;
+    }
+
+    path.push_back( hop );
+    visited.insert( hop );
+    current = Handle<Fix>::forge( base16::decode( link.filename().string() ) ).unwrap<Expression>().unwrap<Object>();
+  }
+  return current;
+}
+
+void Repository::relink( Handle<Relation> relation, Handle<Object> target )
+{
+  // Replaces the link in one step, so that a concurrent reader sees either the old target or the new one. Each
+  // temporary link has a name of its own, so that concurrent writers never share one.
+  static std::atomic<uint64_t> next_id { 0 };
+  auto name = base16::encode( Handle<Fix>( relation ).content );
+  auto tmp = repo_ / ( "relink-" + name + "-" + to_string( getpid() ) + "-" + to_string( next_id++ ) );
+
+  std::error_code error;
+  fs::create_symlink( "../data/" + base16::encode( target.content ), tmp, error );
+  if ( not error ) {
+    fs::rename( tmp, repo_ / "relations" / name, error );
+  }
+  if ( error ) {
+    std::error_code ignored;
+    fs::remove( tmp, ignored );
+    LOG( WARNING ) << "could not shorten the link of " << relation << ": " << error.message();
+  }
+}
+
 void Repository::put( Handle<Named> name, BlobData data )
 {
   assert( not handle::is_local( name ) );
@@ -238,8 +287,31 @@ void Repository::put( Handle<Relation> relation, Handle<Object> target )
     Handle<Fix> fix( relation );
     VLOG( 2 ) << "writing " << fix.content << " to disk";
     auto path = repo_ / "relations" / base16::encode( fix.content );
-    if ( fs::exists( path ) )
+
+    // A Think whose target is a thunk is linked to the end of the chain of thunks, as far as it has resolved, and so
+    // are the Thinks of the chain which still link to a thunk
+    std::vector<Handle<Think>> chain;
+    if ( relation.contains<Think>() and target.contains<Thunk>() ) {
+      chain.push_back( relation.unwrap<Think>() );
+      target = follow( target, chain );
+      if ( not target.contains<Thunk>() ) {
+        // The last Think of the chain already links to the end
+        for ( size_t i = 1; i + 1 < chain.size(); i++ ) {
+          relink( chain[i], target );
+        }
+      }
+    }
+
+    if ( fs::is_symlink( path ) ) {
+      // A Think whose link still points at an intermediate thunk gets the shortcut to the end of its chain
+      auto current = Handle<Fix>::forge( base16::decode( fs::read_symlink( path ).filename().string() ) )
+                       .unwrap<Expression>()
+                       .unwrap<Object>();
+      if ( relation.contains<Think>() and current.contains<Thunk>() and current != target ) {
+        relink( relation, target );
+      }
       return;
+    }
     VLOG( 2 ) << "linking to " << target.content;
     relations_.insert( relation, true );
     fs::create_symlink( "../data/" + base16::encode( target.content ), path );
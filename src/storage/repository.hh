@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "handle.hh"
 #include "hash_table.hh"
@@ -18,6 +19,13 @@ class Repository : public IRuntime
   FixTable<AnyTree, size_t, AbslHash, handle::any_tree_equal> trees_;
   FixTable<Relation, bool, AbslHash> relations_;
 
+  // Follows a chain of Think relations on disk from next to its end, as far as it has resolved, appending every
+  // Think on the way to path. Only reads the repository.
+  Handle<Object> follow( Handle<Object> next, std::vector<Handle<Think>>& path );
+  // Points the link of relation at target, in place of the thunk it links to. Failures are only logged, since the
+  // old link stays valid.
+  void relink( Handle<Relation> relation, Handle<Object> target );
+
 public:
   Repository( size_t fix_table_size = 1000000, std::filesystem::path directory = std::filesystem::current_path() );
   static std::filesystem::path find( std::filesystem::path directory = std::filesystem::current_path() );
@@ -2,7 +2,9 @@
 
 #include <glog/logging.h>
 #include <string_view>
+#include <unordered_set>
 #include <variant>
+#include <vector>
 
 #include "handle.hh"
 #include "handle_post.hh"
@@ -41,6 +43,12 @@ Handle<AnyTree> RuntimeStorage::create_tree_shallow( TreeData tree, std::optiona
 void RuntimeStorage::create( Handle<Object> result, Handle<Relation> relation )
 {
   relations_.insert( relation, result );
+
+  // A Think whose chain has already resolved gets its shortcut now, so reads do not have to follow the chain
+  auto think = relation.try_into<Think>();
+  if ( think.has_value() and result.contains<Thunk>() ) {
+    compress( think.value(), result );
+  }
 }
 
 template<FixTreeType T>
@@ -142,14 +150,57 @@ TreeData RuntimeStorage::get_shallow( Handle<AnyTree> handle )
 
 Handle<Object> RuntimeStorage::get( Handle<Relation> handle )
 {
+  auto think = handle.try_into<Think>();
+  if ( think.has_value() ) {
+    if ( auto shortcut = shortcuts_.get( think.value() ); shortcut.has_value() ) {
+      return shortcut.value();
+    }
+  }
+
   auto res = relations_.get( handle );
   if ( res.has_value() ) {
+    if ( think.has_value() and res->contains<Thunk>() ) {
+      return compress( think.value(), res.value() );
+    }
     return res.value();
   } else {
     throw HandleNotFound( handle );
   }
 }
 
+Handle<Object> RuntimeStorage::compress( Handle<Think> head, Handle<Object> next )
+{
+  std::vector<Handle<Think>> path { head };
+  std::unordered_set<Handle<Fix>> visited { head };
+
+  auto current = next;
+  while ( auto thunk = current.try_into<Thunk>() ) {
+    Handle<Think> hop( thunk.value() );
+    if ( auto shortcut = shortcuts_.get( hop ); shortcut.has_value() ) {
+      current = shortcut.value();
+      break;
+    }
+
+    auto result = relations_.get( hop );
+    if ( not result.has_value() or visited.contains( hop ) ) {
+      // The chain has not resolved yet; there is nothing to record
+      return current;
+    }
+
+    path.push_back( hop );
+    visited.insert( hop );
+    current = result.value();
+  }
+
+  // Shortcuts only save work, so once the table is full the chains are followed as they are
+  for ( const auto& think : path ) {
+    if ( not shortcuts_.try_insert( think, current ) ) {
+      break;
+    }
+  }
+  return current;
+}
+
 template<FixType T>
 void RuntimeStorage::visit( Handle<T> handle,
                             std::function<void( Handle<Fix> )> visitor,
@@ -43,10 +43,17 @@ private:
   TreeMap trees_ { 100000 };
   TreeMap tree_refs_ { 100000 };
   RelationMap relations_ { 100000 };
+  // Think(head) -> the first non-thunk object of the chain of thunks starting at head; sized like relations_, and
+  // only ever probed for Thinks
+  RelationMap shortcuts_ { 100000 };
 
   SharedMutex<PinMap> pins_ {};
   SharedMutex<LabelMap> labels_ {};
 
+  // Follows a chain of Think relations from head to its end, recording a shortcut for every Think on the way while
+  // there is room for it
+  Handle<Object> compress( Handle<Think> head, Handle<Object> next );
+
 public:
   RuntimeStorage() {}
 
@@ -15,6 +15,7 @@ extern "C" {
 #include "option-parser.hh"
 
 #include "base16.hh"
+#include "guest_symbols.hh"
 #include "object.hh"
 #include "overload.hh"
 #include "repository.hh"
@@ -417,6 +418,13 @@ void eval( int argc, char* argv[] )
 
   auto res = rt->execute( Handle<Eval>( handle::extract<Object>( handle ).value() ) );
   cout << res.content << endl;
+
+#ifdef TIME_FIXPOINT
+  global_timer().summary( cerr );
+#if TIME_FIXPOINT == 2
+  guest_symbols().summary( cerr );
+#endif
+#endif
 }
 
 void init( int, char*[] )
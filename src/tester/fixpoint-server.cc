@@ -1,14 +1,23 @@
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 extern "C" {
 #include <sys/resource.h>
 }
 #include <memory>
+#include <thread>
 
+#include "guest_symbols.hh"
+#include "huge_pages.hh"
+#include "metrics.hh"
 #include "mmap.hh"
 #include "option-parser.hh"
+#include "result_directory.hh"
 #include "runtimes.hh"
 #include "scheduler.hh"
+#include "snapshot.hh"
+#include "speculator.hh"
 
 using namespace std;
 
@@ -48,6 +57,9 @@ int main( int argc, char* argv[] )
   optional<const char*> peerfile;
   optional<string> sche_opt;
   optional<size_t> threads;
+  size_t network_threads = 1;
+  size_t processing_threads = 0;
+  optional<string> metrics_path;
 
   parser.AddArgument(
     "listening-port", OptionParser::ArgumentCount::One, [&]( const char* argument ) { port = stoi( argument ); } );
@@ -61,14 +73,112 @@ int main( int argc, char* argv[] )
     'p', "peers", "peers", "Path to a file that contains a list of all servers.", [&]( const char* argument ) {
       peerfile = argument;
     } );
-  parser.AddOption( 's', "scheduler", "scheduler", "Scheduler to use [onepass, hint]", [&]( const char* argument ) {
-    sche_opt = argument;
-    if ( not( *sche_opt == "onepass" or *sche_opt == "hint" ) ) {
-      throw runtime_error( "Invalid scheduler: " + sche_opt.value() );
-    }
-  } );
+  parser.AddOption( 's',
+                    "scheduler",
+                    "scheduler",
+                    "Scheduler to use [onepass, hint, local, continuation]",
+                    [&]( const char* argument ) {
+                      sche_opt = argument;
+                      if ( not( *sche_opt == "onepass" or *sche_opt == "hint" or *sche_opt == "local"
+                                or *sche_opt == "continuation" ) ) {
+                        throw runtime_error( "Invalid scheduler: " + sche_opt.value() );
+                      }
+                    } );
   parser.AddOption(
     't', "threads", "#", "Number of threads", [&]( const char* argument ) { threads = stoull( argument ); } );
+  parser.AddOption( 'n',
+                    "network-threads",
+                    "#",
+                    "Number of network threads; connections are sharded across them",
+                    [&]( const char* argument ) { network_threads = stoull( argument ); } );
+  parser.AddOption( 'w',
+                    "processing-threads",
+                    "#",
+                    "Number of threads that process incoming messages off the network threads",
+                    [&]( const char* argument ) { processing_threads = stoull( argument ); } );
+  parser.AddOption( 'b',
+                    "batch-delay",
+                    "us",
+                    "Maximum delay before batched control messages are sent; 0 disables batching",
+                    [&]( const char* argument ) {
+                      Remote::batch_delay = stoull( argument );
+                      Remote::enable_batching = Remote::batch_delay != 0;
+                    } );
+  parser.AddOption( "lazy-results",
+                    "Send results back to peers without their data, which the peers fetch only if they need it",
+                    [&] { Remote::result_shipping = Remote::ResultShipping::Lazy; } );
+  parser.AddOption( "compress",
+                    "Compress large blobs and trees sent to peers that support it, while doing so pays off",
+                    [&] { Remote::enable_compression = true; } );
+  parser.AddOption( "no-local-transport",
+                    "Connect to peers on the same host over TCP instead of a Unix-domain socket",
+                    [&] { LocalRemote::enable = false; } );
+  parser.AddOption(
+    "no-stealing", "Do not steal queued jobs from busy peers or give them to idle ones", [&] {
+      Remote::enable_stealing = false;
+    } );
+  parser.AddOption( 'c',
+                    "credit-window",
+                    "MiB",
+                    "Number of bytes a peer may send before it has to wait for this server to catch up",
+                    [&]( const char* argument ) {
+                      Remote::credit_bytes = stoull( argument ) << 20;
+                      if ( Remote::credit_bytes == 0 ) {
+                        throw runtime_error( "Invalid credit window: " + string( argument ) );
+                      }
+                    } );
+  parser.AddOption( 'm',
+                    "metrics",
+                    "path",
+                    "On SIGUSR1, write network metrics to this file: as JSON if its name ends in .json, and in the "
+                    "Prometheus text format otherwise",
+                    [&]( const char* argument ) { metrics_path = argument; } );
+  parser.AddOption( 'q',
+                    "speculate",
+                    "quantile",
+                    "Launch a backup of a remote job once it runs longer than this quantile of the durations of its "
+                    "procedure (e.g. 0.95)",
+                    [&]( const char* argument ) {
+                      Speculator::quantile = stod( argument );
+                      if ( Speculator::quantile <= 0 or Speculator::quantile > 1 ) {
+                        throw runtime_error( "Invalid quantile: " + string( argument ) );
+                      }
+                      Speculator::enable = true;
+                    } );
+  parser.AddOption( 'r',
+                    "share-results",
+                    "ms",
+                    "Before running a job whose procedure takes at least this long, ask the node that owns the job "
+                    "for its result, and publish the result there if it had to be computed",
+                    [&]( const char* argument ) {
+                      ResultDirectory::min_cost = stoull( argument ) * 1000;
+                      ResultDirectory::enable = true;
+                    } );
+  parser.AddOption( 'f',
+                    "fan-out",
+                    "width",
+                    "With the local scheduler, evaluate the children of trees at least this wide in chunks that run "
+                    "as jobs of their own on idle threads",
+                    [&]( const char* argument ) { LocalScheduler::fan_out_width = stoull( argument ); } );
+  parser.AddOption( 'i',
+                    "snapshot",
+                    "Start the instances of each procedure from a snapshot taken after its init, and keep portable "
+                    "snapshots in the repository",
+                    [&]() { Snapshot::enable = true; } );
+  parser.AddOption( 'P',
+                    "perf-map",
+                    "Write the functions of every linked procedure to /tmp/perf-<pid>.map, so perf can name them",
+                    [&]() { GuestSymbols::perf_map = true; } );
+  parser.AddOption( 'H',
+                    "huge-pages",
+                    "MiB",
+                    "Back linear memories and blob buffers of at least this size with transparent huge pages",
+                    [&]( const char* argument ) {
+                      huge_pages::threshold = stoull( argument ) << 20;
+                      if ( huge_pages::threshold == 0 ) {
+                        throw runtime_error( "Invalid huge page threshold: " + string( argument ) );
+                      }
+                    } );
 
   parser.Parse( argc, argv );
 
@@ -105,10 +215,36 @@ int main( int argc, char* argv[] )
       scheduler = make_shared<HintScheduler>();
     } else if ( *sche_opt == "local" ) {
       scheduler = make_shared<LocalScheduler>();
+    } else if ( *sche_opt == "continuation" ) {
+      scheduler = make_shared<ContinuationScheduler>();
     }
   }
 
-  auto server = Server::init( listen_address, scheduler, peer_address, threads );
+  // Metrics are written by a thread of their own, so SIGUSR1 is blocked in every thread started from here on
+  if ( metrics_path.has_value() ) {
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGUSR1 );
+    pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+
+    thread( [path = *metrics_path, signals] {
+      while ( true ) {
+        int signal;
+        if ( sigwait( &signals, &signal ) != 0 ) {
+          continue;
+        }
+
+        ofstream out( path, ios::trunc );
+        if ( path.ends_with( ".json" ) ) {
+          global_metrics().json( out );
+        } else {
+          global_metrics().prometheus( out );
+        }
+      }
+    } ).detach();
+  }
+
+  auto server = Server::init( listen_address, scheduler, peer_address, threads, network_threads, processing_threads );
   cout << "Server initialized" << endl;
 
   server->join();
@@ -0,0 +1,183 @@
+#include <chrono>
+#include <csignal>
+#include <sstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bptree-helper.hh"
+#include "cluster.hh"
+#include "test.hh"
+
+// Runs the mapreduce, count-words and bptree-get applications on in-process clusters of 1, 2, 4, ... nodes whose
+// connections go through emulated links. Every workload is run once with different input first, so the programs are
+// already compiled on the entry node when the timed run starts.
+//
+// Usage: cluster-perf [max nodes] [latency us] [bandwidth MB/s] [loss probability] [threads per node]
+
+using namespace std;
+
+namespace {
+
+const string MAPREDUCE = "applications-prefix/src/applications-build/mapreduce/mapreduce.wasm";
+const string CURRY = "applications-prefix/src/applications-build/curry/curry.wasm";
+const string ADD = "testing/wasm-examples/add-simple.wasm";
+const string COUNT_WORDS = "applications-prefix/src/applications-build/count-words/count_words.wasm";
+const string MERGE_COUNTS = "applications-prefix/src/applications-build/count-words/merge_counts.wasm";
+const string BPTREE_GET = "applications-prefix/src/applications-build/bptree-get/bptree-get.wasm";
+
+constexpr size_t MAPREDUCE_ELEMENTS = 1024;
+constexpr size_t COUNT_WORDS_CHUNKS = 64;
+constexpr size_t COUNT_WORDS_CHUNK_SIZE = 64 * 1024;
+constexpr size_t BPTREE_KEYS = 1 << 16;
+constexpr size_t BPTREE_QUERIES = 256;
+
+using Run = Timed<string>;
+
+string to_string( IRuntime& rt, Handle<Value> value )
+{
+  return value.try_into<Blob>()
+    .transform( [&]( auto h ) {
+      return h.template visit<string>( overload {
+        []( Handle<Literal> l ) { return std::to_string( uint64_t( l ) ); },
+        [&]( Handle<Named> n ) { return std::to_string( rt.get( n ).value()->size() ) + " bytes"; },
+      } );
+    } )
+    .value_or( "tree" );
+}
+
+Run mapreduce( Cluster& cluster, uint32_t salt )
+{
+  auto& rt = cluster.entry();
+  auto sum = compile( rt, file( rt, ADD ) );
+  auto add = Handle<Strict>( Handle<Thunk>( handle::upcast(
+    tree( rt, limits( rt, 1024 * 1024, 1024, 1 ), compile( rt, file( rt, CURRY ) ), sum, 2_literal32 ) ) ) );
+  auto add100 = Handle<Strict>(
+    Handle<Thunk>( handle::upcast( tree( rt, limits( rt, 1024 * 1024, 1024, 1 ), add, 0x100_literal32 ) ) ) );
+
+  auto input = OwnedMutTree::allocate( MAPREDUCE_ELEMENTS );
+  for ( size_t i = 0; i < MAPREDUCE_ELEMENTS; i++ ) {
+    input[i] = Handle<Literal>( static_cast<uint32_t>( salt + i ) );
+  }
+  auto elements = handle::upcast( rt.create( make_shared<OwnedTree>( std::move( input ) ) ) );
+
+  auto thunk = Handle<Thunk>( handle::upcast( tree( rt,
+                                                    limits( rt, 1024 * 1024, 1024, 1 ),
+                                                    compile( rt, file( rt, MAPREDUCE ) ),
+                                                    add100,
+                                                    sum,
+                                                    elements,
+                                                    limits( rt, 1024 * 1024, 1024, 1 ),
+                                                    limits( rt, 1024 * 1024, 1024, 1 ) ) ) );
+  return timed( [&] { return to_string( rt, cluster.execute( Handle<Eval>( thunk ) ) ); } );
+}
+
+Run count_words( Cluster& cluster, uint32_t salt )
+{
+  static const vector<string> words { "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "times" };
+
+  auto& rt = cluster.entry();
+  mt19937 gen( salt );
+  uniform_int_distribution<size_t> pick( 0, words.size() - 1 );
+
+  auto goal = blob( rt, "the" );
+  auto chunks = OwnedMutTree::allocate( COUNT_WORDS_CHUNKS );
+  for ( size_t i = 0; i < COUNT_WORDS_CHUNKS; i++ ) {
+    string text;
+    while ( text.size() < COUNT_WORDS_CHUNK_SIZE ) {
+      text += words[pick( gen )];
+      text += " ";
+    }
+    chunks[i] = handle::upcast( tree( rt, goal, blob( rt, text ) ) );
+  }
+  auto input = handle::upcast( rt.create( make_shared<OwnedTree>( std::move( chunks ) ) ) );
+
+  auto thunk = Handle<Thunk>( handle::upcast( tree( rt,
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ),
+                                                    compile( rt, file( rt, MAPREDUCE ) ),
+                                                    compile( rt, file( rt, COUNT_WORDS ) ),
+                                                    compile( rt, file( rt, MERGE_COUNTS ) ),
+                                                    input,
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ),
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ) ) ) );
+  return timed( [&] { return to_string( rt, cluster.execute( Handle<Eval>( thunk ) ) ); } );
+}
+
+Run bptree_get( Cluster& cluster, uint32_t salt )
+{
+  auto& rt = cluster.entry();
+  BPTree<int, string> index( 16 );
+  for ( size_t i = 0; i < BPTREE_KEYS; i++ ) {
+    index.insert( i, std::to_string( i ) );
+  }
+  auto root = bptree::to_storage( rt.get_storage(), index );
+  auto elf = compile( rt, file( rt, BPTREE_GET ) );
+
+  // Consecutive keys from a salted start, so that no query is answered from an earlier run's results
+  vector<Handle<Relation>> queries;
+  for ( size_t i = 0; i < BPTREE_QUERIES; i++ ) {
+    int key = ( salt * BPTREE_QUERIES + i ) % BPTREE_KEYS;
+    auto combination = tree( rt,
+                             limits( rt, 1024 * 1024, 1024, 1 ).into<Fix>(),
+                             elf,
+                             Handle<Strict>( Handle<Selection>( Handle<ObjectTree>(
+                               tree( rt, root, Handle<Literal>( (uint64_t)0 ) ).unwrap<ValueTree>() ) ) ),
+                             root,
+                             Handle<Literal>( key ) )
+                         .visit<Handle<ExpressionTree>>( []( auto h ) { return Handle<ExpressionTree>( h ); } );
+    queries.push_back( Handle<Eval>( Handle<Application>( combination ) ) );
+  }
+
+  return timed( [&] {
+    size_t found = 0;
+    for ( const auto& query : queries ) {
+      found += cluster.execute( query ).try_into<Blob>().has_value();
+    }
+    return std::to_string( found ) + " found";
+  } );
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t max_nodes = argc > 1 ? stoull( argv[1] ) : 4;
+  LinkModel link;
+  link.latency = chrono::microseconds( argc > 2 ? stoull( argv[2] ) : 0 );
+  link.bandwidth = ( argc > 3 ? stoull( argv[3] ) : 0 ) * 1000 * 1000;
+  link.loss = argc > 4 ? stod( argv[4] ) : 0;
+  size_t threads = argc > 5 ? stoull( argv[5] ) : 2;
+
+  // A peer hanging up mid-write must not kill the benchmark
+  signal( SIGPIPE, SIG_IGN );
+
+  vector<pair<string, Run ( * )( Cluster&, uint32_t )>> workloads {
+    { "mapreduce", mapreduce },
+    { "count-words", count_words },
+    { "bptree-get", bptree_get },
+  };
+
+  for ( const auto& [name, workload] : workloads ) {
+    for ( size_t nodes = 1; nodes <= max_nodes; nodes *= 2 ) {
+      Cluster cluster( nodes, threads, link );
+      workload( cluster, 0 );
+      auto run = workload( cluster, 1 );
+
+      ostringstream link_json;
+      link.json( link_json );
+
+      PerfRecord()
+        .add( "workload", name )
+        .add( "nodes", nodes )
+        .add( "threads_per_node", threads )
+        .raw( "link", link_json.str() )
+        .add( "elapsed_us", run.elapsed_us )
+        .add( "result", run.result )
+        .print();
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+#include <sys/socket.h>
+
+#include "cluster.hh"
+#include "scheduler.hh"
+
+using namespace std;
+
+void LinkModel::json( ostream& out ) const
+{
+  out << "{ \"latency_us\": " << latency.count() << ", \"bandwidth\": " << bandwidth << ", \"loss\": " << loss
+      << ", \"retransmit_us\": " << retransmit.count() << " }";
+}
+
+LinkEmulator::LinkEmulator( const LinkModel& model )
+  : model_( model )
+  , accept_category_( events_.add_category( "link_accept" ) )
+  , forward_category_( events_.add_category( "link_forward" ) )
+  , deliver_category_( events_.add_category( "link_deliver" ) )
+{
+  events_.add_rule( deliver_category_, [&] { timers_.advance(); }, [&] { return timers_.due(); } );
+}
+
+LinkEmulator::~LinkEmulator()
+{
+  should_exit_ = true;
+  if ( thread_.joinable() ) {
+    thread_.join();
+  }
+}
+
+Address LinkEmulator::add_link( const Address& target )
+{
+  if ( thread_.joinable() ) {
+    throw runtime_error( "LinkEmulator: links must be added before starting" );
+  }
+
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address( "127.0.0.1", 0 ) );
+  listener.listen();
+  listener.set_blocking( false );
+  Address address = listener.local_address();
+
+  listeners_.push_back( move( listener ) );
+  auto& socket = listeners_.back();
+  events_.add_rule( accept_category_, socket, Direction::In, [this, &socket, target] { accept( socket, target ); } );
+  return address;
+}
+
+void LinkEmulator::start()
+{
+  thread_ = thread( [&] {
+    while ( not should_exit_ ) {
+      events_.wait_next_event( 1 );
+    }
+  } );
+}
+
+void LinkEmulator::accept( TCPSocket& listener, const Address& target )
+{
+  TCPSocket client = listener.accept();
+  TCPSocket server;
+  server.connect( target );
+  client.set_blocking( false );
+  server.set_blocking( false );
+
+  auto up = make_shared<Pipe>( Pipe { .from = client.duplicate(), .to = server.duplicate() } );
+  auto down = make_shared<Pipe>( Pipe { .from = server.duplicate(), .to = client.duplicate() } );
+  connections_.push_back( { up, down } );
+  install( up );
+  install( down );
+}
+
+LinkEmulator::Clock::time_point LinkEmulator::release_time( Pipe& pipe, const size_t bytes )
+{
+  // Data leaves once the link has sent everything queued before it, and arrives one latency later; a lost chunk
+  // arrives one retransmission timeout later still, holding up everything behind it
+  auto now = Clock::now();
+  auto start = max( now, pipe.next_free );
+  pipe.next_free = start;
+  if ( model_.bandwidth != 0 ) {
+    pipe.next_free += chrono::microseconds( bytes * 1'000'000 / model_.bandwidth );
+  }
+
+  auto release = pipe.next_free + model_.latency;
+  if ( model_.loss > 0 and uniform_real_distribution<double>( 0, 1 )( random_ ) < model_.loss ) {
+    release += model_.retransmit;
+  }
+  pipe.last_release = max( pipe.last_release, release );
+  return pipe.last_release;
+}
+
+void LinkEmulator::install( shared_ptr<Pipe> pipe )
+{
+  events_.add_rule(
+    forward_category_,
+    pipe->from,
+    Direction::In,
+    [this, pipe] {
+      string chunk( CHUNK, 0 );
+      chunk.resize( pipe->from.read( chunk ) );
+      if ( chunk.empty() ) {
+        return;
+      }
+
+      pipe->in_flight += chunk.size();
+      auto delay = chrono::duration_cast<chrono::microseconds>( release_time( *pipe, chunk.size() ) - Clock::now() );
+      timers_.schedule( delay, [pipe, chunk = move( chunk )] {
+        pipe->in_flight -= chunk.size();
+        pipe->outbound.append( chunk );
+      } );
+    },
+    [pipe] { return pipe->in_flight + pipe->outbound.size() < MAX_IN_FLIGHT; },
+    [this, pipe] {
+      // The sender hung up; pass that on once everything it sent has been delivered
+      auto delay = chrono::duration_cast<chrono::microseconds>( release_time( *pipe, 0 ) - Clock::now() );
+      timers_.schedule( delay, [pipe] {
+        pipe->closed = true;
+        if ( pipe->outbound.empty() ) {
+          ::shutdown( pipe->to.fd_num(), SHUT_WR );
+        }
+      } );
+    } );
+
+  events_.add_rule(
+    forward_category_,
+    pipe->to,
+    Direction::Out,
+    [pipe] {
+      try {
+        pipe->outbound.erase( 0, pipe->to.write( pipe->outbound ) );
+      } catch ( const exception& ) {
+        pipe->outbound.clear();
+      }
+      if ( pipe->closed and pipe->outbound.empty() ) {
+        ::shutdown( pipe->to.fd_num(), SHUT_WR );
+      }
+    },
+    [pipe] { return not pipe->outbound.empty(); } );
+}
+
+Cluster::Cluster( const size_t nodes, const size_t threads_per_node, const LinkModel& link )
+{
+  if ( nodes == 0 ) {
+    throw runtime_error( "Cluster needs at least one node" );
+  }
+
+  // Nodes in one process would otherwise talk over Unix-domain sockets, bypassing the emulated links
+  if ( not link.is_ideal() ) {
+    LocalRemote::enable = false;
+    emulator_.emplace( link );
+  }
+
+  for ( size_t i = 0; i < nodes; i++ ) {
+    auto relater = make_unique<Relater>( threads_per_node, nullopt, make_shared<HintScheduler>() );
+    auto network = make_unique<NetworkWorker<Remote>>( *relater );
+    network->start();
+    auto address = network->start_server( Address( "127.0.0.1", 0 ) );
+    nodes_.push_back( { move( relater ), move( network ), address } );
+  }
+
+  vector<pair<size_t, Address>> links;
+  for ( size_t i = 0; i < nodes; i++ ) {
+    for ( size_t j = 0; j < i; j++ ) {
+      nodes_[i].peers.push_back( emulator_ ? emulator_->add_link( nodes_[j].address ) : nodes_[j].address );
+      links.push_back( { i, nodes_[i].peers.back() } );
+    }
+  }
+
+  if ( emulator_ ) {
+    emulator_->start();
+  }
+
+  for ( const auto& [from, address] : links ) {
+    nodes_[from].network->connect( address );
+    nodes_[from].network->get_remote( address );
+  }
+}
+
+Cluster::~Cluster()
+{
+  for ( auto& node : nodes_ ) {
+    node.network->stop();
+  }
+  nodes_.clear();
+  LocalRemote::enable = local_remotes_;
+}
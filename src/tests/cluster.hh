@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "network.hh"
+#include "relater.hh"
+#include "socket.hh"
+#include "timer_wheel.hh"
+
+/**
+ * The properties of an emulated network link, applied independently to each direction of every connection.
+ */
+struct LinkModel
+{
+  std::chrono::microseconds latency { 0 };
+  // Bytes per second; 0 means unlimited
+  uint64_t bandwidth { 0 };
+  // Probability that a chunk of data is lost and has to be retransmitted
+  double loss { 0 };
+  // How long a lost chunk is delayed by; later data waits behind it, as on a TCP connection
+  std::chrono::microseconds retransmit { std::chrono::milliseconds( 200 ) };
+
+  bool is_ideal() const { return latency.count() == 0 and bandwidth == 0 and loss == 0; }
+
+  void json( std::ostream& out ) const;
+};
+
+/**
+ * Forwards TCP connections through emulated links. Each link listens on a loopback port and connects every
+ * accepted connection to its target; data read from one side is handed to the other side once the link would
+ * have delivered it. All links are served by one thread, with delivery driven by a TimerWheel, so the emulator
+ * does not need a thread per connection or per message. The wheel is only advanced when the event loop wakes up,
+ * so latencies are accurate to about a millisecond.
+ */
+class LinkEmulator
+{
+  using Clock = TimerWheel::Clock;
+
+  struct Pipe
+  {
+    FileDescriptor from;
+    FileDescriptor to;
+    std::string outbound {};
+    size_t in_flight {};
+    Clock::time_point next_free { Clock::now() };
+    Clock::time_point last_release { Clock::now() };
+    bool closed {};
+  };
+
+  struct Connection
+  {
+    std::shared_ptr<Pipe> up;
+    std::shared_ptr<Pipe> down;
+  };
+
+  static constexpr size_t CHUNK = 64 * 1024;
+  static constexpr size_t MAX_IN_FLIGHT = 16 * 1024 * 1024;
+
+  LinkModel model_;
+  EventLoop events_ {};
+  TimerWheel timers_ { std::chrono::microseconds( 50 ) };
+  std::mt19937_64 random_ { 0 };
+  std::list<Connection> connections_ {};
+  std::list<TCPSocket> listeners_ {};
+  std::atomic<bool> should_exit_ { false };
+  std::thread thread_ {};
+
+  size_t accept_category_;
+  size_t forward_category_;
+  size_t deliver_category_;
+
+  void accept( TCPSocket& listener, const Address& target );
+  void install( std::shared_ptr<Pipe> pipe );
+  Clock::time_point release_time( Pipe& pipe, size_t bytes );
+
+public:
+  explicit LinkEmulator( const LinkModel& model );
+  ~LinkEmulator();
+
+  //! Adds a link to @p target and returns the address to connect to instead. Must be called before start().
+  Address add_link( const Address& target );
+
+  void start();
+};
+
+/**
+ * A cluster of fixpoint nodes in one process, each with its own Relater and NetworkWorker, connected all-to-all
+ * over loopback TCP. Unless the link model is ideal, every connection goes through a LinkEmulator. Node 0 is the
+ * entry point: work submitted to it is distributed by its scheduler like on a real deployment.
+ */
+class Cluster
+{
+  struct Node
+  {
+    std::unique_ptr<Relater> relater;
+    std::unique_ptr<NetworkWorker<Remote>> network;
+    Address address;
+    // The address this node connected to each of the nodes before it through
+    std::vector<Address> peers {};
+  };
+
+  std::optional<LinkEmulator> emulator_ {};
+  std::vector<Node> nodes_ {};
+
+  // LocalRemote::enable as it was before the cluster overrode it
+  bool local_remotes_ { LocalRemote::enable };
+
+public:
+  Cluster( size_t nodes, size_t threads_per_node, const LinkModel& link = {} );
+  ~Cluster();
+
+  size_t size() const { return nodes_.size(); }
+  Relater& node( size_t i ) { return *nodes_.at( i ).relater; }
+  Relater& entry() { return node( 0 ); }
+
+  //! The connection from node @p from to node @p to, which must come before it.
+  std::shared_ptr<IRuntime> remote( size_t from, size_t to )
+  {
+    return nodes_.at( from ).network->get_remote( nodes_.at( from ).peers.at( to ) );
+  }
+
+  Handle<Value> execute( Handle<Relation> relation ) { return entry().execute( relation ); }
+};
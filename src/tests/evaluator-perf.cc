@@ -0,0 +1,111 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "relater.hh"
+#include "scheduler.hh"
+#include "test.hh"
+
+// Compares the recursive schedulers against the ContinuationScheduler on a deep chain of thunks (fib) and on a
+// wide tree (mapreduce), where the recursive ones hold a native stack frame per level of the job.
+//
+// Usage: evaluator-perf [fib argument] [mapreduce elements] [threads]
+
+using namespace std;
+
+namespace {
+
+const string FIB = "testing/wasm-examples/fib.wasm";
+const string ADDBLOB = "testing/wasm-examples/addblob.wasm";
+const string MAPREDUCE = "applications-prefix/src/applications-build/mapreduce/mapreduce.wasm";
+const string CURRY = "applications-prefix/src/applications-build/curry/curry.wasm";
+const string ADD = "testing/wasm-examples/add-simple.wasm";
+
+Handle<Relation> fib( Relater& rt, uint32_t x )
+{
+  auto thunk = Handle<Application>( handle::upcast( tree( rt,
+                                                          limits( rt, 1024 * 1024, 1024, 1 ),
+                                                          compile( rt, file( rt, FIB ) ),
+                                                          Handle<Literal>( x ),
+                                                          compile( rt, file( rt, ADDBLOB ) ) ) ) );
+  return Handle<Eval>( thunk );
+}
+
+Handle<Relation> mapreduce( Relater& rt, uint32_t elements )
+{
+  auto sum = compile( rt, file( rt, ADD ) );
+  auto add = Handle<Strict>( Handle<Thunk>( handle::upcast(
+    tree( rt, limits( rt, 1024 * 1024, 1024, 1 ), compile( rt, file( rt, CURRY ) ), sum, 2_literal32 ) ) ) );
+  auto add100 = Handle<Strict>(
+    Handle<Thunk>( handle::upcast( tree( rt, limits( rt, 1024 * 1024, 1024, 1 ), add, 0x100_literal32 ) ) ) );
+
+  auto input = OwnedMutTree::allocate( elements );
+  for ( size_t i = 0; i < elements; i++ ) {
+    input[i] = Handle<Literal>( static_cast<uint32_t>( i ) );
+  }
+
+  auto thunk = Handle<Thunk>( handle::upcast( tree( rt,
+                                                    limits( rt, 1024 * 1024, 1024, 1 ),
+                                                    compile( rt, file( rt, MAPREDUCE ) ),
+                                                    add100,
+                                                    sum,
+                                                    handle::upcast( rt.create( make_shared<OwnedTree>(
+                                                      std::move( input ) ) ) ),
+                                                    limits( rt, 1024 * 1024, 1024, 1 ),
+                                                    limits( rt, 1024 * 1024, 1024, 1 ) ) ) );
+  return Handle<Eval>( thunk );
+}
+
+shared_ptr<Scheduler> make_scheduler( const string& name )
+{
+  if ( name == "local" ) {
+    return make_shared<LocalScheduler>();
+  } else if ( name == "continuation" ) {
+    return make_shared<ContinuationScheduler>();
+  }
+  return make_shared<HintScheduler>();
+}
+
+void run( const string& workload, const string& scheduler, uint32_t argument, size_t threads )
+{
+  auto rt = make_shared<Relater>( threads, nullopt, make_scheduler( scheduler ) );
+  auto job = workload == "fib" ? fib( *rt, argument ) : mapreduce( *rt, argument );
+
+  struct rusage before, after;
+  getrusage( RUSAGE_SELF, &before );
+  auto run = timed( [&] { return rt->execute( job ); } );
+  getrusage( RUSAGE_SELF, &after );
+
+  PerfRecord()
+    .add( "workload", workload )
+    .add( "argument", argument )
+    .add( "scheduler", scheduler )
+    .add( "threads", threads )
+    .add( "elapsed_us", run.elapsed_us )
+    .usage( before, after )
+    .add( "result", literal_value( run.result ) )
+    .print();
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  uint32_t fib_argument = argc > 1 ? stoul( argv[1] ) : 20;
+  uint32_t elements = argc > 2 ? stoul( argv[2] ) : 4096;
+  size_t threads = argc > 3 ? stoull( argv[3] ) : thread::hardware_concurrency();
+
+  vector<pair<string, uint32_t>> workloads { { "fib", fib_argument }, { "mapreduce", elements } };
+  for ( const auto& workload : workloads ) {
+    for ( const auto& scheduler : { "local", "hint", "continuation" } ) {
+      if ( not in_child( [&] { run( workload.first, scheduler, workload.second, threads ); } ) ) {
+        cerr << workload.first << " with the " << scheduler << " scheduler failed" << endl;
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "overload.hh"
+#include "relater.hh"
+#include "scheduler.hh"
+#include "test.hh"
+
+// Evaluates a wide ObjectTree whose children are selection thunks with the LocalScheduler, with and without fanning
+// the children out to idle executor threads.
+//
+// Usage: fan-out-perf [elements] [threads] [chunk]
+
+using namespace std;
+
+namespace {
+
+Handle<ObjectTree> object_tree( Relater& rt, OwnedMutTree&& tree )
+{
+  return rt.create( make_shared<OwnedTree>( std::move( tree ) ) )
+    .visit<Handle<ObjectTree>>( overload {
+      []( Handle<ExpressionTree> ) -> Handle<ObjectTree> { throw runtime_error( "Invalid tree." ); },
+      []( auto x ) { return Handle<ObjectTree>( x ); },
+    } );
+}
+
+// A tree of @p elements selection thunks, each picking one element out of a tree of literals; @p salt keeps runs
+// from sharing results
+Handle<Relation> selections( Relater& rt, size_t elements, uint64_t salt )
+{
+  auto values = OwnedMutTree::allocate( elements );
+  for ( size_t i = 0; i < elements; i++ ) {
+    values[i] = Handle<Literal>( salt * elements + i );
+  }
+  auto base = object_tree( rt, std::move( values ) );
+
+  auto thunks = OwnedMutTree::allocate( elements );
+  for ( size_t i = 0; i < elements; i++ ) {
+    auto pick = OwnedMutTree::allocate( 2 );
+    pick[0] = base;
+    pick[1] = Handle<Literal>( static_cast<uint64_t>( i ) );
+    thunks[i] = Handle<Selection>( object_tree( rt, std::move( pick ) ) );
+  }
+
+  return Handle<Eval>( object_tree( rt, std::move( thunks ) ) );
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t elements = argc > 1 ? stoull( argv[1] ) : 100000;
+  size_t threads = argc > 2 ? stoull( argv[2] ) : thread::hardware_concurrency();
+  LocalScheduler::fan_out_chunk = argc > 3 ? stoull( argv[3] ) : LocalScheduler::fan_out_chunk;
+
+  auto rt = make_shared<Relater>( threads, nullopt, make_shared<LocalScheduler>() );
+
+  uint64_t salt = 0;
+  for ( size_t width : { size_t( 0 ), LocalScheduler::fan_out_chunk + 1 } ) {
+    LocalScheduler::fan_out_width = width;
+    auto job = selections( *rt, elements, salt++ );
+
+    auto run = timed( [&] { return rt->execute( job ); } );
+
+    PerfRecord()
+      .add( "elements", elements )
+      .add( "threads", threads )
+      .add( "fan_out", width > 0 )
+      .add( "chunk", LocalScheduler::fan_out_chunk )
+      .add( "elapsed_us", run.elapsed_us )
+      .add( "result", run.result.try_into<ValueTree>().has_value() ? "tree" : "other" )
+      .print();
+  }
+
+  return 0;
+}
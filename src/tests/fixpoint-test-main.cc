@@ -16,12 +16,16 @@ int main( int argc, char* argv[] )
 
   OptionParser parser( "fixpoint-test", "Run a fixpoint test" );
   optional<string> sche_opt;
-  parser.AddOption( 's', "scheduler", "scheduler", "Scheduler to use [local, hint]", [&]( const char* argument ) {
-    sche_opt = argument;
-    if ( not( *sche_opt == "hint" or *sche_opt == "local" ) ) {
-      throw runtime_error( "Invalid scheduler: " + sche_opt.value() );
-    }
-  } );
+  parser.AddOption( 's',
+                    "scheduler",
+                    "scheduler",
+                    "Scheduler to use [local, hint, continuation]",
+                    [&]( const char* argument ) {
+                      sche_opt = argument;
+                      if ( not( *sche_opt == "hint" or *sche_opt == "local" or *sche_opt == "continuation" ) ) {
+                        throw runtime_error( "Invalid scheduler: " + sche_opt.value() );
+                      }
+                    } );
 
   google::InitGoogleLogging( argv[0] );
   google::SetStderrLogging( google::INFO );
@@ -33,6 +37,8 @@ int main( int argc, char* argv[] )
   if ( sche_opt.has_value() ) {
     if ( *sche_opt == "local" ) {
       scheduler = make_shared<LocalScheduler>();
+    } else if ( *sche_opt == "continuation" ) {
+      scheduler = make_shared<ContinuationScheduler>();
     }
   }
 
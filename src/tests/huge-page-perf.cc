@@ -0,0 +1,106 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "huge_pages.hh"
+#include "relater.hh"
+#include "test.hh"
+
+// Counts words in a large generated text, once with huge pages left to the system's policy and once with linear
+// memories and blob buffers above a threshold backed by huge pages, and reports the page faults taken by each run.
+//
+// Usage: huge-page-perf [input MiB] [chunks] [threads] [threshold MiB]
+
+using namespace std;
+
+namespace {
+
+const string MAPREDUCE = "applications-prefix/src/applications-build/mapreduce/mapreduce.wasm";
+const string COUNT_WORDS = "applications-prefix/src/applications-build/count-words/count_words.wasm";
+const string MERGE_COUNTS = "applications-prefix/src/applications-build/count-words/merge_counts.wasm";
+
+// A mapped blob of @p size bytes of random words, so it gets huge pages under the same policy as other blobs
+Handle<Blob> text( Relater& rt, size_t size, uint32_t seed )
+{
+  static const vector<string> words { "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "times" };
+  mt19937 gen( seed );
+  uniform_int_distribution<size_t> pick( 0, words.size() - 1 );
+
+  auto blob = OwnedMutBlob::map( size );
+  size_t offset = 0;
+  while ( offset < size ) {
+    const auto& word = words[pick( gen )];
+    size_t length = min( word.size(), size - offset );
+    memcpy( blob.data() + offset, word.data(), length );
+    offset += length;
+    if ( offset < size ) {
+      blob.data()[offset++] = ' ';
+    }
+  }
+  return rt.create( make_shared<OwnedBlob>( std::move( blob ) ) );
+}
+
+Handle<Relation> count_words( Relater& rt, size_t input_size, size_t chunks )
+{
+  auto goal = blob( rt, "the" );
+  auto input = OwnedMutTree::allocate( chunks );
+  for ( size_t i = 0; i < chunks; i++ ) {
+    input[i] = handle::upcast( tree( rt, goal, text( rt, input_size / chunks, i ) ) );
+  }
+
+  auto thunk = Handle<Thunk>( handle::upcast( tree( rt,
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ),
+                                                    compile( rt, file( rt, MAPREDUCE ) ),
+                                                    compile( rt, file( rt, COUNT_WORDS ) ),
+                                                    compile( rt, file( rt, MERGE_COUNTS ) ),
+                                                    handle::upcast( rt.create( make_shared<OwnedTree>(
+                                                      std::move( input ) ) ) ),
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ),
+                                                    limits( rt, 1024 * 1024 * 1024, 1024, 1 ) ) ) );
+  return Handle<Eval>( thunk );
+}
+
+void run( size_t input_size, size_t chunks, size_t threads, uint64_t threshold )
+{
+  huge_pages::threshold = threshold;
+  auto rt = make_shared<Relater>( threads );
+  auto job = count_words( *rt, input_size, chunks );
+
+  struct rusage before, after;
+  getrusage( RUSAGE_SELF, &before );
+  auto run = timed( [&] { return rt->execute( job ); } );
+  getrusage( RUSAGE_SELF, &after );
+
+  PerfRecord()
+    .add( "input_bytes", input_size )
+    .add( "chunks", chunks )
+    .add( "threads", threads )
+    .add( "huge_page_threshold", threshold )
+    .add( "elapsed_us", run.elapsed_us )
+    .usage( before, after )
+    .add( "result", literal_value( run.result ) )
+    .print();
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t input_size = ( argc > 1 ? stoull( argv[1] ) : 1024 ) << 20;
+  size_t chunks = argc > 2 ? stoull( argv[2] ) : 16;
+  size_t threads = argc > 3 ? stoull( argv[3] ) : thread::hardware_concurrency();
+  uint64_t threshold = ( argc > 4 ? stoull( argv[4] ) : 2 ) << 20;
+
+  for ( uint64_t t : { uint64_t( 0 ), threshold } ) {
+    if ( not in_child( [&] { run( input_size, chunks, threads, t ); } ) ) {
+      cerr << "count-words with a huge page threshold of " << t << " bytes failed" << endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "executor.hh"
+#include "overload.hh"
+#include "relater.hh"
+#include "test.hh"
+
+// Applies add_2 from applications/map to every element of a wide tree, once with each Application instantiated on
+// its own and once with ready Applications applied in batches through the program's batch entry point.
+//
+// Usage: map-batch-perf [elements] [threads] [batch size]
+
+using namespace std;
+
+namespace {
+
+const string ADD_2_MAP = "applications-prefix/src/applications-build/map/add_2_map.wasm";
+
+// A tree of @p elements Applications of add_2; @p salt keeps runs from sharing results
+Handle<Relation> add_2s( Relater& rt, Handle<Fix> program, size_t elements, uint32_t salt )
+{
+  auto applications = OwnedMutTree::allocate( elements );
+  for ( size_t i = 0; i < elements; i++ ) {
+    auto x = Handle<Literal>( static_cast<uint32_t>( salt * elements + i ) );
+    applications[i] = Handle<Application>(
+      handle::upcast( tree( rt, limits( rt, 1024 * 1024, 1024, 1 ), program, Handle<Literal>( uint32_t( 1 ) ), x ) ) );
+  }
+
+  auto combinations = rt.create( make_shared<OwnedTree>( std::move( applications ) ) );
+  return Handle<Eval>( combinations.visit<Handle<ObjectTree>>( overload {
+    []( Handle<ExpressionTree> ) -> Handle<ObjectTree> { throw runtime_error( "Invalid tree." ); },
+    []( auto x ) { return Handle<ObjectTree>( x ); },
+  } ) );
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t elements = argc > 1 ? stoull( argv[1] ) : 10000;
+  size_t threads = argc > 2 ? stoull( argv[2] ) : thread::hardware_concurrency();
+  size_t batch_size = argc > 3 ? stoull( argv[3] ) : Executor::batch_size.load();
+
+  auto rt = make_shared<Relater>( threads );
+  auto program = compile( *rt, file( *rt, ADD_2_MAP ) );
+
+  uint32_t salt = 0;
+  for ( size_t size : { size_t( 0 ), batch_size } ) {
+    Executor::batch_size = size;
+    auto job = add_2s( *rt, program, elements, salt++ );
+
+    auto run = timed( [&] { return rt->execute( job ); } );
+
+    PerfRecord()
+      .add( "elements", elements )
+      .add( "threads", threads )
+      .add( "batch_size", size )
+      .add( "elapsed_us", run.elapsed_us )
+      .add( "result", run.result.try_into<ValueTree>().has_value() ? "tree" : "other" )
+      .print();
+  }
+
+  return 0;
+}
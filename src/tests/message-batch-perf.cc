@@ -0,0 +1,97 @@
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "handle.hh"
+#include "message.hh"
+
+// Compares framing RUN/RESULT/LOADBLOB messages one per frame against packing them into BATCH messages.
+//
+// Usage: message-batch-perf [messages]
+
+using namespace std;
+
+vector<OutgoingMessage> make_messages( size_t count )
+{
+  vector<OutgoingMessage> messages;
+  for ( size_t i = 0; i < count; i++ ) {
+    auto task = Handle<Eval>( Handle<Literal>( i ) );
+    switch ( i % 3 ) {
+      case 0:
+        messages.push_back( OutgoingMessage::to_message( RunPayload { .task = task } ) );
+        break;
+      case 1:
+        messages.push_back(
+          OutgoingMessage::to_message( ResultPayload { .task = task, .result = Handle<Literal>( i ) } ) );
+        break;
+      default:
+        messages.push_back( OutgoingMessage::to_message( LoadBlobPayload { .handle = Handle<Literal>( i ) } ) );
+        break;
+    }
+  }
+  return messages;
+}
+
+void append( string& wire, OutgoingMessage&& msg )
+{
+  string header;
+  msg.serialize_header( header );
+  wire.append( header );
+  wire.append( msg.payload() );
+}
+
+void report( const string& name, size_t count, size_t bytes, clock_t cpu )
+{
+  double seconds = static_cast<double>( cpu ) / CLOCKS_PER_SEC;
+  cout << name << ": " << count << " messages, " << bytes << " bytes, " << static_cast<size_t>( count / seconds )
+       << " msgs/s, " << seconds * 1e9 / count << " ns CPU/msg" << endl;
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t count = argc > 1 ? stoull( argv[1] ) : 1000000;
+
+  {
+    auto messages = make_messages( count );
+    auto start = clock();
+    string wire;
+    for ( auto& msg : messages ) {
+      append( wire, std::move( msg ) );
+    }
+    MessageParser parser;
+    parser.parse( wire );
+    size_t parsed = 0;
+    while ( not parser.empty() ) {
+      parser.pop();
+      parsed++;
+    }
+    report( "unbatched", parsed, wire.size(), clock() - start );
+  }
+
+  {
+    auto messages = make_messages( count );
+    auto start = clock();
+    string wire;
+    MessageBatch batch;
+    for ( auto& msg : messages ) {
+      batch.push( msg );
+      if ( batch.size() >= 16384 ) {
+        append( wire, batch.release() );
+      }
+    }
+    if ( not batch.empty() ) {
+      append( wire, batch.release() );
+    }
+    MessageParser parser;
+    parser.parse( wire );
+    size_t parsed = 0;
+    while ( not parser.empty() ) {
+      parser.pop();
+      parsed++;
+    }
+    report( "batched", parsed, wire.size(), clock() - start );
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "handle.hh"
+#include "interface.hh"
+#include "network.hh"
+#include "object.hh"
+#include "runtimestorage.hh"
+
+// Measures how long a server takes to receive jobs from many loopback peers, each pushing a tree of blobs.
+//
+// Usage: network-scaling-perf [network threads] [processing threads] [peers] [blobs per peer] [blob size]
+
+using namespace std;
+
+class PerfRuntime : public MultiWorkerRuntime
+{
+  RuntimeStorage storage_ {};
+
+public:
+  optional<BlobData> get( Handle<Named> name ) override { return storage_.get( name ); };
+  optional<TreeData> get( Handle<AnyTree> name ) override { return storage_.get( name ); };
+  optional<Handle<Object>> get( Handle<Relation> name ) override { return storage_.get( name ); };
+  optional<Handle<AnyTree>> get_handle( Handle<AnyTree> name ) override { return storage_.get_handle( name ); };
+  optional<TreeData> get_shallow( Handle<AnyTree> name ) override { return storage_.get_shallow( name ); };
+
+  void put( Handle<Named> name, BlobData data ) override { storage_.create( data, name ); }
+  void put( Handle<AnyTree> name, TreeData data ) override { storage_.create( data, name ); }
+  void put_shallow( Handle<AnyTree> name, TreeData data ) override { storage_.create_tree_shallow( data, name ); }
+  void put( Handle<Relation> name, Handle<Object> data ) override { storage_.create( data, name ); }
+
+  bool contains( Handle<Named> handle ) override { return storage_.contains( handle ); }
+  bool contains( Handle<AnyTree> handle ) override { return storage_.contains( handle ); }
+  bool contains_shallow( Handle<AnyTree> handle ) override { return storage_.contains_shallow( handle ); }
+  bool contains( Handle<Relation> handle ) override { return storage_.contains( handle ); }
+
+  void add_worker( shared_ptr<IRuntime> ) override {}
+};
+
+Handle<AnyTree> create_job( PerfRuntime& rt, size_t peer, size_t blobs, size_t blob_size )
+{
+  OwnedMutTree tree = OwnedMutTree::allocate( blobs );
+  for ( size_t i = 0; i < blobs; i++ ) {
+    OwnedMutBlob blob = OwnedMutBlob::allocate( blob_size );
+    memset( blob.data(), 0, blob_size );
+    memcpy( blob.data(), &peer, sizeof( peer ) );
+    memcpy( blob.data() + sizeof( peer ), &i, sizeof( i ) );
+    tree[i] = rt.create( make_shared<OwnedBlob>( std::move( blob ) ) );
+  }
+  return rt.create( make_shared<OwnedTree>( std::move( tree ) ) );
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t network_threads = argc > 1 ? stoull( argv[1] ) : 1;
+  size_t processing_threads = argc > 2 ? stoull( argv[2] ) : 0;
+  size_t peers = argc > 3 ? stoull( argv[3] ) : 8;
+  size_t blobs = argc > 4 ? stoull( argv[4] ) : 1024;
+  size_t blob_size = argc > 5 ? stoull( argv[5] ) : 4096;
+
+  PerfRuntime server_rt {};
+  NetworkWorker<Remote> server( server_rt, network_threads, processing_threads );
+  server.start();
+  Address address = server.start_server( Address( "127.0.0.1", 0 ) );
+
+  vector<unique_ptr<PerfRuntime>> peer_rts;
+  vector<unique_ptr<NetworkWorker<Remote>>> peer_workers;
+  vector<Handle<AnyTree>> jobs;
+  vector<shared_ptr<IRuntime>> remotes;
+
+  for ( size_t i = 0; i < peers; i++ ) {
+    peer_rts.push_back( make_unique<PerfRuntime>() );
+    jobs.push_back( create_job( *peer_rts.back(), i, blobs, blob_size ) );
+    peer_workers.push_back( make_unique<NetworkWorker<Remote>>( *peer_rts.back() ) );
+    peer_workers.back()->start();
+    peer_workers.back()->connect( address );
+    remotes.push_back( peer_workers.back()->get_remote( address ) );
+  }
+
+  auto start = chrono::steady_clock::now();
+
+  for ( size_t i = 0; i < peers; i++ ) {
+    remotes[i]->get( Handle<Eval>( handle::extract<ValueTree>( jobs[i] ).value() ) );
+  }
+
+  for ( const auto& job : jobs ) {
+    while ( !server_rt.contains( job ) ) {
+      this_thread::yield();
+    }
+  }
+
+  auto elapsed = chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - start ).count();
+  size_t messages = peers * ( blobs + 1 );
+  size_t bytes = peers * blobs * blob_size;
+
+  cout << "network threads: " << network_threads << ", processing threads: " << processing_threads
+       << ", peers: " << peers << endl;
+  cout << "received " << messages << " messages (" << bytes << " bytes) in " << elapsed << " us" << endl;
+  cout << "throughput: " << messages * 1000000 / max( elapsed, int64_t( 1 ) ) << " msgs/s, "
+       << static_cast<double>( bytes ) / max( elapsed, int64_t( 1 ) ) << " MB/s" << endl;
+
+  for ( auto& worker : peer_workers ) {
+    worker->stop();
+  }
+  server.stop();
+
+  return 0;
+}
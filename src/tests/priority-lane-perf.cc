@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "handle.hh"
+#include "handle_util.hh"
+#include "interface.hh"
+#include "network.hh"
+#include "object.hh"
+#include "runtimestorage.hh"
+
+// Measures the RUN-to-RESULT latency of small jobs, first on an idle connection and then while a large blob is being
+// transferred on the same connection.
+//
+// Usage: priority-lane-perf [blob size in MiB] [small jobs] [chunking (0/1)]
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+class PerfRuntime : public MultiWorkerRuntime
+{
+  RuntimeStorage storage_ {};
+  mutex results_mutex_ {};
+  condition_variable results_cv_ {};
+  absl::flat_hash_map<Handle<Relation>, Clock::time_point> results_ {};
+
+public:
+  optional<BlobData> get( Handle<Named> name ) override { return storage_.get( name ); };
+  optional<TreeData> get( Handle<AnyTree> name ) override { return storage_.get( name ); };
+  optional<Handle<AnyTree>> get_handle( Handle<AnyTree> name ) override { return storage_.get_handle( name ); };
+  optional<TreeData> get_shallow( Handle<AnyTree> name ) override { return storage_.get_shallow( name ); };
+
+  // Every job finishes as soon as it is received
+  optional<Handle<Object>> get( Handle<Relation> ) override { return Handle<Literal>( uint64_t( 0 ) ); };
+
+  void put( Handle<Named> name, BlobData data ) override { storage_.create( data, name ); }
+  void put( Handle<AnyTree> name, TreeData data ) override { storage_.create( data, name ); }
+  void put_shallow( Handle<AnyTree> name, TreeData data ) override { storage_.create_tree_shallow( data, name ); }
+  void put( Handle<Relation> name, Handle<Object> ) override
+  {
+    unique_lock lock( results_mutex_ );
+    results_.insert_or_assign( name, Clock::now() );
+    results_cv_.notify_all();
+  }
+
+  bool contains( Handle<Named> handle ) override { return storage_.contains( handle ); }
+  bool contains( Handle<AnyTree> handle ) override { return storage_.contains( handle ); }
+  bool contains_shallow( Handle<AnyTree> handle ) override { return storage_.contains_shallow( handle ); }
+  bool contains( Handle<Relation> ) override { return false; }
+
+  void add_worker( shared_ptr<IRuntime> ) override {}
+
+  Clock::time_point wait( Handle<Relation> job )
+  {
+    unique_lock lock( results_mutex_ );
+    results_cv_.wait( lock, [&] { return results_.contains( job ); } );
+    return results_.at( job );
+  }
+
+  bool done( Handle<Relation> job )
+  {
+    unique_lock lock( results_mutex_ );
+    return results_.contains( job );
+  }
+};
+
+Handle<Relation> create_job( PerfRuntime& rt, size_t id, size_t blob_size )
+{
+  OwnedMutBlob blob = OwnedMutBlob::allocate( blob_size );
+  memset( blob.data(), 0, blob_size );
+  memcpy( blob.data(), &id, sizeof( id ) );
+
+  OwnedMutTree tree = OwnedMutTree::allocate( 1 );
+  tree[0] = rt.create( make_shared<OwnedBlob>( std::move( blob ) ) );
+  auto handle = rt.create( make_shared<OwnedTree>( std::move( tree ) ) );
+  return Handle<Eval>( handle::extract<ValueTree>( handle ).value() );
+}
+
+void report( const string& name, vector<int64_t> latencies )
+{
+  if ( latencies.empty() ) {
+    cout << name << ": no jobs completed" << endl;
+    return;
+  }
+
+  sort( latencies.begin(), latencies.end() );
+  auto percentile = [&]( double p ) { return latencies[min( latencies.size() - 1, size_t( p * latencies.size() ) )]; };
+  cout << name << ": " << latencies.size() << " jobs, p50 " << percentile( 0.5 ) << " us, p99 " << percentile( 0.99 )
+       << " us, max " << latencies.back() << " us" << endl;
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t blob_size = ( argc > 1 ? stoull( argv[1] ) : 256 ) << 20;
+  size_t jobs = argc > 2 ? stoull( argv[2] ) : 200;
+  Remote::enable_chunking = argc > 3 ? stoull( argv[3] ) : true;
+
+  // Measure the TCP lanes, not the same-host transport
+  LocalRemote::enable = false;
+
+  PerfRuntime server_rt {};
+  NetworkWorker<Remote> server( server_rt );
+  server.start();
+  Address address = server.start_server( Address( "127.0.0.1", 0 ) );
+
+  PerfRuntime client_rt {};
+  NetworkWorker<Remote> client( client_rt );
+  client.start();
+  client.connect( address );
+  auto remote = client.get_remote( address );
+
+  size_t next_id = 0;
+  auto run_small = [&] {
+    auto job = create_job( client_rt, next_id++, 64 );
+    auto start = Clock::now();
+    remote->get( job );
+    return chrono::duration_cast<chrono::microseconds>( client_rt.wait( job ) - start ).count();
+  };
+
+  vector<int64_t> idle;
+  for ( size_t i = 0; i < jobs; i++ ) {
+    idle.push_back( run_small() );
+  }
+
+  auto large = create_job( client_rt, next_id++, blob_size );
+  auto start = Clock::now();
+  remote->get( large );
+
+  vector<int64_t> loaded;
+  while ( loaded.size() < jobs and not client_rt.done( large ) ) {
+    loaded.push_back( run_small() );
+  }
+  auto transfer = chrono::duration_cast<chrono::milliseconds>( client_rt.wait( large ) - start ).count();
+
+  cout << "chunking: " << ( Remote::enable_chunking ? "on" : "off" ) << ", large blob: " << ( blob_size >> 20 )
+       << " MiB in " << transfer << " ms" << endl;
+  report( "idle", idle );
+  report( "during transfer", loaded );
+
+  client.stop();
+  server.stop();
+
+  return 0;
+}
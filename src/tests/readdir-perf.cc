@@ -0,0 +1,120 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "fixpointapi.hh"
+#include "runtimestorage.hh"
+#include "test.hh"
+
+// Lists a wide directory of a flatware file system through the fixpoint api, once the way flatware did with a few
+// calls per dirent (attach the dirent, attach and copy its name, check its content) and once with the vectored
+// get_lengths and read_blobs, each with and without the per-invocation front cache.
+//
+// Usage: readdir-perf [dirents] [repetitions]
+
+using namespace std;
+
+namespace {
+
+Handle<Fix> create_tree( RuntimeStorage& storage, OwnedMutTree&& tree )
+{
+  return storage.create( make_shared<OwnedTree>( std::move( tree ) ) ).visit<Handle<Fix>>( []( auto h ) {
+    return h;
+  } );
+}
+
+// A directory of @p dirents files, shaped like the file systems flatware reads
+Handle<Fix> directory( RuntimeStorage& storage, size_t dirents )
+{
+  auto entries = OwnedMutTree::allocate( dirents );
+  for ( size_t i = 0; i < dirents; i++ ) {
+    auto dirent = OwnedMutTree::allocate( 3 );
+    dirent[0] = storage.create( "file-" + to_string( i ) + ".txt" );
+    dirent[1] = storage.create( "100644" );
+    dirent[2] = storage.create( "contents of file " + to_string( i ) );
+    entries[i] = create_tree( storage, std::move( dirent ) );
+  }
+  return create_tree( storage, std::move( entries ) );
+}
+
+size_t per_dirent( Handle<Fix> dir, size_t dirents, vector<uint8_t>& out )
+{
+  wasm_rt_externref_table_t entries {};
+  wasm_rt_externref_table_t dirent {};
+  wasm_rt_memory_t name {};
+  size_t files = 0, offset = 0;
+  fixpoint::attach_tree( dir.content, &entries );
+  for ( size_t i = 0; i < dirents; i++ ) {
+    fixpoint::attach_tree( entries.data[i], &dirent );
+    fixpoint::attach_blob( dirent.data[0], &name );
+    memcpy( out.data() + offset, name.data, name.size );
+    offset += name.size;
+    files += fixpoint::is_blob( dirent.data[2] );
+  }
+  return files;
+}
+
+size_t vectored( Handle<Fix> dir, size_t dirents, vector<uint8_t>& out )
+{
+  wasm_rt_memory_t memory {};
+  memory.data = out.data();
+  memory.size = out.size();
+
+  fixpoint::get_lengths( dir.content, 0, dirents, 2, 0, &memory );
+  const size_t names = dirents * 2 * sizeof( uint32_t );
+  fixpoint::read_blobs( dir.content, 0, dirents, 0, names, out.size() - names, &memory );
+
+  size_t files = 0;
+  for ( size_t i = 0; i < dirents; i++ ) {
+    uint32_t kind;
+    memcpy( &kind, out.data() + i * 2 * sizeof( uint32_t ) + sizeof( uint32_t ), sizeof( kind ) );
+    files += kind == uint32_t( fixpoint::EntryKind::Blob );
+  }
+  return files;
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t dirents = argc > 1 ? stoull( argv[1] ) : 1000;
+  size_t repetitions = argc > 2 ? stoull( argv[2] ) : 1000;
+
+  RuntimeStorage storage;
+  fixpoint::storage = &storage;
+  auto dir = directory( storage, dirents );
+  vector<uint8_t> out( dirents * 64 );
+
+  using List = size_t ( * )( Handle<Fix>, size_t, vector<uint8_t>& );
+  const vector<pair<string, List>> lists { { "per_dirent", per_dirent }, { "vectored", vectored } };
+  for ( bool cached : { false, true } ) {
+    for ( const auto& api : lists ) {
+      auto run = timed( [&] {
+        size_t files = 0;
+        for ( size_t i = 0; i < repetitions; i++ ) {
+          // each repetition stands for one invocation of a procedure, with or without its front cache
+          optional<fixpoint::Invocation> invocation;
+          if ( cached ) {
+            invocation.emplace();
+          }
+          files += api.second( dir, dirents, out );
+        }
+        return files;
+      } );
+
+      PerfRecord()
+        .add( "api", api.first )
+        .add( "front_cache", cached )
+        .add( "dirents", dirents )
+        .add( "repetitions", repetitions )
+        .add( "ns_per_dirent", run.elapsed_us * 1000 / int64_t( repetitions * dirents ) )
+        .add( "files", run.result / repetitions )
+        .print();
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "relater.hh"
+#include "snapshot.hh"
+#include "test.hh"
+
+// Runs a small Python script many times with flatware, once with every instance starting from its init and once with
+// instances starting from a snapshot, and reports for each mode the latency of the first run (which links the
+// program, and takes the snapshot) and the mean latency of the rest. The snapshot holds the instance after its data
+// segments and flatware's checkpoint; the interpreter still starts in every run, as it reads its files from the input.
+//
+// Usage: snapshot-perf [runs] [threads]
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+const string PYTHON = "applications-prefix/src/applications-build/flatware/examples/python/python-fixpoint.wasm";
+const string WORKINGDIR = "applications-prefix/src/applications-build/flatware/examples/python/python-workingdir";
+
+Handle<Fix> dirent( Relater& rt, string_view name, string_view permissions, Handle<Fix> content )
+{
+  return handle::upcast( tree( rt, blob( rt, name ), blob( rt, permissions ), content ) );
+}
+
+Handle<Fix> create_from_path( Relater& rt, fs::path path )
+{
+  if ( fs::is_regular_file( path ) ) {
+    return dirent( rt, path.filename().string(), "100644", file( rt, path ) );
+  } else if ( fs::is_directory( path ) ) {
+    size_t count = distance( fs::directory_iterator( path ), {} );
+    OwnedMutTree tree = OwnedMutTree::allocate( count );
+
+    size_t i = 0;
+    for ( auto& subpath : fs::directory_iterator( path ) ) {
+      tree[i] = create_from_path( rt, subpath );
+      i++;
+    }
+
+    return dirent( rt,
+                   path.filename().string(),
+                   "040000",
+                   handle::upcast( rt.create( make_shared<OwnedTree>( std::move( tree ) ) ) ) );
+  } else {
+    throw runtime_error( "Invalid file type" );
+  }
+}
+
+// The working directory of the interpreter, with a main.py printing @p salt so that no two runs share a result
+Handle<Fix> filesys( Relater& rt, const vector<Handle<Fix>>& entries, uint64_t salt )
+{
+  OwnedMutTree tree = OwnedMutTree::allocate( entries.size() + 1 );
+  for ( size_t i = 0; i < entries.size(); i++ ) {
+    tree[i] = entries[i];
+  }
+  tree[entries.size()] = dirent( rt, "main.py", "100644", blob( rt, "print(" + to_string( salt ) + ")" ) );
+  return dirent( rt, ".", "040000", handle::upcast( rt.create( make_shared<OwnedTree>( std::move( tree ) ) ) ) );
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  size_t runs = argc > 1 ? stoull( argv[1] ) : 20;
+  size_t threads = argc > 2 ? stoull( argv[2] ) : thread::hardware_concurrency();
+
+  uint64_t salt = chrono::steady_clock::now().time_since_epoch().count();
+  for ( bool enable : { false, true } ) {
+    Snapshot::enable = enable;
+    auto rt = make_shared<Relater>( threads );
+
+    auto python = compile( *rt, file( *rt, PYTHON ) );
+    vector<Handle<Fix>> entries;
+    for ( auto& subpath : fs::directory_iterator( WORKINGDIR ) ) {
+      entries.push_back( create_from_path( *rt, subpath ) );
+    }
+
+    int64_t first = 0, rest = 0;
+    for ( size_t i = 0; i < runs; i++ ) {
+      auto input = flatware_input( *rt,
+                                   limits( *rt, 1024 * 1024 * 1024, 1024 * 1024, 1024 ),
+                                   python,
+                                   filesys( *rt, entries, salt++ ),
+                                   handle::upcast( tree( *rt, blob( *rt, "python" ), blob( *rt, "main.py" ) ) ) );
+
+      ( i == 0 ? first : rest ) += timed( [&] { return rt->execute( input ); } ).elapsed_us;
+    }
+
+    PerfRecord()
+      .add( "snapshot", enable )
+      .add( "runs", runs )
+      .add( "threads", threads )
+      .add( "first_us", first )
+      .add( "mean_us", runs > 1 ? rest / int64_t( runs - 1 ) : 0 )
+      .print();
+  }
+
+  return 0;
+}
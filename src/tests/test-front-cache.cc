@@ -0,0 +1,49 @@
+#include <glog/logging.h>
+#include <string>
+
+#include "front_cache.hh"
+#include "runtimestorage.hh"
+
+using namespace std;
+
+namespace {
+
+// A Named Blob, long enough not to be a Literal
+Handle<Named> named( RuntimeStorage& storage, size_t i )
+{
+  return storage.create( "a blob that is too long to be a literal, number " + to_string( i ) ).unwrap<Named>();
+}
+
+}
+
+void test( void )
+{
+  RuntimeStorage storage;
+  FrontCache<Handle<Named>, BlobData> cache;
+
+  // Hit: a second lookup returns the data the first one cached
+  auto first = named( storage, 0 );
+  CHECK( not cache.contains( first ) );
+  const auto* data = cache.get( first, storage ).get();
+  CHECK( data == storage.get( first ).get() );
+  CHECK( cache.contains( first ) );
+  CHECK( cache.get( first, storage ).get() == data );
+
+  // Eviction: a handle in the same slot replaces the first one, whose data the storage still holds
+  size_t i = 1;
+  while ( not FrontCache<Handle<Named>, BlobData>::collide( first, named( storage, i ) ) ) {
+    i++;
+  }
+  auto second = named( storage, i );
+  CHECK( cache.get( second, storage ).get() == storage.get( second ).get() );
+  CHECK( cache.contains( second ) );
+  CHECK( not cache.contains( first ) );
+  CHECK( cache.get( first, storage ).get() == data );
+  CHECK( not cache.contains( second ) );
+
+  // Clear: nothing is cached any more
+  cache.clear();
+  CHECK( not cache.contains( first ) );
+  CHECK( not cache.contains( second ) );
+  CHECK( cache.get( first, storage )->size() == storage.get( first )->size() );
+}
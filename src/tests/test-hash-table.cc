@@ -48,4 +48,11 @@ void test( void )
 
   test_table.insert( Handle<Blob>( Handle<Literal>( "one" ) ), de_bello_gallico );
   CHECK_EQ( test_table.get( Handle<Blob>( Handle<Literal>( "one" ) ) ).value(), aeneid );
+
+  FixTable<Blob, string, AbslHash> small_table( 2 );
+  CHECK( small_table.try_insert( Handle<Blob>( Handle<Literal>( "one" ) ), aeneid ) );
+  CHECK( small_table.try_insert( Handle<Blob>( Handle<Literal>( "two" ) ), de_bello_gallico ) );
+  CHECK( small_table.try_insert( Handle<Blob>( Handle<Literal>( "one" ) ), de_bello_gallico ) );
+  CHECK( !small_table.try_insert( Handle<Blob>( Handle<Literal>( "three" ) ), aeneid ) );
+  CHECK_EQ( small_table.get( Handle<Blob>( Handle<Literal>( "one" ) ) ).value(), aeneid );
 }
@@ -0,0 +1,54 @@
+#include <chrono>
+#include <glog/logging.h>
+#include <string>
+#include <thread>
+
+#include "cluster.hh"
+#include "handle_post.hh"
+#include "test.hh"
+
+using namespace std;
+
+namespace {
+
+// Waits up to ten seconds for @p done to hold
+template<typename F>
+bool eventually( F&& done )
+{
+  const auto deadline = chrono::steady_clock::now() + chrono::seconds( 10 );
+  while ( not done() ) {
+    if ( chrono::steady_clock::now() > deadline ) {
+      return false;
+    }
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  }
+  return true;
+}
+
+}
+
+void test( void )
+{
+  // Node 0 computed some data and kept it; node 2 knows that, and sends node 1 a tree that refers to the data
+  Cluster cluster( 3, 1 );
+  auto& holder = cluster.node( 0 );
+  auto& receiver = cluster.node( 1 );
+  auto& sender = cluster.node( 2 );
+
+  auto data = blob( holder, string( 4096, 'x' ) ).unwrap<Named>();
+  auto root = tree( sender, data, 1_literal64 );
+  sender.held_by( data, holder.get_info()->node );
+  CHECK( not sender.contains( data ) );
+
+  cluster.remote( 2, 1 )->put( root, sender.get( root ).value() );
+
+  // The receiver learns where the data that was left out is, instead of never hearing about it
+  CHECK( eventually( [&] { return receiver.contains( root ) and receiver.holder( data ).has_value(); } ) );
+  CHECK_EQ( receiver.holder( data ).value(), holder.get_info()->node );
+  CHECK( not receiver.contains( data ) );
+
+  // Fetching the tree brings the data from its holder
+  receiver.fetch( handle::data( root ).value() );
+  CHECK( receiver.contains( data ) );
+  CHECK_EQ( receiver.get( data ).value()->size(), 4096 );
+}
@@ -0,0 +1,66 @@
+#include <cstring>
+#include <glog/logging.h>
+#include <memory>
+#include <vector>
+
+#include "executor.hh"
+#include "overload.hh"
+#include "relater.hh"
+#include "test.hh"
+
+using namespace std;
+
+namespace {
+
+// Applies add_2 to 0, 1, ... @p elements - 1 with a memory limit of @p memory, and returns the results
+vector<uint32_t> add_2s( Relater& rt, Handle<Fix> program, size_t elements, uint64_t memory )
+{
+  auto applications = OwnedMutTree::allocate( elements );
+  for ( size_t i = 0; i < elements; i++ ) {
+    auto x = Handle<Literal>( static_cast<uint32_t>( i ) );
+    applications[i] = Handle<Application>(
+      handle::upcast( tree( rt, limits( rt, memory, 1024, 1 ), program, Handle<Literal>( uint32_t( 1 ) ), x ) ) );
+  }
+
+  auto combinations = rt.create( make_shared<OwnedTree>( std::move( applications ) ) );
+  auto job = Handle<Eval>( combinations.visit<Handle<ObjectTree>>( overload {
+    []( Handle<ExpressionTree> ) -> Handle<ObjectTree> { throw runtime_error( "Invalid tree." ); },
+    []( auto x ) { return Handle<ObjectTree>( x ); },
+  } ) );
+
+  auto result = rt.execute( job );
+  auto data = rt.get( handle::extract<ValueTree>( result ).value() ).value();
+  CHECK_EQ( data->size(), elements );
+
+  vector<uint32_t> sums;
+  for ( const auto& element : data->span() ) {
+    uint32_t sum = 0;
+    memcpy( &sum, handle::extract<Literal>( element ).value().data(), sizeof( uint32_t ) );
+    sums.push_back( sum );
+  }
+  return sums;
+}
+
+}
+
+void test( void )
+{
+  const size_t elements = 500;
+
+  // Few threads, so that ready Applications queue up and are taken in batches
+  auto rt = make_shared<Relater>( 2 );
+  auto program = compile( *rt, file( *rt, "applications-prefix/src/applications-build/map/add_2_map.wasm" ) );
+
+  // The memory limits differ so that the second run does not reuse the results of the first
+  const size_t batch_size = Executor::batch_size;
+  Executor::batch_size = 1;
+  auto unbatched = add_2s( *rt, program, elements, 1024 * 1024 );
+  Executor::batch_size = 64;
+  auto batched = add_2s( *rt, program, elements, 2 * 1024 * 1024 );
+  Executor::batch_size = batch_size;
+
+  CHECK( batched == unbatched );
+  for ( size_t i = 0; i < elements; i++ ) {
+    CHECK_EQ( batched[i], i + 2 );
+  }
+}
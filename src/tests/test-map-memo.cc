@@ -0,0 +1,74 @@
+#include <glog/logging.h>
+#include <span>
+#include <vector>
+
+#include "runtimestorage.hh"
+#include "scheduler.hh"
+
+using namespace std;
+
+namespace {
+
+MapMemo::Progress partial( size_t outstanding )
+{
+  return { .results = OwnedMutTree::allocate( 4 ), .resolved = vector<bool>( 4 ), .outstanding = outstanding };
+}
+
+}
+
+void test( void )
+{
+  RuntimeStorage storage;
+  auto tree = [&]( size_t size ) {
+    vector<Handle<Fix>> entries( size, Handle<Literal>( 1 ) );
+    return storage.create( span<const Handle<Fix>>( entries ) );
+  };
+  auto first = tree( 1 );
+  auto second = tree( 2 );
+  auto third = tree( 3 );
+
+  const Handle<Relation> a = Handle<Eval>( Handle<Object>( Handle<Value>( Handle<Blob>( Handle<Literal>( 'a' ) ) ) ) );
+  const Handle<Relation> b = Handle<Eval>( Handle<Object>( Handle<Value>( Handle<Blob>( Handle<Literal>( 'b' ) ) ) ) );
+
+  MapMemo memo;
+  memo.keep( first, MapMemo::Mode::Eval, partial( 3 ), a );
+  memo.keep( first, MapMemo::Mode::Lift, partial( 3 ), a );
+  memo.keep( second, MapMemo::Mode::Eval, partial( 2 ), b );
+  memo.keep( third, MapMemo::Mode::Reduce, partial( 1 ), {} );
+  CHECK_EQ( memo.size(), 4 );
+
+  // A job that finishes or is given up on drops its records, and only its own
+  memo.forget( a );
+  CHECK_EQ( memo.size(), 2 );
+  CHECK_EQ( memo.take( first, MapMemo::Mode::Eval, 4 ).outstanding, 4 );
+  CHECK_EQ( memo.take( first, MapMemo::Mode::Lift, 4 ).outstanding, 4 );
+
+  // A record taken over by another job stays when the job that kept it first is forgotten
+  memo.keep( first, MapMemo::Mode::Eval, partial( 3 ), a );
+  memo.keep( first, MapMemo::Mode::Eval, partial( 2 ), b );
+  memo.forget( a );
+  CHECK_EQ( memo.size(), 3 );
+
+  // A record that makes less progress than the one already kept does not replace it
+  memo.keep( first, MapMemo::Mode::Eval, partial( 3 ), a );
+  memo.forget( a );
+  CHECK_EQ( memo.size(), 3 );
+
+  memo.forget( b );
+  CHECK_EQ( memo.size(), 1 );
+  CHECK_EQ( memo.take( second, MapMemo::Mode::Eval, 4 ).outstanding, 4 );
+  CHECK_EQ( memo.take( third, MapMemo::Mode::Reduce, 4 ).outstanding, 1 );
+  CHECK_EQ( memo.size(), 0 );
+
+  // Records go once their tree resolves, including those kept outside of any job
+  const auto value_tree = handle::extract<ValueTree>( first );
+  CHECK( value_tree.has_value() );
+  memo.keep( first, MapMemo::Mode::Lift, partial( 3 ), {} );
+  memo.keep( first, MapMemo::Mode::Eval, partial( 3 ), a );
+  memo.keep( first, MapMemo::Mode::Eval, partial( 2 ), a );
+  CHECK_EQ( memo.size(), 2 );
+  memo.resolved( Handle<Eval>( Handle<Object>( Handle<Value>( value_tree.value() ) ) ) );
+  CHECK_EQ( memo.size(), 1 );
+  memo.forget( a );
+  CHECK_EQ( memo.size(), 0 );
+}
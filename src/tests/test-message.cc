@@ -0,0 +1,107 @@
+#include <cstring>
+#include <glog/logging.h>
+#include <stdexcept>
+#include <string>
+
+#include "compression.hh"
+#include "message.hh"
+
+using namespace std;
+
+namespace {
+
+string frame( Message::Opcode opcode, string_view payload )
+{
+  string out;
+  Message::serialize_header( opcode, payload.size(), out );
+  out.append( payload );
+  return out;
+}
+
+string compressed( Message::Opcode opcode, string_view data, uint64_t announced )
+{
+  return serialize( CompressedHeader { .opcode = opcode, .size = announced } ) + compression::compress( data );
+}
+
+// Sends @p payload as a chunked message of @p opcode, in chunks of at most @p chunk_size bytes
+string chunked( Message::Opcode opcode, string_view payload, size_t chunk_size )
+{
+  string out;
+  for ( size_t offset = 0; offset < payload.size(); offset += chunk_size ) {
+    const auto piece = payload.substr( offset, chunk_size );
+    Message::serialize_header( Message::Opcode::CHUNK, ChunkHeader::LENGTH + piece.size(), out );
+    out += serialize( ChunkHeader { .stream = 7, .opcode = opcode, .size = payload.size() } );
+    out.append( piece );
+  }
+  return out;
+}
+
+bool rejects( const string& wire )
+{
+  MessageParser parser;
+  try {
+    parser.parse( wire );
+  } catch ( const runtime_error& ) {
+    return true;
+  }
+  return false;
+}
+
+}
+
+void test( void )
+{
+  if ( not compression::available() ) {
+    return;
+  }
+
+  string text;
+  while ( text.size() < 100000 ) {
+    text += "the quick brown fox jumps over the lazy dog ";
+  }
+
+  // A compressed blob in a single frame
+  {
+    MessageParser parser;
+    parser.parse( frame( Message::Opcode::COMPRESSED, compressed( Message::Opcode::BLOBDATA, text, text.size() ) ) );
+    CHECK_EQ( parser.size(), 1 );
+    CHECK( parser.front().opcode() == Message::Opcode::BLOBDATA );
+    auto blob = parser.front().get_blob();
+    CHECK_EQ( string_view( blob->data(), blob->size() ), text );
+  }
+
+  // A compressed tree, split into chunks which are fed to the parser a few bytes at a time
+  {
+    auto tree = OwnedMutTree::allocate( 1000 );
+    for ( size_t i = 0; i < tree.size(); i++ ) {
+      tree[i] = Handle<Literal>( static_cast<uint64_t>( i % 10 ) );
+    }
+    const string_view data( reinterpret_cast<const char*>( tree.data() ), tree.size() * sizeof( Handle<Fix> ) );
+    const auto wire
+      = chunked( Message::Opcode::COMPRESSED, compressed( Message::Opcode::TREEDATA, data, data.size() ), 100 );
+
+    MessageParser parser;
+    for ( size_t offset = 0; offset < wire.size(); offset += 13 ) {
+      parser.parse( string_view( wire ).substr( offset, 13 ) );
+    }
+    CHECK_EQ( parser.size(), 1 );
+    CHECK( parser.front().opcode() == Message::Opcode::TREEDATA );
+    auto received = parser.front().get_tree();
+    CHECK_EQ( received->size(), tree.size() );
+    CHECK_EQ( memcmp( received->data(), tree.data(), data.size() ), 0 );
+  }
+
+  // A size that does not match the frame, or that is too large, is rejected before anything is allocated
+  CHECK( rejects(
+    frame( Message::Opcode::COMPRESSED, compressed( Message::Opcode::BLOBDATA, text, uint64_t( 1 ) << 40 ) ) ) );
+  CHECK( rejects(
+    frame( Message::Opcode::COMPRESSED, compressed( Message::Opcode::BLOBDATA, text, text.size() + 1 ) ) ) );
+  CHECK( rejects( chunked( Message::Opcode::TREEDATA, string( 12, 'x' ), 8 ) ) );
+
+  const auto max_message_size = MessageParser::max_message_size;
+  MessageParser::max_message_size = text.size() - 1;
+  CHECK( rejects(
+    frame( Message::Opcode::COMPRESSED, compressed( Message::Opcode::BLOBDATA, text, text.size() ) ) ) );
+  CHECK( rejects( chunked( Message::Opcode::BLOBDATA, text, 4096 ) ) );
+  MessageParser::max_message_size = max_message_size;
+}
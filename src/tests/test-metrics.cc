@@ -0,0 +1,64 @@
+#include <glog/logging.h>
+#include <sstream>
+
+#include "metrics.hh"
+
+using namespace std;
+
+void test( void )
+{
+  // Every value lands in a bucket whose bounds contain it
+  for ( uint64_t value : { 0UL, 1UL, 7UL, 8UL, 9UL, 15UL, 16UL, 17UL, 1000UL, 123456789UL, UINT64_MAX } ) {
+    const auto bucket = Histogram::bucket( value );
+    CHECK_LT( bucket, Histogram::BUCKETS );
+    CHECK_GE( Histogram::upper_bound( bucket ), value );
+    if ( bucket > 0 ) {
+      CHECK_LT( Histogram::upper_bound( bucket - 1 ), value );
+    }
+  }
+
+  Metrics metrics;
+  auto& histogram = metrics.histogram( "latency", "Latency", { { "peer", "a" } } );
+  for ( uint64_t i = 1; i <= 1000; i++ ) {
+    histogram.record( i );
+  }
+  CHECK_EQ( histogram.count(), 1000 );
+  CHECK_EQ( histogram.sum(), 500500 );
+  CHECK_EQ( histogram.max(), 1000 );
+  // Quantiles are exact up to the width of a sub-bucket
+  CHECK_GE( histogram.quantile( 0.5 ), 500 );
+  CHECK_LE( histogram.quantile( 0.5 ), 500 + 500 / Histogram::SUB_BUCKETS );
+  CHECK_EQ( histogram.quantile( 1 ), 1000 );
+
+  metrics.counter( "messages", "Messages", { { "peer", "a" } } ).add( 2 );
+  metrics.counter( "messages", "Messages", { { "peer", "a" } } ).add( 3 );
+  metrics.gauge( "queue", "Queue" ).set( 7 );
+  CHECK_EQ( metrics.counter( "messages", "Messages", { { "peer", "a" } } ).value(), 5 );
+  CHECK_EQ( metrics.counter( "messages", "Messages", { { "peer", "b" } } ).value(), 0 );
+
+  ostringstream prometheus;
+  metrics.prometheus( prometheus );
+  CHECK_NE( prometheus.str().find( "# TYPE messages counter\n" ), string::npos );
+  CHECK_NE( prometheus.str().find( "messages{peer=\"a\"} 5\n" ), string::npos );
+  CHECK_NE( prometheus.str().find( "queue 7\n" ), string::npos );
+  CHECK_NE( prometheus.str().find( "latency_count{peer=\"a\"} 1000\n" ), string::npos );
+
+  ostringstream json;
+  metrics.json( json );
+  CHECK_NE( json.str().find( "{ \"labels\": { \"peer\": \"a\" }, \"value\": 5 }" ), string::npos );
+
+  // A series is removed only once every user has released it
+  auto& links = metrics.gauge( "link", "Link", { { "peer", "c" } } );
+  metrics.gauge( "link", "Link", { { "peer", "c" } } ).set( 3 );
+  metrics.release( "link", { { "peer", "c" } } );
+  CHECK_EQ( links.value(), 3 );
+  ostringstream kept;
+  metrics.prometheus( kept );
+  CHECK_NE( kept.str().find( "link{peer=\"c\"} 3\n" ), string::npos );
+
+  metrics.release( "link", { { "peer", "c" } } );
+  ostringstream removed;
+  metrics.prometheus( removed );
+  CHECK_EQ( removed.str().find( "link{peer=\"c\"}" ), string::npos );
+  CHECK_EQ( metrics.gauge( "link", "Link", { { "peer", "c" } } ).value(), 0 );
+}
@@ -0,0 +1,56 @@
+#include "handle.hh"
+#include "peer_table.hh"
+#include "runtimestorage.hh"
+#include <glog/logging.h>
+
+using namespace std;
+
+void test( void )
+{
+  PeerTable<Blob, AbslHash> table;
+  auto one = Handle<Blob>( Handle<Literal>( "one" ) );
+  auto two = Handle<Blob>( Handle<Literal>( "two" ) );
+
+  table.insert( one, 0, false );
+  table.insert( one, 70, true );
+  table.insert( two, 70, true );
+
+  CHECK( table.contains( one, 0 ) );
+  CHECK( !table.loaded( one, 0 ) );
+  CHECK( table.contains( one, 70 ) );
+  CHECK( table.loaded( one, 70 ) );
+  CHECK( !table.contains( one, 1 ) );
+  CHECK( !table.contains( two, 0 ) );
+  CHECK( !table.contains( Handle<Blob>( Handle<Literal>( "three" ) ), 70 ) );
+
+  table.insert( one, 0, true );
+  CHECK( table.loaded( one, 0 ) );
+
+  // Forgetting a peer leaves the others alone
+  table.clear( 70 );
+  CHECK( !table.contains( one, 70 ) );
+  CHECK( !table.contains( two, 70 ) );
+  CHECK( table.loaded( one, 0 ) );
+
+  // The table grows past its first segment
+  vector<Handle<Blob>> many;
+  for ( uint64_t i = 0; i < 100000; i++ ) {
+    many.push_back( Handle<Blob>( Handle<Literal>( i ) ) );
+    table.insert( many.back(), i % 3, i % 2 );
+  }
+  for ( uint64_t i = 0; i < many.size(); i++ ) {
+    CHECK( table.contains( many[i], i % 3 ) );
+    CHECK( !table.contains( many[i], ( i + 1 ) % 3 ) );
+    CHECK_EQ( table.loaded( many[i], i % 3 ), bool( i % 2 ) );
+  }
+
+  // A cleared slot starts empty when it is reused, and clearing it again only forgets what it recorded since
+  table.clear( 1 );
+  table.insert( many[0], 1, true );
+  CHECK( table.loaded( many[0], 1 ) );
+  CHECK( !table.contains( many[1], 1 ) );
+  table.clear( 1 );
+  CHECK( !table.contains( many[0], 1 ) );
+  CHECK( table.contains( many[0], 0 ) );
+  CHECK( table.contains( many[2], 2 ) );
+}
@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cstring>
+#include <glog/logging.h>
+#include <thread>
+
+#include "cluster.hh"
+#include "result_directory.hh"
+#include "test.hh"
+
+using namespace std;
+
+namespace {
+
+// Waits up to ten seconds for @p done to hold
+template<typename F>
+bool eventually( F&& done )
+{
+  const auto deadline = chrono::steady_clock::now() + chrono::seconds( 10 );
+  while ( not done() ) {
+    if ( chrono::steady_clock::now() > deadline ) {
+      return false;
+    }
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  }
+  return true;
+}
+
+Handle<Application> add( IRuntime& rt, Handle<Fix> procedure, uint32_t a, uint32_t b )
+{
+  auto combination = tree( rt,
+                           limits( rt, 1024 * 1024, 1024, 1 ).into<Fix>(),
+                           procedure,
+                           Handle<Literal>( a ).into<Fix>(),
+                           Handle<Literal>( b ).into<Fix>() )
+                       .visit<Handle<ExpressionTree>>( []( auto h ) { return Handle<ExpressionTree>( h ); } );
+  return Handle<Application>( combination );
+}
+
+Handle<Relation> think( Handle<Application> application )
+{
+  return Handle<Think>( Handle<Thunk>( application ) );
+}
+
+}
+
+void test( void )
+{
+  ResultDirectory::enable = true;
+  ResultDirectory::min_cost = 1000000;
+
+  Cluster cluster( 2, 1 );
+  auto& asker = cluster.node( 1 );
+  auto& owner = cluster.node( 0 );
+  auto& directory = asker.get_directory();
+
+  auto strict = compile( asker, file( asker, "testing/wasm-examples/addblob.wasm" ) );
+  auto procedure = Handle<Fix>( strict );
+
+  // Picks arguments for which the owner, not the asker, owns the job
+  uint32_t next = 0;
+  auto remote_job = [&] {
+    while ( directory.owns( think( add( asker, procedure, next, 1 ) ) ) ) {
+      next++;
+    }
+    return add( asker, procedure, next++, 1 );
+  };
+
+  // Hit: the owner knows the result, so the asker does not run the job
+  auto known = remote_job();
+  owner.put( think( known ), Handle<Literal>( 42 ) );
+  CHECK( directory.lookup( think( known ) ) );
+  CHECK_EQ( directory.lookups(), 1 );
+  CHECK( eventually( [&] { return asker.contains( think( known ) ); } ) );
+  CHECK_EQ( directory.hits(), 1 );
+  CHECK( asker.get( think( known ) ).value() == Handle<Object>( Handle<Literal>( 42 ) ) );
+
+  // Miss: the procedure has not been applied here yet, so the owner is asked, and the job runs once it does not
+  // know the result, which is then published to it
+  auto unknown = remote_job();
+  auto sum = asker.execute( Handle<Eval>( Handle<Object>( Handle<Thunk>( unknown ) ) ) );
+  auto literal = sum.try_into<Blob>().and_then( []( auto h ) { return h.template try_into<Literal>(); } );
+  CHECK( literal.has_value() );
+  uint32_t x = 0;
+  memcpy( &x, literal->data(), sizeof( uint32_t ) );
+  CHECK_EQ( x, next );
+  CHECK_EQ( directory.lookups(), 2 );
+  CHECK_EQ( directory.hits(), 1 );
+  CHECK( eventually( [&] { return directory.published() == 1 and owner.contains( think( unknown ) ); } ) );
+
+  // Threshold: the cost is recorded by the procedure as applied, which a job with the encoded procedure still finds
+  auto compiled = asker.execute( Handle<Eval>( Handle<Object>( strict.unwrap<Thunk>() ) ) );
+  directory.ran( Handle<Fix>( Handle<Expression>( Handle<Object>( compiled ) ) ), chrono::microseconds( 10 ) );
+  CHECK( not directory.lookup( think( remote_job() ) ) );
+  CHECK_EQ( directory.lookups(), 2 );
+
+  directory.ran( Handle<Fix>( Handle<Expression>( Handle<Object>( compiled ) ) ), chrono::seconds( 100 ) );
+  auto expensive = remote_job();
+  CHECK( directory.lookup( think( expensive ) ) );
+  CHECK_EQ( directory.lookups(), 3 );
+  CHECK( eventually( [&] { return asker.contains( think( expensive ) ); } ) );
+
+  ResultDirectory::enable = false;
+}
@@ -0,0 +1,59 @@
+#include <cstring>
+#include <glog/logging.h>
+#include <memory>
+
+#include "relater.hh"
+#include "snapshot.hh"
+#include "test.hh"
+
+using namespace std;
+
+namespace {
+
+const string COUNT_WORDS = "applications-prefix/src/applications-build/count-words/count_words.wasm";
+
+uint64_t count( Relater& rt, Handle<Fix> program, string_view pattern, string_view text )
+{
+  auto application = tree( rt,
+                           limits( rt, 1024 * 1024, 1024, 1 ).into<Fix>(),
+                           program,
+                           handle::upcast( tree( rt, blob( rt, pattern ), blob( rt, text ) ) ) );
+  auto result = rt.execute( Handle<Eval>( Handle<Application>( handle::upcast( application ) ) ) );
+
+  auto literal = handle::extract<Literal>( result );
+  CHECK( literal.has_value() );
+  uint64_t x = 0;
+  memcpy( &x, literal->data(), sizeof( uint64_t ) );
+  return x;
+}
+
+}
+
+void test( void )
+{
+  Snapshot::enable = true;
+
+  auto rt = make_shared<Relater>( 2 );
+  auto strict = compile( *rt, file( *rt, COUNT_WORDS ) );
+  auto program = Handle<Fix>( strict );
+
+  // count-words allocates its needle buffer in the checkpoint, so both runs start from the snapshot's memory
+  CHECK_EQ( count( *rt, program, "the", "the cat and the hat" ), 2 );
+  CHECK_EQ( count( *rt, program, "at", "the cat and the hat sat" ), 3 );
+
+  // The snapshot is kept under the compiled procedure, and reads back from its tree to the same tree
+  auto compiled = rt->execute( Handle<Eval>( Handle<Object>( strict.unwrap<Thunk>() ) ) );
+  auto kept = rt->snapshot( compiled );
+  CHECK( kept.has_value() );
+
+  auto code_size = handle::extract<Literal>( rt->get( kept.value() ).value()->at( 0 ) );
+  CHECK( code_size.has_value() );
+  const size_t size = uint64_t( code_size.value() );
+
+  auto snapshot = Snapshot::from_tree( rt->get_storage(), kept.value(), size );
+  CHECK( snapshot );
+  CHECK( snapshot->to_tree( rt->get_storage() ) == kept.value() );
+  CHECK( not Snapshot::from_tree( rt->get_storage(), kept.value(), size + 1 ) );
+
+  Snapshot::enable = false;
+}
@@ -1,8 +1,13 @@
+#include <filesystem>
 #include <stdio.h>
+#include <unistd.h>
 
+#include "base16.hh"
 #include "handle.hh"
 #include "overload.hh"
+#include "repository.hh"
 #include "runtimestorage.hh"
+#include "storage_exception.hh"
 
 #include <glog/logging.h>
 
@@ -35,8 +40,118 @@ const std::string de_bello_gallico
     "Rheni, spectant in septentrionem et orientem solem. Aquitania a Garumna flumine ad Pyrenaeos montes et eam "
     "partem Oceani quae est ad Hispaniam pertinet; spectat inter occasum solis et septentriones.";
 
+namespace {
+
+// The thunk identifying literal @p n, whose Think is a link in the chains below
+Handle<Thunk> thunk( uint64_t n )
+{
+  return Handle<Identification>( Handle<Value>( Handle<Blob>( Handle<Literal>( n ) ) ) );
+}
+
+Handle<Relation> think( uint64_t n )
+{
+  return Handle<Think>( thunk( n ) );
+}
+
+const Handle<Object> end = Handle<Value>( Handle<Blob>( "end"_literal ) );
+
+void test_shortcuts()
+{
+  RuntimeStorage storage;
+
+  // 1 -> 2 -> 3, which has not resolved yet
+  storage.create( thunk( 2 ), think( 1 ) );
+  storage.create( thunk( 3 ), think( 2 ) );
+  CHECK_EQ( storage.get( think( 1 ) ), Handle<Object>( thunk( 3 ) ) );
+
+  // Once the chain resolves, every link on it leads to its end, including the one that was followed before
+  storage.create( end, think( 3 ) );
+  CHECK_EQ( storage.get( think( 1 ) ), end );
+  CHECK_EQ( storage.get( think( 2 ) ), end );
+  CHECK_EQ( storage.get( think( 3 ) ), end );
+
+  // A chain which joins one that has been compressed ends at the same place
+  storage.create( thunk( 1 ), think( 0 ) );
+  CHECK_EQ( storage.get( think( 0 ) ), end );
+
+  // A cycle of thunks does not send the lookup around forever
+  storage.create( thunk( 5 ), think( 4 ) );
+  storage.create( thunk( 4 ), think( 5 ) );
+  CHECK( storage.get( think( 4 ) ).contains<Thunk>() );
+}
+
+void test_repository()
+{
+  namespace fs = std::filesystem;
+  auto directory = fs::temp_directory_path() / ( "fix-test-storage-" + to_string( getpid() ) );
+  fs::remove_all( directory );
+  for ( const auto* subdirectory : { "data", "relations", "labels" } ) {
+    fs::create_directories( directory / ".fix" / subdirectory );
+  }
+
+  auto link = [&]( Handle<Relation> relation ) {
+    return Handle<Fix>::forge(
+             base16::decode(
+               fs::read_symlink( directory / ".fix" / "relations" / base16::encode( Handle<Fix>( relation ).content ) )
+                 .filename()
+                 .string() ) )
+      .unwrap<Expression>()
+      .unwrap<Object>();
+  };
+
+  {
+    Repository repository( 1000, directory );
+    repository.put( think( 1 ), thunk( 2 ) );
+    repository.put( think( 2 ), thunk( 3 ) );
+    repository.put( think( 3 ), end );
+
+    // Reading follows the chain, but leaves the links on disk as they are
+    CHECK_EQ( repository.get( think( 1 ) ), end );
+    CHECK_EQ( link( think( 1 ) ), Handle<Object>( thunk( 2 ) ) );
+    CHECK_EQ( link( think( 2 ) ), Handle<Object>( thunk( 3 ) ) );
+
+    // Writing a Think that joins the chain links it, and the rest of the chain, straight to the end
+    repository.put( think( 0 ), thunk( 1 ) );
+    CHECK_EQ( link( think( 0 ) ), end );
+    CHECK_EQ( link( think( 1 ) ), end );
+    CHECK_EQ( link( think( 2 ) ), end );
+    CHECK_EQ( repository.get( think( 0 ) ), end );
+
+    // Writing a link again shortens it if it still points at a thunk
+    repository.put( think( 7 ), thunk( 8 ) );
+    repository.put( think( 8 ), end );
+    CHECK_EQ( link( think( 7 ) ), Handle<Object>( thunk( 8 ) ) );
+    repository.put( think( 7 ), thunk( 8 ) );
+    CHECK_EQ( link( think( 7 ) ), end );
+
+    // No temporary links are left behind
+    for ( const auto& entry : fs::directory_iterator( directory / ".fix" ) ) {
+      CHECK( entry.path().filename().string().rfind( "relink-", 0 ) == string::npos );
+    }
+  }
+
+  // A missing link is reported as such
+  {
+    Repository repository( 1000, directory );
+    bool missing = false;
+    try {
+      repository.get( think( 9 ) );
+    } catch ( HandleNotFound& ) {
+      missing = true;
+    }
+    CHECK( missing );
+  }
+
+  fs::remove_all( directory );
+}
+
+}
+
 void test( void )
 {
+  test_shortcuts();
+  test_repository();
+
   RuntimeStorage storage;
 
   Handle virgil = storage.create( aeneid );
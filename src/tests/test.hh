@@ -3,8 +3,15 @@
 #include "interface.hh"
 #include "runtimes.hh"
 
+#include <chrono>
 #include <functional>
 #include <glog/logging.h>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <type_traits>
+#include <unistd.h>
 
 #pragma GCC diagnostic ignored "-Wunused-function"
 
@@ -98,3 +105,91 @@ static Handle<Eval> flatware_input( IRuntime& rt,
 
 static std::function<Handle<ValueTree>( IRuntime& )> standard_limits
   = std::bind( limits, std::placeholders::_1, 1024 * 1024, 1024, 1 );
+
+/**
+ * The measurements of one run of a perf tool, printed as a JSON object on a line of its own so that the runs of a
+ * tool can be collected and compared by scripts.
+ */
+class PerfRecord
+{
+  std::ostringstream fields_ {};
+
+  std::ostream& key( std::string_view name )
+  {
+    return fields_ << ( fields_.tellp() > 0 ? ", " : "" ) << '"' << name << "\": ";
+  }
+
+public:
+  template<typename T>
+  PerfRecord& add( std::string_view name, const T& value )
+  {
+    if constexpr ( std::is_same_v<T, bool> ) {
+      key( name ) << ( value ? "true" : "false" );
+    } else if constexpr ( std::is_arithmetic_v<T> ) {
+      key( name ) << value;
+    } else {
+      key( name ) << '"' << value << '"';
+    }
+    return *this;
+  }
+
+  // Adds @p json as it is
+  PerfRecord& raw( std::string_view name, std::string_view json )
+  {
+    key( name ) << json;
+    return *this;
+  }
+
+  // Adds the page faults taken between @p before and @p after, and the peak resident memory at @p after
+  PerfRecord& usage( const struct rusage& before, const struct rusage& after )
+  {
+    return add( "minor_faults", after.ru_minflt - before.ru_minflt )
+      .add( "major_faults", after.ru_majflt - before.ru_majflt )
+      .add( "peak_rss_kb", after.ru_maxrss );
+  }
+
+  void print( std::ostream& out = std::cout ) const { out << "{ " << fields_.str() << " }" << std::endl; }
+};
+
+template<typename T>
+struct Timed
+{
+  T result;
+  int64_t elapsed_us;
+};
+
+// Runs @p f, and returns its result along with how long it took
+template<typename F>
+Timed<std::invoke_result_t<F>> timed( F&& f )
+{
+  auto start = std::chrono::steady_clock::now();
+  auto result = f();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return { std::move( result ), std::chrono::duration_cast<std::chrono::microseconds>( elapsed ).count() };
+}
+
+// Runs @p run in a process of its own, so that the memory one run faulted in does not hide the faults or the peak
+// memory of the next; false if it did not exit cleanly
+static bool in_child( const std::function<void()>& run )
+{
+  pid_t pid = fork();
+  if ( pid == 0 ) {
+    run();
+    std::cout.flush();
+    _exit( 0 );
+  }
+
+  int status;
+  waitpid( pid, &status, 0 );
+  return WIFEXITED( status ) and WEXITSTATUS( status ) == 0;
+}
+
+// The value of @p result if it is a Literal, and 0 otherwise
+static uint64_t literal_value( Handle<Value> result )
+{
+  uint64_t value = 0;
+  if ( auto literal = result.try_into<Blob>().and_then( []( auto h ) { return h.template try_into<Literal>(); } ) ) {
+    memcpy( &value, literal->data(), std::min<size_t>( sizeof( value ), literal->size() ) );
+  }
+  return value;
+}
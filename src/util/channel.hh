@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <concurrentqueue/concurrentqueue.h>
 #include <condition_variable>
+#include <deque>
+#include <iterator>
 #include <mutex>
 #include <optional>
+#include <vector>
 
 class ChannelClosed : public std::exception
 {
@@ -19,6 +23,9 @@ template<typename T>
 class Channel
 {
   moodycamel::ConcurrentQueue<T> data_ {};
+  // Items put back by push_front(), which are popped before anything in data_
+  std::deque<T> front_ {};
+  std::atomic<size_t> front_size_ { 0 };
   std::mutex mutex_ {};
   std::condition_variable cv_ {};
   bool shutdown_ = false;
@@ -66,12 +73,28 @@ public:
     cv_.notify_one();
   }
 
+  // Puts @p items back at the head of the channel, ahead of everything queued, keeping their order
+  void push_front( std::vector<T>&& items )
+  {
+    std::unique_lock lock( mutex_ );
+    if ( shutdown_ ) {
+      throw ChannelClosed {};
+    }
+    front_.insert( front_.begin(), std::make_move_iterator( items.begin() ), std::make_move_iterator( items.end() ) );
+    front_size_ = front_.size();
+    size_ += items.size();
+    cv_.notify_all();
+  }
+
   std::optional<T> pop()
   {
     std::unique_lock lock( mutex_ );
     if ( shutdown_ ) {
       throw ChannelClosed();
     }
+    if ( not front_.empty() ) {
+      return pop_front();
+    }
     T item;
     if ( data_.try_dequeue( item ) ) {
       --size_;
@@ -88,6 +111,9 @@ public:
       if ( shutdown_ ) {
         throw ChannelClosed();
       }
+      if ( not front_.empty() ) {
+        return pop_front();
+      }
       T item;
       if ( data_.try_dequeue( item ) ) {
         --size_;
@@ -96,13 +122,25 @@ public:
     }
   }
 
-  size_t size_approx() { return data_.size_approx(); }
+  size_t size_approx() { return data_.size_approx() + front_size_; }
 
   void operator<<( T&& item ) { push( std::move( item ) ); }
   void operator<<( T item ) { push( item ); }
   void operator>>( std::optional<T>& item ) { item = pop(); }
   void operator>>( T& item ) { item = pop_or_wait(); }
 
+private:
+  // Requires mutex_ to be held
+  T pop_front()
+  {
+    T item = std::move( front_.front() );
+    front_.pop_front();
+    front_size_ = front_.size();
+    --size_;
+    return item;
+  }
+
+public:
   void close()
   {
     std::unique_lock lock( mutex_ );
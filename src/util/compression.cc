@@ -0,0 +1,82 @@
+#include "compression.hh"
+
+#include <memory>
+#include <stdexcept>
+
+#ifdef FIX_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace compression {
+
+#ifdef FIX_HAVE_ZSTD
+
+bool available()
+{
+  return true;
+}
+
+string compress( const string_view input, const int level )
+{
+  // A context per thread saves reallocating its tables for every message
+  thread_local unique_ptr<ZSTD_CCtx, decltype( &ZSTD_freeCCtx )> context { ZSTD_createCCtx(), ZSTD_freeCCtx };
+
+  string output( ZSTD_compressBound( input.size() ), 0 );
+  const size_t size
+    = ZSTD_compressCCtx( context.get(), output.data(), output.size(), input.data(), input.size(), level );
+  if ( ZSTD_isError( size ) ) {
+    throw runtime_error( string( "ZSTD_compressCCtx: " ) + ZSTD_getErrorName( size ) );
+  }
+  output.resize( size );
+  return output;
+}
+
+void decompress( const string_view input, const span<char> output )
+{
+  thread_local unique_ptr<ZSTD_DCtx, decltype( &ZSTD_freeDCtx )> context { ZSTD_createDCtx(), ZSTD_freeDCtx };
+
+  const size_t size = ZSTD_decompressDCtx( context.get(), output.data(), output.size(), input.data(), input.size() );
+  if ( ZSTD_isError( size ) ) {
+    throw runtime_error( string( "ZSTD_decompressDCtx: " ) + ZSTD_getErrorName( size ) );
+  }
+  if ( size != output.size() ) {
+    throw runtime_error( "Decompressed data has the wrong size" );
+  }
+}
+
+optional<uint64_t> content_size( const string_view input )
+{
+  const auto size = ZSTD_getFrameContentSize( input.data(), input.size() );
+  if ( size == ZSTD_CONTENTSIZE_UNKNOWN or size == ZSTD_CONTENTSIZE_ERROR ) {
+    return {};
+  }
+  return size;
+}
+
+#else
+
+bool available()
+{
+  return false;
+}
+
+string compress( const string_view, const int )
+{
+  throw runtime_error( "fixpoint was built without compression support" );
+}
+
+void decompress( const string_view, const span<char> )
+{
+  throw runtime_error( "fixpoint was built without compression support" );
+}
+
+optional<uint64_t> content_size( const string_view )
+{
+  throw runtime_error( "fixpoint was built without compression support" );
+}
+
+#endif
+
+}
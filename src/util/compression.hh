@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+/**
+ * Compression of data sent over the network, using zstd. If fixpoint was built without zstd, available() is false
+ * and the other functions throw.
+ */
+namespace compression {
+
+bool available();
+
+//! Compresses @p input. Low levels are fast; the default suits links of a few Gbit/s.
+std::string compress( std::string_view input, int level = 1 );
+
+//! Decompresses @p input into @p output, which must be exactly as large as the original data.
+void decompress( std::string_view input, std::span<char> output );
+
+//! The size of the data @p input decompresses to, if its frame records it.
+std::optional<uint64_t> content_size( std::string_view input );
+
+}
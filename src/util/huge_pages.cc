@@ -0,0 +1,21 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "huge_pages.hh"
+
+namespace huge_pages {
+uint64_t threshold = 0;
+
+void advise( void* addr, size_t size )
+{
+#ifdef MADV_HUGEPAGE
+  const uintptr_t page_size = sysconf( _SC_PAGESIZE );
+  const uintptr_t begin = ( reinterpret_cast<uintptr_t>( addr ) + page_size - 1 ) & ~( page_size - 1 );
+  const uintptr_t end = ( reinterpret_cast<uintptr_t>( addr ) + size ) & ~( page_size - 1 );
+  if ( end > begin ) {
+    // Only a hint: memory which cannot be advised is still usable with normal pages
+    madvise( reinterpret_cast<void*>( begin ), end - begin, MADV_HUGEPAGE );
+  }
+#endif
+}
+};
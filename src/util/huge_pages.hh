@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * An opt-in policy for backing large buffers (Wasm linear memories, mapped blobs) with transparent huge pages, which
+ * cuts the page faults and TLB misses of procedures that stream through hundreds of MB.
+ *
+ * Only whole huge pages inside an advised range are ever backed by one, so a buffer never has more memory faulted in
+ * than the bytes accounted for it in resource_limits::available_bytes.
+ */
+namespace huge_pages {
+// Buffers of at least this many bytes are backed by huge pages; 0 leaves every buffer to the system's policy
+extern uint64_t threshold;
+
+inline bool wanted( size_t size )
+{
+  return threshold != 0 and size >= threshold;
+}
+
+// Advises the kernel to back the whole pages of [addr, addr + size) by huge pages
+void advise( void* addr, size_t size );
+};
@@ -0,0 +1,226 @@
+#include "metrics.hh"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+constexpr array<pair<double, const char*>, 4> QUANTILES {
+  { { 0.5, "0.5" }, { 0.9, "0.9" }, { 0.99, "0.99" }, { 0.999, "0.999" } } };
+constexpr array<const char*, 3> TYPE_NAMES { "counter", "gauge", "summary" };
+
+string escape( const string_view str )
+{
+  string out;
+  for ( const char c : str ) {
+    switch ( c ) {
+      case '\\':
+        out += "\\\\";
+        break;
+      case '"':
+        out += "\\\"";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      default:
+        out += c;
+    }
+  }
+  return out;
+}
+
+void write_labels( ostream& out, const Metrics::Labels& labels, const string& extra = {} )
+{
+  if ( labels.empty() and extra.empty() ) {
+    return;
+  }
+
+  out << "{";
+  bool first = true;
+  for ( const auto& [key, value] : labels ) {
+    out << ( first ? "" : "," ) << key << "=\"" << escape( value ) << "\"";
+    first = false;
+  }
+  if ( not extra.empty() ) {
+    out << ( first ? "" : "," ) << extra;
+  }
+  out << "}";
+}
+
+}
+
+size_t Histogram::bucket( const uint64_t value )
+{
+  if ( value < SUB_BUCKETS ) {
+    return value;
+  }
+
+  const size_t shift = 63 - __builtin_clzll( value ) - SUB_BUCKET_BITS;
+  return ( shift + 1 ) * SUB_BUCKETS + ( ( value >> shift ) - SUB_BUCKETS );
+}
+
+uint64_t Histogram::upper_bound( const size_t bucket )
+{
+  if ( bucket < SUB_BUCKETS ) {
+    return bucket;
+  }
+
+  const size_t shift = bucket / SUB_BUCKETS - 1;
+  const uint64_t sub = bucket % SUB_BUCKETS;
+  return ( ( SUB_BUCKETS + sub ) << shift ) + ( ( uint64_t( 1 ) << shift ) - 1 );
+}
+
+void Histogram::record( const uint64_t value )
+{
+  buckets_[bucket( value )].fetch_add( 1, memory_order_relaxed );
+  count_.fetch_add( 1, memory_order_relaxed );
+  sum_.fetch_add( value, memory_order_relaxed );
+
+  uint64_t max = max_.load( memory_order_relaxed );
+  while ( value > max and not max_.compare_exchange_weak( max, value, memory_order_relaxed ) ) {}
+}
+
+uint64_t Histogram::quantile( const double q ) const
+{
+  const uint64_t total = count();
+  if ( total == 0 ) {
+    return 0;
+  }
+
+  const uint64_t target = std::max<uint64_t>( 1, ceil( q * total ) );
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < BUCKETS; i++ ) {
+    seen += buckets_[i].load( memory_order_relaxed );
+    if ( seen >= target ) {
+      return std::min( upper_bound( i ), max() );
+    }
+  }
+  return max();
+}
+
+template<class T>
+T& Metrics::get( const string& name, const string& help, const Labels& labels )
+{
+  constexpr size_t type = is_same_v<T, Counter> ? 0 : is_same_v<T, Gauge> ? 1 : 2;
+
+  unique_lock lock( mutex_ );
+  auto& family = families_.try_emplace( name, Family { .help = help, .type = type } ).first->second;
+  if ( family.type != type ) {
+    throw runtime_error( "Metric " + name + " already exists with another type" );
+  }
+
+  auto it = family.series.find( labels );
+  if ( it == family.series.end() ) {
+    it = family.series.emplace( labels, Series { .metric = make_unique<T>() } ).first;
+  }
+  it->second.users++;
+  return *std::get<unique_ptr<T>>( it->second.metric );
+}
+
+Counter& Metrics::counter( const string& name, const string& help, const Labels& labels )
+{
+  return get<Counter>( name, help, labels );
+}
+
+Gauge& Metrics::gauge( const string& name, const string& help, const Labels& labels )
+{
+  return get<Gauge>( name, help, labels );
+}
+
+Histogram& Metrics::histogram( const string& name, const string& help, const Labels& labels )
+{
+  return get<Histogram>( name, help, labels );
+}
+
+void Metrics::release( const string& name, const Labels& labels )
+{
+  unique_lock lock( mutex_ );
+  auto family = families_.find( name );
+  if ( family == families_.end() ) {
+    return;
+  }
+
+  auto it = family->second.series.find( labels );
+  if ( it != family->second.series.end() and --it->second.users == 0 ) {
+    family->second.series.erase( it );
+  }
+}
+
+void Metrics::prometheus( ostream& out ) const
+{
+  unique_lock lock( mutex_ );
+  for ( const auto& [name, family] : families_ ) {
+    out << "# HELP " << name << " " << family.help << "\n";
+    out << "# TYPE " << name << " " << TYPE_NAMES.at( family.type ) << "\n";
+
+    for ( const auto& [labels, series] : family.series ) {
+      const auto& metric = series.metric;
+      if ( holds_alternative<unique_ptr<Counter>>( metric ) ) {
+        out << name;
+        write_labels( out, labels );
+        out << " " << std::get<unique_ptr<Counter>>( metric )->value() << "\n";
+      } else if ( holds_alternative<unique_ptr<Gauge>>( metric ) ) {
+        out << name;
+        write_labels( out, labels );
+        out << " " << std::get<unique_ptr<Gauge>>( metric )->value() << "\n";
+      } else {
+        const auto& histogram = *std::get<unique_ptr<Histogram>>( metric );
+        for ( const auto& [q, label] : QUANTILES ) {
+          out << name;
+          write_labels( out, labels, "quantile=\"" + string( label ) + "\"" );
+          out << " " << histogram.quantile( q ) << "\n";
+        }
+        out << name << "_sum";
+        write_labels( out, labels );
+        out << " " << histogram.sum() << "\n";
+        out << name << "_count";
+        write_labels( out, labels );
+        out << " " << histogram.count() << "\n";
+      }
+    }
+  }
+}
+
+void Metrics::json( ostream& out ) const
+{
+  unique_lock lock( mutex_ );
+  out << "{";
+  bool first_family = true;
+  for ( const auto& [name, family] : families_ ) {
+    out << ( first_family ? "" : "," ) << "\n  \"" << escape( name ) << "\": { \"help\": \"" << escape( family.help )
+        << "\", \"type\": \"" << TYPE_NAMES.at( family.type ) << "\", \"series\": [";
+    first_family = false;
+
+    bool first_series = true;
+    for ( const auto& [labels, series] : family.series ) {
+      const auto& metric = series.metric;
+      out << ( first_series ? "" : "," ) << "\n    { \"labels\": {";
+      first_series = false;
+
+      bool first_label = true;
+      for ( const auto& [key, value] : labels ) {
+        out << ( first_label ? " " : ", " ) << "\"" << escape( key ) << "\": \"" << escape( value ) << "\"";
+        first_label = false;
+      }
+      out << ( labels.empty() ? "}" : " }" );
+
+      if ( holds_alternative<unique_ptr<Counter>>( metric ) ) {
+        out << ", \"value\": " << std::get<unique_ptr<Counter>>( metric )->value();
+      } else if ( holds_alternative<unique_ptr<Gauge>>( metric ) ) {
+        out << ", \"value\": " << std::get<unique_ptr<Gauge>>( metric )->value();
+      } else {
+        const auto& histogram = *std::get<unique_ptr<Histogram>>( metric );
+        out << ", \"count\": " << histogram.count() << ", \"sum\": " << histogram.sum()
+            << ", \"max\": " << histogram.max();
+        out << ", \"p50\": " << histogram.quantile( 0.5 ) << ", \"p90\": " << histogram.quantile( 0.9 )
+            << ", \"p99\": " << histogram.quantile( 0.99 ) << ", \"p999\": " << histogram.quantile( 0.999 );
+      }
+      out << " }";
+    }
+    out << ( family.series.empty() ? "] }" : "\n  ] }" );
+  }
+  out << "\n}\n";
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "summarize.hh"
+
+//! A monotonically increasing count, updated from any thread without locking.
+class Counter
+{
+  std::atomic<uint64_t> value_ { 0 };
+
+public:
+  void add( const uint64_t n = 1 ) { value_.fetch_add( n, std::memory_order_relaxed ); }
+  uint64_t value() const { return value_.load( std::memory_order_relaxed ); }
+};
+
+//! A value that goes up and down, such as the depth of a queue.
+class Gauge
+{
+  std::atomic<int64_t> value_ { 0 };
+
+public:
+  void set( const int64_t value ) { value_.store( value, std::memory_order_relaxed ); }
+  int64_t value() const { return value_.load( std::memory_order_relaxed ); }
+};
+
+//! A histogram with log-linear buckets, in the style of HdrHistogram: each power of two is split into SUB_BUCKETS
+//! equal sub-buckets, so quantiles are accurate to within 1/SUB_BUCKETS of the value. Recording is lock-free.
+class Histogram
+{
+public:
+  static constexpr size_t SUB_BUCKET_BITS = 3;
+  static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr size_t BUCKETS = ( 64 - SUB_BUCKET_BITS + 1 ) * SUB_BUCKETS;
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKETS> buckets_ {};
+  std::atomic<uint64_t> count_ { 0 };
+  std::atomic<uint64_t> sum_ { 0 };
+  std::atomic<uint64_t> max_ { 0 };
+
+public:
+  static size_t bucket( uint64_t value );
+
+  //! The largest value that falls into @p bucket.
+  static uint64_t upper_bound( size_t bucket );
+
+  void record( uint64_t value );
+
+  uint64_t count() const { return count_.load( std::memory_order_relaxed ); }
+  uint64_t sum() const { return sum_.load( std::memory_order_relaxed ); }
+  uint64_t max() const { return max_.load( std::memory_order_relaxed ); }
+
+  //! An upper bound on the @p q quantile of the recorded values, or 0 if nothing has been recorded.
+  uint64_t quantile( double q ) const;
+};
+
+//! Records the lifetime of this object, in microseconds, into a histogram (if any).
+class HistogramTimer
+{
+  Histogram* histogram_;
+  std::chrono::steady_clock::time_point start_ { std::chrono::steady_clock::now() };
+
+public:
+  explicit HistogramTimer( Histogram* histogram )
+    : histogram_( histogram )
+  {}
+
+  ~HistogramTimer()
+  {
+    if ( histogram_ != nullptr ) {
+      histogram_->record(
+        std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start_ ).count() );
+    }
+  }
+
+  HistogramTimer( const HistogramTimer& ) = delete;
+  HistogramTimer& operator=( const HistogramTimer& ) = delete;
+};
+
+//! A registry of named metrics, each of which may have several series told apart by their labels. Metrics are
+//! created once (under a lock) and then updated through the returned reference, which stays valid until every
+//! user of the series has released it.
+class Metrics : public Summarizable
+{
+public:
+  using Labels = std::vector<std::pair<std::string, std::string>>;
+
+private:
+  using Metric = std::variant<std::unique_ptr<Counter>, std::unique_ptr<Gauge>, std::unique_ptr<Histogram>>;
+
+  struct Series
+  {
+    Metric metric;
+    size_t users {};
+  };
+
+  struct Family
+  {
+    std::string help;
+    size_t type;
+    std::map<Labels, Series> series {};
+  };
+
+  mutable std::mutex mutex_ {};
+  std::map<std::string, Family> families_ {};
+
+  template<class T>
+  T& get( const std::string& name, const std::string& help, const Labels& labels );
+
+public:
+  Counter& counter( const std::string& name, const std::string& help, const Labels& labels = {} );
+  Gauge& gauge( const std::string& name, const std::string& help, const Labels& labels = {} );
+  Histogram& histogram( const std::string& name, const std::string& help, const Labels& labels = {} );
+
+  //! Gives up one reference returned for this series. The series is removed, and no longer exported, once every
+  //! reference to it has been released.
+  void release( const std::string& name, const Labels& labels );
+
+  //! Writes every metric in the Prometheus text exposition format. Histograms are written as summaries.
+  void prometheus( std::ostream& out ) const;
+
+  //! Writes every metric as a JSON object, keyed by metric name.
+  void json( std::ostream& out ) const;
+
+  void summary( std::ostream& out ) const override { prometheus( out ); }
+};
+
+inline Metrics& global_metrics()
+{
+  static Metrics the_global_metrics;
+  return the_global_metrics;
+}
@@ -3,7 +3,9 @@
 #include "exception.hh"
 
 #include <cstddef>
+#include <cstring>
 #include <stdexcept>
+#include <sys/un.h>
 #include <unistd.h>
 
 using namespace std;
@@ -155,3 +157,130 @@ void Socket::throw_if_error() const
     throw unix_error( "socket error", socket_error );
   }
 }
+
+// send data along with file descriptors
+//! \param[in] buffer is the data to send; the descriptors are delivered with its first byte
+//! \param[in] fds are the descriptors to pass (at most SCM_MAX_FD)
+//! \returns number of bytes sent
+size_t Socket::send_with_fds( const string_view buffer, span<const int> fds )
+{
+  if ( fds.empty() ) {
+    return write( buffer );
+  }
+
+  iovec iov { const_cast<char*>( buffer.data() ), buffer.size() };
+  vector<char> control( CMSG_SPACE( fds.size_bytes() ) );
+
+  msghdr message {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+
+  cmsghdr* header = CMSG_FIRSTHDR( &message );
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN( fds.size_bytes() );
+  memcpy( CMSG_DATA( header ), fds.data(), fds.size_bytes() );
+
+  const ssize_t bytes_sent = CheckSystemCall( "sendmsg", ::sendmsg( fd_num(), &message, MSG_NOSIGNAL ) );
+  register_write();
+
+  return bytes_sent;
+}
+
+// receive data along with any file descriptors passed with it
+//! \param[in] buffer is the buffer to receive into
+//! \param[out] fds receives the passed descriptors, in the order they were sent
+//! \returns number of bytes received
+size_t Socket::recv_with_fds( span<char> buffer, vector<FileDescriptor>& fds )
+{
+  static constexpr size_t MAX_FDS = 64;
+
+  iovec iov { buffer.data(), buffer.size() };
+  alignas( cmsghdr ) char control[CMSG_SPACE( MAX_FDS * sizeof( int ) )];
+
+  msghdr message {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof( control );
+
+  const ssize_t bytes_read = CheckSystemCall( "recvmsg", ::recvmsg( fd_num(), &message, MSG_CMSG_CLOEXEC ) );
+  register_read();
+
+  for ( cmsghdr* header = CMSG_FIRSTHDR( &message ); header != nullptr; header = CMSG_NXTHDR( &message, header ) ) {
+    if ( header->cmsg_level == SOL_SOCKET and header->cmsg_type == SCM_RIGHTS ) {
+      const size_t count = ( header->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+      for ( size_t i = 0; i < count; i++ ) {
+        int fd;
+        memcpy( &fd, CMSG_DATA( header ) + i * sizeof( int ), sizeof( int ) );
+        fds.emplace_back( fd );
+      }
+    }
+  }
+
+  if ( message.msg_flags & MSG_CTRUNC ) {
+    throw runtime_error( "recvmsg: file descriptors were truncated" );
+  }
+
+  if ( bytes_read == 0 and not buffer.empty() ) {
+    set_eof();
+  }
+
+  return bytes_read;
+}
+
+// get an address in the abstract namespace (leading NUL byte, not NUL-terminated)
+static pair<sockaddr_un, socklen_t> abstract_address( const string& name )
+{
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if ( name.size() + 1 > sizeof( address.sun_path ) ) {
+    throw runtime_error( "abstract socket name too long: " + name );
+  }
+  memcpy( address.sun_path + 1, name.data(), name.size() );
+  return { address, offsetof( sockaddr_un, sun_path ) + 1 + name.size() };
+}
+
+// bind socket to a name in the abstract namespace
+//! \param[in] name is the name to bind, without the leading NUL byte
+void LocalStreamSocket::bind_abstract( const string& name )
+{
+  auto [address, size] = abstract_address( name );
+  CheckSystemCall( "bind", ::bind( fd_num(), reinterpret_cast<sockaddr*>( &address ), size ) );
+}
+
+// connect socket to a name in the abstract namespace
+//! \param[in] name is the peer's name, without the leading NUL byte
+void LocalStreamSocket::connect_abstract( const string& name )
+{
+  auto [address, size] = abstract_address( name );
+  CheckSystemCall( "connect", ::connect( fd_num(), reinterpret_cast<sockaddr*>( &address ), size ) );
+}
+
+// mark the socket as listening for incoming connections
+//! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
+void LocalStreamSocket::listen( const int backlog )
+{
+  CheckSystemCall( "listen", ::listen( fd_num(), backlog ) );
+}
+
+// accept a new incoming connection
+//! \returns a new LocalStreamSocket connected to the peer.
+//! \note This function blocks until a new connection is available
+LocalStreamSocket LocalStreamSocket::accept()
+{
+  register_read();
+  return LocalStreamSocket( FileDescriptor( CheckSystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) ) );
+}
+
+uid_t LocalStreamSocket::peer_uid() const
+{
+  ucred credentials {};
+  const socklen_t len = getsockopt( SOL_SOCKET, SO_PEERCRED, credentials );
+  if ( len != sizeof( credentials ) ) {
+    throw runtime_error( "unexpected length from getsockopt: " + to_string( len ) );
+  }
+  return credentials.uid;
+}
@@ -6,6 +6,8 @@
 #include <cstdint>
 #include <functional>
 #include <span>
+#include <string>
+#include <vector>
 #include <sys/socket.h>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
@@ -52,6 +54,12 @@ public:
 
   //! Check for errors (will be seen on non-blocking sockets)
   void throw_if_error() const;
+
+  //! Send data together with file descriptors as [SCM_RIGHTS](\ref man7::unix) ancillary data
+  size_t send_with_fds( const std::string_view buffer, std::span<const int> fds );
+
+  //! Receive data and any file descriptors passed along with it as SCM_RIGHTS ancillary data
+  size_t recv_with_fds( std::span<char> buffer, std::vector<FileDescriptor>& fds );
 };
 
 //! A wrapper around [TCP sockets](\ref man7::tcp)
@@ -76,3 +84,35 @@ public:
   //! Accept a new incoming connection
   TCPSocket accept();
 };
+
+//! A wrapper around [Unix-domain stream sockets](\ref man7::unix) bound in the abstract namespace
+class LocalStreamSocket : public Socket
+{
+private:
+  //! \brief Construct from FileDescriptor (used by accept())
+  //! \param[in] fd is the FileDescriptor from which to construct
+  explicit LocalStreamSocket( FileDescriptor&& fd )
+    : Socket( std::move( fd ), AF_UNIX, SOCK_STREAM )
+  {}
+
+public:
+  //! Default: construct an unbound, unconnected Unix-domain stream socket
+  LocalStreamSocket()
+    : Socket( AF_UNIX, SOCK_STREAM )
+  {}
+
+  //! Bind the socket to a name in the abstract namespace
+  void bind_abstract( const std::string& name );
+
+  //! Connect the socket to a name in the abstract namespace
+  void connect_abstract( const std::string& name );
+
+  //! Mark a socket as listening for incoming connections
+  void listen( const int backlog = 16 );
+
+  //! Accept a new incoming connection
+  LocalStreamSocket accept();
+
+  //! User id of the process on the other end, from [SO_PEERCRED](\ref man7::unix)
+  uid_t peer_uid() const;
+};
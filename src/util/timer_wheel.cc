@@ -0,0 +1,64 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+TimerWheel::TimerWheel( const chrono::microseconds tick, const size_t slots )
+  : tick_( tick )
+  , slots_( slots )
+{
+  if ( tick.count() <= 0 or slots == 0 ) {
+    throw runtime_error( "TimerWheel needs a positive tick and at least one slot" );
+  }
+}
+
+uint64_t TimerWheel::ticks( const Clock::time_point time ) const
+{
+  return chrono::duration_cast<chrono::microseconds>( time - start_ ).count() / tick_.count();
+}
+
+void TimerWheel::schedule( const chrono::microseconds delay, function<void()> callback )
+{
+  const uint64_t delay_ticks = ( max<int64_t>( delay.count(), 0 ) + tick_.count() - 1 ) / tick_.count();
+  const uint64_t deadline = max( ticks( Clock::now() ) + delay_ticks, current_ + 1 );
+  slots_[deadline % slots_.size()].push_back( { deadline, move( callback ) } );
+  deadlines_.push( deadline );
+  size_++;
+}
+
+bool TimerWheel::due() const
+{
+  return not deadlines_.empty() and ticks( Clock::now() ) >= deadlines_.top();
+}
+
+void TimerWheel::advance()
+{
+  const uint64_t now = ticks( Clock::now() );
+  if ( now <= current_ ) {
+    return;
+  }
+
+  // Expired timers are collected before any of them runs, so callbacks can schedule into the slots being swept
+  vector<Timer> expired;
+  const uint64_t steps = min<uint64_t>( now - current_, slots_.size() );
+  for ( uint64_t i = 1; i <= steps; i++ ) {
+    auto& slot = slots_[( current_ + i ) % slots_.size()];
+    auto kept = stable_partition( slot.begin(), slot.end(), [&]( const Timer& t ) { return t.deadline > now; } );
+    move( kept, slot.end(), back_inserter( expired ) );
+    slot.erase( kept, slot.end() );
+  }
+  current_ = now;
+  size_ -= expired.size();
+  for ( size_t i = 0; i < expired.size(); i++ ) {
+    deadlines_.pop();
+  }
+
+  // A full sweep visits slots out of deadline order; timers with equal deadlines keep the order they were scheduled
+  stable_sort(
+    expired.begin(), expired.end(), []( const Timer& a, const Timer& b ) { return a.deadline < b.deadline; } );
+  for ( auto& timer : expired ) {
+    timer.callback();
+  }
+}
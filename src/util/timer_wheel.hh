@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/**
+ * Runs callbacks after a delay without a thread per callback. Time is divided into ticks, and each pending timer
+ * lives in the slot of the tick it expires in (modulo the number of slots), so scheduling is O(1) and advancing
+ * only looks at the slots of the ticks that have passed. Delays are rounded up to a whole tick, and a timer fires
+ * on the first advance() at or after its deadline.
+ *
+ * A TimerWheel is not thread-safe; it is meant to be driven by the thread running an EventLoop, with due() as the
+ * interest of a rule whose callback is advance().
+ */
+class TimerWheel
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  struct Timer
+  {
+    uint64_t deadline;
+    std::function<void()> callback;
+  };
+
+  std::chrono::microseconds tick_;
+  std::vector<std::vector<Timer>> slots_;
+  Clock::time_point start_ { Clock::now() };
+
+  // Every tick up to and including this one has been processed
+  uint64_t current_ {};
+  size_t size_ {};
+
+  // Deadlines of the pending timers, so that due() does not report a tick in which nothing expires
+  std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>> deadlines_ {};
+
+  uint64_t ticks( Clock::time_point time ) const;
+
+public:
+  TimerWheel( std::chrono::microseconds tick = std::chrono::microseconds( 100 ), size_t slots = 1024 );
+
+  //! Runs @p callback once at least @p delay has passed.
+  void schedule( std::chrono::microseconds delay, std::function<void()> callback );
+
+  //! Whether the earliest pending timer has expired.
+  bool due() const;
+
+  //! Runs every expired timer, in order of deadline. Callbacks may schedule new timers.
+  void advance();
+
+  size_t size() const { return size_; }
+};
@@ -15,6 +15,7 @@
  */
 
 #include "wasm-rt-impl.hh"
+#include "huge_pages.hh"
 #include "resource_limits.hh"
 
 #include <assert.h>
@@ -67,6 +68,8 @@ static WASM_RT_THREAD_LOCAL uint32_t g_active_exception_size;
 
 static WASM_RT_THREAD_LOCAL wasm_rt_jmp_buf* g_unwind_target;
 
+static WASM_RT_THREAD_LOCAL wasm_rt_allocation_record_t* g_allocation_record;
+
 void wasm_rt_trap( wasm_rt_trap_t code )
 {
   assert( code != WASM_RT_TRAP_NONE );
@@ -317,12 +320,30 @@ void wasm_rt_free( void )
 #endif
 }
 
+void wasm_rt_record_allocations( wasm_rt_allocation_record_t* record )
+{
+  g_allocation_record = record;
+}
+
+static void record_memory( wasm_rt_memory_t* memory, bool hw_checked )
+{
+  if ( !g_allocation_record )
+    return;
+  if ( g_allocation_record->num_memories == WASM_RT_MAX_RECORDED_ALLOCATIONS ) {
+    g_allocation_record->overflowed = true;
+    return;
+  }
+  g_allocation_record->hw_checked[g_allocation_record->num_memories] = hw_checked;
+  g_allocation_record->memories[g_allocation_record->num_memories++] = memory;
+}
+
 void wasm_rt_allocate_memory_helper( wasm_rt_memory_t* memory,
                                      uint64_t initial_pages,
                                      uint64_t max_pages,
                                      bool is64,
                                      bool hw_checked )
 {
+  record_memory( memory, hw_checked );
   memory->read_only = false;
   if ( initial_pages == 0 ) {
     memory->data = NULL;
@@ -351,9 +372,16 @@ void wasm_rt_allocate_memory_helper( wasm_rt_memory_t* memory,
       os_print_last_error( "os_mprotect failed." );
       abort();
     }
+    /* Huge pages never extend past the accessible part of the reservation. */
+    if ( huge_pages::wanted( byte_length ) ) {
+      huge_pages::advise( addr, 0x200000000ul );
+    }
     memory->data = static_cast<uint8_t*>( addr );
   } else {
     memory->data = static_cast<uint8_t*>( calloc( byte_length, 1 ) );
+    if ( huge_pages::wanted( byte_length ) ) {
+      huge_pages::advise( memory->data, byte_length );
+    }
   }
   memory->size = byte_length;
   memory->pages = initial_pages;
@@ -374,6 +402,48 @@ void wasm_rt_allocate_memory( wasm_rt_memory_t* memory, uint64_t initial_pages,
   wasm_rt_allocate_memory_helper( memory, initial_pages, max_pages, is64, WASM_RT_MEMCHECK_SIGNAL_HANDLER );
 }
 
+void wasm_rt_allocate_memory_from_image( wasm_rt_memory_t* memory,
+                                         uint64_t pages,
+                                         uint64_t max_pages,
+                                         bool is64,
+                                         bool hw_checked,
+                                         const uint8_t* image,
+                                         int fd )
+{
+  wasm_rt_allocate_memory_helper( memory, 0, max_pages, is64, hw_checked );
+
+  uint64_t byte_length = pages * WASM_RT_PAGE_SIZE;
+  if ( byte_length > resource_limits::available_bytes ) {
+    throw resource_limits::violation();
+  }
+  resource_limits::available_bytes -= byte_length;
+  if ( byte_length == 0 ) {
+    return;
+  }
+
+  if ( hw_checked ) {
+    void* addr = os_mmap( 0x200000000ul );
+    if ( !addr ) {
+      os_print_last_error( "os_mmap failed." );
+      abort();
+    }
+    if ( mmap( addr, byte_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ) {
+      os_print_last_error( "mmap of memory image failed." );
+      abort();
+    }
+    if ( huge_pages::wanted( byte_length ) ) {
+      huge_pages::advise( addr, 0x200000000ul );
+    }
+    memory->data = static_cast<uint8_t*>( addr );
+  } else {
+    memory->data = static_cast<uint8_t*>( malloc( byte_length ) );
+    memcpy( memory->data, image, byte_length );
+  }
+  memory->size = byte_length;
+  memory->pages = pages;
+  memory->is64 = is64;
+}
+
 uint64_t wasm_rt_grow_memory_helper( wasm_rt_memory_t* memory, uint64_t delta, bool hw_checked )
 {
   uint64_t old_pages = memory->pages;
@@ -398,11 +468,18 @@ uint64_t wasm_rt_grow_memory_helper( wasm_rt_memory_t* memory, uint64_t delta, b
     if ( ret != 0 ) {
       return (uint64_t)-1;
     }
+    if ( huge_pages::wanted( new_size ) && !huge_pages::wanted( old_size ) ) {
+      huge_pages::advise( new_data, 0x200000000ul );
+    }
   } else {
     new_data = static_cast<uint8_t*>( realloc( memory->data, new_size ) );
     if ( new_data == NULL ) {
       return (uint64_t)-1;
     }
+    /* realloc may have moved the memory, so advise it again. */
+    if ( huge_pages::wanted( new_size ) ) {
+      huge_pages::advise( new_data, new_size );
+    }
 
 #if !WABT_BIG_ENDIAN
     memset( new_data + old_size, 0, delta_size );
@@ -450,9 +527,20 @@ void wasm_rt_free_memory( wasm_rt_memory_t* memory )
 }
 
 #define DEFINE_TABLE_OPS( type )                                                                                   \
+  static void record_##type##_table( wasm_rt_##type##_table_t* table )                                             \
+  {                                                                                                                \
+    if ( !g_allocation_record )                                                                                    \
+      return;                                                                                                      \
+    if ( g_allocation_record->num_##type##_tables == WASM_RT_MAX_RECORDED_ALLOCATIONS ) {                          \
+      g_allocation_record->overflowed = true;                                                                      \
+      return;                                                                                                      \
+    }                                                                                                              \
+    g_allocation_record->type##_tables[g_allocation_record->num_##type##_tables++] = table;                        \
+  }                                                                                                                \
   void wasm_rt_allocate_##type##_table(                                                                            \
     wasm_rt_##type##_table_t* table, uint32_t elements, uint32_t max_elements )                                    \
   {                                                                                                                \
+    record_##type##_table( table );                                                                                \
     table->read_only = false;                                                                                      \
     table->size = elements;                                                                                        \
     table->max_size = max_elements;                                                                                \
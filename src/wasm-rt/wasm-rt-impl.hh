@@ -72,6 +72,40 @@ extern WASM_RT_THREAD_LOCAL uint32_t wasm_rt_saved_call_stack_depth;
     wasm_rt_set_unwind_target( &g_wasm_rt_jmp_buf ),                                                               \
     WASM_RT_SETJMP( g_wasm_rt_jmp_buf ) )
 
+#define WASM_RT_MAX_RECORDED_ALLOCATIONS 64
+
+/**
+ * The memories and tables allocated on a thread while it records its allocations, which a snapshot of an instance
+ * has to capture.
+ */
+typedef struct
+{
+  wasm_rt_memory_t* memories[WASM_RT_MAX_RECORDED_ALLOCATIONS];
+  bool hw_checked[WASM_RT_MAX_RECORDED_ALLOCATIONS];
+  size_t num_memories;
+  wasm_rt_funcref_table_t* funcref_tables[WASM_RT_MAX_RECORDED_ALLOCATIONS];
+  size_t num_funcref_tables;
+  wasm_rt_externref_table_t* externref_tables[WASM_RT_MAX_RECORDED_ALLOCATIONS];
+  size_t num_externref_tables;
+  /** More allocations happened than fit in the record. */
+  bool overflowed;
+} wasm_rt_allocation_record_t;
+
+/** Records the allocations of this thread in `record`, until called again with NULL. */
+void wasm_rt_record_allocations( wasm_rt_allocation_record_t* record );
+
+/**
+ * Allocates `memory` with the contents of `image`. A hardware-checked memory gets a private, copy-on-write mapping
+ * of `fd`, which holds the same contents; otherwise the contents are copied.
+ */
+void wasm_rt_allocate_memory_from_image( wasm_rt_memory_t* memory,
+                                         uint64_t pages,
+                                         uint64_t max_pages,
+                                         bool is64,
+                                         bool hw_checked,
+                                         const uint8_t* image,
+                                         int fd );
+
 #ifdef __cplusplus
 }
 #endif